@@ -0,0 +1,488 @@
+﻿#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+# define COLOR_CONVERTER_X86 1
+# if defined(_MSC_VER)
+#  include <intrin.h>
+# endif
+# include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+# define COLOR_CONVERTER_NEON 1
+# include <arm_neon.h>
+#endif
+
+// GCC/Clang では命令セットを関数ごとに有効にする. MSVC は指定なしで使える.
+#if defined(_MSC_VER)
+# define COLOR_CONVERTER_TARGET(isa)
+#else
+# define COLOR_CONVERTER_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#include "ColorConverter.h"
+
+#undef min
+#undef max
+
+namespace {
+
+using Coefficients = ColorConverter::Coefficients;
+constexpr int32_t SHIFT = ColorConverter::COEFFICIENT_SHIFT;
+constexpr int32_t ROUND = 1 << (SHIFT - 1);
+constexpr uint32_t MIN_ROWS_PER_BAND = 16;
+
+Coefficients MakeCoefficients(ColorConverter::Matrix matrix, ColorConverter::Range range)
+{
+	const bool isBT709 = matrix == ColorConverter::Matrix::BT709;
+	const bool isLimited = range == ColorConverter::Range::Limited;
+	const double kr = isBT709 ? 0.2126 : 0.299;
+	const double kb = isBT709 ? 0.0722 : 0.114;
+	const double kg = 1.0 - kr - kb;
+	const double yScale = isLimited ? 255.0 / 219.0 : 1.0;
+	const double cScale = isLimited ? 255.0 / 224.0 : 1.0;
+	const double one = double(1 << SHIFT);
+	return Coefficients{
+		.yOffset = isLimited ? 16 : 0,
+		.yScale = int32_t(std::lround(yScale * one)),
+		.crToR = int32_t(std::lround(2.0 * (1.0 - kr) * cScale * one)),
+		.cbToG = int32_t(std::lround(2.0 * kb * (1.0 - kb) / kg * cScale * one)),
+		.crToG = int32_t(std::lround(2.0 * kr * (1.0 - kr) / kg * cScale * one)),
+		.cbToB = int32_t(std::lround(2.0 * (1.0 - kb) * cScale * one)),
+	};
+}
+
+inline uint8_t Clamp8(int32_t v)
+{
+	return uint8_t(std::clamp(v, 0, 255));
+}
+
+// 基準となる実装. SIMD 版が処理しきれない行末もこれで変換する.
+void ConvertRowScalar(const Coefficients& c, const uint8_t* y, const uint8_t* uv, uint8_t* dst, uint32_t begin, uint32_t end, bool bgra)
+{
+	for (uint32_t x = begin; x < end; ++x)
+	{
+		const int32_t luma = (int32_t(y[x]) - c.yOffset) * c.yScale + ROUND;
+		const int32_t cb = int32_t(uv[(x & ~1u) + 0]) - 128;
+		const int32_t cr = int32_t(uv[(x & ~1u) + 1]) - 128;
+		const int32_t r = (luma + c.crToR * cr) >> SHIFT;
+		const int32_t g = (luma - c.cbToG * cb - c.crToG * cr) >> SHIFT;
+		const int32_t b = (luma + c.cbToB * cb) >> SHIFT;
+		uint8_t* px = dst + size_t(x) * 4;
+		px[0] = Clamp8(bgra ? b : r);
+		px[1] = Clamp8(g);
+		px[2] = Clamp8(bgra ? r : b);
+		px[3] = 255;
+	}
+}
+
+#if COLOR_CONVERTER_X86
+// packus 後の [R0-3 G0-3 B0-3 A0-3] を画素ごとに並べ替える.
+inline __m128i GetInterleaveMask(bool bgra)
+{
+	return bgra
+		? _mm_setr_epi8(8, 4, 0, 12, 9, 5, 1, 13, 10, 6, 2, 14, 11, 7, 3, 15)
+		: _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+}
+
+// 4画素ずつ. 処理した画素数を返す.
+COLOR_CONVERTER_TARGET("sse4.1")
+uint32_t ConvertRowSSE41(const Coefficients& c, const uint8_t* y, const uint8_t* uv, uint8_t* dst, uint32_t width, bool bgra)
+{
+	const __m128i yOffset = _mm_set1_epi32(c.yOffset);
+	const __m128i yScale = _mm_set1_epi32(c.yScale);
+	const __m128i crToR = _mm_set1_epi32(c.crToR);
+	const __m128i cbToG = _mm_set1_epi32(c.cbToG);
+	const __m128i crToG = _mm_set1_epi32(c.crToG);
+	const __m128i cbToB = _mm_set1_epi32(c.cbToB);
+	const __m128i round = _mm_set1_epi32(ROUND);
+	const __m128i bias = _mm_set1_epi32(128);
+	const __m128i alpha = _mm_set1_epi32(255);
+	const __m128i mask = GetInterleaveMask(bgra);
+
+	uint32_t x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		int32_t luma4, chroma4;
+		memcpy(&luma4, y + x, 4);
+		memcpy(&chroma4, uv + x, 4);
+		const __m128i yv = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(luma4));
+		// [Cb0 Cr0 Cb1 Cr1] を画素ごとに複製する.
+		const __m128i cv = _mm_sub_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(chroma4)), bias);
+		const __m128i cb = _mm_shuffle_epi32(cv, _MM_SHUFFLE(2, 2, 0, 0));
+		const __m128i cr = _mm_shuffle_epi32(cv, _MM_SHUFFLE(3, 3, 1, 1));
+
+		const __m128i l = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(yv, yOffset), yScale), round);
+		const __m128i r = _mm_srai_epi32(_mm_add_epi32(l, _mm_mullo_epi32(cr, crToR)), SHIFT);
+		const __m128i g = _mm_srai_epi32(_mm_sub_epi32(_mm_sub_epi32(l, _mm_mullo_epi32(cb, cbToG)), _mm_mullo_epi32(cr, crToG)), SHIFT);
+		const __m128i b = _mm_srai_epi32(_mm_add_epi32(l, _mm_mullo_epi32(cb, cbToB)), SHIFT);
+
+		const __m128i px = _mm_packus_epi16(_mm_packs_epi32(r, g), _mm_packs_epi32(b, alpha));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + size_t(x) * 4), _mm_shuffle_epi8(px, mask));
+	}
+	return x;
+}
+
+// 8画素ずつ. 128bit のレーンごとに SSE 版と同じ処理となる.
+COLOR_CONVERTER_TARGET("avx2")
+uint32_t ConvertRowAVX2(const Coefficients& c, const uint8_t* y, const uint8_t* uv, uint8_t* dst, uint32_t width, bool bgra)
+{
+	const __m256i yOffset = _mm256_set1_epi32(c.yOffset);
+	const __m256i yScale = _mm256_set1_epi32(c.yScale);
+	const __m256i crToR = _mm256_set1_epi32(c.crToR);
+	const __m256i cbToG = _mm256_set1_epi32(c.cbToG);
+	const __m256i crToG = _mm256_set1_epi32(c.crToG);
+	const __m256i cbToB = _mm256_set1_epi32(c.cbToB);
+	const __m256i round = _mm256_set1_epi32(ROUND);
+	const __m256i bias = _mm256_set1_epi32(128);
+	const __m256i alpha = _mm256_set1_epi32(255);
+	const __m256i mask = _mm256_broadcastsi128_si256(GetInterleaveMask(bgra));
+
+	uint32_t x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		const __m256i yv = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + x)));
+		const __m256i cv = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(uv + x))), bias);
+		const __m256i cb = _mm256_shuffle_epi32(cv, _MM_SHUFFLE(2, 2, 0, 0));
+		const __m256i cr = _mm256_shuffle_epi32(cv, _MM_SHUFFLE(3, 3, 1, 1));
+
+		const __m256i l = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(yv, yOffset), yScale), round);
+		const __m256i r = _mm256_srai_epi32(_mm256_add_epi32(l, _mm256_mullo_epi32(cr, crToR)), SHIFT);
+		const __m256i g = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_sub_epi32(l, _mm256_mullo_epi32(cb, cbToG)), _mm256_mullo_epi32(cr, crToG)), SHIFT);
+		const __m256i b = _mm256_srai_epi32(_mm256_add_epi32(l, _mm256_mullo_epi32(cb, cbToB)), SHIFT);
+
+		const __m256i px = _mm256_packus_epi16(_mm256_packs_epi32(r, g), _mm256_packs_epi32(b, alpha));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + size_t(x) * 4), _mm256_shuffle_epi8(px, mask));
+	}
+	return x;
+}
+
+bool HasAVX2()
+{
+#if !defined(_MSC_VER)
+	// OS が YMM レジスタを保存するかも含めて確認される.
+	return __builtin_cpu_supports("avx2");
+#else
+	int info[4];
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	// OS が YMM レジスタを保存する場合のみ使える.
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+	{
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#endif
+}
+
+bool HasSSE41()
+{
+#if !defined(_MSC_VER)
+	return __builtin_cpu_supports("sse4.1");
+#else
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 19)) != 0;
+#endif
+}
+#endif
+
+#if COLOR_CONVERTER_NEON
+inline void ComputeRGB(const Coefficients& c, int16x4_t y, int16x4_t cb, int16x4_t cr, int16x4_t& r, int16x4_t& g, int16x4_t& b)
+{
+	const int32x4_t l = vaddq_s32(vmulq_n_s32(vmovl_s16(y), c.yScale), vdupq_n_s32(ROUND));
+	const int32x4_t cb32 = vmovl_s16(cb);
+	const int32x4_t cr32 = vmovl_s16(cr);
+	r = vqmovn_s32(vshrq_n_s32(vmlaq_n_s32(l, cr32, c.crToR), SHIFT));
+	g = vqmovn_s32(vshrq_n_s32(vmlsq_n_s32(vmlsq_n_s32(l, cb32, c.cbToG), cr32, c.crToG), SHIFT));
+	b = vqmovn_s32(vshrq_n_s32(vmlaq_n_s32(l, cb32, c.cbToB), SHIFT));
+}
+
+// 8画素ずつ.
+uint32_t ConvertRowNEON(const Coefficients& c, const uint8_t* y, const uint8_t* uv, uint8_t* dst, uint32_t width, bool bgra)
+{
+	const int16x8_t yOffset = vdupq_n_s16(int16_t(c.yOffset));
+	const int16x8_t bias = vdupq_n_s16(128);
+	const uint8x8_t alpha = vdup_n_u8(255);
+
+	uint32_t x = 0;
+	for (; x + 8 <= width; x += 8)
+	{
+		const int16x8_t yv = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + x))), yOffset);
+		// [Cb0 Cr0 ... Cb3 Cr3] を分けてから画素ごとに複製する.
+		const uint8x8x2_t split = vuzp_u8(vld1_u8(uv + x), vld1_u8(uv + x));
+		const int16x8_t cb = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vzip_u8(split.val[0], split.val[0]).val[0])), bias);
+		const int16x8_t cr = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vzip_u8(split.val[1], split.val[1]).val[0])), bias);
+
+		int16x4_t rLo, gLo, bLo, rHi, gHi, bHi;
+		ComputeRGB(c, vget_low_s16(yv), vget_low_s16(cb), vget_low_s16(cr), rLo, gLo, bLo);
+		ComputeRGB(c, vget_high_s16(yv), vget_high_s16(cb), vget_high_s16(cr), rHi, gHi, bHi);
+		const uint8x8_t r = vqmovun_s16(vcombine_s16(rLo, rHi));
+		const uint8x8_t g = vqmovun_s16(vcombine_s16(gLo, gHi));
+		const uint8x8_t b = vqmovun_s16(vcombine_s16(bLo, bHi));
+
+		uint8x8x4_t px;
+		px.val[0] = bgra ? b : r;
+		px.val[1] = g;
+		px.val[2] = bgra ? r : b;
+		px.val[3] = alpha;
+		vst4_u8(dst + size_t(x) * 4, px);
+	}
+	return x;
+}
+#endif
+
+}
+
+ColorConverter::NV12Planes ColorConverter::MakePackedPlanes(const uint8_t* data, uint32_t width, uint32_t height, uint64_t chromaOffset)
+{
+	return NV12Planes{
+		.luma = data,
+		.lumaPitch = width,
+		.chroma = data + chromaOffset,
+		.chromaPitch = size_t((width + 1) & ~1u),
+		.width = width,
+		.height = height,
+	};
+}
+
+bool ColorConverter::IsKernelSupported(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Auto:
+	case Kernel::Scalar:
+		return true;
+#if COLOR_CONVERTER_X86
+	case Kernel::SSE41:
+		return HasSSE41();
+	case Kernel::AVX2:
+		return HasAVX2();
+#endif
+#if COLOR_CONVERTER_NEON
+	case Kernel::NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+const char* ColorConverter::GetKernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Auto: return "Auto";
+	case Kernel::Scalar: return "Scalar";
+	case Kernel::SSE41: return "SSE4.1";
+	case Kernel::AVX2: return "AVX2";
+	case Kernel::NEON: return "NEON";
+	}
+	return "Unknown";
+}
+
+bool ColorConverter::Initialize(const Desc& desc)
+{
+	Shutdown();
+	if (!IsKernelSupported(desc.kernel))
+	{
+		return false;
+	}
+	m_desc = desc;
+	m_coefficients = MakeCoefficients(desc.matrix, desc.range);
+
+	m_kernel = desc.kernel;
+	if (m_kernel == Kernel::Auto)
+	{
+		m_kernel = Kernel::Scalar;
+		for (auto kernel : { Kernel::AVX2, Kernel::SSE41, Kernel::NEON })
+		{
+			if (IsKernelSupported(kernel))
+			{
+				m_kernel = kernel;
+				break;
+			}
+		}
+	}
+
+	uint32_t threadCount = desc.threadCount;
+	if (threadCount == 0)
+	{
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	// 呼び出しスレッドも変換に加わるため、ワーカーは1つ少なくてよい.
+	m_closing = false;
+	m_generation = 0;
+	for (uint32_t i = 1; i < threadCount; ++i)
+	{
+		m_workers.emplace_back([this]() { WorkerThread(); });
+	}
+	return true;
+}
+
+void ColorConverter::Shutdown()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_closing = true;
+	}
+	m_cv.notify_all();
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+}
+
+void ColorConverter::Convert(const NV12Planes& src, uint8_t* dst, size_t dstPitch)
+{
+	assert(src.luma && src.chroma && dst);
+	m_src = src;
+	m_dst = dst;
+	m_dstPitch = dstPitch;
+
+	// 帯はスレッド数より細かく分け、スレッドごとの処理時間の偏りをならす.
+	const uint32_t threadCount = GetThreadCount();
+	m_rowsPerBand = std::max((src.height + threadCount * 4 - 1) / (threadCount * 4), MIN_ROWS_PER_BAND);
+	m_bandCount = (src.height + m_rowsPerBand - 1) / m_rowsPerBand;
+	if (m_workers.empty() || m_bandCount <= 1)
+	{
+		ConvertRows(0, src.height);
+		return;
+	}
+
+	m_nextBand = 0;
+	{
+		std::lock_guard lock(m_mutex);
+		m_busyWorkers = uint32_t(m_workers.size());
+		m_generation++;
+	}
+	m_cv.notify_all();
+	ProcessBands();
+
+	std::unique_lock lock(m_mutex);
+	m_doneCv.wait(lock, [&]() { return m_busyWorkers == 0; });
+}
+
+void ColorConverter::WorkerThread()
+{
+	uint64_t generation = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock lock(m_mutex);
+			m_cv.wait(lock, [&]() { return m_closing || m_generation != generation; });
+			if (m_closing)
+			{
+				return;
+			}
+			generation = m_generation;
+		}
+		ProcessBands();
+		{
+			std::lock_guard lock(m_mutex);
+			if (--m_busyWorkers == 0)
+			{
+				m_doneCv.notify_one();
+			}
+		}
+	}
+}
+
+void ColorConverter::ProcessBands()
+{
+	for (;;)
+	{
+		const uint32_t band = m_nextBand.fetch_add(1);
+		if (m_bandCount <= band)
+		{
+			return;
+		}
+		const uint32_t rowBegin = band * m_rowsPerBand;
+		ConvertRows(rowBegin, std::min(rowBegin + m_rowsPerBand, m_src.height));
+	}
+}
+
+void ColorConverter::ConvertRows(uint32_t rowBegin, uint32_t rowEnd)
+{
+	const bool bgra = m_desc.order == PixelOrder::BGRA;
+	const auto& c = m_coefficients;
+	for (uint32_t row = rowBegin; row < rowEnd; ++row)
+	{
+		const uint8_t* y = m_src.luma + m_src.lumaPitch * row;
+		const uint8_t* uv = m_src.chroma + m_src.chromaPitch * (row / 2);
+		uint8_t* dst = m_dst + m_dstPitch * row;
+
+		uint32_t x = 0;
+		switch (m_kernel)
+		{
+#if COLOR_CONVERTER_X86
+		case Kernel::AVX2:
+			x = ConvertRowAVX2(c, y, uv, dst, m_src.width, bgra);
+			break;
+		case Kernel::SSE41:
+			x = ConvertRowSSE41(c, y, uv, dst, m_src.width, bgra);
+			break;
+#endif
+#if COLOR_CONVERTER_NEON
+		case Kernel::NEON:
+			x = ConvertRowNEON(c, y, uv, dst, m_src.width, bgra);
+			break;
+#endif
+		default:
+			break;
+		}
+		ConvertRowScalar(c, y, uv, dst, x, m_src.width, bgra);
+	}
+}
+
+std::vector<ColorConverter::BenchmarkResult> ColorConverter::Benchmark(uint32_t width, uint32_t height, uint32_t iterations)
+{
+	// 入力の内容で速度は変わらないため、単純なグラデーションとする.
+	const uint64_t chromaOffset = uint64_t(width) * height;
+	std::vector<uint8_t> nv12(chromaOffset + size_t((width + 1) & ~1u) * ((height + 1) / 2));
+	for (size_t i = 0; i < nv12.size(); ++i)
+	{
+		nv12[i] = uint8_t(i * 7);
+	}
+	std::vector<uint8_t> rgba(size_t(width) * height * 4);
+	const auto src = MakePackedPlanes(nv12.data(), width, height, chromaOffset);
+
+	const uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<BenchmarkResult> results;
+	for (auto kernel : { Kernel::Scalar, Kernel::SSE41, Kernel::AVX2, Kernel::NEON })
+	{
+		if (!IsKernelSupported(kernel))
+		{
+			continue;
+		}
+		for (uint32_t threadCount : { 1u, hardwareThreads })
+		{
+			if (threadCount == hardwareThreads && hardwareThreads == 1 && !results.empty() && results.back().kernel == kernel)
+			{
+				continue;
+			}
+			ColorConverter converter;
+			converter.Initialize(Desc{ .kernel = kernel, .threadCount = threadCount });
+			// 初回はページフォールトを含むため計測から外す.
+			converter.Convert(src, rgba.data(), size_t(width) * 4);
+
+			auto start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < iterations; ++i)
+			{
+				converter.Convert(src, rgba.data(), size_t(width) * 4);
+			}
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			results.push_back(BenchmarkResult{
+				.kernel = kernel,
+				.threadCount = converter.GetThreadCount(),
+				.megapixelsPerSecond = double(width) * height * iterations / std::max(seconds, 1e-9) / 1e6,
+			});
+		}
+	}
+	return results;
+}
@@ -0,0 +1,125 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// NV12 から RGBA/BGRA への CPU 変換. 読み戻したフレームを CPU で解析する用途に使う.
+// 色差は最近傍で拡大する (DeviceContext の VkSamplerYcbcrConversion の chromaFilter と同じ).
+// 行を帯に分けて複数スレッドで変換する. どのカーネルもスカラー版と同じ整数演算で、結果は一致する.
+class ColorConverter
+{
+public:
+	enum class Matrix
+	{
+		BT601,
+		BT709,
+	};
+	enum class Range
+	{
+		Limited,	// Y: 16-235, CbCr: 16-240.
+		Full,
+	};
+	enum class PixelOrder
+	{
+		RGBA,
+		BGRA,
+	};
+	enum class Kernel
+	{
+		Auto,		// 実行環境で使える最速のもの.
+		Scalar,
+		SSE41,
+		AVX2,
+		NEON,
+	};
+
+	struct Desc
+	{
+		Matrix matrix = Matrix::BT709;
+		Range range = Range::Limited;
+		PixelOrder order = PixelOrder::RGBA;
+		Kernel kernel = Kernel::Auto;
+		uint32_t threadCount = 0;	// 0 の場合はハードウェアスレッド数.
+	};
+
+	// 読み戻した NV12. Y の平面と、Cb/Cr を交互に並べた 1/2 x 1/2 の平面.
+	struct NV12Planes
+	{
+		const uint8_t* luma = nullptr;
+		size_t lumaPitch = 0;
+		const uint8_t* chroma = nullptr;
+		size_t chromaPitch = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+	// 詰めて配置した NV12 (PLANE_0 を先頭に、PLANE_1 を chromaOffset に置いたもの).
+	static NV12Planes MakePackedPlanes(const uint8_t* data, uint32_t width, uint32_t height, uint64_t chromaOffset);
+
+	~ColorConverter() { Shutdown(); }
+
+	// 指定したカーネルが使えない場合は false を返す.
+	bool Initialize(const Desc& desc);
+	void Shutdown();
+
+	// dst は 1画素 4バイトで dstPitch バイトごとの行.
+	void Convert(const NV12Planes& src, uint8_t* dst, size_t dstPitch);
+
+	Kernel GetKernel() const { return m_kernel; }
+	uint32_t GetThreadCount() const { return uint32_t(m_workers.size()) + 1; }
+
+	static bool IsKernelSupported(Kernel kernel);
+	static const char* GetKernelName(Kernel kernel);
+
+	struct BenchmarkResult
+	{
+		Kernel kernel = Kernel::Scalar;
+		uint32_t threadCount = 1;
+		double megapixelsPerSecond = 0.0;
+	};
+	// 使えるカーネルごとに、1スレッドと全スレッドでの変換速度を計る.
+	static std::vector<BenchmarkResult> Benchmark(uint32_t width, uint32_t height, uint32_t iterations);
+
+	// 固定小数点の変換係数.
+	struct Coefficients
+	{
+		int32_t yOffset;
+		int32_t yScale;
+		int32_t crToR;
+		int32_t cbToG;
+		int32_t crToG;
+		int32_t cbToB;
+	};
+	enum {
+		COEFFICIENT_SHIFT = 13,
+	};
+
+private:
+	void WorkerThread();
+	// 帯がなくなるまで取り出して変換する. 呼び出しスレッドも処理に加わる.
+	void ProcessBands();
+	void ConvertRows(uint32_t rowBegin, uint32_t rowEnd);
+
+	Desc m_desc;
+	Kernel m_kernel = Kernel::Scalar;
+	Coefficients m_coefficients{};
+
+	// 実行中の変換.
+	NV12Planes m_src;
+	uint8_t* m_dst = nullptr;
+	size_t m_dstPitch = 0;
+	uint32_t m_rowsPerBand = 0;
+	uint32_t m_bandCount = 0;
+	std::atomic<uint32_t> m_nextBand = 0;
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::condition_variable m_doneCv;
+	uint64_t m_generation = 0;		// Convert ごとに進める. ワーカーは1回ずつ処理に加わる.
+	uint32_t m_busyWorkers = 0;		// 今回の変換をまだ終えていないワーカーの数.
+	bool m_closing = false;
+};
@@ -0,0 +1,33 @@
+﻿#include "DebugLog.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <csignal>
+#endif
+
+void DebugLog(const char* format, ...)
+{
+	char buf[1024] = { 0 };
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+#ifdef _WIN32
+	OutputDebugStringA(buf);
+#else
+	fputs(buf, stderr);
+#endif
+}
+
+void DebugTrap()
+{
+#ifdef _WIN32
+	DebugBreak();
+#else
+	raise(SIGTRAP);
+#endif
+}
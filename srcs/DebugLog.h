@@ -0,0 +1,8 @@
+﻿#pragma once
+
+// デバッグ出力. Windows ではデバッガーへ (OutputDebugStringA)、それ以外では標準エラー出力へ書く.
+// 書式は printf と同じ. 改行は呼び出し側で付ける.
+void DebugLog(const char* format, ...);
+
+// デバッガーで停止する. Windows 以外では SIGTRAP を送る.
+void DebugTrap();
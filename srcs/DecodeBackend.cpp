@@ -0,0 +1,67 @@
+﻿#include "DecodeBackend.h"
+
+#include <cassert>
+#include <sstream>
+
+bool NullDecodeBackend::Initialize(const DecodeStreamDesc& desc)
+{
+	m_desc = desc;
+	m_bitstream.resize(desc.bitstreamSlotCount * desc.maxFrameSizeBytes);
+	m_records.clear();
+	m_decodeCount = 0;
+	return true;
+}
+
+void NullDecodeBackend::Shutdown()
+{
+	m_bitstream.clear();
+	m_bitstream.shrink_to_fit();
+}
+
+uint8_t* NullDecodeBackend::GetBitstreamSlot(uint32_t slot, uint64_t& capacity)
+{
+	assert(slot < m_desc.bitstreamSlotCount);
+	capacity = m_desc.maxFrameSizeBytes;
+	return m_bitstream.data() + slot * m_desc.maxFrameSizeBytes;
+}
+
+void NullDecodeBackend::Decode(const VideoDecodeOperation& operation, const DecodeScheduler::Job&)
+{
+	assert(operation.outputIndex < m_desc.outputCount);
+	assert(operation.current_dpb < operation.dpbSlotNum);
+	m_decodeCount++;
+	if (!m_recordingEnabled)
+	{
+		return;
+	}
+
+	auto& record = m_records.emplace_back();
+	record.decodedFrameIndex = operation.decodedFrameIndex;
+	record.displayOrder = operation.displayOrder;
+	record.flags = operation.flags;
+	record.currentSlot = operation.current_dpb;
+	record.referenceSlots.assign(operation.dpbReferenceSlots, operation.dpbReferenceSlots + operation.dpbReferenceCount);
+	record.bitstreamSlot = operation.bitstreamSlot;
+	record.streamSize = operation.streamSize;
+	record.outputIndex = operation.outputIndex;
+}
+
+std::string NullDecodeBackend::Dump() const
+{
+	std::stringstream ss;
+	for (const auto& record : m_records)
+	{
+		ss << "frame:" << record.decodedFrameIndex
+			<< " display:" << record.displayOrder
+			<< " reset:" << ((record.flags & VideoDecodeOperation::eSessionReset) ? 1 : 0)
+			<< " slot:" << record.currentSlot
+			<< " refs:[";
+		for (size_t i = 0; i < record.referenceSlots.size(); ++i)
+		{
+			ss << (i ? "," : "") << int(record.referenceSlots[i]);
+		}
+		ss << "] bitstream:" << record.bitstreamSlot << "/" << record.streamSize
+			<< " output:" << record.outputIndex << "\n";
+	}
+	return ss.str();
+}
@@ -0,0 +1,139 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+
+#include "DecodeScheduler.h"
+
+class VideoScaler;
+
+// デコード1フレーム分の指示. DPB スロットや出力先の選択は VideoPlayer が行い、
+// バックエンドはこの内容どおりにデコードする.
+struct VideoDecodeOperation
+{
+	enum Flags {
+		eNone = 0,
+		eSessionReset = 1 << 0,
+	};
+	enum class FrameType {
+		eIntra = 0,
+		ePredictive,
+	};
+	enum {
+		MaxDpbSlotCount = 17,
+	};
+	uint32_t flags = eNone;
+	uint32_t bitstreamSlot = 0;		// ビットストリームを書き込んだスロット.
+	uint64_t streamSize = 0;
+	uint32_t sliceCount = 0;		// ビットストリーム内のスライス数と各スライスの先頭位置.
+	const uint32_t* sliceOffsets = nullptr;
+	FrameType frameType = FrameType::eIntra;
+	uint32_t referencePriority = 0;
+	int decodedFrameIndex = 0;		// デコード順のフレーム番号.
+	int64_t displayOrder = -1;
+	uint32_t outputIndex = 0;		// 結果をコピーする出力先.
+	const void* slideHeader = nullptr;
+	const void* pps = nullptr;
+	const void* sps = nullptr;
+	int poc[2] = { 0 };
+	uint32_t current_dpb = 0;
+	uint32_t dpbReferenceCount = 0;
+	const uint8_t* dpbReferenceSlots = nullptr;
+	const int* dpbPoc = nullptr;
+	const int* dpbFramenum = nullptr;
+	uint32_t dpbSlotNum = 0;
+};
+
+struct DecodeStreamDesc
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t bitstreamSlotCount = 0;
+	uint64_t maxFrameSizeBytes = 0;
+	uint32_t outputCount = 0;
+	// メモリの予算が足りない場合、出力テクスチャはこの数まで減らしてよい. 0 の場合は outputCount.
+	uint32_t minOutputCount = 0;
+};
+
+// 出力先のテクスチャ. 表示に使用する.
+struct DecodeOutputTexture
+{
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+};
+
+// デコードの実行側.
+class IDecodeBackend
+{
+public:
+	virtual ~IDecodeBackend() = default;
+	virtual const char* GetName() const = 0;
+
+	virtual bool Initialize(const DecodeStreamDesc& desc) = 0;
+	virtual void Shutdown() = 0;
+
+	// ビットストリームの書き込み先. capacity にスロットの容量を返す.
+	virtual uint8_t* GetBitstreamSlot(uint32_t slot, uint64_t& capacity) = 0;
+	// ビットストリームのサイズはこの値の倍数とする.
+	virtual uint64_t GetBitstreamAlignment() const = 0;
+
+	// 1フレーム分のデコードを記録する. job はスケジューラーなしで使う場合は空となる.
+	virtual void Decode(const VideoDecodeOperation& operation, const DecodeScheduler::Job& job) = 0;
+
+	// 実際に確保できた出力テクスチャの数. DecodeStreamDesc::outputCount より少ない場合がある.
+	virtual uint32_t GetOutputTextureCount() const = 0;
+	virtual DecodeOutputTexture GetOutputTexture(uint32_t index) const = 0;
+
+	// デコード後のバリアに続けて縮小を記録する. 出力テクスチャを持たないバックエンドでは何もしない.
+	virtual void SetScaler(std::shared_ptr<VideoScaler> scaler) { }
+};
+
+// 何もせずに即座にデコードを完了するバックエンド.
+// 受け取った指示を記録するため、GPU なしでスケジューリングの確認や CPU 負荷の計測に使う.
+class NullDecodeBackend : public IDecodeBackend
+{
+public:
+	struct Record
+	{
+		int decodedFrameIndex = 0;
+		int64_t displayOrder = -1;
+		uint32_t flags = 0;
+		uint32_t currentSlot = 0;
+		std::vector<uint8_t> referenceSlots;
+		uint32_t bitstreamSlot = 0;
+		uint64_t streamSize = 0;
+		uint32_t outputIndex = 0;
+	};
+
+	const char* GetName() const override { return "Null"; }
+
+	bool Initialize(const DecodeStreamDesc& desc) override;
+	void Shutdown() override;
+
+	uint8_t* GetBitstreamSlot(uint32_t slot, uint64_t& capacity) override;
+	uint64_t GetBitstreamAlignment() const override { return 1; }
+
+	void Decode(const VideoDecodeOperation& operation, const DecodeScheduler::Job& job) override;
+
+	uint32_t GetOutputTextureCount() const override { return m_desc.outputCount; }
+	DecodeOutputTexture GetOutputTexture(uint32_t index) const override { return {}; }
+
+	// 計測時は記録を止めてメモリ確保の影響を除く.
+	void SetRecordingEnabled(bool enabled) { m_recordingEnabled = enabled; }
+	const std::vector<Record>& GetRecords() const { return m_records; }
+	const DecodeStreamDesc& GetStreamDesc() const { return m_desc; }
+	void ClearRecords() { m_records.clear(); }
+	uint64_t GetDecodeCount() const { return m_decodeCount; }
+
+	// 記録を1行1フレームの文字列にする. 実行結果の比較に使う.
+	std::string Dump() const;
+
+private:
+	DecodeStreamDesc m_desc;
+	std::vector<uint8_t> m_bitstream;
+	std::vector<Record> m_records;
+	bool m_recordingEnabled = true;
+	uint64_t m_decodeCount = 0;
+};
@@ -0,0 +1,418 @@
+﻿#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#include "DeviceContext.h"
+#include "DecodeScheduler.h"
+
+#undef min
+#undef max
+
+namespace {
+
+double GetCurrentTimeSeconds()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+bool DecodeScheduler::Initialize(uint32_t frameCount)
+{
+	auto devCtx = DeviceContext::GetContext();
+	auto vkDevice = devCtx->GetVkDevice();
+
+	m_queueStreamCounts.assign(devCtx->GetVideoDecodeQueueCount(), 0);
+	VkSemaphoreTypeCreateInfo timelineTypeCI{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+	VkSemaphoreCreateInfo timelineCI{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &timelineTypeCI,
+	};
+	m_decodeTimelines.resize(m_queueStreamCounts.size());
+	m_decodeTimelineValues.assign(m_queueStreamCounts.size(), 0);
+	for (auto& sem : m_decodeTimelines)
+	{
+		auto res = vkCreateSemaphore(vkDevice, &timelineCI, nullptr, &sem);
+		assert(res == VK_SUCCESS);
+	}
+
+	m_frames.resize(frameCount);
+	for (auto& frame : m_frames)
+	{
+		VkCommandPoolCreateInfo commandPoolCI{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		};
+		commandPoolCI.queueFamilyIndex = devCtx->GetDecoderQueueFamilyIndex();
+		auto res = vkCreateCommandPool(vkDevice, &commandPoolCI, nullptr, &frame.videoCommandPool);
+		assert(res == VK_SUCCESS);
+		commandPoolCI.queueFamilyIndex = devCtx->GetGraphicsQueueFamilyIndex();
+		res = vkCreateCommandPool(vkDevice, &commandPoolCI, nullptr, &frame.graphicsCommandPool);
+		assert(res == VK_SUCCESS);
+
+		VkSemaphoreCreateInfo semCI{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		};
+		frame.semVideoToGfx.resize(m_queueStreamCounts.size());
+		for (auto& sem : frame.semVideoToGfx)
+		{
+			vkCreateSemaphore(vkDevice, &semCI, nullptr, &sem);
+		}
+		frame.decodeValues.assign(m_queueStreamCounts.size(), 0);
+
+		VkFenceCreateInfo fenceCI{
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+		};
+		vkCreateFence(vkDevice, &fenceCI, nullptr, &frame.fence);
+	}
+	m_windowStart = GetCurrentTimeSeconds();
+	return true;
+}
+
+void DecodeScheduler::Shutdown()
+{
+	auto vkDevice = DeviceContext::GetContext()->GetVkDevice();
+	for (auto& frame : m_frames)
+	{
+		vkWaitForFences(vkDevice, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+		vkDestroyFence(vkDevice, frame.fence, nullptr);
+		for (auto sem : frame.semVideoToGfx)
+		{
+			vkDestroySemaphore(vkDevice, sem, nullptr);
+		}
+		// コマンドバッファはプールと共に解放される.
+		vkDestroyCommandPool(vkDevice, frame.videoCommandPool, nullptr);
+		vkDestroyCommandPool(vkDevice, frame.graphicsCommandPool, nullptr);
+	}
+	m_frames.clear();
+	for (auto sem : m_decodeTimelines)
+	{
+		vkDestroySemaphore(vkDevice, sem, nullptr);
+	}
+	m_decodeTimelines.clear();
+	m_decodeTimelineValues.clear();
+	m_streams.clear();
+	m_requests.clear();
+	m_jobStreams.clear();
+	m_queueStreamCounts.clear();
+	m_profiler.reset();
+}
+
+DecodeScheduler::StreamId DecodeScheduler::RegisterStream(const std::string& name)
+{
+	// 空いている番号を再利用する.
+	auto it = std::find_if(m_streams.begin(), m_streams.end(), [](const Stream& s) { return !s.active; });
+	if (it == m_streams.end())
+	{
+		it = m_streams.insert(m_streams.end(), Stream{});
+	}
+	*it = Stream{};
+	it->name = name;
+	it->active = true;
+	// 同じストリームのデコードは順序が必要なため、常に同じキューへ送る.
+	auto queue = std::min_element(m_queueStreamCounts.begin(), m_queueStreamCounts.end());
+	it->queueIndex = uint32_t(std::distance(m_queueStreamCounts.begin(), queue));
+	(*queue)++;
+	return StreamId(std::distance(m_streams.begin(), it));
+}
+
+void DecodeScheduler::UnregisterStream(StreamId id)
+{
+	assert(id < m_streams.size());
+	if (m_streams[id].active)
+	{
+		m_queueStreamCounts[m_streams[id].queueIndex]--;
+	}
+	m_streams[id] = Stream{};
+	std::erase(m_requests, id);
+}
+
+uint32_t DecodeScheduler::GetStreamCount() const
+{
+	return uint32_t(std::count_if(m_streams.begin(), m_streams.end(), [](const Stream& s) { return s.active; }));
+}
+
+const std::string& DecodeScheduler::GetStreamName(StreamId id) const
+{
+	assert(id < m_streams.size());
+	return m_streams[id].name;
+}
+
+uint32_t DecodeScheduler::GetStreamQueue(StreamId id) const
+{
+	assert(id < m_streams.size());
+	return m_streams[id].queueIndex;
+}
+
+void DecodeScheduler::BeginFrame(uint32_t frameIndex)
+{
+	assert(frameIndex < m_frames.size());
+	m_frameIndex = frameIndex;
+
+	auto vkDevice = DeviceContext::GetContext()->GetVkDevice();
+	auto& frame = m_frames[m_frameIndex];
+	if (frame.submitted)
+	{
+		vkWaitForFences(vkDevice, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+		frame.submitted = false;
+	}
+	// フェンスはデコードの完了も含むため、このフレームのデコードは全て終えている.
+	std::fill(frame.decodeValues.begin(), frame.decodeValues.end(), 0);
+	vkResetCommandPool(vkDevice, frame.videoCommandPool, 0);
+	vkResetCommandPool(vkDevice, frame.graphicsCommandPool, 0);
+	frame.usedCount = 0;
+	frame.jobQueues.clear();
+
+	m_requests.clear();
+	m_jobStreams.clear();
+	for (auto& stream : m_streams)
+	{
+		stream.requested = false;
+		stream.granted = false;
+	}
+}
+
+void DecodeScheduler::RequestDecode(StreamId id, double deadlineSeconds)
+{
+	assert(id < m_streams.size() && m_streams[id].active);
+	auto& stream = m_streams[id];
+	if (stream.requested)
+	{
+		return;
+	}
+	stream.requested = true;
+	stream.deadline = deadlineSeconds;
+	stream.stats.requested++;
+	m_total.requested++;
+	m_requests.push_back(id);
+}
+
+void DecodeScheduler::Schedule()
+{
+	if (m_requests.empty())
+	{
+		return;
+	}
+
+	// 締め切りが迫っているものを先に、それ以外はラウンドロビンの順に並べる.
+	const auto streamCount = uint32_t(m_streams.size());
+	auto order = [&](StreamId id) { return (id + streamCount - m_roundRobinCursor) % streamCount; };
+	std::sort(m_requests.begin(), m_requests.end(), [&](StreamId a, StreamId b) {
+		bool urgentA = m_streams[a].deadline < m_urgentThresholdSeconds;
+		bool urgentB = m_streams[b].deadline < m_urgentThresholdSeconds;
+		if (urgentA != urgentB)
+		{
+			return urgentA;
+		}
+		if (urgentA)
+		{
+			return m_streams[a].deadline < m_streams[b].deadline;
+		}
+		return order(a) < order(b);
+	});
+
+	const auto grantCount = std::min(uint32_t(m_requests.size()), m_maxDecodesPerFrame);
+	for (uint32_t i = 0; i < m_requests.size(); ++i)
+	{
+		auto& stream = m_streams[m_requests[i]];
+		if (i < grantCount)
+		{
+			stream.granted = true;
+			if (stream.deadline < 0.0)
+			{
+				stream.stats.deadlineMissed++;
+				m_total.deadlineMissed++;
+			}
+		}
+		else
+		{
+			stream.stats.deferred++;
+			m_total.deferred++;
+		}
+	}
+	// 次回は今回最後にデコードしたストリームの次から.
+	m_roundRobinCursor = (m_requests[grantCount - 1] + 1) % streamCount;
+}
+
+bool DecodeScheduler::IsGranted(StreamId id) const
+{
+	assert(id < m_streams.size());
+	return m_streams[id].granted;
+}
+
+DecodeScheduler::Job DecodeScheduler::BeginJob(StreamId id)
+{
+	assert(IsGranted(id));
+	auto vkDevice = DeviceContext::GetContext()->GetVkDevice();
+	auto& frame = m_frames[m_frameIndex];
+	if (frame.videoCommandBuffers.size() <= frame.usedCount)
+	{
+		VkCommandBufferAllocateInfo ai{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		ai.commandPool = frame.videoCommandPool;
+		vkAllocateCommandBuffers(vkDevice, &ai, &commandBuffer);
+		frame.videoCommandBuffers.push_back(commandBuffer);
+		ai.commandPool = frame.graphicsCommandPool;
+		vkAllocateCommandBuffers(vkDevice, &ai, &commandBuffer);
+		frame.graphicsCommandBuffers.push_back(commandBuffer);
+	}
+
+	Job job{
+		.videoCommandBuffer = frame.videoCommandBuffers[frame.usedCount],
+		.graphicsCommandBuffer = frame.graphicsCommandBuffers[frame.usedCount],
+		.profiler = m_profiler.get(),
+	};
+	frame.usedCount++;
+	frame.jobQueues.push_back(m_streams[id].queueIndex);
+
+	VkCommandBufferBeginInfo beginInfo{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	vkBeginCommandBuffer(job.videoCommandBuffer, &beginInfo);
+	vkBeginCommandBuffer(job.graphicsCommandBuffer, &beginInfo);
+	return job;
+}
+
+void DecodeScheduler::EndJob(StreamId id, const Job& job)
+{
+	vkEndCommandBuffer(job.videoCommandBuffer);
+	vkEndCommandBuffer(job.graphicsCommandBuffer);
+	m_jobStreams.push_back(id);
+
+	auto& stream = m_streams[id];
+	stream.stats.decoded++;
+	stream.windowDecoded++;
+	m_total.decoded++;
+	m_totalWindowDecoded++;
+}
+
+void DecodeScheduler::Submit()
+{
+	UpdateThroughput();
+
+	auto& frame = m_frames[m_frameIndex];
+	if (frame.usedCount == 0)
+	{
+		return;
+	}
+
+	auto devCtx = DeviceContext::GetContext();
+	vkResetFences(devCtx->GetVkDevice(), 1, &frame.fence);
+
+	// デコードキューごとに、そのキューのストリームのデコードを1回で送信し、完了をセマフォでグラフィックス側へ伝える.
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<VkCommandBuffer> commandBuffers;
+	for (uint32_t queue = 0; queue < uint32_t(frame.semVideoToGfx.size()); ++queue)
+	{
+		commandBuffers.clear();
+		for (uint32_t i = 0; i < frame.usedCount; ++i)
+		{
+			if (frame.jobQueues[i] == queue)
+			{
+				commandBuffers.push_back(frame.videoCommandBuffers[i]);
+			}
+		}
+		if (commandBuffers.empty())
+		{
+			continue;
+		}
+		// キューの完了を調べるため、タイムラインセマフォも合わせてシグナルする. バイナリセマフォの値は無視される.
+		frame.decodeValues[queue] = ++m_decodeTimelineValues[queue];
+		VkSemaphore signalSemaphores[] = { frame.semVideoToGfx[queue], m_decodeTimelines[queue] };
+		uint64_t signalValues[] = { 0, frame.decodeValues[queue] };
+		VkTimelineSemaphoreSubmitInfo timelineInfo{
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+			.signalSemaphoreValueCount = 2,
+			.pSignalSemaphoreValues = signalValues,
+		};
+		VkSubmitInfo submitInfo{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pNext = &timelineInfo,
+			.commandBufferCount = uint32_t(commandBuffers.size()),
+			.pCommandBuffers = commandBuffers.data(),
+			.signalSemaphoreCount = 2,
+			.pSignalSemaphores = signalSemaphores,
+		};
+		devCtx->Submit(DeviceContext::VideoDecode, &submitInfo, VK_NULL_HANDLE, queue);
+		waitSemaphores.push_back(frame.semVideoToGfx[queue]);
+	}
+	{
+		std::vector<VkPipelineStageFlags> waitStages(waitSemaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+		VkSubmitInfo submitInfo{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.waitSemaphoreCount = uint32_t(waitSemaphores.size()),
+			.pWaitSemaphores = waitSemaphores.data(),
+			.pWaitDstStageMask = waitStages.data(),
+			.commandBufferCount = frame.usedCount,
+			.pCommandBuffers = frame.graphicsCommandBuffers.data(),
+		};
+		// グラフィックス側はデコード完了を待つため、このフェンスで両方の完了がわかる.
+		devCtx->Submit(DeviceContext::Graphics, &submitInfo, frame.fence);
+	}
+	frame.submitted = true;
+}
+
+bool DecodeScheduler::IsSaturated(StreamId id) const
+{
+	assert(id < m_streams.size());
+	// 現在のフレームは BeginFrame で完了を待っているため、数えられるのは残りのフレームの分まで.
+	if (m_frames.size() < 2)
+	{
+		return false;
+	}
+	return uint32_t(m_frames.size() - 1) <= GetPendingFrameCount(m_streams[id].queueIndex);
+}
+
+uint32_t DecodeScheduler::GetPendingFrameCount(uint32_t queue) const
+{
+	assert(queue < m_decodeTimelines.size());
+	uint64_t completed = 0;
+	vkGetSemaphoreCounterValue(DeviceContext::GetContext()->GetVkDevice(), m_decodeTimelines[queue], &completed);
+	uint32_t pendingCount = 0;
+	for (const auto& frame : m_frames)
+	{
+		if (completed < frame.decodeValues[queue])
+		{
+			pendingCount++;
+		}
+	}
+	return pendingCount;
+}
+
+const DecodeScheduler::Statistics& DecodeScheduler::GetStreamStatistics(StreamId id) const
+{
+	assert(id < m_streams.size());
+	return m_streams[id].stats;
+}
+
+void DecodeScheduler::UpdateThroughput()
+{
+	auto now = GetCurrentTimeSeconds();
+	auto elapsed = now - m_windowStart;
+	if (elapsed < 1.0)
+	{
+		return;
+	}
+	for (auto& stream : m_streams)
+	{
+		stream.stats.framesPerSecond = stream.windowDecoded / elapsed;
+		stream.windowDecoded = 0;
+	}
+	m_total.framesPerSecond = m_totalWindowDecoded / elapsed;
+	m_totalWindowDecoded = 0;
+	m_windowStart = now;
+}
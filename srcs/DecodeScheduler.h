@@ -0,0 +1,128 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class GpuProfiler;
+
+// 複数のストリーム (VideoPlayer) からのデコード要求を受け付け、
+// デコードキューとグラフィックスキューへの送信をまとめて行う.
+// デコードキューが複数ある場合、ストリームは登録時に最も空いているキューへ割り当てられ、以後そのキューで順にデコードされる.
+// 1フレームの流れ:
+//   BeginFrame -> RequestDecode (各ストリーム) -> Schedule
+//   -> BeginJob/EndJob (許可されたストリーム) -> Submit
+class DecodeScheduler
+{
+public:
+	using StreamId = uint32_t;
+	static constexpr StreamId InvalidStream = ~0u;
+
+	// デコード1回分のコマンドバッファ. BeginJob で記録可能な状態で渡される.
+	struct Job {
+		VkCommandBuffer videoCommandBuffer = VK_NULL_HANDLE;
+		VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+		GpuProfiler* profiler = nullptr;	// 設定されている場合、バックエンドはデコードとコピーの区間を記録する.
+	};
+
+	struct Statistics {
+		uint64_t requested = 0;
+		uint64_t decoded = 0;
+		uint64_t deferred = 0;			// 上限を超えたため次のフレームへ見送った回数.
+		uint64_t deadlineMissed = 0;	// 締め切りを過ぎてからデコードした回数.
+		double   framesPerSecond = 0.0;	// 直近1秒間のデコード数.
+	};
+
+	bool Initialize(uint32_t frameCount);
+	void Shutdown();
+
+	StreamId RegisterStream(const std::string& name);
+	void UnregisterStream(StreamId id);
+	uint32_t GetStreamCount() const;
+	const std::string& GetStreamName(StreamId id) const;
+	// ストリームのデコードに使うキューの番号 (DeviceContext::GetQueue(VideoDecode, n)).
+	uint32_t GetStreamQueue(StreamId id) const;
+	uint32_t GetQueueCount() const { return uint32_t(m_queueStreamCounts.size()); }
+
+	// 1フレームでデコードするストリーム数の上限. 0 ではどのストリームも進まないため 1 以上とする.
+	void SetMaxDecodesPerFrame(uint32_t count) { m_maxDecodesPerFrame = count != 0 ? count : 1; }
+	uint32_t GetMaxDecodesPerFrame() const { return m_maxDecodesPerFrame; }
+	// 締め切りまでの残りがこの値未満の要求は、順番に関わらず優先する.
+	void SetUrgentThreshold(double seconds) { m_urgentThresholdSeconds = seconds; }
+	// ジョブに渡す GPU の時間計測. 区画の切り替え (GpuProfiler::BeginFrame) は呼び出し側が BeginFrame の後に行う.
+	void SetProfiler(std::shared_ptr<GpuProfiler> profiler) { m_profiler = std::move(profiler); }
+
+	// frameIndex のコマンドバッファが再利用可能になるまで待つ.
+	void BeginFrame(uint32_t frameIndex);
+
+	// deadlineSeconds: デコード結果が表示に必要となるまでの残り時間.
+	void RequestDecode(StreamId id, double deadlineSeconds);
+	// 要求の中から今回デコードするストリームを決める.
+	void Schedule();
+	bool IsGranted(StreamId id) const;
+
+	Job BeginJob(StreamId id);
+	void EndJob(StreamId id, const Job& job);
+
+	// 今回のジョブをデコードキューごと、グラフィックスキューの順にまとめて送信する.
+	void Submit();
+
+	// ストリームのデコードキューが、現在のフレーム以外の全ての処理中のフレームのデコードを終えていないか.
+	// BeginFrame の後に呼ぶ. 飽和している場合、次の BeginFrame はデコードの完了を待つことになる.
+	bool IsSaturated(StreamId id) const;
+	// デコードキューで未完了のフレーム数. デコードの完了はキューごとのタイムラインセマフォで調べる.
+	uint32_t GetPendingFrameCount(uint32_t queue) const;
+
+	const Statistics& GetStreamStatistics(StreamId id) const;
+	const Statistics& GetTotalStatistics() const { return m_total; }
+
+private:
+	struct Stream
+	{
+		std::string name;
+		bool active = false;
+		bool requested = false;
+		bool granted = false;
+		uint32_t queueIndex = 0;
+		double deadline = 0.0;
+		uint64_t windowDecoded = 0;
+		Statistics stats;
+	};
+	struct FrameResource
+	{
+		VkCommandPool videoCommandPool = VK_NULL_HANDLE;
+		VkCommandPool graphicsCommandPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> videoCommandBuffers;
+		std::vector<VkCommandBuffer> graphicsCommandBuffers;
+		uint32_t usedCount = 0;
+		std::vector<uint32_t> jobQueues;			// コマンドバッファごとのデコードキュー.
+		std::vector<VkSemaphore> semVideoToGfx;		// デコードキューごと.
+		std::vector<uint64_t> decodeValues;			// デコードキューごとに、送信でシグナルするタイムラインの値. 0 なら送信なし.
+		VkFence fence = VK_NULL_HANDLE;
+		bool submitted = false;
+	};
+
+	void UpdateThroughput();
+
+	std::vector<Stream> m_streams;
+	std::vector<FrameResource> m_frames;
+	std::vector<uint32_t> m_queueStreamCounts;	// キューごとに割り当てたストリーム数.
+	std::vector<VkSemaphore> m_decodeTimelines;	// デコードキューごとのタイムラインセマフォ. 送信のたびに値を 1 進める.
+	std::vector<uint64_t> m_decodeTimelineValues;
+	uint32_t m_frameIndex = 0;
+
+	std::vector<StreamId> m_requests;
+	std::vector<StreamId> m_jobStreams;
+	uint32_t m_roundRobinCursor = 0;
+	uint32_t m_maxDecodesPerFrame = 16;
+	double m_urgentThresholdSeconds = 1.0 / 60.0;
+
+	std::shared_ptr<GpuProfiler> m_profiler;
+
+	Statistics m_total;
+	uint64_t m_totalWindowDecoded = 0;
+	double m_windowStart = 0.0;
+};
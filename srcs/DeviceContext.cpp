@@ -1,538 +1,1117 @@
-﻿#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <windows.h>
-#undef ERROR
-
-#include "DeviceContext.h"
-#include "Swapchain.h"
-
-// volk をインクルード.
-// VOLK_IMPLEMENTATIONを定義して実装も含める.
-//#define VOLK_IMPLEMENTATION
-#define VK_USE_PLATFORM_WIN32_KHR
-#include "Volk/volk.h"
-
-#define GLFW_EXPOSE_NATIVE_WIN32
-#include "GLFW/glfw3.h"
-#include "GLFW/glfw3native.h"
-
-#include <cstdint>
-#include <iostream>
-#include <vector>
-#include <string>
-#include <memory>
-#include <algorithm>
-#include <filesystem>
-#include <fstream>
-#include <array>
-#include <format>
-#include <cassert>
-
-static DeviceContext* gDeviceContext;
-
-static VkBool32 VKAPI_CALL VulkanDebugCallback(
-  VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-  VkDebugUtilsMessageTypeFlagsEXT messageType,
-  const VkDebugUtilsMessengerCallbackDataEXT* data,
-  void* userData)
-{
-  if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
-  {
-    OutputDebugStringA(data->pMessage);
-    OutputDebugStringA("\n");
-  }
-  return VK_FALSE;
-}
-
-VkInstance DeviceContext::GetVkInstance()
-{
-  return m_vkInstance;
-}
-VkDevice DeviceContext::GetVkDevice()
-{
-  return m_vkDevice;
-}
-
-bool DeviceContext::Initialize()
-{
-  gDeviceContext = new DeviceContext();
-  gDeviceContext->InitializeVkInstance();
-  gDeviceContext->EnumerateGPUs();
-
-  return true;
-}
-
-void DeviceContext::Shutdown()
-{
-  if (!gDeviceContext)
-  {
-    return;
-  }
-  gDeviceContext->GetSwapchain()->Shutdown();
-  delete gDeviceContext;
-  gDeviceContext = nullptr;
-}
-
-DeviceContext* DeviceContext::GetContext()
-{
-  return gDeviceContext;
-}
-
-bool DeviceContext::InitializeDevice(int useGpuIndex)
-{
-  uint32_t familyPropsCount = 0;
-  m_useGpuIndex = useGpuIndex;
-  auto gpu = GetGPU();
-  vkGetPhysicalDeviceQueueFamilyProperties2(gpu, &familyPropsCount, nullptr);
-
-  std::vector<VkQueueFamilyVideoPropertiesKHR> familyPropsVideo(familyPropsCount);
-  std::vector<VkQueueFamilyProperties2> familyProps(familyPropsCount);
-  
-  for (uint32_t i = 0; i < familyPropsCount; ++i)
-  {
-    auto& prop = familyProps[i];
-    auto& videoProp = familyPropsVideo[i];
-    prop.sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_PROPERTIES_2;
-    prop.pNext = &videoProp;
-    videoProp.sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_VIDEO_PROPERTIES_KHR;
-  }
-  vkGetPhysicalDeviceQueueFamilyProperties2(gpu, &familyPropsCount, familyProps.data());
-  m_queueFamilies.resize(familyPropsCount);
-  
-  for (uint32_t i = 0; i < familyPropsCount; ++i)
-  {
-    m_queueFamilies[i].properties = familyProps[i];
-    m_queueFamilies[i].propertiesVideo = familyPropsVideo[i];
-    m_queueFamilies[i].properties.pNext = nullptr;
-
-    auto& queueFamily = m_queueFamilies[i].properties.queueFamilyProperties;
-    if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-    {
-      if (m_graphicsFamily == VK_QUEUE_FAMILY_IGNORED)
-      {
-        m_graphicsFamily = i;
-        m_queueFamilyIndices.push_back(m_graphicsFamily);
-      }
-    }
-    if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_VIDEO_DECODE_BIT_KHR)
-    {
-      if (m_videoDecodeFamily == VK_QUEUE_FAMILY_IGNORED)
-      {
-        // H264 サポートしてる？
-        if (m_queueFamilies[i].propertiesVideo.videoCodecOperations & VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_KHR)
-        {
-          m_videoDecodeFamily = i;
-          m_queueFamilyIndices.push_back(m_videoDecodeFamily);
-        }
-      }
-    }
-  }
-  
-  m_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
-  m_features2.pNext = &m_vulkan12Features;
-  m_vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
-  m_vulkan12Features.pNext = &m_vulkan13Features;
-  m_vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
-  vkGetPhysicalDeviceFeatures2(gpu, &m_features2);
-
-  float defaultPrior = 1.0f;
-  std::vector<VkDeviceQueueCreateInfo> deviceQueueCI = {
-    {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-      .queueFamilyIndex = m_graphicsFamily,
-      .queueCount = 1,
-      .pQueuePriorities = &defaultPrior,
-    },
-    {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-      .queueFamilyIndex = m_videoDecodeFamily,
-      .queueCount = 1,
-      .pQueuePriorities = &defaultPrior,
-    }
-  };
-
-  std::vector<const char*> activeDeviceExtensions = {
-      VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-
-      VK_KHR_VIDEO_QUEUE_EXTENSION_NAME,
-      VK_KHR_VIDEO_DECODE_QUEUE_EXTENSION_NAME,
-      VK_KHR_VIDEO_DECODE_H264_EXTENSION_NAME,
-      VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME,
-  };
-
-  VkPhysicalDeviceSamplerYcbcrConversionFeatures samplerYcbcrConversionFeatures{
-    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SAMPLER_YCBCR_CONVERSION_FEATURES,
-    .pNext = nullptr,
-    .samplerYcbcrConversion = VK_TRUE,
-  };
-  m_vulkan13Features.pNext = &samplerYcbcrConversionFeatures;
-
-  VkDeviceCreateInfo deviceCreateInfo{
-    .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-    .pNext = &m_features2,
-    .queueCreateInfoCount = uint32_t(deviceQueueCI.size()),
-    .pQueueCreateInfos = deviceQueueCI.data(),
-    .enabledExtensionCount = uint32_t(activeDeviceExtensions.size()),
-    .ppEnabledExtensionNames = activeDeviceExtensions.data(),
-  };
-
-  auto res = vkCreateDevice(gpu, &deviceCreateInfo, nullptr, &m_vkDevice);
-  if (res != VK_SUCCESS)
-  {
-    DebugBreak();
-  }
-  volkLoadDevice(m_vkDevice);
-
-  // デバイスキューを取得.
-  vkGetDeviceQueue(m_vkDevice, m_graphicsFamily, 0, &m_graphicsQueue);
-  vkGetDeviceQueue(m_vkDevice, m_videoDecodeFamily, 0, &m_videoDecodeQueue);
-
-  m_videoProfileInfo.sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_INFO_KHR;
-  m_videoProfileInfo.videoCodecOperation = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_KHR;
-  m_videoProfileInfo.lumaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
-  m_videoProfileInfo.chromaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
-  m_videoProfileInfo.chromaSubsampling = VK_VIDEO_CHROMA_SUBSAMPLING_420_BIT_KHR;
-  m_videoProfileInfo.pNext = &m_videoDecodeH264.profile;
-
-  m_videoDecodeH264.profile.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_PROFILE_INFO_KHR;
-  m_videoDecodeH264.profile.stdProfileIdc = STD_VIDEO_H264_PROFILE_IDC_HIGH;
-  m_videoDecodeH264.profile.pictureLayout = VK_VIDEO_DECODE_H264_PICTURE_LAYOUT_INTERLACED_INTERLEAVED_LINES_BIT_KHR;
-
-  m_videoCapabilities.sType = VK_STRUCTURE_TYPE_VIDEO_CAPABILITIES_KHR;
-  m_videoCapabilities.pNext = &m_videoDecodeCapabilities;
-
-  m_videoDecodeCapabilities.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_CAPABILITIES_KHR;
-  m_videoDecodeCapabilities.pNext = &m_videoDecodeH264.capabilities;
-
-  m_videoDecodeH264.capabilities.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_CAPABILITIES_KHR;
-  vkGetPhysicalDeviceVideoCapabilitiesKHR(gpu, &m_videoProfileInfo, &m_videoCapabilities);
-
-  VIDEO_DECODE_BITSTREAM_ALIGNMENT = std::max(VIDEO_DECODE_BITSTREAM_ALIGNMENT, m_videoCapabilities.minBitstreamBufferOffsetAlignment);
-  VIDEO_DECODE_BITSTREAM_ALIGNMENT = std::max(VIDEO_DECODE_BITSTREAM_ALIGNMENT, m_videoCapabilities.minBitstreamBufferSizeAlignment);
-
-
-  VmaVulkanFunctions vulkanFunctions = {
-    .vkGetInstanceProcAddr = vkGetInstanceProcAddr,
-    .vkGetDeviceProcAddr = vkGetDeviceProcAddr,
-    .vkGetPhysicalDeviceProperties = vkGetPhysicalDeviceProperties,
-    .vkGetPhysicalDeviceMemoryProperties = vkGetPhysicalDeviceMemoryProperties,
-    .vkAllocateMemory = vkAllocateMemory,
-    .vkFreeMemory = vkFreeMemory,
-    .vkMapMemory = vkMapMemory,
-    .vkUnmapMemory = vkUnmapMemory,
-    .vkFlushMappedMemoryRanges = vkFlushMappedMemoryRanges,
-    .vkInvalidateMappedMemoryRanges = vkInvalidateMappedMemoryRanges,
-    .vkBindBufferMemory = vkBindBufferMemory,
-    .vkBindImageMemory = vkBindImageMemory,
-    .vkGetBufferMemoryRequirements = vkGetBufferMemoryRequirements,
-    .vkGetImageMemoryRequirements = vkGetImageMemoryRequirements,
-    .vkCreateBuffer = vkCreateBuffer,
-    .vkDestroyBuffer = vkDestroyBuffer,
-    .vkCreateImage = vkCreateImage,
-    .vkDestroyImage = vkDestroyImage,
-    .vkCmdCopyBuffer = vkCmdCopyBuffer,
-  };
-
-  VmaAllocatorCreateInfo allocatorCI{
-    .flags = 0, //VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT,
-    .physicalDevice = GetGPU(),
-    .device = m_vkDevice,
-    //.pAllocationCallbacks = allocationCallbacks,
-    .pVulkanFunctions = &vulkanFunctions,
-    .instance = m_vkInstance,
-    .vulkanApiVersion = VK_API_VERSION_1_3,
-  };
-  vmaCreateAllocator(&allocatorCI, &m_vmaAllocator);
-
-  VkSamplerYcbcrConversionCreateInfo samplerYcbcrConversionCI = {
-    .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_CREATE_INFO, // VkStructureType
-    .pNext = nullptr,                                                // void *, optional
-    .format = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM,                     // VkFormat
-    .ycbcrModel = VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_709,            // VkSamplerYcbcrModelConversion
-    .ycbcrRange = VK_SAMPLER_YCBCR_RANGE_ITU_NARROW,                      // VkSamplerYcbcrRange
-    .components = {},                                                     // VkComponentMapping
-    .xChromaOffset = VK_CHROMA_LOCATION_MIDPOINT,                            // VkChromaLocation
-    .yChromaOffset = VK_CHROMA_LOCATION_MIDPOINT,                            // VkChromaLocation
-    .chromaFilter = VK_FILTER_NEAREST,                                      // VkFilter
-    .forceExplicitReconstruction = 0,                                                      // VkBool32
-  };
-
-  vkCreateSamplerYcbcrConversion(m_vkDevice, &samplerYcbcrConversionCI, nullptr, &m_samplerYcbcrConversion);
-
-  return true;
-}
-
-bool DeviceContext::InitializeSwapchain(GLFWwindow* window)
-{
-  m_swapchain = std::make_shared<Swapchain>();
-  return m_swapchain->Initialize(window);
-}
-
-
-void DeviceContext::CreateBuffer(const GPUBufferDesc* desc, GPUBuffer* buffer)
-{
-  VkBufferCreateInfo bufferCI{
-    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-  };
-
-}
-
-void DeviceContext::CreateImage(const GPUImageDesc& desc, GPUImage* image)
-{
-  VkImageCreateInfo imageCI{
-    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-    .flags = 0,
-    .imageType = desc.type,
-    .format = desc.format,
-    .extent = desc.extent,
-    .mipLevels = desc.mipLevels,
-    .arrayLayers = desc.arraySize,
-    .samples = VK_SAMPLE_COUNT_1_BIT,
-    .tiling = VK_IMAGE_TILING_OPTIMAL,
-    .usage = desc.usage,
-    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-    .queueFamilyIndexCount = 0,
-    .pQueueFamilyIndices = nullptr,
-    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-  };
-  imageCI.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
- 
-  VkVideoProfileListInfoKHR profileListInfo{
-    .sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR,
-    .profileCount = 1,
-    .pProfiles = &m_videoProfileInfo,
-  };
-  if (desc.usage & (VK_IMAGE_USAGE_VIDEO_DECODE_DST_BIT_KHR | VK_IMAGE_USAGE_VIDEO_DECODE_SRC_BIT_KHR | VK_IMAGE_USAGE_VIDEO_DECODE_DPB_BIT_KHR))
-  {
-    imageCI.pNext = &profileListInfo;
-
-    VkPhysicalDeviceVideoFormatInfoKHR videoFormatInfo{
-      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VIDEO_FORMAT_INFO_KHR,
-      .pNext = &profileListInfo,
-      .imageUsage = imageCI.usage,
-    };
-    uint32_t formatCount = 0;
-    vkGetPhysicalDeviceVideoFormatPropertiesKHR(GetGPU(), &videoFormatInfo, &formatCount, nullptr);
-    std::vector<VkVideoFormatPropertiesKHR> videoFormats(formatCount);
-    for (auto& v : videoFormats)
-    {
-      v.sType = VK_STRUCTURE_TYPE_VIDEO_FORMAT_PROPERTIES_KHR;
-    }
-    auto res = vkGetPhysicalDeviceVideoFormatPropertiesKHR(GetGPU(), &videoFormatInfo, &formatCount, videoFormats.data());
-    assert(res == VK_SUCCESS);
-  }
-
-  if (m_queueFamilyIndices.size() > 1)
-  {
-    imageCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
-    imageCI.queueFamilyIndexCount = (uint32_t)m_queueFamilyIndices.size();
-    imageCI.pQueueFamilyIndices = m_queueFamilyIndices.data();
-  }
-
-  vkCreateImage(m_vkDevice, &imageCI, nullptr, &image->image);
-
-  VkMemoryRequirements2 reqs{
-    .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
-  };
-  VkImageMemoryRequirementsInfo2 info{
-    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
-    .image = image->image,
-  };
-  vkGetImageMemoryRequirements2(m_vkDevice, &info, &reqs);
-  
-  VkMemoryAllocateInfo allocInfo{
-    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-    .allocationSize = reqs.memoryRequirements.size,
-    .memoryTypeIndex = GetMemoryTypeIndex(reqs, desc.memoryProperty),
-  };
-  vkAllocateMemory(m_vkDevice, &allocInfo, nullptr, &image->memory);
-  vkBindImageMemory(m_vkDevice, image->image, image->memory, 0);
-
-  VkImageViewCreateInfo viewCI{
-    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-    .flags = 0,
-    .image = image->image,
-    .viewType = VK_IMAGE_VIEW_TYPE_2D,
-    .format = imageCI.format,
-    .components = {
-      VK_COMPONENT_SWIZZLE_IDENTITY,
-      VK_COMPONENT_SWIZZLE_IDENTITY,
-      VK_COMPONENT_SWIZZLE_IDENTITY,
-      VK_COMPONENT_SWIZZLE_IDENTITY,
-    },
-    .subresourceRange = {
-      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-      .baseMipLevel = 0,
-      .levelCount = imageCI.mipLevels,
-      .baseArrayLayer = 0,
-      .layerCount = imageCI.arrayLayers,
-    }
-  };
-  switch (desc.type)
-  {
-    case VK_IMAGE_TYPE_1D: viewCI.viewType = VK_IMAGE_VIEW_TYPE_1D; break;
-    case VK_IMAGE_TYPE_2D: viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D; break;
-    case VK_IMAGE_TYPE_3D: viewCI.viewType = VK_IMAGE_VIEW_TYPE_3D; break;
-  }
-  vkCreateImageView(m_vkDevice, &viewCI, nullptr, &image->imageView);
-
-}
-
-void DeviceContext::Submit(QueueType type, const VkSubmitInfo* pSubmitInfo, VkFence waitFence)
-{
-  VkQueue queue = m_graphicsQueue;
-  if (type == Graphics) { queue = m_graphicsQueue; }
-  if (type == VideoDecode) { queue = m_videoDecodeQueue; }
-  vkQueueSubmit(queue, 1, pSubmitInfo, waitFence);
-}
-
-
-void DeviceContext::Present(std::vector<VkSemaphore> waitSemaphores)
-{
-  auto handle = m_swapchain->GetHandle();
-  auto index = m_swapchain->GetCurrentIndex();
-  VkPresentInfoKHR present{
-    .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-    .waitSemaphoreCount = uint32_t(waitSemaphores.size()),
-    .pWaitSemaphores = waitSemaphores.data(),
-    .swapchainCount = 1,
-    .pSwapchains = &handle,
-    .pImageIndices = &index,
-  };
-
-  vkQueuePresentKHR(m_graphicsQueue, &present);
-  vkQueueWaitIdle(m_graphicsQueue);
-}
-
-void DeviceContext::WaitForIdle()
-{
-  vkQueueWaitIdle(m_graphicsQueue);
-  vkQueueWaitIdle(m_videoDecodeQueue);
-}
-
-VkQueue DeviceContext::GetQueue(QueueType type)
-{
-  if (type == Graphics) { return m_graphicsQueue; }
-  if (type == VideoDecode) { return m_videoDecodeQueue; }
-  return VK_NULL_HANDLE;
-}
-
-bool DeviceContext::InitializeVkInstance()
-{
-  if (volkInitialize() != VK_SUCCESS)
-  {
-    OutputDebugStringA("volkInitialize failed.\n");
-    return false;
-  }
-  uint32_t instanceExtensionCount;
-  vkEnumerateInstanceExtensionProperties(nullptr, &instanceExtensionCount, nullptr);
-  std::vector<VkExtensionProperties> instanceExtensions(instanceExtensionCount);
-  vkEnumerateInstanceExtensionProperties(nullptr, &instanceExtensionCount, instanceExtensions.data());
-
-  std::vector<const char*> activeInstanceExtensions;
-
-  uint32_t glfwRequiredCount;
-  auto glfwRequiredExtensionNames = glfwGetRequiredInstanceExtensions(&glfwRequiredCount);
-  std::for_each_n(glfwRequiredExtensionNames, glfwRequiredCount, [&](auto v) { activeInstanceExtensions.push_back(v); });
-
-  // VK_EXT_full_screen_exclusiveのために依存する拡張機能を有効化する.
-  auto instanceExtensionRequired = {
-    VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
-    VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME,
-    // ----
-#ifdef _DEBUG
-      VK_EXT_DEBUG_UTILS_EXTENSION_NAME
-#endif
-  };
-  for (auto v : instanceExtensionRequired)
-  {
-    activeInstanceExtensions.push_back(v);
-  }
-
-  std::vector<const char*> activeInstanceLayers = {
-#ifdef _DEBUG
-      "VK_LAYER_KHRONOS_validation"
-#endif
-  };
-
-  VkApplicationInfo appInfo{
-    .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-    .pApplicationName = "Sample",
-    .pEngineName = "Sample",
-    .engineVersion = VK_API_VERSION_1_3,
-    .apiVersion = VK_API_VERSION_1_3,
-  };
-
-  VkInstanceCreateInfo instanceCreateInfo = {
-    .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-    .pApplicationInfo = &appInfo,
-    .enabledLayerCount = uint32_t(activeInstanceLayers.size()),
-    .ppEnabledLayerNames = (activeInstanceLayers.size() > 0) ? activeInstanceLayers.data() : nullptr,
-    .enabledExtensionCount = uint32_t(activeInstanceExtensions.size()),
-    .ppEnabledExtensionNames = (activeInstanceExtensions.size() > 0) ? activeInstanceExtensions.data() : nullptr,
-  };
-
-#ifdef _DEBUG
-  VkDebugUtilsMessengerCreateInfoEXT debugUtilsCreateInfo{
-    .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
-    .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT,
-    .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-    .pfnUserCallback = VulkanDebugCallback,
-  };
-  instanceCreateInfo.pNext = &debugUtilsCreateInfo;
-#endif
-  auto res = vkCreateInstance(&instanceCreateInfo, nullptr, &m_vkInstance);
-  if (res != VK_SUCCESS)
-  {
-    OutputDebugStringA("Failed vkCreateInstance().\n");
-    return false;
-  }
-  volkLoadInstance(m_vkInstance);
-#ifdef _DEBUG
-  res = vkCreateDebugUtilsMessengerEXT(m_vkInstance, &debugUtilsCreateInfo, nullptr, &m_debugUtils);
-  if (res != VK_SUCCESS)
-  {
-    OutputDebugStringA("Failed vkCreateDebugUtilsMessengerEXT().\n");
-    return false;
-  }
-#endif
-  return true;
-}
-
-void DeviceContext::EnumerateGPUs()
-{
-  uint32_t gpuCount = 0;
-  vkEnumeratePhysicalDevices(m_vkInstance, &gpuCount, nullptr);
-  m_gpus.resize(gpuCount);
-  vkEnumeratePhysicalDevices(m_vkInstance, &gpuCount, m_gpus.data());
-
-  m_physicalDeviceMemoryProps.resize(gpuCount);
-  for (uint32_t i = 0; i < gpuCount; ++i)
-  {
-    auto& memProps = m_physicalDeviceMemoryProps[i];
-    memProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
-    memProps.pNext = nullptr;
-
-    vkGetPhysicalDeviceMemoryProperties2(m_gpus[i], &memProps);
-  }
-}
-
-uint32_t DeviceContext::GetMemoryTypeIndex(VkMemoryRequirements2 reqs, VkMemoryPropertyFlags flags)
-{
-  auto requestBits = reqs.memoryRequirements.memoryTypeBits;
-  const auto& memoryProps = m_physicalDeviceMemoryProps[m_useGpuIndex].memoryProperties;
-  for (uint32_t i = 0; i < memoryProps.memoryTypeCount; ++i)
-  {
-    if (requestBits & 1)
-    {
-      // 要求されたメモリプロパティと一致するものを見つける.
-      const auto types = memoryProps.memoryTypes[i];
-      if ((types.propertyFlags & flags) == flags)
-      {
-        return i;
-      }
-    }
-    requestBits >>= 1;
-  }
-  return UINT32_MAX;
-}
+﻿#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef ERROR
+
+#include "DeviceContext.h"
+#include "Swapchain.h"
+
+// volk をインクルード.
+// VOLK_IMPLEMENTATIONを定義して実装も含める.
+//#define VOLK_IMPLEMENTATION
+#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#define GLFW_EXPOSE_NATIVE_WIN32
+#include "GLFW/glfw3.h"
+#include "GLFW/glfw3native.h"
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <array>
+#include <format>
+#include <cassert>
+#include <cstring>
+#include <tuple>
+
+static DeviceContext* gDeviceContext;
+
+namespace {
+  // パイプラインキャッシュファイルの先頭に置くヘッダー.
+  // Vulkan のキャッシュヘッダーには driverVersion がないため、ドライバー更新後の古いキャッシュはここで弾く.
+  struct PipelineCacheFileHeader
+  {
+    uint32_t magic;
+    uint32_t dataSize;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+  };
+  constexpr uint32_t PIPELINE_CACHE_FILE_MAGIC = 0x4350'4B56; // "VKPC"
+
+  bool IsCompatiblePipelineCacheData(const std::vector<char>& data, const VkPhysicalDeviceProperties& props)
+  {
+    VkPipelineCacheHeaderVersionOne header;
+    if (data.size() < sizeof(header))
+    {
+      return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    return header.headerSize >= sizeof(header) && header.headerSize <= data.size()
+      && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+      && header.vendorID == props.vendorID
+      && header.deviceID == props.deviceID
+      && memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+  }
+}
+
+static VkBool32 VKAPI_CALL VulkanDebugCallback(
+  VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+  VkDebugUtilsMessageTypeFlagsEXT messageType,
+  const VkDebugUtilsMessengerCallbackDataEXT* data,
+  void* userData)
+{
+  if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+  {
+    OutputDebugStringA(data->pMessage);
+    OutputDebugStringA("\n");
+  }
+  return VK_FALSE;
+}
+
+VkInstance DeviceContext::GetVkInstance()
+{
+  return m_vkInstance;
+}
+VkDevice DeviceContext::GetVkDevice()
+{
+  return m_vkDevice;
+}
+
+bool DeviceContext::Initialize()
+{
+  gDeviceContext = new DeviceContext();
+  gDeviceContext->InitializeVkInstance();
+  gDeviceContext->EnumerateGPUs();
+
+  return true;
+}
+
+void DeviceContext::Shutdown()
+{
+  if (!gDeviceContext)
+  {
+    return;
+  }
+  // オフラインのデコードではスワップチェインを作らない.
+  if (gDeviceContext->GetSwapchain())
+  {
+    gDeviceContext->GetSwapchain()->Shutdown();
+  }
+  if (gDeviceContext->m_pipelineCache != VK_NULL_HANDLE)
+  {
+    vkDestroyPipelineCache(gDeviceContext->m_vkDevice, gDeviceContext->m_pipelineCache, nullptr);
+    gDeviceContext->m_pipelineCache = VK_NULL_HANDLE;
+  }
+  delete gDeviceContext;
+  gDeviceContext = nullptr;
+}
+
+DeviceContext* DeviceContext::GetContext()
+{
+  return gDeviceContext;
+}
+
+bool DeviceContext::InitializeDevice(int useGpuIndex)
+{
+  if (useGpuIndex == AUTO_SELECT_GPU)
+  {
+    useGpuIndex = int(GetRankedGPUs().front());
+  }
+  uint32_t familyPropsCount = 0;
+  m_useGpuIndex = useGpuIndex;
+  auto gpu = GetGPU();
+  OutputDebugStringA(std::format("GPU: {} (index {})\n", m_gpuInfos[m_useGpuIndex].name, m_useGpuIndex).c_str());
+  vkGetPhysicalDeviceQueueFamilyProperties2(gpu, &familyPropsCount, nullptr);
+
+  std::vector<VkQueueFamilyVideoPropertiesKHR> familyPropsVideo(familyPropsCount);
+  std::vector<VkQueueFamilyQueryResultStatusPropertiesKHR> familyPropsQueryResultStatus(familyPropsCount);
+  std::vector<VkQueueFamilyProperties2> familyProps(familyPropsCount);
+  
+  for (uint32_t i = 0; i < familyPropsCount; ++i)
+  {
+    auto& prop = familyProps[i];
+    auto& videoProp = familyPropsVideo[i];
+    auto& queryResultStatusProp = familyPropsQueryResultStatus[i];
+    prop.sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_PROPERTIES_2;
+    prop.pNext = &videoProp;
+    videoProp.sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_VIDEO_PROPERTIES_KHR;
+    videoProp.pNext = &queryResultStatusProp;
+    queryResultStatusProp.sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_QUERY_RESULT_STATUS_PROPERTIES_KHR;
+  }
+  vkGetPhysicalDeviceQueueFamilyProperties2(gpu, &familyPropsCount, familyProps.data());
+  m_queueFamilies.resize(familyPropsCount);
+  
+  for (uint32_t i = 0; i < familyPropsCount; ++i)
+  {
+    m_queueFamilies[i].properties = familyProps[i];
+    m_queueFamilies[i].propertiesVideo = familyPropsVideo[i];
+    m_queueFamilies[i].propertiesQueryResultStatus = familyPropsQueryResultStatus[i];
+    m_queueFamilies[i].properties.pNext = nullptr;
+    m_queueFamilies[i].propertiesVideo.pNext = nullptr;
+    m_queueFamilies[i].propertiesQueryResultStatus.pNext = nullptr;
+
+    auto& queueFamily = m_queueFamilies[i].properties.queueFamilyProperties;
+    if (queueFamily.queueCount == 0)
+    {
+      continue;
+    }
+    bool isGraphics = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+    // H264 サポートしてる？
+    bool isDecodeH264 = (queueFamily.queueFlags & VK_QUEUE_VIDEO_DECODE_BIT_KHR)
+      && (m_queueFamilies[i].propertiesVideo.videoCodecOperations & VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_KHR);
+    if (isGraphics && m_graphicsFamily == VK_QUEUE_FAMILY_IGNORED)
+    {
+      m_graphicsFamily = i;
+    }
+    if (!isDecodeH264 || m_isUnifiedQueue)
+    {
+      continue;
+    }
+    // 両方できるファミリーを優先する. それ以外はキューの多いファミリー.
+    if (isGraphics)
+    {
+      m_graphicsFamily = i;
+      m_videoDecodeFamily = i;
+      m_isUnifiedQueue = true;
+    }
+    else if (m_videoDecodeFamily == VK_QUEUE_FAMILY_IGNORED
+      || m_queueFamilies[m_videoDecodeFamily].properties.queueFamilyProperties.queueCount < queueFamily.queueCount)
+    {
+      m_videoDecodeFamily = i;
+    }
+  }
+  
+  m_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  m_features2.pNext = &m_vulkan12Features;
+  m_vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  m_vulkan12Features.pNext = &m_vulkan13Features;
+  m_vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  vkGetPhysicalDeviceFeatures2(gpu, &m_features2);
+  {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(gpu, &props);
+    m_timestampPeriod = props.limits.timestampPeriod;
+  }
+
+  // H.264 のデコードキューがなければ CPU でデコードする. デコード用のキューはグラフィックスキューで代用する.
+  m_hasVideoDecodeQueue = m_videoDecodeFamily != VK_QUEUE_FAMILY_IGNORED;
+  if (!m_hasVideoDecodeQueue)
+  {
+    OutputDebugStringA("NOTE: H.264 video decode queue not found. Falling back to software decoding.\n");
+    m_videoDecodeFamily = m_graphicsFamily;
+    m_isUnifiedQueue = true;
+  }
+  m_queueFamilyIndices.push_back(m_graphicsFamily);
+  if (!m_isUnifiedQueue)
+  {
+    m_queueFamilyIndices.push_back(m_videoDecodeFamily);
+  }
+
+  // デコードキューはファミリーの全てを作り、ストリームごとに振り分けて複数のデコーダーを並行に使う.
+  // 同じファミリーの場合、キュー 0 をグラフィックスに、残りをデコードに使う (1つしかなければ共有する).
+  uint32_t decodeQueueCount = 1;
+  if (m_hasVideoDecodeQueue)
+  {
+    decodeQueueCount = m_queueFamilies[m_videoDecodeFamily].properties.queueFamilyProperties.queueCount;
+  }
+  std::vector<float> queuePriorities(decodeQueueCount, 1.0f);
+  std::vector<VkDeviceQueueCreateInfo> deviceQueueCI = {
+    {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = m_graphicsFamily,
+      .queueCount = m_isUnifiedQueue ? decodeQueueCount : 1,
+      .pQueuePriorities = queuePriorities.data(),
+    },
+  };
+  if (!m_isUnifiedQueue)
+  {
+    deviceQueueCI.push_back({
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = m_videoDecodeFamily,
+      .queueCount = decodeQueueCount,
+      .pQueuePriorities = queuePriorities.data(),
+    });
+  }
+
+  std::vector<const char*> activeDeviceExtensions = {
+      VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+      VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME,
+  };
+  if (m_hasVideoDecodeQueue)
+  {
+    activeDeviceExtensions.push_back(VK_KHR_VIDEO_QUEUE_EXTENSION_NAME);
+    activeDeviceExtensions.push_back(VK_KHR_VIDEO_DECODE_QUEUE_EXTENSION_NAME);
+    activeDeviceExtensions.push_back(VK_KHR_VIDEO_DECODE_H264_EXTENSION_NAME);
+  }
+
+  // 予算を超える前に任意の確保を減らせるよう、利用できればドライバーから予算を取得する.
+  uint32_t deviceExtensionCount = 0;
+  vkEnumerateDeviceExtensionProperties(gpu, nullptr, &deviceExtensionCount, nullptr);
+  std::vector<VkExtensionProperties> deviceExtensions(deviceExtensionCount);
+  vkEnumerateDeviceExtensionProperties(gpu, nullptr, &deviceExtensionCount, deviceExtensions.data());
+  m_hasMemoryBudget = std::any_of(deviceExtensions.begin(), deviceExtensions.end(), [](const VkExtensionProperties& v) {
+    return strcmp(v.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+  });
+  if (m_hasMemoryBudget)
+  {
+    activeDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+
+  VkPhysicalDeviceSamplerYcbcrConversionFeatures samplerYcbcrConversionFeatures{
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SAMPLER_YCBCR_CONVERSION_FEATURES,
+    .pNext = nullptr,
+    .samplerYcbcrConversion = VK_TRUE,
+  };
+  m_vulkan13Features.pNext = &samplerYcbcrConversionFeatures;
+
+  VkDeviceCreateInfo deviceCreateInfo{
+    .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+    .pNext = &m_features2,
+    .queueCreateInfoCount = uint32_t(deviceQueueCI.size()),
+    .pQueueCreateInfos = deviceQueueCI.data(),
+    .enabledExtensionCount = uint32_t(activeDeviceExtensions.size()),
+    .ppEnabledExtensionNames = activeDeviceExtensions.data(),
+  };
+
+  auto res = vkCreateDevice(gpu, &deviceCreateInfo, nullptr, &m_vkDevice);
+  if (res != VK_SUCCESS)
+  {
+    DebugBreak();
+  }
+  volkLoadDevice(m_vkDevice);
+
+  // デバイスキューを取得.
+  vkGetDeviceQueue(m_vkDevice, m_graphicsFamily, 0, &m_graphicsQueue);
+  uint32_t firstDecodeQueue = (m_isUnifiedQueue && decodeQueueCount > 1) ? 1 : 0;
+  for (uint32_t i = firstDecodeQueue; i < decodeQueueCount; ++i)
+  {
+    VkQueue queue = VK_NULL_HANDLE;
+    vkGetDeviceQueue(m_vkDevice, m_videoDecodeFamily, i, &queue);
+    m_videoDecodeQueues.push_back(queue);
+  }
+  OutputDebugStringA(std::format("Queues: graphics family {}, decode family {} x{}{}\n",
+    m_graphicsFamily, m_videoDecodeFamily, m_videoDecodeQueues.size(), m_isUnifiedQueue ? " (unified)" : "").c_str());
+
+  m_videoProfileInfo.sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_INFO_KHR;
+  m_videoProfileInfo.videoCodecOperation = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_KHR;
+  m_videoProfileInfo.lumaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
+  m_videoProfileInfo.chromaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
+  m_videoProfileInfo.chromaSubsampling = VK_VIDEO_CHROMA_SUBSAMPLING_420_BIT_KHR;
+  m_videoProfileInfo.pNext = &m_videoDecodeH264.profile;
+
+  m_videoDecodeH264.profile.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_PROFILE_INFO_KHR;
+  m_videoDecodeH264.profile.stdProfileIdc = STD_VIDEO_H264_PROFILE_IDC_HIGH;
+  m_videoDecodeH264.profile.pictureLayout = VK_VIDEO_DECODE_H264_PICTURE_LAYOUT_INTERLACED_INTERLEAVED_LINES_BIT_KHR;
+
+  m_videoCapabilities.sType = VK_STRUCTURE_TYPE_VIDEO_CAPABILITIES_KHR;
+  m_videoCapabilities.pNext = &m_videoDecodeCapabilities;
+
+  m_videoDecodeCapabilities.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_CAPABILITIES_KHR;
+  m_videoDecodeCapabilities.pNext = &m_videoDecodeH264.capabilities;
+
+  m_videoDecodeH264.capabilities.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_CAPABILITIES_KHR;
+  if (m_hasVideoDecodeQueue)
+  {
+    vkGetPhysicalDeviceVideoCapabilitiesKHR(gpu, &m_videoProfileInfo, &m_videoCapabilities);
+
+    VIDEO_DECODE_BITSTREAM_ALIGNMENT = std::max(VIDEO_DECODE_BITSTREAM_ALIGNMENT, m_videoCapabilities.minBitstreamBufferOffsetAlignment);
+    VIDEO_DECODE_BITSTREAM_ALIGNMENT = std::max(VIDEO_DECODE_BITSTREAM_ALIGNMENT, m_videoCapabilities.minBitstreamBufferSizeAlignment);
+  }
+
+
+  VmaVulkanFunctions vulkanFunctions = {
+    .vkGetInstanceProcAddr = vkGetInstanceProcAddr,
+    .vkGetDeviceProcAddr = vkGetDeviceProcAddr,
+    .vkGetPhysicalDeviceProperties = vkGetPhysicalDeviceProperties,
+    .vkGetPhysicalDeviceMemoryProperties = vkGetPhysicalDeviceMemoryProperties,
+    .vkAllocateMemory = vkAllocateMemory,
+    .vkFreeMemory = vkFreeMemory,
+    .vkMapMemory = vkMapMemory,
+    .vkUnmapMemory = vkUnmapMemory,
+    .vkFlushMappedMemoryRanges = vkFlushMappedMemoryRanges,
+    .vkInvalidateMappedMemoryRanges = vkInvalidateMappedMemoryRanges,
+    .vkBindBufferMemory = vkBindBufferMemory,
+    .vkBindImageMemory = vkBindImageMemory,
+    .vkGetBufferMemoryRequirements = vkGetBufferMemoryRequirements,
+    .vkGetImageMemoryRequirements = vkGetImageMemoryRequirements,
+    .vkCreateBuffer = vkCreateBuffer,
+    .vkDestroyBuffer = vkDestroyBuffer,
+    .vkCreateImage = vkCreateImage,
+    .vkDestroyImage = vkDestroyImage,
+    .vkCmdCopyBuffer = vkCmdCopyBuffer,
+  };
+
+  VmaAllocatorCreateInfo allocatorCI{
+    .flags = m_hasMemoryBudget ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0u,
+    .physicalDevice = GetGPU(),
+    .device = m_vkDevice,
+    //.pAllocationCallbacks = allocationCallbacks,
+    .pVulkanFunctions = &vulkanFunctions,
+    .instance = m_vkInstance,
+    .vulkanApiVersion = VK_API_VERSION_1_3,
+  };
+  vmaCreateAllocator(&allocatorCI, &m_vmaAllocator);
+
+  VkSamplerYcbcrConversionCreateInfo samplerYcbcrConversionCI = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_CREATE_INFO, // VkStructureType
+    .pNext = nullptr,                                                // void *, optional
+    .format = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM,                     // VkFormat
+    .ycbcrModel = VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_709,            // VkSamplerYcbcrModelConversion
+    .ycbcrRange = VK_SAMPLER_YCBCR_RANGE_ITU_NARROW,                      // VkSamplerYcbcrRange
+    .components = {},                                                     // VkComponentMapping
+    .xChromaOffset = VK_CHROMA_LOCATION_MIDPOINT,                            // VkChromaLocation
+    .yChromaOffset = VK_CHROMA_LOCATION_MIDPOINT,                            // VkChromaLocation
+    .chromaFilter = VK_FILTER_NEAREST,                                      // VkFilter
+    .forceExplicitReconstruction = 0,                                                      // VkBool32
+  };
+
+  vkCreateSamplerYcbcrConversion(m_vkDevice, &samplerYcbcrConversionCI, nullptr, &m_samplerYcbcrConversion);
+
+  // 変換を伴うサンプラーは実装によって平面数より多くの記述子を消費する. 取得できない場合は 3 とみなす.
+  VkSamplerYcbcrConversionImageFormatProperties ycbcrFormatProps{
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_IMAGE_FORMAT_PROPERTIES,
+  };
+  VkImageFormatProperties2 imageFormatProps{
+    .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2,
+    .pNext = &ycbcrFormatProps,
+  };
+  VkPhysicalDeviceImageFormatInfo2 imageFormatInfo{
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+    .format = samplerYcbcrConversionCI.format,
+    .type = VK_IMAGE_TYPE_2D,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+  };
+  if (vkGetPhysicalDeviceImageFormatProperties2(GetGPU(), &imageFormatInfo, &imageFormatProps) == VK_SUCCESS &&
+    ycbcrFormatProps.combinedImageSamplerDescriptorCount != 0)
+  {
+    m_ycbcrDescriptorCount = ycbcrFormatProps.combinedImageSamplerDescriptorCount;
+  }
+
+  return true;
+}
+
+bool DeviceContext::InitializeSwapchain(GLFWwindow* window, VkPresentModeKHR presentMode, uint32_t imageCount)
+{
+  m_swapchain = std::make_shared<Swapchain>();
+  m_swapchain->SetPresentMode(presentMode);
+  m_swapchain->SetImageCount(imageCount);
+  return m_swapchain->Initialize(window);
+}
+
+
+VkResult DeviceContext::CreateBuffer(const GPUBufferDesc* desc, GPUBuffer* buffer)
+{
+  VkBufferCreateInfo bufferCI{
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size = desc->size,
+    .usage = desc->usage,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  VmaAllocationCreateInfo allocationCI{
+    .usage = VMA_MEMORY_USAGE_AUTO,
+    .requiredFlags = desc->memoryProperty,
+  };
+  if (desc->memoryProperty & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+  {
+    allocationCI.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+  }
+  VmaAllocationInfo allocationInfo{};
+  auto res = CreateBuffer(desc->category, bufferCI, allocationCI, &buffer->buffer, &buffer->allocation, &allocationInfo);
+  if (res != VK_SUCCESS)
+  {
+    return res;
+  }
+  buffer->desc = *desc;
+  buffer->pMapped = allocationInfo.pMappedData;
+  if (desc->usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+  {
+    VkBufferDeviceAddressInfo addressInfo{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+      .buffer = buffer->buffer,
+    };
+    buffer->deviceAddress = vkGetBufferDeviceAddress(m_vkDevice, &addressInfo);
+  }
+  return VK_SUCCESS;
+}
+
+VkResult DeviceContext::CreateImage(const GPUImageDesc& desc, GPUImage* image)
+{
+  VkImageCreateInfo imageCI{
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .flags = 0,
+    .imageType = desc.type,
+    .format = desc.format,
+    .extent = desc.extent,
+    .mipLevels = desc.mipLevels,
+    .arrayLayers = desc.arraySize,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .usage = desc.usage,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .queueFamilyIndexCount = 0,
+    .pQueueFamilyIndices = nullptr,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  imageCI.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+ 
+  VkVideoProfileListInfoKHR profileListInfo{
+    .sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR,
+    .profileCount = 1,
+    .pProfiles = &m_videoProfileInfo,
+  };
+  if (desc.usage & (VK_IMAGE_USAGE_VIDEO_DECODE_DST_BIT_KHR | VK_IMAGE_USAGE_VIDEO_DECODE_SRC_BIT_KHR | VK_IMAGE_USAGE_VIDEO_DECODE_DPB_BIT_KHR))
+  {
+    imageCI.pNext = &profileListInfo;
+
+    VkPhysicalDeviceVideoFormatInfoKHR videoFormatInfo{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VIDEO_FORMAT_INFO_KHR,
+      .pNext = &profileListInfo,
+      .imageUsage = imageCI.usage,
+    };
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceVideoFormatPropertiesKHR(GetGPU(), &videoFormatInfo, &formatCount, nullptr);
+    std::vector<VkVideoFormatPropertiesKHR> videoFormats(formatCount);
+    for (auto& v : videoFormats)
+    {
+      v.sType = VK_STRUCTURE_TYPE_VIDEO_FORMAT_PROPERTIES_KHR;
+    }
+    auto res = vkGetPhysicalDeviceVideoFormatPropertiesKHR(GetGPU(), &videoFormatInfo, &formatCount, videoFormats.data());
+    assert(res == VK_SUCCESS);
+  }
+
+  if (m_queueFamilyIndices.size() > 1)
+  {
+    imageCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    imageCI.queueFamilyIndexCount = (uint32_t)m_queueFamilyIndices.size();
+    imageCI.pQueueFamilyIndices = m_queueFamilyIndices.data();
+  }
+
+  VmaAllocationCreateInfo allocationCI{
+    .usage = VMA_MEMORY_USAGE_AUTO,
+    .requiredFlags = desc.memoryProperty,
+  };
+  auto res = CreateImage(desc.category, imageCI, allocationCI, &image->image, &image->allocation);
+  if (res != VK_SUCCESS)
+  {
+    return res;
+  }
+  image->desc = desc;
+
+  VkImageViewCreateInfo viewCI{
+    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .flags = 0,
+    .image = image->image,
+    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+    .format = imageCI.format,
+    .components = {
+      VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY,
+    },
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = 0,
+      .levelCount = imageCI.mipLevels,
+      .baseArrayLayer = 0,
+      .layerCount = imageCI.arrayLayers,
+    }
+  };
+  switch (desc.type)
+  {
+    case VK_IMAGE_TYPE_1D: viewCI.viewType = VK_IMAGE_VIEW_TYPE_1D; break;
+    case VK_IMAGE_TYPE_2D: viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D; break;
+    case VK_IMAGE_TYPE_3D: viewCI.viewType = VK_IMAGE_VIEW_TYPE_3D; break;
+  }
+  return vkCreateImageView(m_vkDevice, &viewCI, nullptr, &image->imageView);
+}
+
+void DeviceContext::DestroyBuffer(GPUBuffer* buffer)
+{
+  DestroyBuffer(buffer->buffer, buffer->allocation);
+  *buffer = {};
+}
+
+void DeviceContext::DestroyImage(GPUImage* image)
+{
+  if (image->imageView != VK_NULL_HANDLE)
+  {
+    vkDestroyImageView(m_vkDevice, image->imageView, nullptr);
+  }
+  DestroyImage(image->image, image->allocation);
+  *image = {};
+}
+
+VmaAllocationCreateInfo DeviceContext::PrepareAllocation(MemoryCategory category, const VmaAllocationCreateInfo& allocationCI) const
+{
+  // 解放時に集計から差し引けるよう、分類をユーザーデータに記録する. 0 は未分類.
+  auto ret = allocationCI;
+  ret.pUserData = reinterpret_cast<void*>(uintptr_t(category) + 1);
+  if (IsOptional(category))
+  {
+    ret.flags |= VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+  }
+  return ret;
+}
+
+void DeviceContext::TrackAllocation(VmaAllocation allocation, bool allocated)
+{
+  VmaAllocationInfo info{};
+  vmaGetAllocationInfo(m_vmaAllocator, allocation, &info);
+  auto category = size_t(reinterpret_cast<uintptr_t>(info.pUserData)) - 1;
+  if (category < m_categoryBytes.size())
+  {
+    if (allocated)
+    {
+      m_categoryBytes[category] += info.size;
+    }
+    else
+    {
+      m_categoryBytes[category] -= info.size;
+    }
+  }
+}
+
+VkResult DeviceContext::CreateBuffer(MemoryCategory category, const VkBufferCreateInfo& bufferCI, const VmaAllocationCreateInfo& allocationCI,
+  VkBuffer* buffer, VmaAllocation* allocation, VmaAllocationInfo* allocationInfo)
+{
+  // プールからの確保は、プール作成時に予算を確認済み.
+  if (IsOptional(category) && allocationCI.pool == VK_NULL_HANDLE && FitToBudget(bufferCI.size, 1, 1) == 0)
+  {
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  }
+  auto ci = PrepareAllocation(category, allocationCI);
+  auto res = vmaCreateBuffer(m_vmaAllocator, &bufferCI, &ci, buffer, allocation, allocationInfo);
+  if (res == VK_SUCCESS)
+  {
+    TrackAllocation(*allocation, true);
+  }
+  return res;
+}
+
+VkResult DeviceContext::CreateImage(MemoryCategory category, const VkImageCreateInfo& imageCI, const VmaAllocationCreateInfo& allocationCI,
+  VkImage* image, VmaAllocation* allocation, VmaAllocationInfo* allocationInfo)
+{
+  if (IsOptional(category) && allocationCI.pool == VK_NULL_HANDLE)
+  {
+    VkDeviceImageMemoryRequirements imageReqInfo{
+      .sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS,
+      .pCreateInfo = &imageCI,
+    };
+    VkMemoryRequirements2 memReqs{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+    };
+    vkGetDeviceImageMemoryRequirements(m_vkDevice, &imageReqInfo, &memReqs);
+    if (FitToBudget(memReqs.memoryRequirements.size, 1, 1) == 0)
+    {
+      return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+  }
+  auto ci = PrepareAllocation(category, allocationCI);
+  auto res = vmaCreateImage(m_vmaAllocator, &imageCI, &ci, image, allocation, allocationInfo);
+  if (res == VK_SUCCESS)
+  {
+    TrackAllocation(*allocation, true);
+  }
+  return res;
+}
+
+void DeviceContext::DestroyBuffer(VkBuffer buffer, VmaAllocation allocation)
+{
+  if (allocation != VK_NULL_HANDLE)
+  {
+    TrackAllocation(allocation, false);
+  }
+  vmaDestroyBuffer(m_vmaAllocator, buffer, allocation);
+}
+
+void DeviceContext::DestroyImage(VkImage image, VmaAllocation allocation)
+{
+  if (allocation != VK_NULL_HANDLE)
+  {
+    TrackAllocation(allocation, false);
+  }
+  vmaDestroyImage(m_vmaAllocator, image, allocation);
+}
+
+VmaPool DeviceContext::CreateImagePool(MemoryCategory category, const VkImageCreateInfo& imageCI, uint32_t& itemCount, uint32_t minItemCount)
+{
+  VkDeviceImageMemoryRequirements imageReqInfo{
+    .sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS,
+    .pCreateInfo = &imageCI,
+  };
+  VkMemoryRequirements2 memReqs{
+    .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+  };
+  vkGetDeviceImageMemoryRequirements(m_vkDevice, &imageReqInfo, &memReqs);
+  const auto& reqs = memReqs.memoryRequirements;
+  const VkDeviceSize itemSize = (reqs.size + reqs.alignment - 1) / reqs.alignment * reqs.alignment;
+
+  if (IsOptional(category))
+  {
+    auto fitCount = FitToBudget(itemSize, itemCount, minItemCount);
+    if (fitCount != itemCount)
+    {
+      OutputDebugStringA(std::format("Memory: {} reduced {} -> {} ({} bytes each).\n",
+        GetMemoryCategoryName(category), itemCount, fitCount, itemSize).c_str());
+    }
+    itemCount = fitCount;
+    if (itemCount == 0)
+    {
+      return VK_NULL_HANDLE;
+    }
+  }
+
+  VmaAllocationCreateInfo allocationCI{
+    .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+  };
+  uint32_t memoryTypeIndex = 0;
+  auto res = vmaFindMemoryTypeIndexForImageInfo(m_vmaAllocator, &imageCI, &allocationCI, &memoryTypeIndex);
+  if (res != VK_SUCCESS)
+  {
+    return VK_NULL_HANDLE;
+  }
+
+  // 全てが収まる1ブロックを最初に確保する. 再生中にブロックが増えることはない.
+  VmaPoolCreateInfo poolCI{
+    .memoryTypeIndex = memoryTypeIndex,
+    .flags = VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT,
+    .blockSize = itemSize * itemCount,
+    .minBlockCount = 1,
+    .maxBlockCount = 1,
+  };
+  VmaPool pool = VK_NULL_HANDLE;
+  res = vmaCreatePool(m_vmaAllocator, &poolCI, &pool);
+  if (res != VK_SUCCESS)
+  {
+    OutputDebugStringA(std::format("Memory: failed to create {} pool ({} bytes).\n", GetMemoryCategoryName(category), poolCI.blockSize).c_str());
+    return VK_NULL_HANDLE;
+  }
+  vmaSetPoolName(m_vmaAllocator, pool, std::format("{}Pool", GetMemoryCategoryName(category)).c_str());
+  return pool;
+}
+
+void DeviceContext::DestroyPool(VmaPool pool)
+{
+  if (pool != VK_NULL_HANDLE)
+  {
+    vmaDestroyPool(m_vmaAllocator, pool);
+  }
+}
+
+DeviceContext::MemoryBudget DeviceContext::GetMemoryBudget() const
+{
+  MemoryBudget ret;
+  const VkPhysicalDeviceMemoryProperties* memoryProps = nullptr;
+  vmaGetMemoryProperties(m_vmaAllocator, &memoryProps);
+  VmaBudget budgets[VK_MAX_MEMORY_HEAPS]{};
+  vmaGetHeapBudgets(m_vmaAllocator, budgets);
+  for (uint32_t i = 0; i < memoryProps->memoryHeapCount; ++i)
+  {
+    if (memoryProps->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+    {
+      ret.usage += budgets[i].usage;
+      ret.budget += budgets[i].budget;
+    }
+  }
+  for (size_t i = 0; i < m_categoryBytes.size(); ++i)
+  {
+    ret.categoryBytes[i] = m_categoryBytes[i];
+  }
+  return ret;
+}
+
+uint32_t DeviceContext::FitToBudget(VkDeviceSize itemSize, uint32_t count, uint32_t minCount) const
+{
+  auto budget = GetMemoryBudget();
+  const VkDeviceSize limit = budget.budget / 100 * OPTIONAL_BUDGET_PERCENT;
+  const VkDeviceSize available = budget.usage < limit ? limit - budget.usage : 0;
+  const uint64_t fitCount = itemSize != 0 ? available / itemSize : count;
+  if (fitCount < minCount)
+  {
+    return 0;
+  }
+  return uint32_t(std::min<uint64_t>(fitCount, count));
+}
+
+const char* DeviceContext::GetMemoryCategoryName(MemoryCategory category)
+{
+  switch (category)
+  {
+    case MemoryCategory::DPB: return "DPB";
+    case MemoryCategory::Bitstream: return "Bitstream";
+    case MemoryCategory::OutputTexture: return "OutputTexture";
+    case MemoryCategory::Staging: return "Staging";
+    default: return "Other";
+  }
+}
+
+void DeviceContext::Submit(QueueType type, const VkSubmitInfo* pSubmitInfo, VkFence waitFence, uint32_t queueIndex)
+{
+  vkQueueSubmit(GetQueue(type, queueIndex), 1, pSubmitInfo, waitFence);
+}
+
+
+VkResult DeviceContext::Present(std::vector<VkSemaphore> waitSemaphores)
+{
+  auto handle = m_swapchain->GetHandle();
+  auto index = m_swapchain->GetCurrentIndex();
+  VkPresentInfoKHR present{
+    .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+    .waitSemaphoreCount = uint32_t(waitSemaphores.size()),
+    .pWaitSemaphores = waitSemaphores.data(),
+    .swapchainCount = 1,
+    .pSwapchains = &handle,
+    .pImageIndices = &index,
+  };
+
+  // 完了の待機は呼び出し側がフレームごとのフェンスで行う.
+  return vkQueuePresentKHR(m_graphicsQueue, &present);
+}
+
+void DeviceContext::WaitForIdle()
+{
+  vkQueueWaitIdle(m_graphicsQueue);
+  for (auto queue : m_videoDecodeQueues)
+  {
+    vkQueueWaitIdle(queue);
+  }
+}
+
+bool DeviceContext::InitializePipelineCache(const std::filesystem::path& path)
+{
+  m_pipelineCachePath = path;
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(GetGPU(), &props);
+
+  std::vector<char> initialData;
+  std::ifstream infile(path, std::ios::binary);
+  if (infile)
+  {
+    PipelineCacheFileHeader header{};
+    infile.read(reinterpret_cast<char*>(&header), sizeof(header));
+    bool isValid = infile.good()
+      && header.magic == PIPELINE_CACHE_FILE_MAGIC
+      && header.vendorID == props.vendorID
+      && header.deviceID == props.deviceID
+      && header.driverVersion == props.driverVersion
+      && memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    if (isValid)
+    {
+      initialData.resize(header.dataSize);
+      infile.read(initialData.data(), initialData.size());
+      isValid = infile.good() && IsCompatiblePipelineCacheData(initialData, props);
+    }
+    if (!isValid)
+    {
+      // 別の GPU/ドライバーのもの、または壊れている. 空のキャッシュから作り直す.
+      OutputDebugStringA("NOTE: Pipeline cache is incompatible. Discarded.\n");
+      initialData.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo pipelineCacheCI{
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+    .initialDataSize = initialData.size(),
+    .pInitialData = initialData.data(),
+  };
+  auto res = vkCreatePipelineCache(m_vkDevice, &pipelineCacheCI, nullptr, &m_pipelineCache);
+  if (res != VK_SUCCESS && !initialData.empty())
+  {
+    pipelineCacheCI.initialDataSize = 0;
+    pipelineCacheCI.pInitialData = nullptr;
+    res = vkCreatePipelineCache(m_vkDevice, &pipelineCacheCI, nullptr, &m_pipelineCache);
+  }
+  if (res != VK_SUCCESS)
+  {
+    m_pipelineCache = VK_NULL_HANDLE;
+    return false;
+  }
+  OutputDebugStringA(std::format("Pipeline cache: loaded {} bytes.\n", initialData.size()).c_str());
+  return true;
+}
+
+void DeviceContext::SavePipelineCache()
+{
+  if (m_pipelineCache == VK_NULL_HANDLE || m_pipelineCachePath.empty())
+  {
+    return;
+  }
+
+  size_t dataSize = 0;
+  vkGetPipelineCacheData(m_vkDevice, m_pipelineCache, &dataSize, nullptr);
+  std::vector<char> data(dataSize);
+  auto res = vkGetPipelineCacheData(m_vkDevice, m_pipelineCache, &dataSize, data.data());
+  if (res != VK_SUCCESS || dataSize == 0)
+  {
+    return;
+  }
+  data.resize(dataSize);
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(GetGPU(), &props);
+  PipelineCacheFileHeader header{
+    .magic = PIPELINE_CACHE_FILE_MAGIC,
+    .dataSize = uint32_t(data.size()),
+    .vendorID = props.vendorID,
+    .deviceID = props.deviceID,
+    .driverVersion = props.driverVersion,
+  };
+  memcpy(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE);
+
+  auto tempPath = m_pipelineCachePath;
+  tempPath += ".tmp";
+  {
+    std::ofstream outfile(tempPath, std::ios::binary | std::ios::trunc);
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outfile.write(data.data(), data.size());
+    if (!outfile.good())
+    {
+      return;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tempPath, m_pipelineCachePath, ec);
+  if (ec)
+  {
+    std::filesystem::remove(tempPath, ec);
+    return;
+  }
+  OutputDebugStringA(std::format("Pipeline cache: saved {} bytes.\n", data.size()).c_str());
+}
+
+uint32_t DeviceContext::GetTimestampValidBits(QueueType type) const
+{
+  auto family = (type == Graphics) ? m_graphicsFamily : m_videoDecodeFamily;
+  if (family == VK_QUEUE_FAMILY_IGNORED)
+  {
+    return 0;
+  }
+  return m_queueFamilies[family].properties.queueFamilyProperties.timestampValidBits;
+}
+
+bool DeviceContext::HasDecodeQueryResultStatus() const
+{
+  if (!m_hasVideoDecodeQueue)
+  {
+    return false;
+  }
+  return m_queueFamilies[m_videoDecodeFamily].propertiesQueryResultStatus.queryResultStatusSupport == VK_TRUE;
+}
+
+VkQueue DeviceContext::GetQueue(QueueType type, uint32_t queueIndex)
+{
+  if (type == Graphics) { return m_graphicsQueue; }
+  if (type == VideoDecode)
+  {
+    assert(queueIndex < m_videoDecodeQueues.size());
+    return m_videoDecodeQueues[queueIndex];
+  }
+  return VK_NULL_HANDLE;
+}
+
+std::vector<uint32_t> DeviceContext::GetRankedGPUs() const
+{
+  std::vector<uint32_t> ranked(m_gpus.size());
+  for (uint32_t i = 0; i < ranked.size(); ++i)
+  {
+    ranked[i] = i;
+  }
+  auto key = [&](uint32_t index) {
+    const auto& info = m_gpuInfos[index];
+    return std::make_tuple(
+      info.hasH264Decode,
+      uint64_t(info.maxCodedExtent.width) * info.maxCodedExtent.height,
+      info.maxDpbSlots,
+      info.decodeQueueCount,
+      info.type == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU);
+  };
+  // 同じ能力なら列挙順を保つ.
+  std::stable_sort(ranked.begin(), ranked.end(), [&](uint32_t a, uint32_t b) { return key(a) > key(b); });
+  return ranked;
+}
+
+bool DeviceContext::InitializeVkInstance()
+{
+  if (volkInitialize() != VK_SUCCESS)
+  {
+    OutputDebugStringA("volkInitialize failed.\n");
+    return false;
+  }
+  uint32_t instanceExtensionCount;
+  vkEnumerateInstanceExtensionProperties(nullptr, &instanceExtensionCount, nullptr);
+  std::vector<VkExtensionProperties> instanceExtensions(instanceExtensionCount);
+  vkEnumerateInstanceExtensionProperties(nullptr, &instanceExtensionCount, instanceExtensions.data());
+
+  std::vector<const char*> activeInstanceExtensions;
+
+  uint32_t glfwRequiredCount;
+  auto glfwRequiredExtensionNames = glfwGetRequiredInstanceExtensions(&glfwRequiredCount);
+  std::for_each_n(glfwRequiredExtensionNames, glfwRequiredCount, [&](auto v) { activeInstanceExtensions.push_back(v); });
+
+  // VK_EXT_full_screen_exclusiveのために依存する拡張機能を有効化する.
+  auto instanceExtensionRequired = {
+    VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+    VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME,
+    // ----
+#ifdef _DEBUG
+      VK_EXT_DEBUG_UTILS_EXTENSION_NAME
+#endif
+  };
+  for (auto v : instanceExtensionRequired)
+  {
+    activeInstanceExtensions.push_back(v);
+  }
+
+  std::vector<const char*> activeInstanceLayers = {
+#ifdef _DEBUG
+      "VK_LAYER_KHRONOS_validation"
+#endif
+  };
+
+  VkApplicationInfo appInfo{
+    .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+    .pApplicationName = "Sample",
+    .pEngineName = "Sample",
+    .engineVersion = VK_API_VERSION_1_3,
+    .apiVersion = VK_API_VERSION_1_3,
+  };
+
+  VkInstanceCreateInfo instanceCreateInfo = {
+    .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+    .pApplicationInfo = &appInfo,
+    .enabledLayerCount = uint32_t(activeInstanceLayers.size()),
+    .ppEnabledLayerNames = (activeInstanceLayers.size() > 0) ? activeInstanceLayers.data() : nullptr,
+    .enabledExtensionCount = uint32_t(activeInstanceExtensions.size()),
+    .ppEnabledExtensionNames = (activeInstanceExtensions.size() > 0) ? activeInstanceExtensions.data() : nullptr,
+  };
+
+#ifdef _DEBUG
+  VkDebugUtilsMessengerCreateInfoEXT debugUtilsCreateInfo{
+    .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+    .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT,
+    .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+    .pfnUserCallback = VulkanDebugCallback,
+  };
+  instanceCreateInfo.pNext = &debugUtilsCreateInfo;
+#endif
+  auto res = vkCreateInstance(&instanceCreateInfo, nullptr, &m_vkInstance);
+  if (res != VK_SUCCESS)
+  {
+    OutputDebugStringA("Failed vkCreateInstance().\n");
+    return false;
+  }
+  volkLoadInstance(m_vkInstance);
+#ifdef _DEBUG
+  res = vkCreateDebugUtilsMessengerEXT(m_vkInstance, &debugUtilsCreateInfo, nullptr, &m_debugUtils);
+  if (res != VK_SUCCESS)
+  {
+    OutputDebugStringA("Failed vkCreateDebugUtilsMessengerEXT().\n");
+    return false;
+  }
+#endif
+  return true;
+}
+
+void DeviceContext::EnumerateGPUs()
+{
+  uint32_t gpuCount = 0;
+  vkEnumeratePhysicalDevices(m_vkInstance, &gpuCount, nullptr);
+  m_gpus.resize(gpuCount);
+  vkEnumeratePhysicalDevices(m_vkInstance, &gpuCount, m_gpus.data());
+
+  m_physicalDeviceMemoryProps.resize(gpuCount);
+  for (uint32_t i = 0; i < gpuCount; ++i)
+  {
+    auto& memProps = m_physicalDeviceMemoryProps[i];
+    memProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memProps.pNext = nullptr;
+
+    vkGetPhysicalDeviceMemoryProperties2(m_gpus[i], &memProps);
+  }
+
+  // GPU の選択のため、デコードできるキューファミリーと H.264 の能力を調べる.
+  m_gpuInfos.resize(gpuCount);
+  for (uint32_t i = 0; i < gpuCount; ++i)
+  {
+    auto& info = m_gpuInfos[i];
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(m_gpus[i], &props);
+    info.name = props.deviceName;
+    info.type = props.deviceType;
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties2(m_gpus[i], &familyCount, nullptr);
+    std::vector<VkQueueFamilyVideoPropertiesKHR> familyPropsVideo(familyCount, { .sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_VIDEO_PROPERTIES_KHR });
+    std::vector<VkQueueFamilyProperties2> familyProps(familyCount, { .sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_PROPERTIES_2 });
+    for (uint32_t j = 0; j < familyCount; ++j)
+    {
+      familyProps[j].pNext = &familyPropsVideo[j];
+    }
+    vkGetPhysicalDeviceQueueFamilyProperties2(m_gpus[i], &familyCount, familyProps.data());
+    for (uint32_t j = 0; j < familyCount; ++j)
+    {
+      const auto& family = familyProps[j].queueFamilyProperties;
+      if (family.queueCount == 0 || !(family.queueFlags & VK_QUEUE_VIDEO_DECODE_BIT_KHR)
+        || !(familyPropsVideo[j].videoCodecOperations & VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_KHR))
+      {
+        continue;
+      }
+      info.hasH264Decode = true;
+      info.decodeQueueCount = std::max(info.decodeQueueCount, family.queueCount);
+      info.hasUnifiedQueue |= (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+    }
+    if (info.hasH264Decode)
+    {
+      // InitializeDevice と同じプロファイルで問い合わせる.
+      VkVideoDecodeH264ProfileInfoKHR h264Profile{
+        .sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_PROFILE_INFO_KHR,
+        .stdProfileIdc = STD_VIDEO_H264_PROFILE_IDC_HIGH,
+        .pictureLayout = VK_VIDEO_DECODE_H264_PICTURE_LAYOUT_INTERLACED_INTERLEAVED_LINES_BIT_KHR,
+      };
+      VkVideoProfileInfoKHR profile{
+        .sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_INFO_KHR,
+        .pNext = &h264Profile,
+        .videoCodecOperation = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_KHR,
+        .chromaSubsampling = VK_VIDEO_CHROMA_SUBSAMPLING_420_BIT_KHR,
+        .lumaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR,
+        .chromaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR,
+      };
+      VkVideoDecodeH264CapabilitiesKHR h264Caps{
+        .sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_CAPABILITIES_KHR,
+      };
+      VkVideoDecodeCapabilitiesKHR decodeCaps{
+        .sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_CAPABILITIES_KHR,
+        .pNext = &h264Caps,
+      };
+      VkVideoCapabilitiesKHR caps{
+        .sType = VK_STRUCTURE_TYPE_VIDEO_CAPABILITIES_KHR,
+        .pNext = &decodeCaps,
+      };
+      if (vkGetPhysicalDeviceVideoCapabilitiesKHR(m_gpus[i], &profile, &caps) == VK_SUCCESS)
+      {
+        info.maxCodedExtent = caps.maxCodedExtent;
+        info.maxDpbSlots = caps.maxDpbSlots;
+      }
+      else
+      {
+        // High プロファイルを扱えないものはデコードできないとみなす.
+        info.hasH264Decode = false;
+      }
+    }
+    OutputDebugStringA(std::format("GPU[{}]: {} decode={} max={}x{} dpb={} queues={}{}\n",
+      i, info.name, info.hasH264Decode, info.maxCodedExtent.width, info.maxCodedExtent.height,
+      info.maxDpbSlots, info.decodeQueueCount, info.hasUnifiedQueue ? " unified" : "").c_str());
+  }
+}
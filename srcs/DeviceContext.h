@@ -1,146 +1,252 @@
-#pragma once
-
-
-#define VK_USE_PLATFORM_WIN32_KHR
-#include <vulkan/vulkan.h>
-
-#include <vector>
-#include <string>
-#include <memory>
-
-#pragma warning(push)
-#pragma warning(disable: 4068)
-#include "vk_mem_alloc.h"
-#pragma warning(pop)
-
-#include "Swapchain.h"
-
-struct GPUBufferDesc
-{
-	VkDeviceSize size = 0;
-	VkBufferUsageFlags usage = 0;
-	VkMemoryPropertyFlags memoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-};
-struct GPUImageDesc
-{
-	VkExtent3D extent{ 0 };
-	uint32_t arraySize = 1;
-	uint32_t mipLevels = 1;
-	VkImageType type = VK_IMAGE_TYPE_2D;
-	VkFormat format = VK_FORMAT_UNDEFINED;
-	uint32_t sampleCount = 1;
-	VkImageUsageFlags usage = 0;
-	VkMemoryPropertyFlags memoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-};
-
-struct GPUBuffer {
-	VkBuffer buffer = VK_NULL_HANDLE;
-	VkDeviceMemory memory = VK_NULL_HANDLE;
-	
-	VkDeviceAddress deviceAddress = 0;
-	void* pMapped = nullptr;
-
-	GPUBufferDesc desc;
-};
-struct GPUImage {
-	VkImage image = VK_NULL_HANDLE;
-	VkImageView imageView = VK_NULL_HANDLE;
-	VkDeviceMemory memory = VK_NULL_HANDLE;
-
-	VkDeviceAddress deviceAddress = 0;
-	void* pMapped = nullptr;
-
-	GPUImageDesc desc;
-};
-
-class Swapchain;
-struct GLFWwindow;
-
-class DeviceContext
-{
-public:
-	static bool Initialize();
-	static void Shutdown();
-	static DeviceContext* GetContext();
-
-	bool InitializeDevice(int useGpuIndex);
-	bool InitializeSwapchain(GLFWwindow* window);
-
-	uint32_t GetGPUCount()const { return uint32_t(std::size(m_gpus)); }
-	VkPhysicalDevice GetGPU(int gpuIndex) const { return m_gpus[gpuIndex]; }
-	VkPhysicalDevice GetGPU() const { return m_gpus[m_useGpuIndex]; }
-
-	VkInstance GetVkInstance();
-	VkDevice   GetVkDevice();
-
-
-	void CreateBuffer(const GPUBufferDesc* desc, GPUBuffer* buffer);
-	void CreateImage(const GPUImageDesc& desc, GPUImage* image);
-
-	void DestroyBuffer(GPUBuffer*);
-	void DestroyImage(GPUImage*);
-
-	enum QueueType
-	{
-		Graphics, VideoDecode,
-	};
-	void Submit(QueueType type, const VkSubmitInfo*, VkFence waitFence);
-
-	void Present(std::vector<VkSemaphore> waitSemaphores);
-
-	void WaitForIdle();
-
-	VkDeviceSize VIDEO_DECODE_BITSTREAM_ALIGNMENT = 1;
-	uint32_t GetGraphicsQueueFamilyIndex() const { return m_graphicsFamily; }
-	uint32_t GetDecoderQueueFamilyIndex() const { return m_videoDecodeFamily; }
-
-	VmaAllocator GetVmaAllocator() const { return m_vmaAllocator; }
-
-	VkSamplerYcbcrConversion m_samplerYcbcrConversion;
-	
-	std::shared_ptr<Swapchain> GetSwapchain() { return m_swapchain; }
-
-	VkQueue GetQueue(QueueType type);
-private:
-	bool InitializeVkInstance();
-	void EnumerateGPUs();
-	uint32_t GetMemoryTypeIndex(VkMemoryRequirements2 reqs, VkMemoryPropertyFlags flags);
-
-	VkInstance m_vkInstance = VK_NULL_HANDLE;
-	VkDevice   m_vkDevice = VK_NULL_HANDLE;
-	VkDebugUtilsMessengerEXT m_debugUtils = VK_NULL_HANDLE;
-	uint32_t m_useGpuIndex = 0;
-
-	std::vector<VkPhysicalDevice> m_gpus;
-	struct QueueFamilyProperties {
-		VkQueueFamilyProperties2 properties;
-		VkQueueFamilyVideoPropertiesKHR propertiesVideo;
-	};
-	std::vector<QueueFamilyProperties> m_queueFamilies;
-	std::vector<uint32_t> m_queueFamilyIndices;
-
-	uint32_t m_graphicsFamily = VK_QUEUE_FAMILY_IGNORED;
-	uint32_t m_videoDecodeFamily = VK_QUEUE_FAMILY_IGNORED;
-	VkQueue m_graphicsQueue;
-	VkQueue m_videoDecodeQueue;
-
-	std::shared_ptr<Swapchain> m_swapchain;
-	std::vector<VkPhysicalDeviceMemoryProperties2> m_physicalDeviceMemoryProps;
-
-
-	VkPhysicalDeviceFeatures2 m_features2;
-	VkPhysicalDeviceVulkan12Features m_vulkan12Features;
-	VkPhysicalDeviceVulkan13Features m_vulkan13Features;
-
-	struct VideoDecodeH264
-	{
-		VkVideoDecodeH264ProfileInfoKHR		profile{};
-		VkVideoDecodeH264CapabilitiesKHR	capabilities{};
-	};
-	VkVideoProfileInfoKHR m_videoProfileInfo;
-	VkVideoCapabilitiesKHR m_videoCapabilities;
-	VkVideoDecodeCapabilitiesKHR m_videoDecodeCapabilities;
-	VideoDecodeH264 m_videoDecodeH264;
-
-	VmaAllocator m_vmaAllocator;
-};
+#pragma once
+
+
+#define VK_USE_PLATFORM_WIN32_KHR
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <filesystem>
+#include <array>
+#include <atomic>
+
+#pragma warning(push)
+#pragma warning(disable: 4068)
+#include "vk_mem_alloc.h"
+#pragma warning(pop)
+
+#include "Swapchain.h"
+
+// 確保の分類. 分類ごとに使用量を集計する.
+enum class MemoryCategory
+{
+	DPB,
+	Bitstream,
+	OutputTexture,	// 任意. 予算が足りなければ枚数を減らす、または確保を断る.
+	Staging,
+	Other,
+	Count,
+};
+
+struct GPUBufferDesc
+{
+	VkDeviceSize size = 0;
+	VkBufferUsageFlags usage = 0;
+	VkMemoryPropertyFlags memoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	MemoryCategory category = MemoryCategory::Other;
+};
+struct GPUImageDesc
+{
+	VkExtent3D extent{ 0 };
+	uint32_t arraySize = 1;
+	uint32_t mipLevels = 1;
+	VkImageType type = VK_IMAGE_TYPE_2D;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t sampleCount = 1;
+	VkImageUsageFlags usage = 0;
+	VkMemoryPropertyFlags memoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	MemoryCategory category = MemoryCategory::Other;
+};
+
+struct GPUBuffer {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	
+	VkDeviceAddress deviceAddress = 0;
+	void* pMapped = nullptr;
+
+	GPUBufferDesc desc;
+};
+struct GPUImage {
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView imageView = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+
+	VkDeviceAddress deviceAddress = 0;
+	void* pMapped = nullptr;
+
+	GPUImageDesc desc;
+};
+
+class Swapchain;
+struct GLFWwindow;
+
+class DeviceContext
+{
+public:
+	static bool Initialize();
+	static void Shutdown();
+	static DeviceContext* GetContext();
+
+	// GPU ごとの H.264 デコードの能力. Initialize で全 GPU について取得し、GPU の選択に使う.
+	struct GPUInfo
+	{
+		std::string name;
+		VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+		bool hasH264Decode = false;
+		VkExtent2D maxCodedExtent{};
+		uint32_t maxDpbSlots = 0;
+		uint32_t decodeQueueCount = 0;	// H.264 をデコードできるファミリーで最も多いキュー数.
+		bool hasUnifiedQueue = false;	// グラフィックスとデコードの両方ができるファミリーがある.
+	};
+	enum {
+		AUTO_SELECT_GPU = -1,
+	};
+	// AUTO_SELECT_GPU の場合はデコードの能力が最も高い GPU を使う.
+	bool InitializeDevice(int useGpuIndex);
+	// imageCount が 0 の場合はサーフェスの最小数 + 1.
+	bool InitializeSwapchain(GLFWwindow* window, VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR, uint32_t imageCount = 0);
+
+	uint32_t GetGPUCount()const { return uint32_t(std::size(m_gpus)); }
+	VkPhysicalDevice GetGPU(int gpuIndex) const { return m_gpus[gpuIndex]; }
+	VkPhysicalDevice GetGPU() const { return m_gpus[m_useGpuIndex]; }
+	uint32_t GetGPUIndex() const { return m_useGpuIndex; }
+	const GPUInfo& GetGPUInfo(int gpuIndex) const { return m_gpuInfos[gpuIndex]; }
+	const GPUInfo& GetGPUInfo() const { return m_gpuInfos[m_useGpuIndex]; }
+	// デコードの能力が高い順の GPU 番号. 最大の大きさ、DPB スロット数、デコードキュー数の順に比べる.
+	std::vector<uint32_t> GetRankedGPUs() const;
+
+	VkInstance GetVkInstance();
+	VkDevice   GetVkDevice();
+
+
+	VkResult CreateBuffer(const GPUBufferDesc* desc, GPUBuffer* buffer);
+	VkResult CreateImage(const GPUImageDesc& desc, GPUImage* image);
+
+	void DestroyBuffer(GPUBuffer*);
+	void DestroyImage(GPUImage*);
+
+	// 全ての確保は VMA で行い、分類ごとに使用量を集計する.
+	// 任意の分類は予算を超える場合に VK_ERROR_OUT_OF_DEVICE_MEMORY を返す.
+	VkResult CreateBuffer(MemoryCategory category, const VkBufferCreateInfo& bufferCI, const VmaAllocationCreateInfo& allocationCI,
+		VkBuffer* buffer, VmaAllocation* allocation, VmaAllocationInfo* allocationInfo = nullptr);
+	VkResult CreateImage(MemoryCategory category, const VkImageCreateInfo& imageCI, const VmaAllocationCreateInfo& allocationCI,
+		VkImage* image, VmaAllocation* allocation, VmaAllocationInfo* allocationInfo = nullptr);
+	void DestroyBuffer(VkBuffer buffer, VmaAllocation allocation);
+	void DestroyImage(VkImage image, VmaAllocation allocation);
+
+	// imageCI のイメージを itemCount 枚まとめて確保する、1ブロックのデバイスローカルのプールを作る.
+	// 任意の分類では予算に収まるよう itemCount を minItemCount まで減らし、それでも収まらなければ VK_NULL_HANDLE を返す.
+	VmaPool CreateImagePool(MemoryCategory category, const VkImageCreateInfo& imageCI, uint32_t& itemCount, uint32_t minItemCount);
+	void DestroyPool(VmaPool pool);
+
+	struct MemoryBudget
+	{
+		VkDeviceSize usage = 0;		// デバイスローカルのヒープの合計.
+		VkDeviceSize budget = 0;
+		std::array<VkDeviceSize, size_t(MemoryCategory::Count)> categoryBytes{};
+	};
+	// VK_EXT_memory_budget がない場合、予算は VMA の推定値 (ヒープサイズの 80%).
+	MemoryBudget GetMemoryBudget() const;
+	bool HasMemoryBudgetExtension() const { return m_hasMemoryBudget; }
+	// itemSize を何個まで任意の分類として確保できるか. count を上限に、minCount に満たない場合は 0 を返す.
+	uint32_t FitToBudget(VkDeviceSize itemSize, uint32_t count, uint32_t minCount) const;
+	static bool IsOptional(MemoryCategory category) { return category == MemoryCategory::OutputTexture; }
+	static const char* GetMemoryCategoryName(MemoryCategory category);
+	enum {
+		// 任意の分類は予算のこの割合までに留め、必須の確保とドライバーの分を残す.
+		OPTIONAL_BUDGET_PERCENT = 90,
+	};
+
+	enum QueueType
+	{
+		Graphics, VideoDecode,
+	};
+	// queueIndex はデコードキューの番号. グラフィックスキューは1つ.
+	void Submit(QueueType type, const VkSubmitInfo*, VkFence waitFence, uint32_t queueIndex = 0);
+
+	// VK_ERROR_OUT_OF_DATE_KHR / VK_SUBOPTIMAL_KHR の場合は呼び出し側でスワップチェインを作り直す.
+	VkResult Present(std::vector<VkSemaphore> waitSemaphores);
+
+	void WaitForIdle();
+
+	// path のキャッシュが同じ GPU とドライバーで作られたものなら読み込み、そうでなければ空で作る.
+	// 作成したキャッシュはアプリのパイプラインと ImGui で共有する.
+	bool InitializePipelineCache(const std::filesystem::path& path);
+	// InitializePipelineCache で指定したファイルへ保存する. 書き込み途中で終了しても壊れないよう一時ファイルを経由する.
+	void SavePipelineCache();
+	VkPipelineCache GetPipelineCache() const { return m_pipelineCache; }
+
+	VkDeviceSize VIDEO_DECODE_BITSTREAM_ALIGNMENT = 1;
+	uint32_t GetGraphicsQueueFamilyIndex() const { return m_graphicsFamily; }
+	uint32_t GetDecoderQueueFamilyIndex() const { return m_videoDecodeFamily; }
+	// false の場合はデコードキューがグラフィックスキューを指し、CPU でデコードする.
+	bool HasVideoDecodeQueue() const { return m_hasVideoDecodeQueue; }
+	// デコードキューの数. ファミリーの全てのキューを作成する. CPU でデコードする場合は 1.
+	uint32_t GetVideoDecodeQueueCount() const { return uint32_t(m_videoDecodeQueues.size()); }
+	// グラフィックスとデコードが同じキューファミリー. ファミリー間の受け渡しが要らない.
+	bool IsUnifiedQueue() const { return m_isUnifiedQueue; }
+
+	VmaAllocator GetVmaAllocator() const { return m_vmaAllocator; }
+
+	VkSamplerYcbcrConversion m_samplerYcbcrConversion;
+	// m_samplerYcbcrConversion を使う COMBINED_IMAGE_SAMPLER 1つが消費する記述子の数. ディスクリプタプールの大きさに使う.
+	uint32_t GetYcbcrDescriptorCount() const { return m_ycbcrDescriptorCount; }
+	
+	std::shared_ptr<Swapchain> GetSwapchain() { return m_swapchain; }
+
+	VkQueue GetQueue(QueueType type, uint32_t queueIndex = 0);
+
+	// キューのファミリーのタイムスタンプの有効ビット数. 0 の場合はそのキューでタイムスタンプを書けない.
+	uint32_t GetTimestampValidBits(QueueType type) const;
+	// タイムスタンプ 1 あたりのナノ秒.
+	float GetTimestampPeriod() const { return m_timestampPeriod; }
+	// デコードキューで結果状態クエリ (VK_QUERY_TYPE_RESULT_STATUS_ONLY_KHR) を使える.
+	bool HasDecodeQueryResultStatus() const;
+private:
+	bool InitializeVkInstance();
+	void EnumerateGPUs();
+	VmaAllocationCreateInfo PrepareAllocation(MemoryCategory category, const VmaAllocationCreateInfo& allocationCI) const;
+	void TrackAllocation(VmaAllocation allocation, bool allocated);
+
+	VkInstance m_vkInstance = VK_NULL_HANDLE;
+	VkDevice   m_vkDevice = VK_NULL_HANDLE;
+	VkDebugUtilsMessengerEXT m_debugUtils = VK_NULL_HANDLE;
+	uint32_t m_useGpuIndex = 0;
+
+	std::vector<VkPhysicalDevice> m_gpus;
+	std::vector<GPUInfo> m_gpuInfos;
+	struct QueueFamilyProperties {
+		VkQueueFamilyProperties2 properties;
+		VkQueueFamilyVideoPropertiesKHR propertiesVideo;
+		VkQueueFamilyQueryResultStatusPropertiesKHR propertiesQueryResultStatus;
+	};
+	std::vector<QueueFamilyProperties> m_queueFamilies;
+	std::vector<uint32_t> m_queueFamilyIndices;
+
+	uint32_t m_graphicsFamily = VK_QUEUE_FAMILY_IGNORED;
+	uint32_t m_videoDecodeFamily = VK_QUEUE_FAMILY_IGNORED;
+	bool m_hasVideoDecodeQueue = false;
+	bool m_isUnifiedQueue = false;
+	float m_timestampPeriod = 1.0f;
+	uint32_t m_ycbcrDescriptorCount = 3;
+	VkQueue m_graphicsQueue;
+	std::vector<VkQueue> m_videoDecodeQueues;
+
+	std::shared_ptr<Swapchain> m_swapchain;
+	std::vector<VkPhysicalDeviceMemoryProperties2> m_physicalDeviceMemoryProps;
+
+
+	VkPhysicalDeviceFeatures2 m_features2;
+	VkPhysicalDeviceVulkan12Features m_vulkan12Features;
+	VkPhysicalDeviceVulkan13Features m_vulkan13Features;
+
+	struct VideoDecodeH264
+	{
+		VkVideoDecodeH264ProfileInfoKHR		profile{};
+		VkVideoDecodeH264CapabilitiesKHR	capabilities{};
+	};
+	VkVideoProfileInfoKHR m_videoProfileInfo;
+	VkVideoCapabilitiesKHR m_videoCapabilities;
+	VkVideoDecodeCapabilitiesKHR m_videoDecodeCapabilities;
+	VideoDecodeH264 m_videoDecodeH264;
+
+	VmaAllocator m_vmaAllocator;
+	bool m_hasMemoryBudget = false;
+	// 分類ごとの確保中のバイト数. 分類は VmaAllocation のユーザーデータに持たせる.
+	std::array<std::atomic<VkDeviceSize>, size_t(MemoryCategory::Count)> m_categoryBytes{};
+
+	VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+	std::filesystem::path m_pipelineCachePath;
+};
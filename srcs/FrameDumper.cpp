@@ -0,0 +1,504 @@
+﻿#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+
+#include "DeviceContext.h"
+
+#undef ERROR
+#undef min
+#undef max
+
+#include "FrameDumper.h"
+
+static constexpr size_t align_to(size_t sz, size_t alignment) {
+	return ((sz - 1) / alignment + 1) * alignment;
+};
+
+FrameDumper::Format FrameDumper::GetFormatFromPath(const std::filesystem::path& path)
+{
+	auto ext = path.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return char(tolower(c)); });
+	if (ext == ".nv12" || ext == ".yuv")
+	{
+		return Format::NV12;
+	}
+	if (ext == ".rgba")
+	{
+		return Format::RGBA;
+	}
+	return Format::Y4M;
+}
+
+bool FrameDumper::Open(const std::filesystem::path& path, const Desc& desc)
+{
+	assert(!IsOpened());
+	m_desc = desc;
+	m_desc.ringSize = std::max(m_desc.ringSize, 2u);
+
+	HANDLE file = INVALID_HANDLE_VALUE;
+	if (path == "-")
+	{
+		file = GetStdHandle(STD_OUTPUT_HANDLE);
+		m_ownsFile = false;
+	}
+	else
+	{
+		file = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		m_ownsFile = true;
+	}
+	if (file == INVALID_HANDLE_VALUE || file == nullptr)
+	{
+		char buf[512];
+		sprintf_s(buf, "FrameDumper: cannot open %s\n", path.string().c_str());
+		OutputDebugStringA(buf);
+		return false;
+	}
+	m_file = file;
+
+	const uint64_t lumaSize = uint64_t(m_desc.width) * m_desc.height;
+	// vkCmdCopyImageToBuffer のオフセットはテクセルサイズの倍数が必要. 余裕をもって揃える.
+	m_chromaOffset = align_to(lumaSize, 16);
+	m_readbackSize = m_chromaOffset + lumaSize / 2;
+	m_frameSize = lumaSize + lumaSize / 2;
+	if (m_desc.format == Format::RGBA)
+	{
+		m_frameSize = lumaSize * 4;
+		m_converter.Initialize(ColorConverter::Desc{
+			.matrix = ColorConverter::Matrix::BT709,
+			.range = ColorConverter::Range::Limited,
+			.order = ColorConverter::PixelOrder::RGBA,
+		});
+	}
+
+	if (m_desc.format == Format::Y4M)
+	{
+		// フレームレートは 1/1000 単位の分数で表す.
+		char header[256];
+		int length = sprintf_s(header, "YUV4MPEG2 W%u H%u F%u:1000 Ip A1:1 C420mpeg2\n",
+			m_desc.width, m_desc.height, uint32_t(std::lround(m_desc.framesPerSecond * 1000.0)));
+		WriteBytes(header, length);
+	}
+
+	CreateSlots();
+
+	m_closing = false;
+	m_nextDisplayOrder = 0;
+	m_writer = std::thread([this]() { WriterThread(); });
+
+	char buf[256];
+	const char* formatNames[] = { "Y4M", "NV12", "RGBA" };
+	sprintf_s(buf, "FrameDumper: %ux%u %s, ring %u\n",
+		m_desc.width, m_desc.height, formatNames[int(m_desc.format)], m_desc.ringSize);
+	OutputDebugStringA(buf);
+	return true;
+}
+
+void FrameDumper::Close()
+{
+	if (!IsOpened())
+	{
+		return;
+	}
+	// 記録だけされたものも送信して書き出す.
+	Submit();
+	{
+		std::lock_guard lock(m_mutex);
+		m_closing = true;
+	}
+	m_cv.notify_all();
+	if (m_writer.joinable())
+	{
+		m_writer.join();
+	}
+
+	DestroySlots();
+	m_converter.Shutdown();
+	if (m_ownsFile)
+	{
+		CloseHandle(HANDLE(m_file));
+	}
+	m_file = nullptr;
+	m_reorder.clear();
+	m_freeFrames.clear();
+
+	char buf[256];
+	sprintf_s(buf, "FrameDumper: written %llu frames (skipped %llu, stalled %llu)\n",
+		m_written.load(), m_skipped.load(), m_stalled.load());
+	OutputDebugStringA(buf);
+}
+
+void FrameDumper::CreateSlots()
+{
+	auto devCtx = DeviceContext::GetContext();
+	auto vkDevice = devCtx->GetVkDevice();
+
+	VkCommandPoolCreateInfo commandPoolCI{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = devCtx->GetGraphicsQueueFamilyIndex(),
+	};
+	auto res = vkCreateCommandPool(vkDevice, &commandPoolCI, nullptr, &m_commandPool);
+	assert(res == VK_SUCCESS);
+
+	m_slots.resize(m_desc.ringSize);
+	for (auto& slot : m_slots)
+	{
+		// GPU から書き込み CPU で読むため、キャッシュされたメモリを優先する.
+		VkBufferCreateInfo bufferCI{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = m_readbackSize,
+			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		};
+		VmaAllocationCreateInfo allocateCI{};
+		allocateCI.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+		allocateCI.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+		allocateCI.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		allocateCI.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		res = devCtx->CreateBuffer(
+			MemoryCategory::Staging,
+			bufferCI,
+			allocateCI,
+			&slot.buffer.buffer,
+			&slot.buffer.allocation,
+			&slot.buffer.allocationInfo);
+		assert(res == VK_SUCCESS);
+		slot.mapped = static_cast<uint8_t*>(slot.buffer.allocationInfo.pMappedData);
+
+		VkCommandBufferAllocateInfo ai{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = m_commandPool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		vkAllocateCommandBuffers(vkDevice, &ai, &slot.commandBuffer);
+
+		VkFenceCreateInfo fenceCI{
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+		};
+		vkCreateFence(vkDevice, &fenceCI, nullptr, &slot.fence);
+		slot.inUse = false;
+	}
+	m_nextSlot = 0;
+	m_recorded.clear();
+	m_submitted.clear();
+}
+
+void FrameDumper::DestroySlots()
+{
+	auto devCtx = DeviceContext::GetContext();
+	auto vkDevice = devCtx->GetVkDevice();
+	for (auto& slot : m_slots)
+	{
+		vkWaitForFences(vkDevice, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+		vkDestroyFence(vkDevice, slot.fence, nullptr);
+		devCtx->DestroyBuffer(slot.buffer.buffer, slot.buffer.allocation);
+	}
+	m_slots.clear();
+	// コマンドバッファはプールと共に解放される.
+	vkDestroyCommandPool(vkDevice, m_commandPool, nullptr);
+	m_commandPool = VK_NULL_HANDLE;
+}
+
+void FrameDumper::Capture(VkImage image, int64_t displayOrder)
+{
+	if (!IsOpened())
+	{
+		return;
+	}
+
+	// 未送信のスロットは空かないため、1フレームで Capture できるのはリングの数まで.
+	assert(m_recorded.size() < m_slots.size());
+	// リングは順に使うため、次のスロットが空くのを待てばよい.
+	auto& slot = m_slots[m_nextSlot];
+	{
+		std::unique_lock lock(m_mutex);
+		if (slot.inUse)
+		{
+			m_stalled++;
+			m_cv.wait(lock, [&]() { return !slot.inUse; });
+		}
+		slot.inUse = true;
+	}
+	slot.displayOrder = displayOrder;
+
+	// 書き込みスレッドが完了を確認済みのため、フェンスはシグナル状態のまま残っている.
+	auto vkDevice = DeviceContext::GetContext()->GetVkDevice();
+	vkResetFences(vkDevice, 1, &slot.fence);
+	RecordReadback(slot, image);
+
+	m_recorded.push_back(m_nextSlot);
+	m_nextSlot = (m_nextSlot + 1) % uint32_t(m_slots.size());
+	m_captured++;
+}
+
+void FrameDumper::RecordReadback(Slot& slot, VkImage image)
+{
+	auto commandBuffer = slot.commandBuffer;
+	VkCommandBufferBeginInfo beginInfo{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	const VkImageSubresourceRange range{
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.baseMipLevel = 0, .levelCount = 1,
+		.baseArrayLayer = 0, .layerCount = 1,
+	};
+	// 表示用のレイアウトから一時的に転送元へ. デコード結果の書き込みは同じキューの先行する送信で完了している.
+	VkImageMemoryBarrier2 toTransfer{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+		.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = range,
+	};
+	VkDependencyInfo depInfo{
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.imageMemoryBarrierCount = 1,
+		.pImageMemoryBarriers = &toTransfer,
+	};
+	vkCmdPipelineBarrier2(commandBuffer, &depInfo);
+
+	const auto width = m_desc.width;
+	const auto height = m_desc.height;
+	VkBufferImageCopy2 regions[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2,
+			.bufferOffset = 0,
+			.bufferRowLength = width,
+			.bufferImageHeight = height,
+			.imageSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT,
+				.mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1,
+			},
+			.imageOffset = { },
+			.imageExtent = { .width = width, .height = height, .depth = 1, }
+		},
+		{
+			// CbCr は 2 バイトで 1 テクセル.
+			.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2,
+			.bufferOffset = m_chromaOffset,
+			.bufferRowLength = width / 2,
+			.bufferImageHeight = height / 2,
+			.imageSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT,
+				.mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1,
+			},
+			.imageOffset = { },
+			.imageExtent = { .width = width / 2, .height = height / 2, .depth = 1, }
+		},
+	};
+	VkCopyImageToBufferInfo2 info{
+		.sType = VK_STRUCTURE_TYPE_COPY_IMAGE_TO_BUFFER_INFO_2,
+		.srcImage = image,
+		.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		.dstBuffer = slot.buffer.buffer,
+		.regionCount = uint32_t(std::size(regions)),
+		.pRegions = regions,
+	};
+	vkCmdCopyImageToBuffer2(commandBuffer, &info);
+
+	// バックエンドが把握しているレイアウトへ戻し、読み戻した内容をホストから見えるようにする.
+	VkImageMemoryBarrier2 toReadOnly = toTransfer;
+	toReadOnly.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	toReadOnly.srcAccessMask = VK_ACCESS_2_NONE;
+	toReadOnly.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	toReadOnly.dstAccessMask = VK_ACCESS_2_NONE;
+	toReadOnly.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	toReadOnly.newLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
+	VkBufferMemoryBarrier2 toHost{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+		.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+		.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = slot.buffer.buffer,
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	};
+	depInfo.bufferMemoryBarrierCount = 1;
+	depInfo.pBufferMemoryBarriers = &toHost;
+	depInfo.pImageMemoryBarriers = &toReadOnly;
+	vkCmdPipelineBarrier2(commandBuffer, &depInfo);
+
+	vkEndCommandBuffer(commandBuffer);
+}
+
+void FrameDumper::Submit()
+{
+	if (m_recorded.empty())
+	{
+		return;
+	}
+	// スロットごとにフェンスを付けて送信する. 書き込みスレッドは送信順に完了を待つ.
+	auto devCtx = DeviceContext::GetContext();
+	for (auto index : m_recorded)
+	{
+		auto& slot = m_slots[index];
+		VkSubmitInfo submitInfo{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &slot.commandBuffer,
+		};
+		devCtx->Submit(DeviceContext::Graphics, &submitInfo, slot.fence);
+	}
+	{
+		std::lock_guard lock(m_mutex);
+		m_submitted.insert(m_submitted.end(), m_recorded.begin(), m_recorded.end());
+	}
+	m_recorded.clear();
+	m_cv.notify_all();
+}
+
+FrameDumper::Statistics FrameDumper::GetStatistics() const
+{
+	return Statistics{
+		.captured = m_captured.load(),
+		.written = m_written.load(),
+		.skipped = m_skipped.load(),
+		.stalled = m_stalled.load(),
+		.bytesWritten = m_bytesWritten.load(),
+	};
+}
+
+void FrameDumper::WriterThread()
+{
+	auto devCtx = DeviceContext::GetContext();
+	auto vkDevice = devCtx->GetVkDevice();
+	while (true)
+	{
+		uint32_t index = 0;
+		{
+			std::unique_lock lock(m_mutex);
+			m_cv.wait(lock, [&]() { return !m_submitted.empty() || m_closing; });
+			if (m_submitted.empty())
+			{
+				break;
+			}
+			index = m_submitted.front();
+		}
+
+		auto& slot = m_slots[index];
+		vkWaitForFences(vkDevice, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+		vmaInvalidateAllocation(devCtx->GetVmaAllocator(), slot.buffer.allocation, 0, VK_WHOLE_SIZE);
+
+		// 書き出す形式へ変換した時点でスロットを返し、ディスクへの書き込みとは重ねる.
+		std::vector<uint8_t> frame;
+		if (!m_freeFrames.empty())
+		{
+			frame = std::move(m_freeFrames.back());
+			m_freeFrames.pop_back();
+		}
+		ConvertFrame(slot.mapped, frame);
+		auto displayOrder = slot.displayOrder;
+		{
+			std::lock_guard lock(m_mutex);
+			m_submitted.pop_front();
+			slot.inUse = false;
+		}
+		m_cv.notify_all();
+
+		m_reorder[displayOrder] = std::move(frame);
+		WriteReadyFrames(false);
+	}
+	WriteReadyFrames(true);
+}
+
+void FrameDumper::WriteReadyFrames(bool flush)
+{
+	while (!m_reorder.empty())
+	{
+		auto it = m_reorder.begin();
+		if (it->first != m_nextDisplayOrder)
+		{
+			// 破棄されたフレームなどで表示順が欠けた場合、待ち続けないよう飛ばす.
+			if (!flush && m_reorder.size() <= MAX_REORDER_FRAMES)
+			{
+				break;
+			}
+			if (m_nextDisplayOrder < it->first)
+			{
+				m_skipped += it->first - m_nextDisplayOrder;
+			}
+		}
+
+		if (m_desc.format == Format::Y4M)
+		{
+			WriteBytes("FRAME\n", 6);
+		}
+		WriteBytes(it->second.data(), it->second.size());
+		m_written++;
+
+		m_nextDisplayOrder = it->first + 1;
+		m_freeFrames.push_back(std::move(it->second));
+		m_reorder.erase(it);
+	}
+}
+
+void FrameDumper::ConvertFrame(const uint8_t* src, std::vector<uint8_t>& dst)
+{
+	dst.resize(m_frameSize);
+	if (m_desc.format == Format::RGBA)
+	{
+		auto planes = ColorConverter::MakePackedPlanes(src, m_desc.width, m_desc.height, m_chromaOffset);
+		m_converter.Convert(planes, dst.data(), size_t(m_desc.width) * 4);
+		return;
+	}
+
+	const size_t lumaSize = size_t(m_desc.width) * m_desc.height;
+	memcpy(dst.data(), src, lumaSize);
+
+	const uint8_t* srcUV = src + m_chromaOffset;
+	const size_t chromaCount = lumaSize / 4;
+	if (m_desc.format == Format::NV12)
+	{
+		memcpy(dst.data() + lumaSize, srcUV, chromaCount * 2);
+		return;
+	}
+
+	// I420 では Cb、Cr を別の平面に分ける.
+	uint8_t* dstU = dst.data() + lumaSize;
+	uint8_t* dstV = dstU + chromaCount;
+	for (size_t i = 0; i < chromaCount; ++i)
+	{
+		dstU[i] = srcUV[2 * i + 0];
+		dstV[i] = srcUV[2 * i + 1];
+	}
+}
+
+bool FrameDumper::WriteBytes(const void* data, size_t size)
+{
+	auto bytes = static_cast<const uint8_t*>(data);
+	while (size > 0)
+	{
+		DWORD chunk = DWORD(std::min<size_t>(size, 1u << 30));
+		DWORD written = 0;
+		if (!WriteFile(HANDLE(m_file), bytes, chunk, &written, nullptr) || written == 0)
+		{
+			// パイプの読み手が終了した場合など. 以降の書き込みも失敗する.
+			OutputDebugStringA("FrameDumper: write failed\n");
+			return false;
+		}
+		bytes += written;
+		size -= written;
+		m_bytesWritten += written;
+	}
+	return true;
+}
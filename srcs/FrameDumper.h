@@ -0,0 +1,126 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ColorConverter.h"
+#include "VideoPlayer.h"
+
+// デコード結果 (出力テクスチャ) を読み戻してファイルへ書き出す. デコード結果の検証やオフラインの解析に使う.
+// 読み戻し先は永続マップしたバッファのリングとし、GPU のコピー、フェンス待ち、書き込みを
+// フレームをまたいで重ねる. フェンス待ちと書き込みは書き込みスレッドが行う.
+// 1フレームの流れ:
+//   Capture (デコードしたフレームごと) -> Submit (DecodeScheduler::Submit の後)
+class FrameDumper
+{
+public:
+	enum class Format
+	{
+		Y4M,	// YUV4MPEG2 (I420). ヘッダーにサイズとフレームレートを持つ.
+		NV12,	// ヘッダーなしの NV12 を連結したもの.
+		RGBA,	// ヘッダーなしの RGBA を連結したもの. 表示と同じ BT.709 (limited) で変換する.
+	};
+
+	struct Desc
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		double framesPerSecond = 30.0;
+		Format format = Format::Y4M;
+		uint32_t ringSize = DEFAULT_RING_SIZE;
+	};
+
+	struct Statistics
+	{
+		uint64_t captured = 0;
+		uint64_t written = 0;
+		uint64_t skipped = 0;		// 表示順が欠けていたため飛ばした数.
+		uint64_t stalled = 0;		// リングに空きがなく Capture が待った回数.
+		uint64_t bytesWritten = 0;
+	};
+
+	enum {
+		DEFAULT_RING_SIZE = 4,
+		// 表示順に並べ替えるために保持するフレーム数の上限. 超えた場合は欠けた表示順を飛ばす.
+		MAX_REORDER_FRAMES = VideoDecodeOperation::MaxDpbSlotCount,
+	};
+
+	~FrameDumper() { Close(); }
+
+	// path が "-" の場合は標準出力へ書き出す (パイプ用).
+	bool Open(const std::filesystem::path& path, const Desc& desc);
+	// 送信済みの読み戻しをすべて書き出してから閉じる.
+	void Close();
+	bool IsOpened() const { return m_file != nullptr; }
+
+	// image の読み戻しを記録する. image は READ_ONLY_OPTIMAL でグラフィックスキューから読める状態であること.
+	// リングに空きがなければ、書き込みスレッドが空けるまで待つ. Submit までに呼べるのは ringSize 回まで.
+	void Capture(VkImage image, int64_t displayOrder);
+	// Capture した読み戻しをグラフィックスキューへ送信する.
+	void Submit();
+	uint32_t GetRingSize() const { return m_desc.ringSize; }
+
+	Statistics GetStatistics() const;
+
+	static Format GetFormatFromPath(const std::filesystem::path& path);
+
+private:
+	struct Slot
+	{
+		vku::GPUBuffer buffer;
+		uint8_t* mapped = nullptr;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		int64_t displayOrder = -1;
+		bool inUse = false;
+	};
+
+	void CreateSlots();
+	void DestroySlots();
+	void RecordReadback(Slot& slot, VkImage image);
+
+	void WriterThread();
+	// 表示順で次のフレームが揃っていれば書き出す. flush の場合は欠けを無視して全て書き出す.
+	void WriteReadyFrames(bool flush);
+	void ConvertFrame(const uint8_t* src, std::vector<uint8_t>& dst);
+	bool WriteBytes(const void* data, size_t size);
+
+	Desc m_desc;
+	void* m_file = nullptr;		// HANDLE.
+	bool m_ownsFile = false;
+	uint64_t m_chromaOffset = 0;	// 読み戻し先の CbCr の位置.
+	uint64_t m_readbackSize = 0;
+	uint64_t m_frameSize = 0;		// 書き出す1フレームのサイズ.
+
+	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+	std::vector<Slot> m_slots;
+	uint32_t m_nextSlot = 0;
+	std::vector<uint32_t> m_recorded;	// Capture 済みで未送信のスロット.
+
+	std::thread m_writer;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<uint32_t> m_submitted;	// 送信順. 書き込みスレッドが完了を待つ.
+	bool m_closing = false;
+
+	// 以下は書き込みスレッドのみが使う.
+	std::map<int64_t, std::vector<uint8_t>> m_reorder;
+	ColorConverter m_converter;
+	std::vector<std::vector<uint8_t>> m_freeFrames;
+	int64_t m_nextDisplayOrder = 0;
+
+	std::atomic<uint64_t> m_captured = 0;
+	std::atomic<uint64_t> m_written = 0;
+	std::atomic<uint64_t> m_skipped = 0;
+	std::atomic<uint64_t> m_stalled = 0;
+	std::atomic<uint64_t> m_bytesWritten = 0;
+};
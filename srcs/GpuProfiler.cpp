@@ -0,0 +1,226 @@
+﻿#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#include <cassert>
+
+#include "DeviceContext.h"
+
+#undef ERROR
+#undef min
+#undef max
+
+#include "GpuProfiler.h"
+
+namespace {
+
+uint64_t GetTimestampMask(uint32_t validBits)
+{
+	if (validBits == 0)
+	{
+		return 0;
+	}
+	return validBits < 64 ? (uint64_t(1) << validBits) - 1 : ~uint64_t(0);
+}
+
+}
+
+bool GpuProfiler::Initialize(uint32_t frameCount)
+{
+	auto devCtx = DeviceContext::GetContext();
+	auto graphicsMask = GetTimestampMask(devCtx->GetTimestampValidBits(DeviceContext::Graphics));
+	// CPU でデコードする場合はデコードキューに記録しないため計らない.
+	auto decodeMask = devCtx->HasVideoDecodeQueue() ? GetTimestampMask(devCtx->GetTimestampValidBits(DeviceContext::VideoDecode)) : 0;
+	m_timestampMasks[size_t(Stage::Decode)] = decodeMask;
+	m_timestampMasks[size_t(Stage::Copy)] = decodeMask;
+	m_timestampMasks[size_t(Stage::Render)] = graphicsMask;
+	m_nanosecondsPerTick = devCtx->GetTimestampPeriod();
+
+	char buf[256] = { 0 };
+	sprintf_s(buf, "GpuProfiler: timestamp bits graphics %u, decode %u (period %.2f ns)\n",
+		devCtx->GetTimestampValidBits(DeviceContext::Graphics), devCtx->GetTimestampValidBits(DeviceContext::VideoDecode), m_nanosecondsPerTick);
+	OutputDebugStringA(buf);
+
+	for (auto& history : m_history)
+	{
+		history.assign(HISTORY_SIZE, 0.0f);
+	}
+	if (graphicsMask == 0 && decodeMask == 0)
+	{
+		// 計れる段階がない. 結果状態クエリの集計のみ行う.
+		return true;
+	}
+
+	VkQueryPoolCreateInfo queryPoolCI{
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = frameCount * MAX_SCOPES_PER_FRAME * 2,
+	};
+	auto res = vkCreateQueryPool(devCtx->GetVkDevice(), &queryPoolCI, nullptr, &m_queryPool);
+	if (res != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	m_frames.resize(frameCount);
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		m_frames[i].firstQuery = i * MAX_SCOPES_PER_FRAME * 2;
+		m_frames[i].scopes.reserve(MAX_SCOPES_PER_FRAME);
+	}
+	m_frameIndex = 0;
+	m_frameNumber = 0;
+	return true;
+}
+
+void GpuProfiler::Shutdown()
+{
+	if (m_queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(DeviceContext::GetContext()->GetVkDevice(), m_queryPool, nullptr);
+		m_queryPool = VK_NULL_HANDLE;
+	}
+	m_frames.clear();
+	if (m_csv.is_open())
+	{
+		m_csv.close();
+	}
+}
+
+void GpuProfiler::BeginFrame(uint32_t frameIndex)
+{
+	if (m_frames.empty())
+	{
+		return;
+	}
+	assert(frameIndex < m_frames.size());
+	m_frameIndex = frameIndex;
+	auto& frame = m_frames[m_frameIndex];
+	if (!frame.scopes.empty())
+	{
+		ReadBack(frame);
+	}
+	frame.scopes.clear();
+	frame.frameNumber = m_frameNumber++;
+}
+
+GpuProfiler::Scope GpuProfiler::BeginScope(VkCommandBuffer commandBuffer, Stage stage)
+{
+	if (m_frames.empty() || !IsStageTimed(stage))
+	{
+		return {};
+	}
+	auto& frame = m_frames[m_frameIndex];
+	if (MAX_SCOPES_PER_FRAME <= frame.scopes.size())
+	{
+		return {};
+	}
+	Scope scope{
+		.stage = stage,
+		.query = frame.firstQuery + uint32_t(frame.scopes.size()) * 2,
+	};
+	frame.scopes.push_back(stage);
+
+	// 区画は前回の読み戻しが済んでいるため、使う直前にリセットする. ホストからのリセットは不要.
+	vkCmdResetQueryPool(commandBuffer, m_queryPool, scope.query, 2);
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, m_queryPool, scope.query);
+	return scope;
+}
+
+void GpuProfiler::EndScope(VkCommandBuffer commandBuffer, const Scope& scope)
+{
+	if (scope.query == INVALID_QUERY)
+	{
+		return;
+	}
+	// 区間の全てのコマンドが完了した時刻.
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, m_queryPool, scope.query + 1);
+}
+
+bool GpuProfiler::OpenCsv(const std::filesystem::path& path)
+{
+	m_csv.open(path, std::ios::trunc);
+	if (!m_csv)
+	{
+		return false;
+	}
+	m_csv << "frame";
+	for (size_t i = 0; i < size_t(Stage::Count); ++i)
+	{
+		m_csv << ',' << GetStageName(Stage(i)) << "_ms";
+	}
+	for (size_t i = 0; i < size_t(Stage::Count); ++i)
+	{
+		m_csv << ',' << GetStageName(Stage(i)) << "_count";
+	}
+	m_csv << '\n';
+	return true;
+}
+
+const char* GpuProfiler::GetStageName(Stage stage)
+{
+	switch (stage)
+	{
+	case Stage::Decode: return "decode";
+	case Stage::Copy: return "copy";
+	case Stage::Render: return "render";
+	default: return "unknown";
+	}
+}
+
+void GpuProfiler::ReadBack(FrameResource& frame)
+{
+	// 値と可用性の組. 完了していない区間は可用性が 0 で返るため、VK_NOT_READY でも待たずに使える分だけ使う.
+	const auto queryCount = uint32_t(frame.scopes.size()) * 2;
+	std::vector<uint64_t> results(queryCount * 2);
+	vkGetQueryPoolResults(DeviceContext::GetContext()->GetVkDevice(), m_queryPool,
+		frame.firstQuery, queryCount, results.size() * sizeof(uint64_t), results.data(), sizeof(uint64_t) * 2,
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	FrameTimes times{ .frameNumber = frame.frameNumber };
+	for (size_t i = 0; i < frame.scopes.size(); ++i)
+	{
+		const uint64_t* begin = &results[i * 4];
+		const uint64_t* end = &results[i * 4 + 2];
+		if (begin[1] == 0 || end[1] == 0)
+		{
+			continue;
+		}
+		auto stage = size_t(frame.scopes[i]);
+		// 有効ビットを超えて一周した場合もマスクで差を求める.
+		auto ticks = (end[0] - begin[0]) & m_timestampMasks[stage];
+		times.milliseconds[stage] += ticks * m_nanosecondsPerTick / 1000000.0;
+		times.counts[stage]++;
+	}
+	m_latest = times;
+	for (size_t i = 0; i < size_t(Stage::Count); ++i)
+	{
+		auto& history = m_history[i];
+		history.erase(history.begin());
+		history.push_back(float(times.milliseconds[i]));
+	}
+	WriteCsv(times);
+}
+
+void GpuProfiler::WriteCsv(const FrameTimes& times)
+{
+	if (!m_csv.is_open())
+	{
+		return;
+	}
+	char buf[64];
+	m_csv << times.frameNumber;
+	for (size_t i = 0; i < size_t(Stage::Count); ++i)
+	{
+		m_csv << ',';
+		if (IsStageTimed(Stage(i)))
+		{
+			sprintf_s(buf, "%.4f", times.milliseconds[i]);
+			m_csv << buf;
+		}
+	}
+	for (size_t i = 0; i < size_t(Stage::Count); ++i)
+	{
+		m_csv << ',' << times.counts[i];
+	}
+	m_csv << '\n';
+}
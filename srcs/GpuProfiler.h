@@ -0,0 +1,104 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// GPU での処理時間をタイムスタンプクエリで計る. デコード、コピー、描画パスの時間の確認に使う.
+// クエリプールはフレームごとの区画に分けたリングとし、区画を再利用する BeginFrame で前回の結果を読み戻す.
+// 読み戻しは可用性と一緒に行い、完了していない区間は捨てるため待たない.
+// キューがタイムスタンプに対応していない (timestampValidBits == 0) 段階は計らない.
+// デコードキューがそうである場合、VulkanDecodeBackend が結果状態クエリでデコードの成否だけを数える.
+// 1フレームの流れ:
+//   BeginFrame (区画を使った送信の完了後) -> BeginScope/EndScope (各コマンドバッファ)
+class GpuProfiler
+{
+public:
+	enum class Stage
+	{
+		Decode,		// vkCmdDecodeVideoKHR. デコードキュー.
+		Copy,		// DPB から出力テクスチャへのコピー. デコードキュー.
+		Render,		// 描画パス. グラフィックスキュー.
+		Count,
+	};
+
+	struct Scope
+	{
+		Stage stage = Stage::Decode;
+		uint32_t query = INVALID_QUERY;
+	};
+
+	// 1フレーム分の結果. 同じ段階が複数回あれば (複数のストリーム) 合計する.
+	struct FrameTimes
+	{
+		uint64_t frameNumber = 0;
+		std::array<double, size_t(Stage::Count)> milliseconds{};
+		std::array<uint32_t, size_t(Stage::Count)> counts{};	// 読み戻せた区間の数.
+	};
+
+	enum : uint32_t {
+		MAX_SCOPES_PER_FRAME = 64,
+		HISTORY_SIZE = 300,
+		INVALID_QUERY = ~0u,
+	};
+
+	~GpuProfiler() { Shutdown(); }
+
+	bool Initialize(uint32_t frameCount);
+	void Shutdown();
+
+	// frameIndex の区画の前回の結果を読み戻し、区画を空にする.
+	void BeginFrame(uint32_t frameIndex);
+
+	// 区間の始まりを記録する. 計れない段階や区画が足りない場合は無効な Scope を返し、EndScope も何もしない.
+	// クエリのリセットも記録するため、描画パスやビデオコーディングの範囲の外で呼ぶ.
+	Scope BeginScope(VkCommandBuffer commandBuffer, Stage stage);
+	void EndScope(VkCommandBuffer commandBuffer, const Scope& scope);
+
+	bool IsStageTimed(Stage stage) const { return m_timestampMasks[size_t(stage)] != 0; }
+	// 読み戻した直近のフレーム.
+	const FrameTimes& GetLatest() const { return m_latest; }
+	// 段階ごとの直近 HISTORY_SIZE フレームの時間 (ms).
+	const std::vector<float>& GetHistory(Stage stage) const { return m_history[size_t(stage)]; }
+
+	// 結果状態クエリで確認したデコードの成否.
+	void AddDecodeStatus(bool succeeded) { (succeeded ? m_decodeSucceeded : m_decodeFailed)++; }
+	uint64_t GetDecodeSucceeded() const { return m_decodeSucceeded; }
+	uint64_t GetDecodeFailed() const { return m_decodeFailed; }
+
+	// 読み戻した結果を1フレーム1行の CSV で書き出す. 計れない段階は空欄.
+	bool OpenCsv(const std::filesystem::path& path);
+
+	static const char* GetStageName(Stage stage);
+
+private:
+	struct FrameResource
+	{
+		uint32_t firstQuery = 0;
+		std::vector<Stage> scopes;		// 区間ごとに始まりと終わりの2つのクエリを使う.
+		uint64_t frameNumber = 0;
+	};
+
+	void ReadBack(FrameResource& frame);
+	void WriteCsv(const FrameTimes& times);
+
+	VkQueryPool m_queryPool = VK_NULL_HANDLE;
+	std::vector<FrameResource> m_frames;
+	uint32_t m_frameIndex = 0;
+	uint64_t m_frameNumber = 0;
+
+	// 段階を記録するキューの有効ビットのマスク. 0 の場合は計らない.
+	std::array<uint64_t, size_t(Stage::Count)> m_timestampMasks{};
+	double m_nanosecondsPerTick = 1.0;
+
+	FrameTimes m_latest;
+	std::array<std::vector<float>, size_t(Stage::Count)> m_history;
+	uint64_t m_decodeSucceeded = 0;
+	uint64_t m_decodeFailed = 0;
+
+	std::ofstream m_csv;
+};
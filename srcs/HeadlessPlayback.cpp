@@ -0,0 +1,181 @@
+﻿#include "HeadlessPlayback.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+
+#include "DebugLog.h"
+
+bool HeadlessPlayback::Run(const char* filePath, const Desc& desc)
+{
+	m_errors.clear();
+	m_playIndices.clear();
+	m_tickCount = 0;
+
+	auto clock = std::make_shared<VirtualClock>();
+	m_backend = std::make_shared<NullDecodeBackend>();
+	VideoPlayer player;
+	player.SetClock(clock);
+	player.SetFramesInFlight(desc.framesInFlight);
+	// 省略は時刻の進み方だけで決まるが、デコード順の検証を単純にするため行わない.
+	player.SetLoadSheddingEnabled(false);
+	if (!player.Initialize(filePath, nullptr, m_backend))
+	{
+		AddError("failed to open %s", filePath);
+		return false;
+	}
+	player.SetLoopEnabled(0 < desc.loopCount);
+
+	// 再生時間の 2 倍 (最低 10 秒) で打ち切る.
+	const auto& videoProps = player.GetVideoProperties();
+	const auto frameCount = int64_t(videoProps.frameInfos.size());
+	const double playSeconds = videoProps.totalDuration * (desc.loopCount + 1);
+	const auto maxTicks = uint64_t(std::max(playSeconds * 2.0, 10.0) * desc.refreshRate);
+	for (; !player.IsStopped() && m_tickCount < maxTicks; ++m_tickCount)
+	{
+		clock->Set(m_tickCount / desc.refreshRate);
+		player.RequestDecode();
+		player.Update();
+		if (player.IsLoopEnabled() && desc.loopCount <= player.GetDecodeLoopCount())
+		{
+			// 最後のループは末尾で止める. デコードは表示より先のループへ進むため、デコード側の回数で判断する.
+			player.SetLoopEnabled(false);
+		}
+
+		auto playIndex = int64_t(player.GetLoopCount()) * frameCount + player.GetDisplayFrameNumber();
+		m_playIndices.resize(m_backend->GetRecords().size(), playIndex);
+	}
+
+	m_presentation = player.GetPresentationStatistics();
+	m_evicted = player.GetReorderEvictedCount();
+	m_stopped = player.IsStopped();
+	Validate(player);
+	player.Shutdown();
+
+	DebugLog("%s\n", GetSummary().c_str());
+	for (const auto& error : m_errors)
+	{
+		DebugLog("HeadlessPlayback: %s\n", error.c_str());
+	}
+	return m_errors.empty();
+}
+
+std::string HeadlessPlayback::Dump() const
+{
+	return m_backend ? m_backend->Dump() : std::string();
+}
+
+std::string HeadlessPlayback::GetSummary() const
+{
+	char buf[256] = { 0 };
+	snprintf(buf, sizeof(buf), "HeadlessPlayback: %zu decodes, %llu ticks, presented %llu, repeated %llu, dropped %llu, %zu errors",
+		m_backend ? m_backend->GetRecords().size() : 0, (unsigned long long)m_tickCount,
+		(unsigned long long)m_presentation.presented, (unsigned long long)m_presentation.repeated,
+		(unsigned long long)m_presentation.dropped, m_errors.size());
+	return buf;
+}
+
+void HeadlessPlayback::Validate(const VideoPlayer& player)
+{
+	const auto& records = m_backend->GetRecords();
+	const auto& videoProps = player.GetVideoProperties();
+	const auto frameCount = int64_t(videoProps.frameInfos.size());
+	const auto& streamDesc = m_backend->GetStreamDesc();
+	if (records.empty())
+	{
+		AddError("no decode was recorded");
+		return;
+	}
+	if (!m_stopped)
+	{
+		AddError("playback did not reach the end in %llu ticks", (unsigned long long)m_tickCount);
+	}
+	if (m_evicted != 0)
+	{
+		AddError("%llu frames were evicted from the reorder queue", (unsigned long long)m_evicted);
+	}
+
+	std::vector<size_t> lastOutputUse(streamDesc.outputCount, SIZE_MAX);
+	int64_t loop = 0;
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const auto& record = records[i];
+		bool isReset = (record.flags & VideoDecodeOperation::eSessionReset) != 0;
+		if (isReset != (i == 0))
+		{
+			AddError("decode %zu: session reset %d", i, int(isReset));
+		}
+
+		// 省略しないため、デコード順はファイルの順に先頭から続く.
+		if (0 < i && record.decodedFrameIndex != (records[i - 1].decodedFrameIndex + 1) % frameCount)
+		{
+			AddError("decode %zu: frame %d follows frame %d", i, record.decodedFrameIndex, records[i - 1].decodedFrameIndex);
+		}
+		if (0 < i && record.decodedFrameIndex == 0)
+		{
+			loop++;
+		}
+		if (record.decodedFrameIndex < 0 || frameCount <= record.decodedFrameIndex)
+		{
+			AddError("decode %zu: frame %d is out of range", i, record.decodedFrameIndex);
+			continue;
+		}
+		const auto expectedDisplayOrder = loop * frameCount + videoProps.frameInfos[record.decodedFrameIndex].displayOrder;
+		if (record.displayOrder != expectedDisplayOrder)
+		{
+			AddError("decode %zu: display order %lld, expected %lld", i, (long long)record.displayOrder, (long long)expectedDisplayOrder);
+		}
+
+		// 直前の (スロット数 - 1) 回のデコードとはスロットを共有しない.
+		for (size_t j = i - std::min<size_t>(i, streamDesc.bitstreamSlotCount - 1); j < i; ++j)
+		{
+			if (records[j].bitstreamSlot == record.bitstreamSlot)
+			{
+				AddError("decode %zu: bitstream slot %u is still used by decode %zu", i, record.bitstreamSlot, j);
+				break;
+			}
+		}
+
+		// 出力テクスチャの前のフレームは、再利用の時点で表示を終えている.
+		if (streamDesc.outputCount <= record.outputIndex)
+		{
+			AddError("decode %zu: output %u is out of range", i, record.outputIndex);
+			continue;
+		}
+		auto& lastUse = lastOutputUse[record.outputIndex];
+		if (lastUse != SIZE_MAX && m_playIndices[i] <= records[lastUse].displayOrder)
+		{
+			AddError("decode %zu: output %u still holds display order %lld (playing %lld)", i, record.outputIndex,
+				(long long)records[lastUse].displayOrder, (long long)m_playIndices[i]);
+		}
+		lastUse = i;
+
+		if (videoProps.numDPBslots <= record.currentSlot)
+		{
+			AddError("decode %zu: DPB slot %u is out of range", i, record.currentSlot);
+		}
+		for (auto ref : record.referenceSlots)
+		{
+			if (videoProps.numDPBslots <= ref || ref == record.currentSlot)
+			{
+				AddError("decode %zu: invalid reference slot %u (current %u)", i, uint32_t(ref), record.currentSlot);
+			}
+		}
+	}
+}
+
+void HeadlessPlayback::AddError(const char* format, ...)
+{
+	// 全てのフレームで同じ問題が起きた場合に備えて、数を制限する.
+	if (64 <= m_errors.size())
+	{
+		return;
+	}
+	char buf[256] = { 0 };
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	m_errors.push_back(buf);
+}
@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DecodeBackend.h"
+#include "VideoPlayer.h"
+
+// GPU とウィンドウを使わずに VideoPlayer を NullDecodeBackend で再生し、記録したデコードの指示を検証する.
+// 時刻は VirtualClock で表示の更新ごとに進めるため、実時間によらず同じ結果となる.
+// 検証する内容:
+//   最初のデコードだけがセッションをリセットする. デコード順と表示順がファイルの内容とループ回数に一致する.
+//   ビットストリームのスロットを処理中のデコードが使っている間は再利用しない.
+//   出力テクスチャを表示を終える前のフレームへ再び割り当てない. DPB の参照が有効なスロットを指す.
+class HeadlessPlayback
+{
+public:
+	struct Desc
+	{
+		uint32_t loopCount = 0;			// 先頭へ戻る回数. 0 ならループしない.
+		double refreshRate = 60.0;		// 表示の更新の頻度.
+		uint32_t framesInFlight = 2;	// VideoPlayer::SetFramesInFlight.
+	};
+
+	bool Run(const char* filePath, const Desc& desc);
+
+	// 検証で見つかった問題. 空なら成功.
+	const std::vector<std::string>& GetErrors() const { return m_errors; }
+	// NullDecodeBackend::Dump の結果. 実行結果の比較に使う.
+	std::string Dump() const;
+	// 結果の要約 (1行).
+	std::string GetSummary() const;
+
+private:
+	void Validate(const VideoPlayer& player);
+	void AddError(const char* format, ...);
+
+	std::shared_ptr<NullDecodeBackend> m_backend;
+	// 記録ごとの、デコードした表示の更新を終えた時点の再生位置 (表示順).
+	std::vector<int64_t> m_playIndices;
+	uint64_t m_tickCount = 0;
+	PresentationClock::Statistics m_presentation;
+	uint64_t m_evicted = 0;
+	bool m_stopped = false;
+	std::vector<std::string> m_errors;
+};
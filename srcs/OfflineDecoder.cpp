@@ -0,0 +1,208 @@
+﻿#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+
+#include "DeviceContext.h"
+
+#undef ERROR
+#undef min
+#undef max
+
+#include "OfflineDecoder.h"
+#include "FrameDumper.h"
+
+bool OfflineDecoder::Initialize(const char* filePath, const Desc& desc)
+{
+	auto devCtx = DeviceContext::GetContext();
+	uint32_t sessionCount = desc.sessionCount;
+	if (sessionCount == 0)
+	{
+		// 1つのキューでも、前の GOP を渡している間に次の GOP を進められるよう 2 つ以上とする.
+		sessionCount = std::max(devCtx->GetVideoDecodeQueueCount(), 2u);
+	}
+	sessionCount = std::min(sessionCount, uint32_t(MAX_SESSIONS));
+	uint32_t outputTextureCount = desc.outputTextureCount;
+	if (outputTextureCount == 0)
+	{
+		outputTextureCount = VideoPlayer::MAX_TEXTURE_COUNT / sessionCount;
+	}
+
+	m_scheduler = std::make_shared<DecodeScheduler>();
+	m_scheduler->Initialize(FRAMES_IN_FLIGHT);
+	m_scheduler->SetMaxDecodesPerFrame(sessionCount);
+
+	// セッションごとにファイルを解析し、ビデオセッション、DPB、出力テクスチャを持つ.
+	m_sessions.resize(sessionCount);
+	for (auto& session : m_sessions)
+	{
+		session.player = std::make_unique<VideoPlayer>();
+		session.player->SetOutputTextureCount(outputTextureCount);
+		if (!session.player->Initialize(filePath, m_scheduler))
+		{
+			return false;
+		}
+		session.player->SetLoadSheddingEnabled(false);
+		// 読み戻しは DecodeScheduler の送信の後に送るため、1回多く待ってから出力テクスチャを再利用する.
+		session.player->SetFramesInFlight(FRAMES_IN_FLIGHT + 1);
+	}
+
+	const auto& videoData = m_sessions.front().player->GetVideoProperties();
+	m_frameCount = uint32_t(videoData.frameInfos.size());
+	SplitGops(videoData);
+	m_stats = {};
+	m_stats.gopCount = uint32_t(m_gops.size());
+	m_startTime = std::chrono::steady_clock::now();
+
+	char buf[256] = { 0 };
+	sprintf_s(buf, "OfflineDecoder: %u sessions (%u output textures each), %u GOPs, %u frames\n",
+		sessionCount, m_sessions.front().player->GetOutputTextureCount(), m_stats.gopCount, m_frameCount);
+	OutputDebugStringA(buf);
+	return true;
+}
+
+void OfflineDecoder::Shutdown()
+{
+	if (!m_scheduler)
+	{
+		return;
+	}
+	DeviceContext::GetContext()->WaitForIdle();
+	for (auto& session : m_sessions)
+	{
+		if (session.player)
+		{
+			session.player->Shutdown();
+		}
+	}
+	m_sessions.clear();
+	m_scheduler->Shutdown();
+	m_scheduler.reset();
+	m_frameDumper.reset();
+	m_gops.clear();
+	m_nextGop = 0;
+	m_deliverGop = 0;
+	m_nextDisplayOrder = 0;
+}
+
+bool OfflineDecoder::Step()
+{
+	if (m_frameCount <= uint32_t(m_nextDisplayOrder))
+	{
+		return false;
+	}
+
+	m_scheduler->BeginFrame(m_frameIndex);
+	AssignGops();
+	for (auto& session : m_sessions)
+	{
+		session.player->RequestRangeDecode();
+	}
+	m_scheduler->Schedule();
+	for (auto& session : m_sessions)
+	{
+		session.player->UpdateRangeDecode();
+	}
+	m_scheduler->Submit();
+	DeliverFrames();
+	m_frameIndex = (m_frameIndex + 1) % FRAMES_IN_FLIGHT;
+
+	m_stats.decoded = m_scheduler->GetTotalStatistics().decoded;
+	m_stats.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+	if (0.0 < m_stats.elapsedSeconds)
+	{
+		m_stats.framesPerSecond = m_stats.delivered / m_stats.elapsedSeconds;
+	}
+	return uint32_t(m_nextDisplayOrder) < m_frameCount;
+}
+
+void OfflineDecoder::SplitGops(const VideoPlayer::Decoder::VideoFilePropertis& videoData)
+{
+	// IDR から次の IDR の手前までを1つの GOP とする. GOP をまたいだ参照はないため独立にデコードできる.
+	m_gops.clear();
+	const auto& frames = videoData.frameInfos;
+	for (int i = 0; i < int(frames.size()); ++i)
+	{
+		if (frames[i].frameType == VideoPlayer::Decoder::FrameType::eIntra || m_gops.empty())
+		{
+			if (!m_gops.empty())
+			{
+				m_gops.back().endFrame = i;
+			}
+			m_gops.push_back({ .firstFrame = i, .endFrame = i, .firstDisplayOrder = INT_MAX, .endDisplayOrder = 0 });
+		}
+		auto& gop = m_gops.back();
+		gop.firstDisplayOrder = std::min(gop.firstDisplayOrder, frames[i].displayOrder);
+		gop.endDisplayOrder = std::max(gop.endDisplayOrder, frames[i].displayOrder + 1);
+	}
+	if (!m_gops.empty())
+	{
+		m_gops.back().endFrame = int(frames.size());
+	}
+	// 表示順は GOP の順に連続している.
+	for (size_t i = 1; i < m_gops.size(); ++i)
+	{
+		assert(m_gops[i - 1].endDisplayOrder == m_gops[i].firstDisplayOrder);
+	}
+}
+
+void OfflineDecoder::AssignGops()
+{
+	for (uint32_t i = 0; i < m_sessions.size() && m_nextGop < m_gops.size(); ++i)
+	{
+		auto& session = m_sessions[i];
+		if (session.busy)
+		{
+			continue;
+		}
+		auto& gop = m_gops[m_nextGop++];
+		gop.session = int(i);
+		session.busy = true;
+		session.player->BeginDecodeRange(gop.firstFrame, gop.endFrame);
+	}
+}
+
+void OfflineDecoder::DeliverFrames()
+{
+	// デコード済みのフレームを表示順に渡す. 次の表示順がまだデコードされていなければ待つ.
+	uint32_t captured = 0;
+	while (m_deliverGop < m_gops.size())
+	{
+		auto& gop = m_gops[m_deliverGop];
+		if (gop.session < 0)
+		{
+			break;
+		}
+		auto& session = m_sessions[gop.session];
+		auto frame = session.player->FindDecodedFrame(m_nextDisplayOrder);
+		if (!frame)
+		{
+			break;
+		}
+		if (m_frameDumper)
+		{
+			// Submit までに Capture できるのはリングの数まで.
+			if (m_frameDumper->GetRingSize() <= captured)
+			{
+				m_frameDumper->Submit();
+				captured = 0;
+			}
+			m_frameDumper->Capture(frame->texture.image, m_nextDisplayOrder);
+			captured++;
+		}
+		session.player->ReleaseDecodedFrame(m_nextDisplayOrder);
+		m_nextDisplayOrder++;
+		m_stats.delivered++;
+		if (gop.endDisplayOrder <= m_nextDisplayOrder)
+		{
+			session.busy = false;
+			m_deliverGop++;
+		}
+	}
+	if (m_frameDumper)
+	{
+		m_frameDumper->Submit();
+	}
+}
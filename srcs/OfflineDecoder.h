@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "DecodeScheduler.h"
+#include "VideoPlayer.h"
+
+class FrameDumper;
+
+// 再生ではなくスループットを優先するデコード. サムネイル作成や解析、書き出しに使う.
+// ストリームを IDR で GOP に分け、複数のセッション (VideoPlayer: ビデオセッション、DPB、出力テクスチャ) で並行にデコードする.
+// セッションは DecodeScheduler のストリームとして登録するため、デコードキューが複数あればキューごとに振り分けられる.
+// デコード結果は表示順に FrameDumper へ渡す.
+// セッションは割り当てた GOP を全て渡し終えてから次の GOP を受け取る. GOP が出力テクスチャ数より長い場合、
+// 後ろの GOP のセッションは、前の GOP が渡し終わって自分のフレームを渡せるようになるまで出力テクスチャの空きを待つ.
+class OfflineDecoder
+{
+public:
+	struct Desc
+	{
+		uint32_t sessionCount = 0;	// 0 の場合はデコードキュー数 (最低 2).
+		// セッションごとの出力テクスチャ数. 0 の場合は VideoPlayer::MAX_TEXTURE_COUNT をセッション数で分ける.
+		uint32_t outputTextureCount = 0;
+	};
+
+	struct Statistics
+	{
+		uint64_t decoded = 0;
+		uint64_t delivered = 0;		// 表示順に渡したフレーム数.
+		uint32_t gopCount = 0;
+		double elapsedSeconds = 0.0;
+		double framesPerSecond = 0.0;
+	};
+
+	enum {
+		FRAMES_IN_FLIGHT = 3,	// DecodeScheduler のフレーム数.
+		MAX_SESSIONS = 8,
+	};
+
+	~OfflineDecoder() { Shutdown(); }
+
+	bool Initialize(const char* filePath, const Desc& desc);
+	void Shutdown();
+
+	// 1回分のデコードを送信し、表示順で揃ったフレームを渡す. 全てのフレームを渡し終えたら false を返す.
+	bool Step();
+
+	// 渡すフレームの書き出し先. Step の前に設定する.
+	void SetFrameDumper(std::shared_ptr<FrameDumper> dumper) { m_frameDumper = std::move(dumper); }
+
+	const VideoPlayer::Decoder::VideoFilePropertis& GetVideoProperties() const { return m_sessions.front().player->GetVideoProperties(); }
+	uint32_t GetSessionCount() const { return uint32_t(m_sessions.size()); }
+	uint32_t GetFrameCount() const { return m_frameCount; }
+	const Statistics& GetStatistics() const { return m_stats; }
+
+private:
+	struct Gop
+	{
+		int firstFrame = 0;			// デコード順. IDR.
+		int endFrame = 0;
+		int firstDisplayOrder = 0;
+		int endDisplayOrder = 0;
+		int session = -1;			// 割り当てたセッション.
+	};
+	struct Session
+	{
+		std::unique_ptr<VideoPlayer> player;
+		bool busy = false;			// 割り当てた GOP を渡し終えていない.
+	};
+
+	void SplitGops(const VideoPlayer::Decoder::VideoFilePropertis& videoData);
+	void AssignGops();
+	void DeliverFrames();
+
+	std::shared_ptr<DecodeScheduler> m_scheduler;
+	std::vector<Session> m_sessions;
+	std::shared_ptr<FrameDumper> m_frameDumper;
+
+	std::vector<Gop> m_gops;
+	uint32_t m_nextGop = 0;			// 次に割り当てる GOP.
+	uint32_t m_deliverGop = 0;		// 次に渡すフレームを含む GOP.
+	int m_nextDisplayOrder = 0;
+	uint32_t m_frameCount = 0;
+	uint32_t m_frameIndex = 0;
+
+	Statistics m_stats;
+	std::chrono::steady_clock::time_point m_startTime;
+};
@@ -0,0 +1,71 @@
+﻿#include "PresentationClock.h"
+
+#include <algorithm>
+#include <cassert>
+
+PresentationClock::PresentationClock()
+	: m_clock(std::make_shared<SystemClock>())
+{
+}
+
+void PresentationClock::SetClock(std::shared_ptr<IClock> clock)
+{
+	assert(clock != nullptr);
+	m_clock = std::move(clock);
+	m_started = false;
+}
+
+void PresentationClock::Start(double mediaTime)
+{
+	m_originClockTime = m_clock->Now();
+	m_originMediaTime = mediaTime;
+	m_started = true;
+}
+
+void PresentationClock::Reset()
+{
+	m_started = false;
+	m_stats = {};
+}
+
+double PresentationClock::GetMediaTime() const
+{
+	if (!m_started)
+	{
+		return m_originMediaTime;
+	}
+	return m_originMediaTime + (m_clock->Now() - m_originClockTime);
+}
+
+PresentationClock::Decision PresentationClock::Evaluate(double pts, double duration, bool isReady, bool canSkip)
+{
+	auto mediaTime = GetMediaTime();
+	if (mediaTime < pts)
+	{
+		return Decision::Wait;
+	}
+	if (!isReady)
+	{
+		m_stats.repeated++;
+		return Decision::Repeat;
+	}
+
+	auto lateness = mediaTime - pts;
+	if (m_resyncThresholdSeconds < lateness)
+	{
+		// 処理が長時間止まっていた場合は、まとめて読み飛ばさずに基準を合わせ直す.
+		Start(pts);
+		m_stats.resynced++;
+		lateness = 0.0;
+	}
+	else if (duration <= lateness && canSkip)
+	{
+		m_stats.dropped++;
+		return Decision::Drop;
+	}
+
+	m_stats.presented++;
+	m_stats.lastLatenessSeconds = lateness;
+	m_stats.maxLatenessSeconds = std::max(m_stats.maxLatenessSeconds, lateness);
+	return Decision::Present;
+}
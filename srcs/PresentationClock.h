@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <chrono>
+
+// 単調増加する時刻源. 秒単位.
+class IClock
+{
+public:
+	virtual ~IClock() = default;
+	virtual double Now() const = 0;
+};
+
+// std::chrono::steady_clock による実時間.
+class SystemClock : public IClock
+{
+public:
+	SystemClock() : m_origin(std::chrono::steady_clock::now()) { }
+	double Now() const override
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_origin).count();
+	}
+private:
+	std::chrono::steady_clock::time_point m_origin;
+};
+
+// 明示的に進める時刻. 表示なしで再生タイミングを再現するために使う.
+class VirtualClock : public IClock
+{
+public:
+	double Now() const override { return m_now; }
+	void Advance(double seconds) { m_now += seconds; }
+	void Set(double seconds) { m_now = seconds; }
+private:
+	double m_now = 0.0;
+};
+
+// フレームの表示時刻 (PTS) を時刻源に対する絶対時刻で判定する.
+// 経過時間の積算を行わないため、長時間再生しても誤差が蓄積しない.
+class PresentationClock
+{
+public:
+	enum class Decision
+	{
+		Wait,		// 次のフレームはまだ表示時刻に達していない.
+		Present,	// 次のフレームを表示する.
+		Repeat,		// 表示時刻だがデコードが間に合っていないので現在のフレームを再表示する.
+		Drop,		// 表示期間を過ぎているので、表示せずに読み飛ばす.
+	};
+
+	struct Statistics
+	{
+		uint64_t presented = 0;
+		uint64_t repeated = 0;
+		uint64_t dropped = 0;
+		uint64_t resynced = 0;
+		double   lastLatenessSeconds = 0.0;	// 直近に表示したフレームの表示時刻からの遅れ.
+		double   maxLatenessSeconds = 0.0;
+	};
+
+	PresentationClock();
+
+	void SetClock(std::shared_ptr<IClock> clock);
+	std::shared_ptr<IClock> GetClock() const { return m_clock; }
+
+	// 遅れがこの値を超えたら、読み飛ばさずに基準時刻を合わせ直す.
+	void SetResyncThreshold(double seconds) { m_resyncThresholdSeconds = seconds; }
+
+	// 現在時刻をメディア時刻 mediaTime に対応付けて開始する.
+	void Start(double mediaTime);
+	void Reset();
+	bool IsStarted() const { return m_started; }
+
+	// 現在のメディア時刻.
+	double GetMediaTime() const;
+
+	// 次に表示するフレームについて判断する.
+	// isReady: デコード済みか. canSkip: さらに後続のフレームが用意できているか.
+	Decision Evaluate(double pts, double duration, bool isReady, bool canSkip);
+
+	const Statistics& GetStatistics() const { return m_stats; }
+
+private:
+	std::shared_ptr<IClock> m_clock;
+	double m_originClockTime = 0.0;
+	double m_originMediaTime = 0.0;
+	double m_resyncThresholdSeconds = 0.5;
+	bool m_started = false;
+	Statistics m_stats;
+};
@@ -0,0 +1,127 @@
+﻿#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <bit>
+
+// 表示順 (display order) をインデックスとするリングバッファ.
+// デコード順に挿入されたフレームを、表示順で O(1) に取り出す.
+// 保持中のフレームの表示順の幅が容量未満であることが前提.
+template<class T>
+class ReorderQueue
+{
+public:
+	enum class State : uint8_t {
+		Empty,		// 未デコード (まだ届いていない).
+		Ready,		// デコード済みで表示可能.
+		Dropped,	// デコードを省略した. 表示時は読み飛ばす.
+	};
+
+	void Initialize(uint32_t capacity)
+	{
+		capacity = std::bit_ceil(capacity);
+		m_entries.assign(capacity, Entry{});
+		m_mask = capacity - 1;
+		m_count = 0;
+	}
+
+	void Clear()
+	{
+		for (auto& entry : m_entries)
+		{
+			entry = Entry{};
+		}
+		m_count = 0;
+	}
+
+	// 挿入先に表示済みにならなかったエントリー (欠けたフレームや容量を超えた先行) が残っている場合は、
+	// それを取り除いてから挿入する. 取り除いたエントリーがアイテムを保持していれば evicted へ返して true を返す.
+	// 呼び出し側は evicted のリソースを回収すること.
+	bool Insert(int64_t displayOrder, const T& item, T& evicted)
+	{
+		auto& entry = At(displayOrder);
+		bool hasEvicted = Evict(entry, evicted);
+		entry.displayOrder = displayOrder;
+		entry.state = State::Ready;
+		entry.item = item;
+		m_count++;
+		return hasEvicted;
+	}
+
+	// 戻り値と evicted は Insert と同じ.
+	bool MarkDropped(int64_t displayOrder, T& evicted)
+	{
+		auto& entry = At(displayOrder);
+		bool hasEvicted = Evict(entry, evicted);
+		entry.displayOrder = displayOrder;
+		entry.state = State::Dropped;
+		return hasEvicted;
+	}
+
+	State GetState(int64_t displayOrder) const
+	{
+		const auto& entry = At(displayOrder);
+		if (entry.displayOrder != displayOrder)
+		{
+			return State::Empty;
+		}
+		return entry.state;
+	}
+
+	T* Find(int64_t displayOrder)
+	{
+		auto& entry = At(displayOrder);
+		if (entry.displayOrder != displayOrder || entry.state != State::Ready)
+		{
+			return nullptr;
+		}
+		return &entry.item;
+	}
+
+	// 表示を終えたフレームを取り除く. 保持していたアイテムがあれば out へ返す.
+	bool Retire(int64_t displayOrder, T& out)
+	{
+		auto& entry = At(displayOrder);
+		if (entry.displayOrder != displayOrder)
+		{
+			return false;
+		}
+		bool hasItem = entry.state == State::Ready;
+		if (hasItem)
+		{
+			out = entry.item;
+			m_count--;
+		}
+		entry = Entry{};
+		return hasItem;
+	}
+
+	// 保持しているデコード済みフレームの数.
+	uint32_t GetCount() const { return m_count; }
+	uint32_t GetCapacity() const { return uint32_t(m_entries.size()); }
+
+private:
+	struct Entry {
+		int64_t displayOrder = -1;
+		State   state = State::Empty;
+		T       item{};
+	};
+	bool Evict(Entry& entry, T& evicted)
+	{
+		bool hasItem = entry.state == State::Ready;
+		if (hasItem)
+		{
+			evicted = entry.item;
+			m_count--;
+		}
+		entry = Entry{};
+		return hasItem;
+	}
+	Entry& At(int64_t displayOrder) { return m_entries[uint64_t(displayOrder) & m_mask]; }
+	const Entry& At(int64_t displayOrder) const { return m_entries[uint64_t(displayOrder) & m_mask]; }
+
+	std::vector<Entry> m_entries;
+	uint32_t m_mask = 0;
+	uint32_t m_count = 0;
+};
@@ -0,0 +1,212 @@
+﻿#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#include "ResourceStateTracker.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+constexpr VkAccessFlags2 WriteAccessMask =
+	VK_ACCESS_2_SHADER_WRITE_BIT |
+	VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+	VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_2_TRANSFER_WRITE_BIT |
+	VK_ACCESS_2_HOST_WRITE_BIT |
+	VK_ACCESS_2_MEMORY_WRITE_BIT |
+	VK_ACCESS_2_VIDEO_DECODE_WRITE_BIT_KHR;
+
+bool IsLess(VkImage imageA, uint32_t layerA, VkImage imageB, uint32_t layerB)
+{
+	if (imageA != imageB)
+	{
+		return uint64_t(imageA) < uint64_t(imageB);
+	}
+	return layerA < layerB;
+}
+
+}
+
+void ResourceStateTracker::Register(VkImage image, uint32_t layer, VkImageAspectFlags aspectMask)
+{
+	auto it = std::lower_bound(m_entries.begin(), m_entries.end(), image,
+		[=](const Entry& e, VkImage img) { return IsLess(e.image, e.layer, img, layer); });
+	if (it != m_entries.end() && it->image == image && it->layer == layer)
+	{
+		it->aspectMask = aspectMask;
+		it->state = {};
+		it->releasedFrom = VK_QUEUE_FAMILY_IGNORED;
+		return;
+	}
+	m_entries.insert(it, Entry{ .image = image, .layer = layer, .aspectMask = aspectMask });
+}
+
+void ResourceStateTracker::Unregister(VkImage image)
+{
+	std::erase_if(m_entries, [=](const Entry& e) { return e.image == image; });
+}
+
+void ResourceStateTracker::Clear()
+{
+	m_entries.clear();
+	m_pendingCount = 0;
+}
+
+void ResourceStateTracker::Require(VkImage image, uint32_t layer, VkPipelineStageFlags2 stage, VkAccessFlags2 access, VkImageLayout layout,
+	uint32_t queueFamily)
+{
+	auto entry = Find(image, layer);
+	assert(entry != nullptr);
+	auto& state = entry->state;
+
+	if (entry->releasedFrom != VK_QUEUE_FAMILY_IGNORED)
+	{
+		// 解放と同じレイアウトの組で取得する. 解放側で書き込みは可視になっているため、src は指定しない.
+		assert(queueFamily == state.queueFamily);
+		Push(*entry, {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+			.srcAccessMask = VK_ACCESS_2_NONE,
+			.dstStageMask = stage,
+			.dstAccessMask = access,
+			.oldLayout = entry->releasedLayout,
+			.newLayout = state.layout,
+			.srcQueueFamilyIndex = entry->releasedFrom,
+			.dstQueueFamilyIndex = state.queueFamily,
+		});
+		entry->releasedFrom = VK_QUEUE_FAMILY_IGNORED;
+		state.stage = stage;
+		state.access = access;
+		if (state.layout == layout)
+		{
+			return;
+		}
+	}
+	else if (queueFamily != VK_QUEUE_FAMILY_IGNORED && state.queueFamily != VK_QUEUE_FAMILY_IGNORED && queueFamily != state.queueFamily)
+	{
+		// 所有権を移していないため内容は引き継げない. 以前のアクセスとの同期はセマフォで保証されている前提.
+		state = { .layout = VK_IMAGE_LAYOUT_UNDEFINED };
+	}
+	if (queueFamily != VK_QUEUE_FAMILY_IGNORED)
+	{
+		state.queueFamily = queueFamily;
+	}
+
+	// レイアウトが同じで読み込み同士なら、バリアは不要. 後続の書き込みに備えて記録だけ残す.
+	bool hasWrite = ((state.access | access) & WriteAccessMask) != 0;
+	if (state.layout == layout && !hasWrite)
+	{
+		state.stage |= stage;
+		state.access |= access;
+		return;
+	}
+
+	Push(*entry, {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+		.srcStageMask = state.stage,
+		.srcAccessMask = state.access,
+		.dstStageMask = stage,
+		.dstAccessMask = access,
+		.oldLayout = state.layout,
+		.newLayout = layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	});
+	state.stage = stage;
+	state.access = access;
+	state.layout = layout;
+}
+
+void ResourceStateTracker::Release(VkImage image, uint32_t layer, uint32_t dstQueueFamily, VkImageLayout layout)
+{
+	auto entry = Find(image, layer);
+	assert(entry != nullptr);
+	auto& state = entry->state;
+	assert(state.queueFamily != VK_QUEUE_FAMILY_IGNORED && entry->releasedFrom == VK_QUEUE_FAMILY_IGNORED);
+	if (state.queueFamily == dstQueueFamily)
+	{
+		return;
+	}
+
+	// 解放側の dst は無視されるため指定しない. レイアウトの遷移は取得側と同じ組を指定する.
+	Push(*entry, {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+		.srcStageMask = state.stage,
+		.srcAccessMask = state.access,
+		.dstStageMask = VK_PIPELINE_STAGE_2_NONE,
+		.dstAccessMask = VK_ACCESS_2_NONE,
+		.oldLayout = state.layout,
+		.newLayout = layout,
+		.srcQueueFamilyIndex = state.queueFamily,
+		.dstQueueFamilyIndex = dstQueueFamily,
+	});
+	entry->releasedFrom = state.queueFamily;
+	entry->releasedLayout = state.layout;
+	state = {
+		.layout = layout,
+		.queueFamily = dstQueueFamily,
+	};
+}
+
+void ResourceStateTracker::Push(const Entry& entry, const VkImageMemoryBarrier2& barrier)
+{
+	assert(m_pendingCount < MaxPendingBarriers);
+	auto& pending = m_pendingBarriers[m_pendingCount++];
+	pending = barrier;
+	pending.image = entry.image;
+	pending.subresourceRange = {
+		.aspectMask = entry.aspectMask,
+		.baseMipLevel = 0,
+		.levelCount = 1,
+		.baseArrayLayer = entry.layer,
+		.layerCount = 1,
+	};
+}
+
+void ResourceStateTracker::ResetAccess(VkImage image, uint32_t layer)
+{
+	auto entry = Find(image, layer);
+	assert(entry != nullptr);
+	entry->state.stage = VK_PIPELINE_STAGE_2_NONE;
+	entry->state.access = VK_ACCESS_2_NONE;
+}
+
+const ResourceStateTracker::State& ResourceStateTracker::GetState(VkImage image, uint32_t layer) const
+{
+	auto entry = Find(image, layer);
+	assert(entry != nullptr);
+	return entry->state;
+}
+
+void ResourceStateTracker::Flush(VkCommandBuffer commandBuffer)
+{
+	if (m_pendingCount == 0)
+	{
+		return;
+	}
+	VkDependencyInfo info{
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.imageMemoryBarrierCount = m_pendingCount,
+		.pImageMemoryBarriers = m_pendingBarriers.data(),
+	};
+	vkCmdPipelineBarrier2(commandBuffer, &info);
+	m_pendingCount = 0;
+}
+
+ResourceStateTracker::Entry* ResourceStateTracker::Find(VkImage image, uint32_t layer)
+{
+	return const_cast<Entry*>(static_cast<const ResourceStateTracker*>(this)->Find(image, layer));
+}
+
+const ResourceStateTracker::Entry* ResourceStateTracker::Find(VkImage image, uint32_t layer) const
+{
+	auto it = std::lower_bound(m_entries.begin(), m_entries.end(), image,
+		[=](const Entry& e, VkImage img) { return IsLess(e.image, e.layer, img, layer); });
+	if (it == m_entries.end() || it->image != image || it->layer != layer)
+	{
+		return nullptr;
+	}
+	return &(*it);
+}
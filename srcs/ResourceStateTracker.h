@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <vector>
+
+// イメージのサブリソース(配列レイヤー)単位でレイアウトとアクセス状態を追跡し,
+// 実際に状態が変わるものだけをバリアとしてまとめて発行する.
+// EXCLUSIVE のイメージを別のキューファミリーで使う場合は、所有権の移動 (解放と取得のバリアの組) も発行する.
+class ResourceStateTracker
+{
+public:
+	struct State {
+		VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2        access = VK_ACCESS_2_NONE;
+		VkImageLayout         layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		uint32_t              queueFamily = VK_QUEUE_FAMILY_IGNORED;	// 最後に使ったキューファミリー. 未指定なら IGNORED.
+	};
+
+	enum {
+		MaxPendingBarriers = 32,
+	};
+
+	// 追跡対象のサブリソースを登録. 初期化時にまとめて行う想定.
+	void Register(VkImage image, uint32_t layer, VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT);
+	void Unregister(VkImage image);
+	void Clear();
+
+	// 要求する状態へ遷移させる. 遷移が必要な場合のみバリアが積まれる.
+	// queueFamily を指定すると使用するキューファミリーを記録する. Release 済みなら取得のバリアを積み、
+	// 解放せずに別のキューファミリーで使う場合は内容を捨てる (UNDEFINED からの遷移).
+	void Require(VkImage image, uint32_t layer, VkPipelineStageFlags2 stage, VkAccessFlags2 access, VkImageLayout layout,
+		uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED);
+
+	// 内容を保ったまま dstQueueFamily へ所有権を移す解放のバリアを積む. 解放元のキューのコマンドバッファで Flush すること.
+	// 取得のバリアは dstQueueFamily を指定した次の Require で積まれる. 同じキューファミリーなら何もしない.
+	void Release(VkImage image, uint32_t layer, uint32_t dstQueueFamily, VkImageLayout layout);
+
+	// 別キューでの使用などで、以降の同期がセマフォで保証される場合にアクセス情報のみ破棄する.
+	void ResetAccess(VkImage image, uint32_t layer);
+
+	const State& GetState(VkImage image, uint32_t layer) const;
+
+	// 積まれたバリアを1回の vkCmdPipelineBarrier2 で発行する.
+	void Flush(VkCommandBuffer commandBuffer);
+
+	uint32_t GetPendingCount() const { return m_pendingCount; }
+
+private:
+	struct Entry {
+		VkImage            image = VK_NULL_HANDLE;
+		uint32_t           layer = 0;
+		VkImageAspectFlags aspectMask = 0;
+		State              state;
+		// Release 後、取得のバリアを積むまでの解放元と遷移前のレイアウト.
+		uint32_t           releasedFrom = VK_QUEUE_FAMILY_IGNORED;
+		VkImageLayout      releasedLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+	void Push(const Entry& entry, const VkImageMemoryBarrier2& barrier);
+	Entry* Find(VkImage image, uint32_t layer);
+	const Entry* Find(VkImage image, uint32_t layer) const;
+
+	// (image, layer) でソートされた配列. 登録後は確保が発生しない.
+	std::vector<Entry> m_entries;
+
+	std::array<VkImageMemoryBarrier2, MaxPendingBarriers> m_pendingBarriers;
+	uint32_t m_pendingCount = 0;
+};
@@ -0,0 +1,358 @@
+﻿#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#include <cassert>
+#include <string>
+
+#include "DeviceContext.h"
+
+#undef ERROR
+#undef min
+#undef max
+
+#include "h264.h"
+#include "SoftwareDecodeBackend.h"
+#include "VideoScaler.h"
+
+static constexpr size_t align_to(size_t sz, size_t alignment) {
+	return ((sz - 1) / alignment + 1) * alignment;
+};
+
+bool SoftwareDecodeBackend::Initialize(const DecodeStreamDesc& desc)
+{
+	const auto& videoData = m_decoder->m_videoData;
+	auto spsArray = reinterpret_cast<const h264::SPS*>(videoData.spsBytes.data());
+	auto ppsArray = reinterpret_cast<const h264::PPS*>(videoData.ppsBytes.data());
+	if (videoData.spsCount == 0 || videoData.ppsCount == 0)
+	{
+		OutputDebugStringA("Software decoder: no parameter sets.\n");
+		return false;
+	}
+	for (uint32_t i = 0; i < videoData.ppsCount; ++i)
+	{
+		const auto& pps = ppsArray[i];
+		if (uint32_t(pps.seq_parameter_set_id) >= videoData.spsCount)
+		{
+			continue;
+		}
+		if (const char* reason = SoftwareH264Decoder::CheckSupport(spsArray[pps.seq_parameter_set_id], pps))
+		{
+			char buf[256];
+			sprintf_s(buf, "Software decoder: unsupported stream (%s).\n", reason);
+			OutputDebugStringA(buf);
+			return false;
+		}
+	}
+
+	const auto& sps = spsArray[0];
+	const uint32_t widthInMbs = sps.pic_width_in_mbs_minus1 + 1;
+	const uint32_t heightInMbs = sps.pic_height_in_map_units_minus1 + 1;
+	if (!m_software.Initialize(widthInMbs, heightInMbs, VideoDecodeOperation::MaxDpbSlotCount))
+	{
+		return false;
+	}
+	{
+		char buf[128];
+		sprintf_s(buf, "Software decoder: %ux%u MBs, %u threads.\n", widthInMbs, heightInMbs, m_software.GetThreadCount());
+		OutputDebugStringA(buf);
+	}
+
+	m_bitstreamSlotCount = desc.bitstreamSlotCount;
+	m_bitstreamSlotSize = desc.maxFrameSizeBytes;
+	m_bitstream.resize(m_bitstreamSlotCount * m_bitstreamSlotSize);
+
+	m_width = desc.width;
+	m_height = desc.height;
+	m_chromaOffset = align_to(uint64_t(m_width) * m_height, 16);
+	m_stagingSize = m_chromaOffset + uint64_t(m_width) * (m_height / 2);
+
+	return CreateOutputTextures(desc.outputCount, desc.minOutputCount != 0 ? desc.minOutputCount : desc.outputCount);
+}
+
+void SoftwareDecodeBackend::Shutdown()
+{
+	auto devCtx = DeviceContext::GetContext();
+
+	SetScaler(nullptr);
+	DestroyOutputTextures();
+	for (auto& [commandBuffer, staging] : m_stagingBuffers)
+	{
+		devCtx->DestroyBuffer(staging.buffer.buffer, staging.buffer.allocation);
+	}
+	m_stagingBuffers.clear();
+
+	m_software.Shutdown();
+	m_bitstream.clear();
+	m_bitstream.shrink_to_fit();
+}
+
+uint8_t* SoftwareDecodeBackend::GetBitstreamSlot(uint32_t slot, uint64_t& capacity)
+{
+	assert(slot < m_bitstreamSlotCount);
+	capacity = m_bitstreamSlotSize;
+	return m_bitstream.data() + slot * m_bitstreamSlotSize;
+}
+
+void SoftwareDecodeBackend::Decode(const VideoDecodeOperation& operation, const DecodeScheduler::Job& job)
+{
+	// 参照するスロットとその frame_num から RefPicList0 を作る.
+	SoftwareH264Decoder::Reference references[VideoDecodeOperation::MaxDpbSlotCount];
+	uint32_t referenceCount = 0;
+	for (uint32_t i = 0; i < operation.dpbReferenceCount; ++i)
+	{
+		const uint32_t slot = operation.dpbReferenceSlots[i];
+		if (slot == operation.current_dpb)
+		{
+			continue;
+		}
+		references[referenceCount++] = { .slot = slot, .frameNum = operation.dpbFramenum[slot] };
+	}
+
+	const auto& videoData = m_decoder->m_videoData;
+	SoftwareH264Decoder::FrameDesc frame{
+		.bitstream = m_bitstream.data() + operation.bitstreamSlot * m_bitstreamSlotSize,
+		.size = operation.streamSize,
+		.sliceOffsets = operation.sliceOffsets,
+		.sliceCount = operation.sliceCount,
+		.spsArray = reinterpret_cast<const h264::SPS*>(videoData.spsBytes.data()),
+		.ppsArray = reinterpret_cast<const h264::PPS*>(videoData.ppsBytes.data()),
+		.spsCount = videoData.spsCount,
+		.ppsCount = videoData.ppsCount,
+		.targetSlot = operation.current_dpb,
+		.references = references,
+		.referenceCount = referenceCount,
+	};
+	if (!m_software.DecodeFrame(frame))
+	{
+		// 復号できなかった部分は参照画像で補われているため、そのまま表示を続ける.
+		char buf[256];
+		sprintf_s(buf, "Software decoder: frame %d (%s).\n", operation.decodedFrameIndex,
+			m_software.GetLastError() ? m_software.GetLastError() : "concealed");
+		OutputDebugStringA(buf);
+	}
+
+	if (job.graphicsCommandBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	auto& staging = GetStagingBuffer(job.graphicsCommandBuffer);
+	m_software.WriteNV12(operation.current_dpb,
+		staging.mapped, m_width,
+		staging.mapped + m_chromaOffset, m_width,
+		m_width, m_height);
+	CopyToTexture(job.graphicsCommandBuffer, staging, operation.outputIndex);
+}
+
+DecodeOutputTexture SoftwareDecodeBackend::GetOutputTexture(uint32_t index) const
+{
+	assert(index < m_outputTextures.size());
+	return {
+		.image = m_outputTextures[index].image,
+		.view = m_outputTextures[index].view,
+	};
+}
+
+void SoftwareDecodeBackend::SetScaler(std::shared_ptr<VideoScaler> scaler)
+{
+	if (m_scaler)
+	{
+		m_scaler->UnregisterResources(m_stateTracker);
+	}
+	m_scaler = std::move(scaler);
+	if (m_scaler)
+	{
+		m_scaler->RegisterResources(m_stateTracker);
+	}
+}
+
+bool SoftwareDecodeBackend::CreateOutputTextures(uint32_t textureCount, uint32_t minTextureCount)
+{
+	auto devCtx = DeviceContext::GetContext();
+
+	// ビデオプロファイルを持たない通常の NV12 テクスチャ.
+	VkImageCreateInfo imageCI = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.flags = 0,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM,
+		.extent = {
+			.width = m_width,
+			.height = m_height,
+			.depth = 1
+		},
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = nullptr,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	// 全テクスチャが収まる1ブロックのプールを作成. 予算に応じて枚数が減る.
+	m_outputTexturePool = devCtx->CreateImagePool(MemoryCategory::OutputTexture, imageCI, textureCount, minTextureCount);
+	if (m_outputTexturePool == VK_NULL_HANDLE)
+	{
+		OutputDebugStringA("Software decoder: not enough memory for output textures.\n");
+		return false;
+	}
+	VmaAllocationCreateInfo allocationCI{
+		.flags = { },
+		.pool = m_outputTexturePool,
+	};
+	VkSamplerYcbcrConversionInfo samplerConversionInfo{
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO,
+		.conversion = devCtx->m_samplerYcbcrConversion,
+	};
+
+	m_outputTextures.resize(textureCount);
+	for (uint32_t i = 0; i < textureCount; ++i)
+	{
+		auto& texture = m_outputTextures[i];
+		auto res = devCtx->CreateImage(MemoryCategory::OutputTexture, imageCI, allocationCI, &texture.image, &texture.allocation, &texture.allocationInfo);
+		assert(res == VK_SUCCESS);
+
+		VkImageViewCreateInfo imageViewCI = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = &samplerConversionInfo,
+			.flags = 0,
+			.image = texture.image,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = imageCI.format,
+			.components = {},
+			.subresourceRange = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			},
+		};
+		res = vkCreateImageView(devCtx->GetVkDevice(), &imageViewCI, nullptr, &texture.view);
+		assert(res == VK_SUCCESS);
+
+		std::string name = "dispImage(sw):" + std::to_string(i);
+		VkDebugUtilsObjectNameInfoEXT nameInfo{
+			.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
+			.objectType = VK_OBJECT_TYPE_IMAGE,
+			.objectHandle = (uint64_t)(void*)texture.image,
+			.pObjectName = name.c_str(),
+		};
+		vkSetDebugUtilsObjectNameEXT(devCtx->GetVkDevice(), &nameInfo);
+
+		m_stateTracker.Register(texture.image, 0);
+	}
+	return true;
+}
+
+void SoftwareDecodeBackend::DestroyOutputTextures()
+{
+	auto devCtx = DeviceContext::GetContext();
+	for (auto& texture : m_outputTextures)
+	{
+		m_stateTracker.Unregister(texture.image);
+		vkDestroyImageView(devCtx->GetVkDevice(), texture.view, nullptr);
+		devCtx->DestroyImage(texture.image, texture.allocation);
+	}
+	m_outputTextures.clear();
+	devCtx->DestroyPool(m_outputTexturePool);
+	m_outputTexturePool = VK_NULL_HANDLE;
+	m_stateTracker.Clear();
+}
+
+SoftwareDecodeBackend::StagingBuffer& SoftwareDecodeBackend::GetStagingBuffer(VkCommandBuffer commandBuffer)
+{
+	auto it = m_stagingBuffers.find(commandBuffer);
+	if (it != m_stagingBuffers.end())
+	{
+		return it->second;
+	}
+
+	auto devCtx = DeviceContext::GetContext();
+	auto& staging = m_stagingBuffers[commandBuffer];
+	VkBufferCreateInfo bufferCI{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = m_stagingSize,
+		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VmaAllocationCreateInfo allocateCI{};
+	allocateCI.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+	allocateCI.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+	allocateCI.requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	auto res = devCtx->CreateBuffer(
+		MemoryCategory::Staging,
+		bufferCI,
+		allocateCI,
+		&staging.buffer.buffer,
+		&staging.buffer.allocation,
+		&staging.buffer.allocationInfo);
+	assert(res == VK_SUCCESS);
+	staging.mapped = static_cast<uint8_t*>(staging.buffer.allocationInfo.pMappedData);
+	return staging;
+}
+
+void SoftwareDecodeBackend::CopyToTexture(VkCommandBuffer graphicsCmdBuffer, const StagingBuffer& staging, uint32_t outputIndex)
+{
+	const auto& output = m_outputTextures[outputIndex];
+	m_stateTracker.Require(output.image, 0,
+		VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	m_stateTracker.Flush(graphicsCmdBuffer);
+
+	VkBufferImageCopy2 regions[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2,
+			.bufferOffset = 0,
+			.bufferRowLength = m_width,
+			.bufferImageHeight = m_height,
+			.imageSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT,
+				.mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1,
+			},
+			.imageOffset = { },
+			.imageExtent = { .width = m_width, .height = m_height, .depth = 1, }
+		},
+		{
+			// CbCr は 2 バイトで 1 テクセル.
+			.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2,
+			.bufferOffset = m_chromaOffset,
+			.bufferRowLength = m_width / 2,
+			.bufferImageHeight = m_height / 2,
+			.imageSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT,
+				.mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1,
+			},
+			.imageOffset = { },
+			.imageExtent = { .width = m_width / 2, .height = m_height / 2, .depth = 1, }
+		},
+	};
+	VkCopyBufferToImageInfo2 info{
+		.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_TO_IMAGE_INFO_2,
+		.srcBuffer = staging.buffer.buffer,
+		.dstImage = output.image,
+		.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.regionCount = uint32_t(std::size(regions)),
+		.pRegions = regions,
+	};
+	vkCmdCopyBufferToImage2(graphicsCmdBuffer, &info);
+
+	VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
+	if (m_scaler)
+	{
+		// 縮小でも読むため、縮小先の遷移と同じバリアで発行する.
+		stage |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		m_scaler->RequireWrite(m_stateTracker, outputIndex);
+	}
+	// テクスチャとして使用するためのレイアウトへ.
+	m_stateTracker.Require(output.image, 0,
+		stage, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL);
+	m_stateTracker.Flush(graphicsCmdBuffer);
+
+	if (m_scaler)
+	{
+		m_scaler->Dispatch(graphicsCmdBuffer, outputIndex);
+		m_scaler->RequireRead(m_stateTracker, outputIndex);
+		m_stateTracker.Flush(graphicsCmdBuffer);
+	}
+}
@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "DecodeBackend.h"
+#include "ResourceStateTracker.h"
+#include "SoftwareH264Decoder.h"
+#include "VideoPlayer.h"
+
+// CPU によるデコード. Vulkan Video のデコードキューがない環境で使う.
+// デコード結果は NV12 としてステージングバッファへ書き出し、グラフィックスキューで出力テクスチャへ転送する.
+class SoftwareDecodeBackend : public IDecodeBackend
+{
+public:
+	explicit SoftwareDecodeBackend(std::shared_ptr<VideoPlayer::Decoder> decoder) : m_decoder(std::move(decoder)) { }
+
+	const char* GetName() const override { return "Software"; }
+
+	// ストリームが対応範囲 (Constrained Baseline) にない場合は false を返す.
+	bool Initialize(const DecodeStreamDesc& desc) override;
+	void Shutdown() override;
+
+	uint8_t* GetBitstreamSlot(uint32_t slot, uint64_t& capacity) override;
+	uint64_t GetBitstreamAlignment() const override { return 1; }
+
+	void Decode(const VideoDecodeOperation& operation, const DecodeScheduler::Job& job) override;
+
+	uint32_t GetOutputTextureCount() const override { return uint32_t(m_outputTextures.size()); }
+	DecodeOutputTexture GetOutputTexture(uint32_t index) const override;
+
+	void SetScaler(std::shared_ptr<VideoScaler> scaler) override;
+
+	const SoftwareH264Decoder::Statistics& GetStatistics() const { return m_software.GetStatistics(); }
+
+private:
+	using Image = VideoPlayer::Image;
+
+	struct StagingBuffer
+	{
+		vku::GPUBuffer buffer;
+		uint8_t* mapped = nullptr;
+	};
+
+	bool CreateOutputTextures(uint32_t textureCount, uint32_t minTextureCount);
+	void DestroyOutputTextures();
+	// コマンドバッファごとに持つ. コマンドバッファの再利用時にはフェンスで完了が保証されている.
+	StagingBuffer& GetStagingBuffer(VkCommandBuffer commandBuffer);
+	void CopyToTexture(VkCommandBuffer graphicsCmdBuffer, const StagingBuffer& staging, uint32_t outputIndex);
+
+	std::shared_ptr<VideoPlayer::Decoder> m_decoder;
+	SoftwareH264Decoder m_software;
+
+	std::vector<uint8_t> m_bitstream;
+	uint64_t m_bitstreamSlotSize = 0;
+	uint32_t m_bitstreamSlotCount = 0;
+
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	uint64_t m_chromaOffset = 0;	// ステージングバッファ内の CbCr の位置.
+	uint64_t m_stagingSize = 0;
+	std::unordered_map<VkCommandBuffer, StagingBuffer> m_stagingBuffers;
+
+	VmaPool m_outputTexturePool = VK_NULL_HANDLE;
+	std::vector<Image> m_outputTextures;
+	ResourceStateTracker m_stateTracker;
+
+	// 設定されている場合は転送に続けて縮小する.
+	std::shared_ptr<VideoScaler> m_scaler;
+};
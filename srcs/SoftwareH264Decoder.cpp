@@ -0,0 +1,2856 @@
+﻿#include "SoftwareH264Decoder.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFTWARE_H264_USE_SSE2 1
+#endif
+
+#include "h264.h"
+
+namespace {
+
+inline int Clip3(int lo, int hi, int v)
+{
+	return v < lo ? lo : (v > hi ? hi : v);
+}
+inline uint8_t Clip1(int v)
+{
+	return uint8_t(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// ---------------------------------------------------------------------------
+// CAVLC のテーブル. 符号長と符号の組で持ち、初回使用時に引き表へ展開する.
+
+// coeff_token. [TotalCoeff * 4 + TrailingOnes] (Table 9-5).
+const uint8_t kCoeffTokenLen[4][4 * 17] = {
+	{
+		 1, 0, 0, 0,
+		 6, 2, 0, 0,     8, 6, 3, 0,     9, 8, 7, 5,    10, 9, 8, 6,
+		11,10, 9, 7,    13,11,10, 8,    13,13,11, 9,    13,13,13,10,
+		14,14,13,11,    14,14,14,13,    15,15,14,14,    15,15,15,14,
+		16,15,15,15,    16,16,16,15,    16,16,16,16,    16,16,16,16,
+	},
+	{
+		 2, 0, 0, 0,
+		 6, 2, 0, 0,     6, 5, 3, 0,     7, 6, 6, 4,     8, 6, 6, 4,
+		 8, 7, 7, 5,     9, 8, 8, 6,    11, 9, 9, 6,    11,11,11, 7,
+		12,11,11, 9,    12,12,12,11,    12,12,12,11,    13,13,13,12,
+		13,13,13,13,    13,14,13,13,    14,14,14,13,    14,14,14,14,
+	},
+	{
+		 4, 0, 0, 0,
+		 6, 4, 0, 0,     6, 5, 4, 0,     6, 5, 5, 4,     7, 5, 5, 4,
+		 7, 5, 5, 4,     7, 6, 6, 4,     7, 6, 6, 4,     8, 7, 7, 5,
+		 8, 8, 7, 6,     9, 8, 8, 7,     9, 9, 8, 8,     9, 9, 9, 8,
+		10, 9, 9, 9,    10,10,10,10,    10,10,10,10,    10,10,10,10,
+	},
+	{
+		 6, 0, 0, 0,
+		 6, 6, 0, 0,     6, 6, 6, 0,     6, 6, 6, 6,     6, 6, 6, 6,
+		 6, 6, 6, 6,     6, 6, 6, 6,     6, 6, 6, 6,     6, 6, 6, 6,
+		 6, 6, 6, 6,     6, 6, 6, 6,     6, 6, 6, 6,     6, 6, 6, 6,
+		 6, 6, 6, 6,     6, 6, 6, 6,     6, 6, 6, 6,     6, 6, 6, 6,
+	},
+};
+const uint8_t kCoeffTokenCode[4][4 * 17] = {
+	{
+		 1, 0, 0, 0,
+		 5, 1, 0, 0,     7, 4, 1, 0,     7, 6, 5, 3,     7, 6, 5, 3,
+		 7, 6, 5, 4,    15, 6, 5, 4,    11,14, 5, 4,     8,10,13, 4,
+		15,14, 9, 4,    11,10,13,12,    15,14, 9,12,    11,10,13, 8,
+		15, 1, 9,12,    11,14,13, 8,     7,10, 9,12,     4, 6, 5, 8,
+	},
+	{
+		 3, 0, 0, 0,
+		11, 2, 0, 0,     7, 7, 3, 0,     7,10, 9, 5,     7, 6, 5, 4,
+		 4, 6, 5, 6,     7, 6, 5, 8,    15, 6, 5, 4,    11,14,13, 4,
+		15,10, 9, 4,    11,14,13,12,     8,10, 9, 8,    15,14,13,12,
+		11,10, 9,12,     7,11, 6, 8,     9, 8,10, 1,     7, 6, 5, 4,
+	},
+	{
+		15, 0, 0, 0,
+		15,14, 0, 0,    11,15,13, 0,     8,12,14,12,    15,10,11,11,
+		11, 8, 9,10,     9,14,13, 9,     8,10, 9, 8,    15,14,13,13,
+		11,14,10,12,    15,10,13,12,    11,14, 9,12,     8,10,13, 8,
+		13, 7, 9,12,     9,12,11,10,     5, 8, 7, 6,     1, 4, 3, 2,
+	},
+	{
+		 3, 0, 0, 0,
+		 0, 1, 0, 0,     4, 5, 6, 0,     8, 9,10,11,    12,13,14,15,
+		16,17,18,19,    20,21,22,23,    24,25,26,27,    28,29,30,31,
+		32,33,34,35,    36,37,38,39,    40,41,42,43,    44,45,46,47,
+		48,49,50,51,    52,53,54,55,    56,57,58,59,    60,61,62,63,
+	},
+};
+// 色差 DC (4:2:0) の coeff_token.
+const uint8_t kChromaDcCoeffTokenLen[4 * 5] = {
+	2, 0, 0, 0,
+	6, 1, 0, 0,
+	6, 6, 3, 0,
+	6, 7, 7, 6,
+	6, 8, 8, 7,
+};
+const uint8_t kChromaDcCoeffTokenCode[4 * 5] = {
+	1, 0, 0, 0,
+	7, 1, 0, 0,
+	4, 6, 1, 0,
+	3, 3, 2, 5,
+	2, 3, 2, 0,
+};
+
+// total_zeros. [TotalCoeff - 1][total_zeros] (Table 9-7, 9-8).
+const uint8_t kTotalZerosLen[15][16] = {
+	{ 1,3,3,4,4,5,5,6,6,7,7,8,8,9,9,9 },
+	{ 3,3,3,3,3,4,4,4,4,5,5,6,6,6,6 },
+	{ 4,3,3,3,4,4,3,3,4,5,5,6,5,6 },
+	{ 5,3,4,4,3,3,3,4,3,4,5,5,5 },
+	{ 4,4,4,3,3,3,3,3,4,5,4,5 },
+	{ 6,5,3,3,3,3,3,3,4,3,6 },
+	{ 6,5,3,3,3,2,3,4,3,6 },
+	{ 6,4,5,3,2,2,3,3,6 },
+	{ 6,6,4,2,2,3,2,5 },
+	{ 5,5,3,2,2,2,4 },
+	{ 4,4,3,3,1,3 },
+	{ 4,4,2,1,3 },
+	{ 3,3,1,2 },
+	{ 2,2,1 },
+	{ 1,1 },
+};
+const uint8_t kTotalZerosCode[15][16] = {
+	{ 1,3,2,3,2,3,2,3,2,3,2,3,2,3,2,1 },
+	{ 7,6,5,4,3,5,4,3,2,3,2,3,2,1,0 },
+	{ 5,7,6,5,4,3,4,3,2,3,2,1,1,0 },
+	{ 3,7,5,4,6,5,4,3,3,2,2,1,0 },
+	{ 5,4,3,7,6,5,4,3,2,1,1,0 },
+	{ 1,1,7,6,5,4,3,2,1,1,0 },
+	{ 1,1,5,4,3,3,2,1,1,0 },
+	{ 1,1,1,3,3,2,2,1,0 },
+	{ 1,0,1,3,2,1,1,1 },
+	{ 1,0,1,3,2,1,1 },
+	{ 0,1,1,2,1,3 },
+	{ 0,1,1,1,1 },
+	{ 0,1,1,1 },
+	{ 0,1,1 },
+	{ 0,1 },
+};
+// 色差 DC (4:2:0) の total_zeros (Table 9-9).
+const uint8_t kChromaDcTotalZerosLen[3][4] = {
+	{ 1,2,3,3 },
+	{ 1,2,2 },
+	{ 1,1 },
+};
+const uint8_t kChromaDcTotalZerosCode[3][4] = {
+	{ 1,1,1,0 },
+	{ 1,1,0 },
+	{ 1,0 },
+};
+// run_before. [Min(zerosLeft, 7) - 1][run_before] (Table 9-10).
+const uint8_t kRunBeforeLen[7][16] = {
+	{ 1,1 },
+	{ 1,2,2 },
+	{ 2,2,2,2 },
+	{ 2,2,2,3,3 },
+	{ 2,2,3,3,3,3 },
+	{ 2,3,3,3,3,3,3 },
+	{ 3,3,3,3,3,3,3,4,5,6,7,8,9,10,11 },
+};
+const uint8_t kRunBeforeCode[7][16] = {
+	{ 1,0 },
+	{ 1,1,0 },
+	{ 3,2,1,0 },
+	{ 3,2,1,1,0 },
+	{ 3,2,3,2,1,0 },
+	{ 3,0,1,3,2,5,4 },
+	{ 7,6,5,4,3,2,1,1,1,1,1,1,1,1,1 },
+};
+
+// coded_block_pattern の me(v) の対応 (Table 9-4, ChromaArrayType 1).
+const uint8_t kIntraCbp[48] = {
+	47, 31, 15,  0, 23, 27, 29, 30,  7, 11, 13, 14, 39, 43, 45, 46,
+	16,  3,  5, 10, 12, 19, 21, 26, 28, 35, 37, 42, 44,  1,  2,  4,
+	 8, 17, 18, 20, 24,  6,  9, 22, 25, 32, 33, 34, 36, 40, 38, 41,
+};
+const uint8_t kInterCbp[48] = {
+	 0, 16,  1,  2,  4,  8, 32,  3,  5, 10, 12, 15, 47,  7, 11, 13,
+	14,  6,  9, 31, 35, 37, 42, 44, 33, 34, 36, 40, 39, 43, 45, 46,
+	17, 18, 20, 24, 19, 21, 26, 28, 23, 27, 29, 30, 22, 25, 38, 41,
+};
+
+// 4x4 ジグザグスキャン. スキャン順 -> ラスター位置.
+const uint8_t kZigzag4x4[16] = { 0, 1, 4, 8, 5, 2, 3, 6, 9, 12, 13, 10, 7, 11, 14, 15 };
+// 4x4 ブロックの復号順 <-> MB 内のラスター順. 互いに逆変換となる.
+const uint8_t kBlkToRaster[16] = { 0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15 };
+
+// 逆量子化の係数 (normAdjust4x4). [qP % 6][位置の種類].
+const int kDequantScale[6][3] = {
+	{ 10, 16, 13 },
+	{ 11, 18, 14 },
+	{ 13, 20, 16 },
+	{ 14, 23, 18 },
+	{ 16, 25, 20 },
+	{ 18, 29, 23 },
+};
+
+const uint8_t kChromaQp[52] = {
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 29, 30,
+	31, 32, 32, 33, 34, 34, 35, 35, 36, 36, 37, 37, 37, 38, 38, 38,
+	39, 39, 39, 39,
+};
+
+// デブロッキングの閾値 (Table 8-16, 8-17).
+const uint8_t kAlpha[52] = {
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	  4,  4,  5,  6,  7,  8,  9, 10, 12, 13, 15, 17, 20, 22, 25, 28,
+	 32, 36, 40, 45, 50, 56, 63, 71, 80, 90,101,113,127,144,162,182,
+	203,226,255,255,
+};
+const uint8_t kBeta[52] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 2,  2,  2,  3,  3,  3,  3,  4,  4,  4,  6,  6,  7,  7,  8,  8,
+	 9,  9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16,
+	17, 17, 18, 18,
+};
+const uint8_t kTc0[52][3] = {
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 1 }, { 0, 0, 1 }, { 0, 0, 1 }, { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 1 }, { 1, 1, 1 },
+	{ 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 2 }, { 1, 1, 2 }, { 1, 1, 2 }, { 1, 1, 2 }, { 1, 2, 3 },
+	{ 1, 2, 3 }, { 2, 2, 3 }, { 2, 2, 4 }, { 2, 3, 4 }, { 2, 3, 4 }, { 3, 3, 5 }, { 3, 4, 6 }, { 3, 4, 6 },
+	{ 4, 5, 7 }, { 4, 5, 8 }, { 4, 6, 9 }, { 5, 7,10 }, { 6, 8,11 }, { 6, 8,13 }, { 7,10,14 }, { 8,11,16 },
+	{ 9,12,18 }, {10,13,20 }, {11,15,23 }, {13,17,25 },
+};
+
+// 先頭 bits ビットで引く VLC の表. 値は (シンボル << 5) | 符号長、0 は不正な符号.
+struct VlcTable
+{
+	int bits = 0;
+	std::vector<uint16_t> lut;
+
+	void Build(const uint8_t* lens, const uint8_t* codes, int count)
+	{
+		bits = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			bits = std::max(bits, int(lens[i]));
+		}
+		lut.assign(size_t(1) << bits, 0);
+		for (int symbol = 0; symbol < count; ++symbol)
+		{
+			const int len = lens[symbol];
+			if (len == 0)
+			{
+				continue;
+			}
+			const uint32_t first = uint32_t(codes[symbol]) << (bits - len);
+			const uint32_t n = 1u << (bits - len);
+			for (uint32_t i = 0; i < n; ++i)
+			{
+				lut[first + i] = uint16_t((symbol << 5) | len);
+			}
+		}
+	}
+};
+
+struct Tables
+{
+	VlcTable coeffToken[4];
+	VlcTable chromaDcCoeffToken;
+	VlcTable totalZeros[15];
+	VlcTable chromaDcTotalZeros[3];
+	VlcTable runBefore[7];
+	int32_t dequant[52][16];	// 位置ごとの逆量子化係数 (スケーリング行列はフラット).
+
+	Tables()
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			coeffToken[i].Build(kCoeffTokenLen[i], kCoeffTokenCode[i], 4 * 17);
+		}
+		chromaDcCoeffToken.Build(kChromaDcCoeffTokenLen, kChromaDcCoeffTokenCode, 4 * 5);
+		for (int i = 0; i < 15; ++i)
+		{
+			totalZeros[i].Build(kTotalZerosLen[i], kTotalZerosCode[i], 16);
+		}
+		for (int i = 0; i < 3; ++i)
+		{
+			chromaDcTotalZeros[i].Build(kChromaDcTotalZerosLen[i], kChromaDcTotalZerosCode[i], 4);
+		}
+		for (int i = 0; i < 7; ++i)
+		{
+			runBefore[i].Build(kRunBeforeLen[i], kRunBeforeCode[i], 16);
+		}
+		for (int qp = 0; qp < 52; ++qp)
+		{
+			for (int pos = 0; pos < 16; ++pos)
+			{
+				const int x = pos & 3;
+				const int y = pos >> 2;
+				const int kind = ((x & 1) == 0 && (y & 1) == 0) ? 0 : (((x & 1) == 1 && (y & 1) == 1) ? 1 : 2);
+				dequant[qp][pos] = kDequantScale[qp % 6][kind] << (qp / 6);
+			}
+		}
+	}
+};
+
+const Tables& GetTables()
+{
+	static const Tables tables;
+	return tables;
+}
+
+// RBSP を読むビットリーダー. バッファの末尾には 8 バイト以上の 0 を置いておく.
+class BitReader
+{
+public:
+	void Init(const uint8_t* data, size_t size, size_t bitPosition, size_t stopBit)
+	{
+		m_data = data;
+		m_size = size;
+		m_position = bitPosition;
+		m_stopBit = stopBit;
+	}
+	uint32_t Peek(int n) const
+	{
+		const size_t byte = m_position >> 3;
+		if (n == 0 || byte >= m_size)
+		{
+			return 0;
+		}
+		uint64_t v = 0;
+		for (int i = 0; i < 8; ++i)
+		{
+			v = (v << 8) | m_data[byte + i];
+		}
+		v <<= (m_position & 7);
+		return uint32_t(v >> (64 - n));
+	}
+	void Skip(int n) { m_position += n; }
+	uint32_t U(int n)
+	{
+		const uint32_t v = Peek(n);
+		Skip(n);
+		return v;
+	}
+	uint32_t U1() { return U(1); }
+	uint32_t Ue()
+	{
+		const uint32_t v = Peek(32);
+		if (v == 0)
+		{
+			m_error = true;
+			Skip(32);
+			return 0;
+		}
+		const int zeros = std::countl_zero(v);
+		Skip(zeros + 1);
+		return ((1u << zeros) - 1) + U(zeros);
+	}
+	int32_t Se()
+	{
+		const uint32_t v = Ue();
+		return (v & 1) ? int32_t((v + 1) >> 1) : -int32_t(v >> 1);
+	}
+	// 連続する 0 の数を読み、続く 1 を読み飛ばす.
+	int LeadingZeros()
+	{
+		const uint32_t v = Peek(32);
+		if (v == 0)
+		{
+			m_error = true;
+			Skip(32);
+			return 32;
+		}
+		const int zeros = std::countl_zero(v);
+		Skip(zeros + 1);
+		return zeros;
+	}
+	void AlignByte() { m_position = (m_position + 7) & ~size_t(7); }
+	bool MoreRbspData() const { return m_position < m_stopBit; }
+	bool HasError() const { return m_error || m_position > m_stopBit + 1; }
+
+	int ReadVlc(const VlcTable& table)
+	{
+		const uint16_t entry = table.lut[Peek(table.bits)];
+		if (entry == 0)
+		{
+			m_error = true;
+			return -1;
+		}
+		Skip(entry & 31);
+		return entry >> 5;
+	}
+
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+	size_t m_position = 0;
+	size_t m_stopBit = 0;
+	bool m_error = false;
+};
+
+// ---------------------------------------------------------------------------
+// 画素処理. 8 画素単位で処理できる部分は SSE2 を使う.
+
+inline int Tap6(const uint8_t* p, ptrdiff_t step)
+{
+	return p[-2 * step] - 5 * p[-step] + 20 * p[0] + 20 * p[step] - 5 * p[2 * step] + p[3 * step];
+}
+
+#if SOFTWARE_H264_USE_SSE2
+inline __m128i Load8(const uint8_t* p)
+{
+	return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+inline __m128i Tap6x8(__m128i a, __m128i b, __m128i c, __m128i d, __m128i e, __m128i f)
+{
+	__m128i sum = _mm_add_epi16(a, f);
+	sum = _mm_sub_epi16(sum, _mm_mullo_epi16(_mm_add_epi16(b, e), _mm_set1_epi16(5)));
+	sum = _mm_add_epi16(sum, _mm_mullo_epi16(_mm_add_epi16(c, d), _mm_set1_epi16(20)));
+	return _mm_srai_epi16(_mm_add_epi16(sum, _mm_set1_epi16(16)), 5);
+}
+#endif
+
+// 横方向の半画素 (b).
+void FilterHalfH(const uint8_t* src, ptrdiff_t srcStride, uint8_t* dst, ptrdiff_t dstStride, int w, int h)
+{
+	for (int y = 0; y < h; ++y, src += srcStride, dst += dstStride)
+	{
+		int x = 0;
+#if SOFTWARE_H264_USE_SSE2
+		for (; x + 8 <= w; x += 8)
+		{
+			const uint8_t* s = src + x;
+			__m128i v = Tap6x8(Load8(s - 2), Load8(s - 1), Load8(s), Load8(s + 1), Load8(s + 2), Load8(s + 3));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(v, v));
+		}
+#endif
+		for (; x < w; ++x)
+		{
+			dst[x] = Clip1((Tap6(src + x, 1) + 16) >> 5);
+		}
+	}
+}
+
+// 縦方向の半画素 (h).
+void FilterHalfV(const uint8_t* src, ptrdiff_t srcStride, uint8_t* dst, ptrdiff_t dstStride, int w, int h)
+{
+	for (int y = 0; y < h; ++y, src += srcStride, dst += dstStride)
+	{
+		int x = 0;
+#if SOFTWARE_H264_USE_SSE2
+		for (; x + 8 <= w; x += 8)
+		{
+			const uint8_t* s = src + x;
+			__m128i v = Tap6x8(
+				Load8(s - 2 * srcStride), Load8(s - srcStride), Load8(s),
+				Load8(s + srcStride), Load8(s + 2 * srcStride), Load8(s + 3 * srcStride));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(v, v));
+		}
+#endif
+		for (; x < w; ++x)
+		{
+			dst[x] = Clip1((Tap6(src + x, srcStride) + 16) >> 5);
+		}
+	}
+}
+
+// 中央の半画素 (j). 横方向の中間値を丸めずに縦方向へ通す.
+void FilterHalfHV(const uint8_t* src, ptrdiff_t srcStride, uint8_t* dst, ptrdiff_t dstStride, int w, int h)
+{
+	int16_t tmp[21 * 16];
+	const uint8_t* s = src - 2 * srcStride;
+	for (int y = 0; y < h + 5; ++y, s += srcStride)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			tmp[y * 16 + x] = int16_t(Tap6(s + x, 1));
+		}
+	}
+	for (int y = 0; y < h; ++y, dst += dstStride)
+	{
+		const int16_t* t = tmp + y * 16;
+		for (int x = 0; x < w; ++x)
+		{
+			const int v = t[x] - 5 * t[16 + x] + 20 * t[32 + x] + 20 * t[48 + x] - 5 * t[64 + x] + t[80 + x];
+			dst[x] = Clip1((v + 512) >> 10);
+		}
+	}
+}
+
+void Average(const uint8_t* a, ptrdiff_t aStride, const uint8_t* b, ptrdiff_t bStride, uint8_t* dst, ptrdiff_t dstStride, int w, int h)
+{
+	for (int y = 0; y < h; ++y, a += aStride, b += bStride, dst += dstStride)
+	{
+		int x = 0;
+#if SOFTWARE_H264_USE_SSE2
+		for (; x + 8 <= w; x += 8)
+		{
+			__m128i va = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + x));
+			__m128i vb = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + x));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_avg_epu8(va, vb));
+		}
+#endif
+		for (; x < w; ++x)
+		{
+			dst[x] = uint8_t((a[x] + b[x] + 1) >> 1);
+		}
+	}
+}
+
+// 4x4 逆変換の結果を予測画像へ加算する. d はラスター順の逆量子化済み係数.
+void Idct4x4Add(const int32_t* d, uint8_t* dst, ptrdiff_t stride)
+{
+#if SOFTWARE_H264_USE_SSE2
+	auto transpose = [](__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3) {
+		__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+		__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+		__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+		__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+		r0 = _mm_unpacklo_epi64(t0, t1);
+		r1 = _mm_unpackhi_epi64(t0, t1);
+		r2 = _mm_unpacklo_epi64(t2, t3);
+		r3 = _mm_unpackhi_epi64(t2, t3);
+	};
+	auto butterfly = [](__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3) {
+		__m128i e0 = _mm_add_epi32(r0, r2);
+		__m128i e1 = _mm_sub_epi32(r0, r2);
+		__m128i e2 = _mm_sub_epi32(_mm_srai_epi32(r1, 1), r3);
+		__m128i e3 = _mm_add_epi32(r1, _mm_srai_epi32(r3, 1));
+		r0 = _mm_add_epi32(e0, e3);
+		r1 = _mm_add_epi32(e1, e2);
+		r2 = _mm_sub_epi32(e1, e2);
+		r3 = _mm_sub_epi32(e0, e3);
+	};
+	__m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + 0));
+	__m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + 4));
+	__m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + 8));
+	__m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + 12));
+	// 各行の変換 (列を束ねて処理) の後、各列の変換.
+	transpose(r0, r1, r2, r3);
+	butterfly(r0, r1, r2, r3);
+	transpose(r0, r1, r2, r3);
+	butterfly(r0, r1, r2, r3);
+
+	const __m128i round = _mm_set1_epi32(32);
+	__m128i res01 = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(r0, round), 6), _mm_srai_epi32(_mm_add_epi32(r1, round), 6));
+	__m128i res23 = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(r2, round), 6), _mm_srai_epi32(_mm_add_epi32(r3, round), 6));
+	auto load4 = [](const uint8_t* p) { int v; memcpy(&v, p, 4); return _mm_cvtsi32_si128(v); };
+	__m128i zero = _mm_setzero_si128();
+	__m128i p01 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(load4(dst), load4(dst + stride)), zero);
+	__m128i p23 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(load4(dst + 2 * stride), load4(dst + 3 * stride)), zero);
+	__m128i out = _mm_packus_epi16(_mm_add_epi16(p01, res01), _mm_add_epi16(p23, res23));
+	for (int y = 0; y < 4; ++y)
+	{
+		int v = _mm_cvtsi128_si32(out);
+		memcpy(dst + y * stride, &v, 4);
+		out = _mm_srli_si128(out, 4);
+	}
+#else
+	int32_t f[16];
+	for (int i = 0; i < 4; ++i)
+	{
+		const int32_t* r = d + i * 4;
+		const int32_t e0 = r[0] + r[2];
+		const int32_t e1 = r[0] - r[2];
+		const int32_t e2 = (r[1] >> 1) - r[3];
+		const int32_t e3 = r[1] + (r[3] >> 1);
+		f[i * 4 + 0] = e0 + e3;
+		f[i * 4 + 1] = e1 + e2;
+		f[i * 4 + 2] = e1 - e2;
+		f[i * 4 + 3] = e0 - e3;
+	}
+	for (int j = 0; j < 4; ++j)
+	{
+		const int32_t g0 = f[j] + f[8 + j];
+		const int32_t g1 = f[j] - f[8 + j];
+		const int32_t g2 = (f[4 + j] >> 1) - f[12 + j];
+		const int32_t g3 = f[4 + j] + (f[12 + j] >> 1);
+		dst[0 * stride + j] = Clip1(dst[0 * stride + j] + ((g0 + g3 + 32) >> 6));
+		dst[1 * stride + j] = Clip1(dst[1 * stride + j] + ((g1 + g2 + 32) >> 6));
+		dst[2 * stride + j] = Clip1(dst[2 * stride + j] + ((g1 - g2 + 32) >> 6));
+		dst[3 * stride + j] = Clip1(dst[3 * stride + j] + ((g0 - g3 + 32) >> 6));
+	}
+#endif
+}
+
+// 輝度の動き補償. (x, y) は整数画素位置、frac は 1/4 画素単位の端数.
+void McLuma(const uint8_t* plane, int planeStride, int planeWidth, int planeHeight,
+	int x, int y, int fracX, int fracY, int w, int h, uint8_t* dst, ptrdiff_t dstStride)
+{
+	// 参照範囲 (-2 .. +3) が画像外にかかる場合は、端を複製した領域から補間する.
+	uint8_t edge[24 * 21];
+	const uint8_t* src = nullptr;
+	ptrdiff_t srcStride = planeStride;
+	if (x - 2 < 0 || y - 2 < 0 || x + w + 3 > planeWidth || y + h + 3 > planeHeight)
+	{
+		for (int yy = 0; yy < h + 5; ++yy)
+		{
+			const uint8_t* row = plane + Clip3(0, planeHeight - 1, y - 2 + yy) * planeStride;
+			for (int xx = 0; xx < w + 5; ++xx)
+			{
+				edge[yy * 24 + xx] = row[Clip3(0, planeWidth - 1, x - 2 + xx)];
+			}
+		}
+		src = edge + 2 * 24 + 2;
+		srcStride = 24;
+	}
+	else
+	{
+		src = plane + y * planeStride + x;
+	}
+
+	uint8_t a[16 * 16];
+	uint8_t b[16 * 16];
+	switch (fracY * 4 + fracX)
+	{
+	case 0:
+		for (int yy = 0; yy < h; ++yy)
+		{
+			memcpy(dst + yy * dstStride, src + yy * srcStride, w);
+		}
+		break;
+	case 1:		// a
+	case 3:		// c
+		FilterHalfH(src, srcStride, a, 16, w, h);
+		Average(a, 16, src + (fracX >> 1), srcStride, dst, dstStride, w, h);
+		break;
+	case 2:		// b
+		FilterHalfH(src, srcStride, dst, dstStride, w, h);
+		break;
+	case 4:		// d
+	case 12:	// n
+		FilterHalfV(src, srcStride, a, 16, w, h);
+		Average(a, 16, src + (fracY >> 1) * srcStride, srcStride, dst, dstStride, w, h);
+		break;
+	case 8:		// h
+		FilterHalfV(src, srcStride, dst, dstStride, w, h);
+		break;
+	case 5:		// e
+	case 7:		// g
+	case 13:	// p
+	case 15:	// r
+		FilterHalfH(src + (fracY >> 1) * srcStride, srcStride, a, 16, w, h);
+		FilterHalfV(src + (fracX >> 1), srcStride, b, 16, w, h);
+		Average(a, 16, b, 16, dst, dstStride, w, h);
+		break;
+	case 10:	// j
+		FilterHalfHV(src, srcStride, dst, dstStride, w, h);
+		break;
+	case 6:		// f
+	case 14:	// q
+		FilterHalfHV(src, srcStride, a, 16, w, h);
+		FilterHalfH(src + (fracY >> 1) * srcStride, srcStride, b, 16, w, h);
+		Average(a, 16, b, 16, dst, dstStride, w, h);
+		break;
+	case 9:		// i
+	case 11:	// k
+		FilterHalfHV(src, srcStride, a, 16, w, h);
+		FilterHalfV(src + (fracX >> 1), srcStride, b, 16, w, h);
+		Average(a, 16, b, 16, dst, dstStride, w, h);
+		break;
+	}
+}
+
+// 色差の動き補償. 1/8 画素単位の双線形補間.
+void McChroma(const uint8_t* plane, int planeStride, int planeWidth, int planeHeight,
+	int x, int y, int fracX, int fracY, int w, int h, uint8_t* dst, ptrdiff_t dstStride)
+{
+	const int wA = (8 - fracX) * (8 - fracY);
+	const int wB = fracX * (8 - fracY);
+	const int wC = (8 - fracX) * fracY;
+	const int wD = fracX * fracY;
+	if (x < 0 || y < 0 || x + w + 1 > planeWidth || y + h + 1 > planeHeight)
+	{
+		for (int yy = 0; yy < h; ++yy)
+		{
+			const uint8_t* row0 = plane + Clip3(0, planeHeight - 1, y + yy) * planeStride;
+			const uint8_t* row1 = plane + Clip3(0, planeHeight - 1, y + yy + 1) * planeStride;
+			for (int xx = 0; xx < w; ++xx)
+			{
+				const int x0 = Clip3(0, planeWidth - 1, x + xx);
+				const int x1 = Clip3(0, planeWidth - 1, x + xx + 1);
+				dst[yy * dstStride + xx] = uint8_t((wA * row0[x0] + wB * row0[x1] + wC * row1[x0] + wD * row1[x1] + 32) >> 6);
+			}
+		}
+		return;
+	}
+	const uint8_t* src = plane + y * planeStride + x;
+	for (int yy = 0; yy < h; ++yy, src += planeStride, dst += dstStride)
+	{
+		for (int xx = 0; xx < w; ++xx)
+		{
+			dst[xx] = uint8_t((wA * src[xx] + wB * src[xx + 1] + wC * src[planeStride + xx] + wD * src[planeStride + xx + 1] + 32) >> 6);
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+// イントラ予測. 利用できない隣接画素は 128 として扱う.
+
+struct IntraEdge
+{
+	uint8_t top[17] = { };		// top[0] が左上、top[1 + x] が上の画素.
+	uint8_t left[17] = { };		// left[0] が左上、left[1 + y] が左の画素.
+	int T(int x) const { return top[1 + x]; }
+	int L(int y) const { return left[1 + y]; }
+};
+
+void PredictIntra4x4(uint8_t* dst, ptrdiff_t stride, int mode, const IntraEdge& e, bool hasTop, bool hasLeft)
+{
+	auto set = [&](int x, int y, int v) { dst[y * stride + x] = uint8_t(v); };
+	switch (mode)
+	{
+	case 0:	// Vertical
+		for (int y = 0; y < 4; ++y) for (int x = 0; x < 4; ++x) set(x, y, e.T(x));
+		break;
+	case 1:	// Horizontal
+		for (int y = 0; y < 4; ++y) for (int x = 0; x < 4; ++x) set(x, y, e.L(y));
+		break;
+	case 2:	// DC
+	{
+		int dc = 128;
+		if (hasTop && hasLeft)
+		{
+			dc = (e.T(0) + e.T(1) + e.T(2) + e.T(3) + e.L(0) + e.L(1) + e.L(2) + e.L(3) + 4) >> 3;
+		}
+		else if (hasLeft)
+		{
+			dc = (e.L(0) + e.L(1) + e.L(2) + e.L(3) + 2) >> 2;
+		}
+		else if (hasTop)
+		{
+			dc = (e.T(0) + e.T(1) + e.T(2) + e.T(3) + 2) >> 2;
+		}
+		for (int y = 0; y < 4; ++y) for (int x = 0; x < 4; ++x) set(x, y, dc);
+		break;
+	}
+	case 3:	// Diagonal Down Left
+		for (int y = 0; y < 4; ++y)
+		{
+			for (int x = 0; x < 4; ++x)
+			{
+				set(x, y, (x == 3 && y == 3)
+					? (e.T(6) + 3 * e.T(7) + 2) >> 2
+					: (e.T(x + y) + 2 * e.T(x + y + 1) + e.T(x + y + 2) + 2) >> 2);
+			}
+		}
+		break;
+	case 4:	// Diagonal Down Right
+		for (int y = 0; y < 4; ++y)
+		{
+			for (int x = 0; x < 4; ++x)
+			{
+				if (x > y)
+				{
+					set(x, y, (e.T(x - y - 2) + 2 * e.T(x - y - 1) + e.T(x - y) + 2) >> 2);
+				}
+				else if (x < y)
+				{
+					set(x, y, (e.L(y - x - 2) + 2 * e.L(y - x - 1) + e.L(y - x) + 2) >> 2);
+				}
+				else
+				{
+					set(x, y, (e.T(0) + 2 * e.T(-1) + e.L(0) + 2) >> 2);
+				}
+			}
+		}
+		break;
+	case 5:	// Vertical Right
+		for (int y = 0; y < 4; ++y)
+		{
+			for (int x = 0; x < 4; ++x)
+			{
+				const int z = 2 * x - y;
+				const int i = x - (y >> 1);
+				if (z >= 0 && (z & 1) == 0)
+				{
+					set(x, y, (e.T(i - 1) + e.T(i) + 1) >> 1);
+				}
+				else if (z >= 0)
+				{
+					set(x, y, (e.T(i - 2) + 2 * e.T(i - 1) + e.T(i) + 2) >> 2);
+				}
+				else if (z == -1)
+				{
+					set(x, y, (e.L(0) + 2 * e.L(-1) + e.T(0) + 2) >> 2);
+				}
+				else
+				{
+					set(x, y, (e.L(y - 1) + 2 * e.L(y - 2) + e.L(y - 3) + 2) >> 2);
+				}
+			}
+		}
+		break;
+	case 6:	// Horizontal Down
+		for (int y = 0; y < 4; ++y)
+		{
+			for (int x = 0; x < 4; ++x)
+			{
+				const int z = 2 * y - x;
+				const int i = y - (x >> 1);
+				if (z >= 0 && (z & 1) == 0)
+				{
+					set(x, y, (e.L(i - 1) + e.L(i) + 1) >> 1);
+				}
+				else if (z >= 0)
+				{
+					set(x, y, (e.L(i - 2) + 2 * e.L(i - 1) + e.L(i) + 2) >> 2);
+				}
+				else if (z == -1)
+				{
+					set(x, y, (e.L(0) + 2 * e.L(-1) + e.T(0) + 2) >> 2);
+				}
+				else
+				{
+					set(x, y, (e.T(x - 1) + 2 * e.T(x - 2) + e.T(x - 3) + 2) >> 2);
+				}
+			}
+		}
+		break;
+	case 7:	// Vertical Left
+		for (int y = 0; y < 4; ++y)
+		{
+			for (int x = 0; x < 4; ++x)
+			{
+				const int i = x + (y >> 1);
+				set(x, y, (y & 1) == 0
+					? (e.T(i) + e.T(i + 1) + 1) >> 1
+					: (e.T(i) + 2 * e.T(i + 1) + e.T(i + 2) + 2) >> 2);
+			}
+		}
+		break;
+	case 8:	// Horizontal Up
+		for (int y = 0; y < 4; ++y)
+		{
+			for (int x = 0; x < 4; ++x)
+			{
+				const int z = x + 2 * y;
+				const int i = y + (x >> 1);
+				if (z > 5)
+				{
+					set(x, y, e.L(3));
+				}
+				else if (z == 5)
+				{
+					set(x, y, (e.L(2) + 3 * e.L(3) + 2) >> 2);
+				}
+				else if ((z & 1) == 0)
+				{
+					set(x, y, (e.L(i) + e.L(i + 1) + 1) >> 1);
+				}
+				else
+				{
+					set(x, y, (e.L(i) + 2 * e.L(i + 1) + e.L(i + 2) + 2) >> 2);
+				}
+			}
+		}
+		break;
+	}
+}
+
+// 16x16 の輝度 (size 16) と 8x8 の色差 (size 8) の予測. mode は輝度の番号 (0:V 1:H 2:DC 3:Plane).
+void PredictIntraBlock(uint8_t* dst, ptrdiff_t stride, int size, int mode, const IntraEdge& e, bool hasTop, bool hasLeft)
+{
+	switch (mode)
+	{
+	case 0:
+		for (int y = 0; y < size; ++y) for (int x = 0; x < size; ++x) dst[y * stride + x] = uint8_t(e.T(x));
+		break;
+	case 1:
+		for (int y = 0; y < size; ++y) for (int x = 0; x < size; ++x) dst[y * stride + x] = uint8_t(e.L(y));
+		break;
+	case 2:
+		if (size == 16)
+		{
+			int sumTop = 0;
+			int sumLeft = 0;
+			for (int i = 0; i < 16; ++i)
+			{
+				sumTop += e.T(i);
+				sumLeft += e.L(i);
+			}
+			int dc = 128;
+			if (hasTop && hasLeft)
+			{
+				dc = (sumTop + sumLeft + 16) >> 5;
+			}
+			else if (hasLeft)
+			{
+				dc = (sumLeft + 8) >> 4;
+			}
+			else if (hasTop)
+			{
+				dc = (sumTop + 8) >> 4;
+			}
+			for (int y = 0; y < 16; ++y) memset(dst + y * stride, dc, 16);
+		}
+		else
+		{
+			// 色差は 4x4 ブロックごとに、位置によって優先する隣接画素が異なる.
+			for (int blk = 0; blk < 4; ++blk)
+			{
+				const int xO = (blk & 1) * 4;
+				const int yO = (blk >> 1) * 4;
+				int sumTop = 0;
+				int sumLeft = 0;
+				for (int i = 0; i < 4; ++i)
+				{
+					sumTop += e.T(xO + i);
+					sumLeft += e.L(yO + i);
+				}
+				int dc = 128;
+				if (blk == 1)
+				{
+					dc = hasTop ? (sumTop + 2) >> 2 : (hasLeft ? (sumLeft + 2) >> 2 : 128);
+				}
+				else if (blk == 2)
+				{
+					dc = hasLeft ? (sumLeft + 2) >> 2 : (hasTop ? (sumTop + 2) >> 2 : 128);
+				}
+				else if (hasTop && hasLeft)
+				{
+					dc = (sumTop + sumLeft + 4) >> 3;
+				}
+				else if (hasLeft)
+				{
+					dc = (sumLeft + 2) >> 2;
+				}
+				else if (hasTop)
+				{
+					dc = (sumTop + 2) >> 2;
+				}
+				for (int y = 0; y < 4; ++y) memset(dst + (yO + y) * stride + xO, dc, 4);
+			}
+		}
+		break;
+	case 3:
+	{
+		const int half = size / 2;
+		int H = 0;
+		int V = 0;
+		for (int i = 0; i < half; ++i)
+		{
+			H += (i + 1) * (e.T(half + i) - e.T(half - 2 - i));
+			V += (i + 1) * (e.L(half + i) - e.L(half - 2 - i));
+		}
+		const int a = 16 * (e.L(size - 1) + e.T(size - 1));
+		const int b = size == 16 ? (5 * H + 32) >> 6 : (34 * H + 32) >> 6;
+		const int c = size == 16 ? (5 * V + 32) >> 6 : (34 * V + 32) >> 6;
+		for (int y = 0; y < size; ++y)
+		{
+			for (int x = 0; x < size; ++x)
+			{
+				dst[y * stride + x] = Clip1((a + b * (x - half + 1) + c * (y - half + 1) + 16) >> 5);
+			}
+		}
+		break;
+	}
+	}
+}
+
+inline bool IsIntraType(uint8_t type)
+{
+	return type <= 2;	// eI4x4, eI16x16, eIPCM.
+}
+
+inline int Blk8(int raster)
+{
+	return ((raster >> 3) << 1) | ((raster & 3) >> 1);
+}
+
+}
+
+// ---------------------------------------------------------------------------
+
+struct SoftwareH264Decoder::Slice
+{
+	std::vector<uint8_t> rbsp;
+	size_t dataBitOffset = 0;
+	size_t stopBit = 0;
+	h264::NALHeader nal = {};
+	h264::SliceHeader header = {};
+	const h264::SPS* sps = nullptr;
+	const h264::PPS* pps = nullptr;
+	int16_t index = 0;
+	uint32_t firstMb = 0;
+	uint32_t endMb = 0;
+	bool isIntra = true;
+	int qp = 26;
+	int chromaQpOffset = 0;
+	bool constrainedIntraPred = false;
+	int numRefIdxActive = 0;
+	int refSlot[32] = { };		// RefPicList0. 該当する参照がなければ -1.
+	int filterOffsetA = 0;
+	int filterOffsetB = 0;
+	int disableDeblocking = 0;
+	bool error = false;
+};
+
+// 1スライス分の MB を復号する. スライス間で共有する情報は書き込まない.
+class SoftwareH264Decoder::SliceDecoder
+{
+public:
+	SliceDecoder(SoftwareH264Decoder& owner, Slice& slice)
+		: m_owner(owner)
+		, m_slice(slice)
+		, m_picture(owner.m_pictures[owner.m_targetSlot])
+		, m_tables(GetTables())
+	{
+		m_bits.Init(slice.rbsp.data(), slice.rbsp.size(), slice.dataBitOffset, slice.stopBit);
+		m_widthInMbs = int(owner.m_widthInMbs);
+		m_heightInMbs = int(owner.m_heightInMbs);
+	}
+
+	void Decode()
+	{
+		m_qp = m_slice.qp;
+		uint32_t mbAddr = m_slice.firstMb;
+		bool ok = true;
+		while (true)
+		{
+			if (!m_slice.isIntra)
+			{
+				const uint32_t skipRun = m_bits.Ue();
+				if (m_bits.HasError() || skipRun > m_slice.endMb - mbAddr)
+				{
+					ok = false;
+					break;
+				}
+				for (uint32_t i = 0; i < skipRun; ++i)
+				{
+					BeginMacroblock(mbAddr++);
+					if (!DecodeSkip())
+					{
+						ok = false;
+						break;
+					}
+					m_mb->decoded = true;
+				}
+				if (!ok || (skipRun > 0 && !m_bits.MoreRbspData()))
+				{
+					break;
+				}
+			}
+			if (mbAddr >= m_slice.endMb)
+			{
+				ok = false;
+				break;
+			}
+			BeginMacroblock(mbAddr++);
+			if (!DecodeMacroblock() || m_bits.HasError())
+			{
+				ok = false;
+				break;
+			}
+			m_mb->decoded = true;
+			if (!m_bits.MoreRbspData())
+			{
+				break;
+			}
+		}
+		m_slice.error = !ok;
+	}
+
+private:
+	struct Neighbor
+	{
+		bool available = false;
+		int refIdx = -1;
+		int mv[2] = { 0, 0 };
+	};
+	enum class Shape
+	{
+		eDefault,
+		e16x8,
+		e8x16,
+	};
+	struct Partition
+	{
+		int x, y, w, h;
+	};
+
+	int MbAddrIfAvailable(int mbx, int mby) const
+	{
+		if (mbx < 0 || mby < 0 || mbx >= m_widthInMbs)
+		{
+			return -1;
+		}
+		const int addr = mby * m_widthInMbs + mbx;
+		return m_owner.m_mbSlice[addr] == m_slice.index ? addr : -1;
+	}
+	bool IsIntraAvailable(int addr) const
+	{
+		return addr >= 0 && (!m_slice.constrainedIntraPred || IsIntraType(m_owner.m_mbs[addr].type));
+	}
+
+	void BeginMacroblock(uint32_t mbAddr)
+	{
+		m_mbx = int(mbAddr) % m_widthInMbs;
+		m_mby = int(mbAddr) / m_widthInMbs;
+		m_mbA = MbAddrIfAvailable(m_mbx - 1, m_mby);
+		m_mbB = MbAddrIfAvailable(m_mbx, m_mby - 1);
+		m_mbC = MbAddrIfAvailable(m_mbx + 1, m_mby - 1);
+		m_mbD = MbAddrIfAvailable(m_mbx - 1, m_mby - 1);
+		m_mb = &m_owner.m_mbs[mbAddr];
+		*m_mb = MbInfo{};
+		m_mb->slice = m_slice.index;
+		m_doneMask = 0;
+	}
+
+	uint8_t* LumaAt(int x, int y) const
+	{
+		return m_picture.plane[0].data() + (m_mby * 16 + y) * m_picture.stride[0] + m_mbx * 16 + x;
+	}
+	uint8_t* ChromaAt(int c, int x, int y) const
+	{
+		return m_picture.plane[1 + c].data() + (m_mby * 8 + y) * m_picture.stride[1 + c] + m_mbx * 8 + x;
+	}
+
+	bool ReadQpDelta()
+	{
+		const int delta = m_bits.Se();
+		if (delta < -26 || delta > 25)
+		{
+			return false;
+		}
+		m_qp = (m_qp + delta + 52) % 52;
+		return true;
+	}
+	int ChromaQp(int qp) const
+	{
+		return kChromaQp[Clip3(0, 51, qp + m_slice.chromaQpOffset)];
+	}
+
+	bool DecodeMacroblock()
+	{
+		uint32_t mbType = m_bits.Ue();
+		if (!m_slice.isIntra)
+		{
+			if (mbType < 5)
+			{
+				return DecodeInter(mbType);
+			}
+			mbType -= 5;
+		}
+		if (mbType > 25)
+		{
+			return false;
+		}
+		for (int i = 0; i < 4; ++i)
+		{
+			m_mb->refIdx[i] = -1;
+			m_mb->refSlot[i] = -1;
+		}
+		if (mbType == 25)
+		{
+			return DecodePcm();
+		}
+		return DecodeIntra(mbType);
+	}
+
+	bool DecodePcm()
+	{
+		m_mb->type = eIPCM;
+		m_mb->qp = 0;	// デブロッキングでは QP 0 として扱う.
+		memset(m_mb->totalCoeff, 16, sizeof(m_mb->totalCoeff));
+		m_bits.AlignByte();
+		for (int y = 0; y < 16; ++y)
+		{
+			uint8_t* dst = LumaAt(0, y);
+			for (int x = 0; x < 16; ++x)
+			{
+				dst[x] = uint8_t(m_bits.U(8));
+			}
+		}
+		for (int c = 0; c < 2; ++c)
+		{
+			for (int y = 0; y < 8; ++y)
+			{
+				uint8_t* dst = ChromaAt(c, 0, y);
+				for (int x = 0; x < 8; ++x)
+				{
+					dst[x] = uint8_t(m_bits.U(8));
+				}
+			}
+		}
+		return true;
+	}
+
+	bool DecodeIntra(uint32_t mbType)
+	{
+		const bool isI16x16 = mbType != 0;
+		int predMode16x16 = 0;
+		int cbpLuma = 0;
+		int cbpChroma = 0;
+		if (isI16x16)
+		{
+			m_mb->type = eI16x16;
+			predMode16x16 = int(mbType - 1) % 4;
+			cbpChroma = (int(mbType - 1) / 4) % 3;
+			cbpLuma = mbType >= 13 ? 15 : 0;
+		}
+		else
+		{
+			m_mb->type = eI4x4;
+			ReadIntra4x4PredModes();
+		}
+		const uint32_t chromaPredMode = m_bits.Ue();
+		if (chromaPredMode > 3)
+		{
+			return false;
+		}
+		if (!isI16x16)
+		{
+			const uint32_t code = m_bits.Ue();
+			if (code > 47)
+			{
+				return false;
+			}
+			cbpLuma = kIntraCbp[code] & 15;
+			cbpChroma = kIntraCbp[code] >> 4;
+		}
+		if ((cbpLuma || cbpChroma || isI16x16) && !ReadQpDelta())
+		{
+			return false;
+		}
+		m_mb->qp = int8_t(m_qp);
+		if (!ParseResidual(isI16x16, cbpLuma, cbpChroma))
+		{
+			return false;
+		}
+
+		if (isI16x16)
+		{
+			ReconstructIntra16x16(predMode16x16);
+		}
+		else
+		{
+			ReconstructIntra4x4();
+		}
+		ReconstructIntraChroma(int(chromaPredMode));
+		return true;
+	}
+
+	void ReadIntra4x4PredModes()
+	{
+		for (int blk = 0; blk < 16; ++blk)
+		{
+			const int r = kBlkToRaster[blk];
+			const int bx = r & 3;
+			const int by = r >> 2;
+			const bool usePredicted = m_bits.U1() != 0;
+			const int remMode = usePredicted ? 0 : int(m_bits.U(3));
+
+			// 隣接ブロックのモードから予測する. MB の外側は種類と利用可否に従う.
+			bool dcPredicted = false;
+			auto neighborMode = [&](int inner, int mbAddr, int outer) {
+				if (inner >= 0)
+				{
+					return int(m_mb->intraPredMode[inner]);
+				}
+				if (mbAddr < 0 || (m_slice.constrainedIntraPred && !IsIntraType(m_owner.m_mbs[mbAddr].type)))
+				{
+					dcPredicted = true;
+					return 2;
+				}
+				const auto& mb = m_owner.m_mbs[mbAddr];
+				return mb.type == eI4x4 ? int(mb.intraPredMode[outer]) : 2;
+			};
+			const int modeA = neighborMode(bx > 0 ? r - 1 : -1, m_mbA, r + 3);
+			const int modeB = neighborMode(by > 0 ? r - 4 : -1, m_mbB, r + 12);
+			const int predicted = dcPredicted ? 2 : std::min(modeA, modeB);
+			m_mb->intraPredMode[r] = int8_t(usePredicted ? predicted : (remMode < predicted ? remMode : remMode + 1));
+		}
+	}
+
+	// 4x4 ブロックの隣接画素を集める.
+	void GatherEdge4x4(int r, IntraEdge& e, bool& hasTop, bool& hasLeft) const
+	{
+		const int bx = r & 3;
+		const int by = r >> 2;
+		const bool hasTopMb = IsIntraAvailable(m_mbB);
+		const bool hasLeftMb = IsIntraAvailable(m_mbA);
+		hasTop = by > 0 || hasTopMb;
+		hasLeft = bx > 0 || hasLeftMb;
+		bool hasCorner = false;
+		if (bx > 0 && by > 0)
+		{
+			hasCorner = true;
+		}
+		else if (by > 0)
+		{
+			hasCorner = hasLeftMb;
+		}
+		else if (bx > 0)
+		{
+			hasCorner = hasTopMb;
+		}
+		else
+		{
+			hasCorner = IsIntraAvailable(m_mbD);
+		}
+		bool hasTopRight = false;
+		if (by == 0)
+		{
+			hasTopRight = bx < 3 ? hasTopMb : IsIntraAvailable(m_mbC);
+		}
+		else if (bx < 3)
+		{
+			// MB 内では、右上のブロックが先に復号されている場合のみ利用できる.
+			hasTopRight = kBlkToRaster[r - 3] < kBlkToRaster[r];
+		}
+
+		const uint8_t* p = LumaAt(bx * 4, by * 4);
+		const ptrdiff_t stride = m_picture.stride[0];
+		memset(e.top, 128, sizeof(e.top));
+		memset(e.left, 128, sizeof(e.left));
+		if (hasTop)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				e.top[1 + i] = p[-stride + i];
+			}
+			for (int i = 4; i < 8; ++i)
+			{
+				e.top[1 + i] = hasTopRight ? p[-stride + i] : e.top[4];
+			}
+		}
+		if (hasLeft)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				e.left[1 + i] = p[i * stride - 1];
+			}
+		}
+		if (hasCorner)
+		{
+			e.top[0] = e.left[0] = p[-stride - 1];
+		}
+	}
+
+	// MB 全体 (輝度 16 / 色差 8) の隣接画素を集める.
+	void GatherEdgeMb(const uint8_t* p, ptrdiff_t stride, int size, IntraEdge& e, bool& hasTop, bool& hasLeft) const
+	{
+		hasTop = IsIntraAvailable(m_mbB);
+		hasLeft = IsIntraAvailable(m_mbA);
+		memset(e.top, 128, sizeof(e.top));
+		memset(e.left, 128, sizeof(e.left));
+		if (hasTop)
+		{
+			memcpy(e.top + 1, p - stride, size);
+		}
+		if (hasLeft)
+		{
+			for (int i = 0; i < size; ++i)
+			{
+				e.left[1 + i] = p[i * stride - 1];
+			}
+		}
+		if (IsIntraAvailable(m_mbD))
+		{
+			e.top[0] = e.left[0] = p[-stride - 1];
+		}
+	}
+
+	void AddLumaResidual(int r, const int32_t* coeff)
+	{
+		int32_t d[16];
+		const int32_t* scale = m_tables.dequant[m_qp];
+		for (int i = 0; i < 16; ++i)
+		{
+			d[i] = coeff[i] * scale[i];
+		}
+		Idct4x4Add(d, LumaAt((r & 3) * 4, (r >> 2) * 4), m_picture.stride[0]);
+	}
+
+	void ReconstructIntra4x4()
+	{
+		for (int blk = 0; blk < 16; ++blk)
+		{
+			const int r = kBlkToRaster[blk];
+			IntraEdge e;
+			bool hasTop = false;
+			bool hasLeft = false;
+			GatherEdge4x4(r, e, hasTop, hasLeft);
+			PredictIntra4x4(LumaAt((r & 3) * 4, (r >> 2) * 4), m_picture.stride[0], m_mb->intraPredMode[r], e, hasTop, hasLeft);
+			if (m_lumaCodedMask & (1 << r))
+			{
+				AddLumaResidual(r, m_coeff[r]);
+			}
+		}
+	}
+
+	void ReconstructIntra16x16(int predMode)
+	{
+		IntraEdge e;
+		bool hasTop = false;
+		bool hasLeft = false;
+		GatherEdgeMb(LumaAt(0, 0), m_picture.stride[0], 16, e, hasTop, hasLeft);
+		PredictIntraBlock(LumaAt(0, 0), m_picture.stride[0], 16, predMode, e, hasTop, hasLeft);
+
+		// DC は 4x4 のアダマール変換の後に逆量子化する.
+		int32_t dc[16] = { };
+		if (m_hasLumaDc)
+		{
+			int32_t t[16];
+			for (int i = 0; i < 4; ++i)
+			{
+				const int32_t* c = m_dc + i * 4;
+				t[i * 4 + 0] = c[0] + c[1] + c[2] + c[3];
+				t[i * 4 + 1] = c[0] + c[1] - c[2] - c[3];
+				t[i * 4 + 2] = c[0] - c[1] - c[2] + c[3];
+				t[i * 4 + 3] = c[0] - c[1] + c[2] - c[3];
+			}
+			const int scale = 16 * kDequantScale[m_qp % 6][0];
+			const int shift = m_qp / 6;
+			for (int j = 0; j < 4; ++j)
+			{
+				const int32_t f[4] = {
+					t[j] + t[4 + j] + t[8 + j] + t[12 + j],
+					t[j] + t[4 + j] - t[8 + j] - t[12 + j],
+					t[j] - t[4 + j] - t[8 + j] + t[12 + j],
+					t[j] - t[4 + j] + t[8 + j] - t[12 + j],
+				};
+				for (int i = 0; i < 4; ++i)
+				{
+					dc[i * 4 + j] = m_qp >= 36
+						? (f[i] * scale) << (shift - 6)
+						: (f[i] * scale + (1 << (5 - shift))) >> (6 - shift);
+				}
+			}
+		}
+		const int32_t* scale = m_tables.dequant[m_qp];
+		for (int r = 0; r < 16; ++r)
+		{
+			if (!(m_lumaCodedMask & (1 << r)) && dc[r] == 0)
+			{
+				continue;
+			}
+			int32_t d[16];
+			d[0] = dc[r];
+			for (int i = 1; i < 16; ++i)
+			{
+				d[i] = m_coeff[r][i] * scale[i];
+			}
+			Idct4x4Add(d, LumaAt((r & 3) * 4, (r >> 2) * 4), m_picture.stride[0]);
+		}
+	}
+
+	void ReconstructIntraChroma(int predMode)
+	{
+		// intra_chroma_pred_mode (0:DC 1:H 2:V 3:Plane) を輝度の番号へ合わせる.
+		static const int kToLumaMode[4] = { 2, 1, 0, 3 };
+		for (int c = 0; c < 2; ++c)
+		{
+			IntraEdge e;
+			bool hasTop = false;
+			bool hasLeft = false;
+			GatherEdgeMb(ChromaAt(c, 0, 0), m_picture.stride[1 + c], 8, e, hasTop, hasLeft);
+			PredictIntraBlock(ChromaAt(c, 0, 0), m_picture.stride[1 + c], 8, kToLumaMode[predMode], e, hasTop, hasLeft);
+		}
+		AddChromaResidual();
+	}
+
+	void AddChromaResidual()
+	{
+		for (int c = 0; c < 2; ++c)
+		{
+			if (!m_chromaCoded[c])
+			{
+				continue;
+			}
+			const int qpc = ChromaQp(m_qp);
+			const int32_t* in = m_chromaDc[c];
+			const int32_t f[4] = {
+				in[0] + in[1] + in[2] + in[3],
+				in[0] - in[1] + in[2] - in[3],
+				in[0] + in[1] - in[2] - in[3],
+				in[0] - in[1] - in[2] + in[3],
+			};
+			const int dcScale = 16 * kDequantScale[qpc % 6][0];
+			const int32_t* scale = m_tables.dequant[qpc];
+			for (int b = 0; b < 4; ++b)
+			{
+				int32_t d[16];
+				d[0] = ((f[b] * dcScale) << (qpc / 6)) >> 5;
+				bool nonZero = d[0] != 0;
+				for (int i = 1; i < 16; ++i)
+				{
+					d[i] = m_chromaAc[c][b][i] * scale[i];
+					nonZero |= d[i] != 0;
+				}
+				if (nonZero)
+				{
+					Idct4x4Add(d, ChromaAt(c, (b & 1) * 4, (b >> 1) * 4), m_picture.stride[1 + c]);
+				}
+			}
+		}
+	}
+
+	// --- CAVLC ---
+
+	int LumaNC(int r) const
+	{
+		const int bx = r & 3;
+		const int by = r >> 2;
+		int nA = -1;
+		int nB = -1;
+		if (bx > 0)
+		{
+			nA = m_mb->totalCoeff[r - 1];
+		}
+		else if (m_mbA >= 0)
+		{
+			nA = m_owner.m_mbs[m_mbA].totalCoeff[r + 3];
+		}
+		if (by > 0)
+		{
+			nB = m_mb->totalCoeff[r - 4];
+		}
+		else if (m_mbB >= 0)
+		{
+			nB = m_owner.m_mbs[m_mbB].totalCoeff[r + 12];
+		}
+		return CombineNC(nA, nB);
+	}
+	int ChromaNC(int c, int b) const
+	{
+		const int base = 16 + c * 4;
+		int nA = -1;
+		int nB = -1;
+		if (b & 1)
+		{
+			nA = m_mb->totalCoeff[base + b - 1];
+		}
+		else if (m_mbA >= 0)
+		{
+			nA = m_owner.m_mbs[m_mbA].totalCoeff[base + b + 1];
+		}
+		if (b & 2)
+		{
+			nB = m_mb->totalCoeff[base + b - 2];
+		}
+		else if (m_mbB >= 0)
+		{
+			nB = m_owner.m_mbs[m_mbB].totalCoeff[base + b + 2];
+		}
+		return CombineNC(nA, nB);
+	}
+	static int CombineNC(int nA, int nB)
+	{
+		if (nA >= 0 && nB >= 0)
+		{
+			return (nA + nB + 1) >> 1;
+		}
+		return nA >= 0 ? nA : (nB >= 0 ? nB : 0);
+	}
+
+	// residual_block_cavlc. levels にスキャン順の係数を返す. 戻り値は TotalCoeff、エラー時は -1.
+	int ResidualBlock(int32_t* levels, int maxNumCoeff, int nC)
+	{
+		memset(levels, 0, sizeof(int32_t) * maxNumCoeff);
+		const VlcTable& tokenTable = nC < 0 ? m_tables.chromaDcCoeffToken
+			: nC < 2 ? m_tables.coeffToken[0]
+			: nC < 4 ? m_tables.coeffToken[1]
+			: nC < 8 ? m_tables.coeffToken[2]
+			: m_tables.coeffToken[3];
+		const int token = m_bits.ReadVlc(tokenTable);
+		if (token < 0)
+		{
+			return -1;
+		}
+		const int totalCoeff = token >> 2;
+		const int trailingOnes = token & 3;
+		if (totalCoeff == 0)
+		{
+			return 0;
+		}
+		if (totalCoeff > maxNumCoeff)
+		{
+			return -1;
+		}
+
+		int32_t level[16];
+		int suffixLength = (totalCoeff > 10 && trailingOnes < 3) ? 1 : 0;
+		for (int i = 0; i < totalCoeff; ++i)
+		{
+			if (i < trailingOnes)
+			{
+				level[i] = m_bits.U1() ? -1 : 1;
+				continue;
+			}
+			const int prefix = m_bits.LeadingZeros();
+			if (prefix > 31)
+			{
+				return -1;
+			}
+			int levelCode = std::min(15, prefix) << suffixLength;
+			if (suffixLength > 0 || prefix >= 14)
+			{
+				const int suffixSize = (prefix == 14 && suffixLength == 0) ? 4 : (prefix >= 15 ? prefix - 3 : suffixLength);
+				if (suffixSize > 0)
+				{
+					levelCode += int(m_bits.U(suffixSize));
+				}
+			}
+			if (prefix >= 15 && suffixLength == 0)
+			{
+				levelCode += 15;
+			}
+			if (prefix >= 16)
+			{
+				levelCode += (1 << (prefix - 3)) - 4096;
+			}
+			if (i == trailingOnes && trailingOnes < 3)
+			{
+				levelCode += 2;
+			}
+			level[i] = (levelCode & 1) == 0 ? (levelCode + 2) >> 1 : (-levelCode - 1) >> 1;
+			if (suffixLength == 0)
+			{
+				suffixLength = 1;
+			}
+			if (std::abs(level[i]) > (3 << (suffixLength - 1)) && suffixLength < 6)
+			{
+				suffixLength++;
+			}
+		}
+
+		int zerosLeft = 0;
+		if (totalCoeff < maxNumCoeff)
+		{
+			zerosLeft = m_bits.ReadVlc(maxNumCoeff == 4
+				? m_tables.chromaDcTotalZeros[totalCoeff - 1]
+				: m_tables.totalZeros[totalCoeff - 1]);
+			if (zerosLeft < 0 || zerosLeft + totalCoeff > maxNumCoeff)
+			{
+				return -1;
+			}
+		}
+
+		// 高い周波数の係数から順に並んでいるため、後ろから配置する.
+		int run[16];
+		for (int i = 0; i < totalCoeff - 1; ++i)
+		{
+			run[i] = 0;
+			if (zerosLeft > 0)
+			{
+				run[i] = m_bits.ReadVlc(m_tables.runBefore[std::min(zerosLeft, 7) - 1]);
+				if (run[i] < 0 || run[i] > zerosLeft)
+				{
+					return -1;
+				}
+				zerosLeft -= run[i];
+			}
+		}
+		run[totalCoeff - 1] = zerosLeft;
+		int coeffNum = -1;
+		for (int i = totalCoeff - 1; i >= 0; --i)
+		{
+			coeffNum += run[i] + 1;
+			levels[coeffNum] = level[i];
+		}
+		return totalCoeff;
+	}
+
+	bool ParseResidual(bool isI16x16, int cbpLuma, int cbpChroma)
+	{
+		memset(m_coeff, 0, sizeof(m_coeff));
+		memset(m_chromaAc, 0, sizeof(m_chromaAc));
+		memset(m_chromaDc, 0, sizeof(m_chromaDc));
+		m_lumaCodedMask = 0;
+		m_hasLumaDc = false;
+		m_chromaCoded[0] = m_chromaCoded[1] = false;
+
+		int32_t levels[16];
+		if (isI16x16)
+		{
+			const int total = ResidualBlock(levels, 16, LumaNC(0));
+			if (total < 0)
+			{
+				return false;
+			}
+			for (int i = 0; i < 16; ++i)
+			{
+				m_dc[kZigzag4x4[i]] = levels[i];
+			}
+			m_hasLumaDc = total > 0;
+		}
+		for (int blk = 0; blk < 16; ++blk)
+		{
+			const int r = kBlkToRaster[blk];
+			if (!(cbpLuma & (1 << (blk >> 2))))
+			{
+				continue;
+			}
+			const int nC = LumaNC(r);
+			const int start = isI16x16 ? 1 : 0;
+			const int total = ResidualBlock(levels, 16 - start, nC);
+			if (total < 0)
+			{
+				return false;
+			}
+			for (int i = 0; i < 16 - start; ++i)
+			{
+				m_coeff[r][kZigzag4x4[i + start]] = levels[i];
+			}
+			m_mb->totalCoeff[r] = uint8_t(total);
+			if (total > 0)
+			{
+				m_lumaCodedMask |= uint16_t(1 << r);
+			}
+		}
+		if (cbpChroma & 3)
+		{
+			for (int c = 0; c < 2; ++c)
+			{
+				if (ResidualBlock(m_chromaDc[c], 4, -1) < 0)
+				{
+					return false;
+				}
+				m_chromaCoded[c] = true;
+			}
+		}
+		if (cbpChroma & 2)
+		{
+			for (int c = 0; c < 2; ++c)
+			{
+				for (int b = 0; b < 4; ++b)
+				{
+					const int total = ResidualBlock(levels, 15, ChromaNC(c, b));
+					if (total < 0)
+					{
+						return false;
+					}
+					for (int i = 0; i < 15; ++i)
+					{
+						m_chromaAc[c][b][kZigzag4x4[i + 1]] = levels[i];
+					}
+					m_mb->totalCoeff[16 + c * 4 + b] = uint8_t(total);
+				}
+			}
+		}
+		return true;
+	}
+
+	// --- インター予測 ---
+
+	Neighbor GetNeighbor(int x, int y) const
+	{
+		Neighbor n;
+		int mbAddr = -1;
+		int r = 0;
+		if (y < 0)
+		{
+			if (x < 0)
+			{
+				mbAddr = m_mbD;
+				r = 15;
+			}
+			else if (x >= 16)
+			{
+				mbAddr = m_mbC;
+				r = 12;
+			}
+			else
+			{
+				mbAddr = m_mbB;
+				r = 12 + (x >> 2);
+			}
+		}
+		else if (x < 0)
+		{
+			mbAddr = m_mbA;
+			r = (y >> 2) * 4 + 3;
+		}
+		else if (x >= 16)
+		{
+			return n;
+		}
+		else
+		{
+			// 現在の MB 内は、先に求めたパーティションのみ利用できる.
+			r = (y >> 2) * 4 + (x >> 2);
+			if (!(m_doneMask & (1 << r)))
+			{
+				return n;
+			}
+			n.available = true;
+			n.refIdx = m_mb->refIdx[Blk8(r)];
+			n.mv[0] = m_mb->mv[r][0];
+			n.mv[1] = m_mb->mv[r][1];
+			return n;
+		}
+		if (mbAddr < 0)
+		{
+			return n;
+		}
+		const auto& mb = m_owner.m_mbs[mbAddr];
+		n.available = true;
+		if (IsIntraType(mb.type))
+		{
+			return n;
+		}
+		n.refIdx = mb.refIdx[Blk8(r)];
+		n.mv[0] = mb.mv[r][0];
+		n.mv[1] = mb.mv[r][1];
+		return n;
+	}
+
+	void PredictMv(const Partition& part, int refIdx, Shape shape, int mvp[2]) const
+	{
+		Neighbor a = GetNeighbor(part.x - 1, part.y);
+		Neighbor b = GetNeighbor(part.x, part.y - 1);
+		Neighbor c = GetNeighbor(part.x + part.w, part.y - 1);
+		if (!c.available)
+		{
+			c = GetNeighbor(part.x - 1, part.y - 1);
+		}
+		const Neighbor* direct = nullptr;
+		if (shape == Shape::e16x8)
+		{
+			direct = part.y == 0 ? &b : &a;
+		}
+		else if (shape == Shape::e8x16)
+		{
+			direct = part.x == 0 ? &a : &c;
+		}
+		if (direct && direct->refIdx == refIdx)
+		{
+			mvp[0] = direct->mv[0];
+			mvp[1] = direct->mv[1];
+			return;
+		}
+
+		if (!b.available && !c.available && a.available)
+		{
+			b = a;
+			c = a;
+		}
+		const int matches = (a.refIdx == refIdx) + (b.refIdx == refIdx) + (c.refIdx == refIdx);
+		if (matches == 1)
+		{
+			const Neighbor& n = a.refIdx == refIdx ? a : (b.refIdx == refIdx ? b : c);
+			mvp[0] = n.mv[0];
+			mvp[1] = n.mv[1];
+			return;
+		}
+		for (int i = 0; i < 2; ++i)
+		{
+			mvp[i] = std::max(std::min(a.mv[i], b.mv[i]), std::min(std::max(a.mv[i], b.mv[i]), c.mv[i]));
+		}
+	}
+
+	const Picture* GetReference(int refIdx, int& slot) const
+	{
+		slot = refIdx < m_slice.numRefIdxActive ? m_slice.refSlot[refIdx] : -1;
+		if (slot < 0)
+		{
+			// 参照が欠けている場合は、リスト内の別の画像で代用する.
+			for (int i = 0; i < m_slice.numRefIdxActive && slot < 0; ++i)
+			{
+				slot = m_slice.refSlot[i];
+			}
+		}
+		return slot >= 0 ? &m_owner.m_pictures[slot] : nullptr;
+	}
+
+	bool SetMotion(const Partition& part, int refIdx, const int mv[2])
+	{
+		int slot = -1;
+		const Picture* ref = GetReference(refIdx, slot);
+		if (!ref)
+		{
+			return false;
+		}
+		const int16_t mvx = int16_t(Clip3(-32768, 32767, mv[0]));
+		const int16_t mvy = int16_t(Clip3(-32768, 32767, mv[1]));
+		for (int y = part.y; y < part.y + part.h; y += 4)
+		{
+			for (int x = part.x; x < part.x + part.w; x += 4)
+			{
+				const int r = (y >> 2) * 4 + (x >> 2);
+				m_mb->mv[r][0] = mvx;
+				m_mb->mv[r][1] = mvy;
+				m_doneMask |= uint16_t(1 << r);
+			}
+		}
+		for (int i = 0; i < 4; ++i)
+		{
+			const int x8 = (i & 1) * 8;
+			const int y8 = (i >> 1) * 8;
+			if (x8 >= part.x && x8 < part.x + part.w && y8 >= part.y && y8 < part.y + part.h)
+			{
+				m_mb->refIdx[i] = int8_t(refIdx);
+				m_mb->refSlot[i] = int8_t(slot);
+			}
+		}
+		// 4x4 などの小さいパーティションでは 8x8 の先頭で参照を記録する.
+		if (part.w < 8 || part.h < 8)
+		{
+			const int i = (part.y >> 3) * 2 + (part.x >> 3);
+			m_mb->refIdx[i] = int8_t(refIdx);
+			m_mb->refSlot[i] = int8_t(slot);
+		}
+
+		const int px = m_mbx * 16 + part.x;
+		const int py = m_mby * 16 + part.y;
+		McLuma(ref->plane[0].data(), int(ref->stride[0]), int(ref->stride[0]), int(ref->height[0]),
+			px + (mvx >> 2), py + (mvy >> 2), mvx & 3, mvy & 3, part.w, part.h,
+			LumaAt(part.x, part.y), m_picture.stride[0]);
+		for (int c = 0; c < 2; ++c)
+		{
+			McChroma(ref->plane[1 + c].data(), int(ref->stride[1 + c]), int(ref->stride[1 + c]), int(ref->height[1 + c]),
+				px / 2 + (mvx >> 3), py / 2 + (mvy >> 3), mvx & 7, mvy & 7, part.w / 2, part.h / 2,
+				ChromaAt(c, part.x / 2, part.y / 2), m_picture.stride[1 + c]);
+		}
+		return true;
+	}
+
+	int ReadRefIdx(int numRefIdxActive)
+	{
+		if (numRefIdxActive <= 1)
+		{
+			return 0;
+		}
+		// te(v). 範囲が 1 の場合は反転した 1 ビット.
+		return numRefIdxActive == 2 ? int(!m_bits.U1()) : int(m_bits.Ue());
+	}
+
+	bool DecodeSkip()
+	{
+		m_mb->type = ePSkip;
+		m_mb->qp = int8_t(m_qp);
+		const Neighbor a = GetNeighbor(-1, 0);
+		const Neighbor b = GetNeighbor(0, -1);
+		int mv[2] = { 0, 0 };
+		const bool zeroA = a.refIdx == 0 && a.mv[0] == 0 && a.mv[1] == 0;
+		const bool zeroB = b.refIdx == 0 && b.mv[0] == 0 && b.mv[1] == 0;
+		if (a.available && b.available && !zeroA && !zeroB)
+		{
+			PredictMv({ 0, 0, 16, 16 }, 0, Shape::eDefault, mv);
+		}
+		return SetMotion({ 0, 0, 16, 16 }, 0, mv);
+	}
+
+	bool DecodeInter(uint32_t mbType)
+	{
+		m_mb->type = eP;
+		const int numRef = m_slice.numRefIdxActive;
+		int refIdx[4] = { 0, 0, 0, 0 };
+		if (mbType < 3)
+		{
+			static const Partition kParts[3][2] = {
+				{ { 0, 0, 16, 16 }, { } },
+				{ { 0, 0, 16, 8 }, { 0, 8, 16, 8 } },
+				{ { 0, 0, 8, 16 }, { 8, 0, 8, 16 } },
+			};
+			const int count = mbType == 0 ? 1 : 2;
+			const Shape shape = mbType == 1 ? Shape::e16x8 : (mbType == 2 ? Shape::e8x16 : Shape::eDefault);
+			for (int i = 0; i < count; ++i)
+			{
+				refIdx[i] = ReadRefIdx(numRef);
+				if (refIdx[i] >= numRef)
+				{
+					return false;
+				}
+			}
+			for (int i = 0; i < count; ++i)
+			{
+				const int mvdX = m_bits.Se();
+				const int mvdY = m_bits.Se();
+				int mv[2];
+				PredictMv(kParts[mbType][i], refIdx[i], shape, mv);
+				mv[0] += mvdX;
+				mv[1] += mvdY;
+				if (!SetMotion(kParts[mbType][i], refIdx[i], mv))
+				{
+					return false;
+				}
+			}
+		}
+		else
+		{
+			uint32_t subType[4];
+			for (int i = 0; i < 4; ++i)
+			{
+				subType[i] = m_bits.Ue();
+				if (subType[i] > 3)
+				{
+					return false;
+				}
+			}
+			for (int i = 0; i < 4; ++i)
+			{
+				// P_8x8ref0 は参照番号を持たない.
+				refIdx[i] = mbType == 3 ? ReadRefIdx(numRef) : 0;
+				if (refIdx[i] >= std::max(numRef, 1))
+				{
+					return false;
+				}
+			}
+			static const Partition kSubParts[4][4] = {
+				{ { 0, 0, 8, 8 } },
+				{ { 0, 0, 8, 4 }, { 0, 4, 8, 4 } },
+				{ { 0, 0, 4, 8 }, { 4, 0, 4, 8 } },
+				{ { 0, 0, 4, 4 }, { 4, 0, 4, 4 }, { 0, 4, 4, 4 }, { 4, 4, 4, 4 } },
+			};
+			static const int kSubCount[4] = { 1, 2, 2, 4 };
+			for (int i = 0; i < 4; ++i)
+			{
+				for (int j = 0; j < kSubCount[subType[i]]; ++j)
+				{
+					const auto& sub = kSubParts[subType[i]][j];
+					const Partition part{ (i & 1) * 8 + sub.x, (i >> 1) * 8 + sub.y, sub.w, sub.h };
+					const int mvdX = m_bits.Se();
+					const int mvdY = m_bits.Se();
+					int mv[2];
+					PredictMv(part, refIdx[i], Shape::eDefault, mv);
+					mv[0] += mvdX;
+					mv[1] += mvdY;
+					if (!SetMotion(part, refIdx[i], mv))
+					{
+						return false;
+					}
+				}
+			}
+		}
+
+		const uint32_t code = m_bits.Ue();
+		if (code > 47)
+		{
+			return false;
+		}
+		const int cbp = kInterCbp[code];
+		if (cbp && !ReadQpDelta())
+		{
+			return false;
+		}
+		m_mb->qp = int8_t(m_qp);
+		if (!ParseResidual(false, cbp & 15, cbp >> 4))
+		{
+			return false;
+		}
+		for (int r = 0; r < 16; ++r)
+		{
+			if (m_lumaCodedMask & (1 << r))
+			{
+				AddLumaResidual(r, m_coeff[r]);
+			}
+		}
+		AddChromaResidual();
+		return true;
+	}
+
+	SoftwareH264Decoder& m_owner;
+	Slice& m_slice;
+	Picture& m_picture;
+	const Tables& m_tables;
+	BitReader m_bits;
+	int m_widthInMbs = 0;
+	int m_heightInMbs = 0;
+	int m_qp = 0;
+
+	int m_mbx = 0;
+	int m_mby = 0;
+	int m_mbA = -1;
+	int m_mbB = -1;
+	int m_mbC = -1;
+	int m_mbD = -1;
+	MbInfo* m_mb = nullptr;
+	uint16_t m_doneMask = 0;	// 動きベクトルを求め終えた 4x4 ブロック.
+
+	// 現在の MB の係数. ラスター位置に並べる.
+	int32_t m_coeff[16][16];
+	int32_t m_dc[16];
+	int32_t m_chromaDc[2][4];
+	int32_t m_chromaAc[2][4][16];
+	uint16_t m_lumaCodedMask = 0;
+	bool m_hasLumaDc = false;
+	bool m_chromaCoded[2] = { };
+};
+
+// ---------------------------------------------------------------------------
+
+SoftwareH264Decoder::SoftwareH264Decoder() = default;
+
+SoftwareH264Decoder::~SoftwareH264Decoder()
+{
+	Shutdown();
+}
+
+const char* SoftwareH264Decoder::CheckSupport(const h264::SPS& sps, const h264::PPS& pps)
+{
+	if (pps.entropy_coding_mode_flag)
+	{
+		return "CABAC is not supported";
+	}
+	if (!sps.frame_mbs_only_flag)
+	{
+		return "interlaced streams are not supported";
+	}
+	// chroma_format_idc は High 系のプロファイルのみが持ち、それ以外は 4:2:0 となる (h264.h の読み取り条件に合わせる).
+	const bool hasChromaFormat = sps.profile_idc == 100 || sps.profile_idc == 110 || sps.profile_idc == 122 || sps.profile_idc == 144;
+	if ((hasChromaFormat && sps.chroma_format_idc != 1) || sps.bit_depth_luma_minus8 != 0 || sps.bit_depth_chroma_minus8 != 0)
+	{
+		return "only 8-bit 4:2:0 is supported";
+	}
+	if (pps.num_slice_groups_minus1 > 0)
+	{
+		return "FMO is not supported";
+	}
+	if (pps.weighted_pred_flag || pps.transform_8x8_mode_flag)
+	{
+		return "weighted prediction and 8x8 transform are not supported";
+	}
+	if (sps.seq_scaling_matrix_present_flag || pps.pic_scaling_matrix_present_flag || sps.qpprime_y_zero_transform_bypass_flag)
+	{
+		return "scaling matrices are not supported";
+	}
+	return nullptr;
+}
+
+bool SoftwareH264Decoder::Initialize(uint32_t widthInMbs, uint32_t heightInMbs, uint32_t slotCount, uint32_t threadCount)
+{
+	Shutdown();
+	if (widthInMbs == 0 || heightInMbs == 0 || slotCount == 0)
+	{
+		return false;
+	}
+	m_widthInMbs = widthInMbs;
+	m_heightInMbs = heightInMbs;
+	m_pictures.assign(slotCount, Picture{});
+	m_mbs.assign(size_t(widthInMbs) * heightInMbs, MbInfo{});
+	m_mbSlice.assign(m_mbs.size(), -1);
+	m_deblockProgress = std::make_unique<std::atomic<uint32_t>[]>(heightInMbs);
+	m_stats = {};
+	GetTables();
+
+	if (threadCount == 0)
+	{
+		threadCount = std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+	}
+	m_exit = false;
+	for (uint32_t i = 1; i < threadCount; ++i)
+	{
+		m_workers.emplace_back(&SoftwareH264Decoder::WorkerMain, this);
+	}
+	return true;
+}
+
+void SoftwareH264Decoder::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_exit = true;
+	}
+	m_wakeWorkers.notify_all();
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+	m_pictures.clear();
+	m_mbs.clear();
+	m_mbSlice.clear();
+	m_slices.clear();
+	m_deblockProgress.reset();
+}
+
+void SoftwareH264Decoder::EnsurePicture(uint32_t slot)
+{
+	auto& picture = m_pictures[slot];
+	if (!picture.plane[0].empty())
+	{
+		return;
+	}
+	// 未デコードのスロットを参照した場合も破綻しないよう、灰色で埋めておく.
+	for (int i = 0; i < 3; ++i)
+	{
+		picture.stride[i] = m_widthInMbs * (i == 0 ? 16 : 8);
+		picture.height[i] = m_heightInMbs * (i == 0 ? 16 : 8);
+		picture.plane[i].assign(size_t(picture.stride[i]) * picture.height[i], 128);
+	}
+}
+
+bool SoftwareH264Decoder::PrepareSlice(Slice& slice, const FrameDesc& desc, uint32_t index)
+{
+	const uint64_t begin = desc.sliceOffsets[index];
+	const uint64_t end = std::min(index + 1 < desc.sliceCount ? uint64_t(desc.sliceOffsets[index + 1]) : desc.size, desc.size);
+	if (begin >= end)
+	{
+		return false;
+	}
+	const uint8_t* p = desc.bitstream + begin;
+	size_t n = size_t(end - begin);
+
+	// 開始コードを読み飛ばす.
+	while (n > 0 && *p == 0)
+	{
+		p++;
+		n--;
+	}
+	if (n < 2 || *p != 1)
+	{
+		m_lastError = "missing start code";
+		return false;
+	}
+	p++;
+	n--;
+
+	slice.nal.idc = h264::NAL_REF_IDC((p[0] >> 5) & 3);
+	slice.nal.type = h264::NAL_UNIT_TYPE(p[0] & 31);
+	if (slice.nal.type != h264::NAL_UNIT_TYPE_CODED_SLICE_IDR && slice.nal.type != h264::NAL_UNIT_TYPE_CODED_SLICE_NON_IDR)
+	{
+		return false;
+	}
+
+	// エミュレーション防止バイトを取り除く.
+	slice.rbsp.clear();
+	slice.rbsp.reserve(n + 8);
+	for (size_t i = 1; i < n; ++i)
+	{
+		if (i + 2 < n && p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 3)
+		{
+			slice.rbsp.push_back(0);
+			slice.rbsp.push_back(0);
+			i += 2;
+			continue;
+		}
+		slice.rbsp.push_back(p[i]);
+	}
+	size_t rbspSize = slice.rbsp.size();
+	while (rbspSize > 0 && slice.rbsp[rbspSize - 1] == 0)
+	{
+		rbspSize--;
+	}
+	if (rbspSize == 0)
+	{
+		m_lastError = "empty slice";
+		return false;
+	}
+	// rbsp_stop_one_bit の位置.
+	slice.stopBit = (rbspSize - 1) * 8 + (7 - std::countr_zero(uint32_t(slice.rbsp[rbspSize - 1])));
+	slice.rbsp.resize(rbspSize);
+	slice.rbsp.insert(slice.rbsp.end(), 8, 0);
+
+	// パラメーターセットの番号を先に確認してから、ヘッダー全体を読む.
+	{
+		h264::Bitstream bs = {};
+		bs.init(slice.rbsp.data(), rbspSize);
+		bs.ue();
+		bs.ue();
+		const uint32_t ppsId = bs.ue();
+		if (ppsId >= desc.ppsCount || uint32_t(desc.ppsArray[ppsId].seq_parameter_set_id) >= desc.spsCount)
+		{
+			m_lastError = "invalid parameter set id";
+			return false;
+		}
+	}
+	h264::Bitstream bs = {};
+	bs.init(slice.rbsp.data(), rbspSize);
+	slice.header = {};
+	h264::read_slice_header(&slice.header, &slice.nal, desc.ppsArray, desc.spsArray, &bs);
+	slice.dataBitOffset = size_t(bs.p - bs.start) * 8 + (8 - bs.bits_left);
+
+	const auto& sh = slice.header;
+	slice.pps = desc.ppsArray + sh.pic_parameter_set_id;
+	slice.sps = desc.spsArray + slice.pps->seq_parameter_set_id;
+	if (const char* reason = CheckSupport(*slice.sps, *slice.pps))
+	{
+		m_lastError = reason;
+		return false;
+	}
+	const int sliceType = sh.slice_type % 5;
+	if (sliceType != h264::SH_SLICE_TYPE_P && sliceType != h264::SH_SLICE_TYPE_I)
+	{
+		m_lastError = "only I and P slices are supported";
+		return false;
+	}
+	if (uint32_t(sh.first_mb_in_slice) >= m_mbs.size())
+	{
+		m_lastError = "invalid first_mb_in_slice";
+		return false;
+	}
+	slice.firstMb = uint32_t(sh.first_mb_in_slice);
+	slice.isIntra = sliceType == h264::SH_SLICE_TYPE_I;
+	slice.qp = 26 + slice.pps->pic_init_qp_minus26 + sh.slice_qp_delta;
+	if (slice.qp < 0 || slice.qp > 51)
+	{
+		m_lastError = "invalid slice qp";
+		return false;
+	}
+	slice.chromaQpOffset = slice.pps->chroma_qp_index_offset;
+	slice.constrainedIntraPred = slice.pps->constrained_intra_pred_flag != 0;
+	slice.disableDeblocking = sh.disable_deblocking_filter_idc;
+	slice.filterOffsetA = sh.slice_alpha_c0_offset_div2 * 2;
+	slice.filterOffsetB = sh.slice_beta_offset_div2 * 2;
+	slice.numRefIdxActive = 0;
+	if (slice.isIntra)
+	{
+		return true;
+	}
+
+	// RefPicList0 の初期化. 短期参照を PicNum の降順に並べる.
+	slice.numRefIdxActive = std::min(32, 1 + (sh.num_ref_idx_active_override_flag ? sh.num_ref_idx_l0_active_minus1 : slice.pps->num_ref_idx_l0_active_minus1));
+	const int maxFrameNum = 1 << (slice.sps->log2_max_frame_num_minus4 + 4);
+	struct Candidate { int slot; int picNum; };
+	Candidate candidates[32];
+	int candidateCount = 0;
+	for (uint32_t i = 0; i < desc.referenceCount && candidateCount < 32; ++i)
+	{
+		const auto& ref = desc.references[i];
+		if (ref.slot >= m_pictures.size())
+		{
+			continue;
+		}
+		const int picNum = ref.frameNum > sh.frame_num ? ref.frameNum - maxFrameNum : ref.frameNum;
+		candidates[candidateCount++] = { int(ref.slot), picNum };
+	}
+	std::stable_sort(candidates, candidates + candidateCount, [](const Candidate& a, const Candidate& b) { return a.picNum > b.picNum; });
+
+	int list[33];	// 候補の番号. -1 は参照なし.
+	for (int i = 0; i < 33; ++i)
+	{
+		list[i] = i < candidateCount ? i : -1;
+	}
+	// ref_pic_list_modification. 長期参照は扱わない.
+	if (sh.rplr.ref_pic_list_reordering_flag_l0)
+	{
+		const int currPicNum = sh.frame_num;
+		int picNumPred = currPicNum;
+		int refIdx = 0;
+		for (int n = 0; n < 64; ++n)
+		{
+			const int idc = sh.rplr.reorder_l0.reordering_of_pic_nums_idc[n];
+			if (idc == 3 || refIdx >= slice.numRefIdxActive)
+			{
+				break;
+			}
+			if (idc != 0 && idc != 1)
+			{
+				continue;
+			}
+			const int absDiff = sh.rplr.reorder_l0.abs_diff_pic_num_minus1[n] + 1;
+			int picNumNoWrap = idc == 0 ? picNumPred - absDiff : picNumPred + absDiff;
+			if (picNumNoWrap < 0)
+			{
+				picNumNoWrap += maxFrameNum;
+			}
+			else if (picNumNoWrap >= maxFrameNum)
+			{
+				picNumNoWrap -= maxFrameNum;
+			}
+			picNumPred = picNumNoWrap;
+			const int picNum = picNumNoWrap > currPicNum ? picNumNoWrap - maxFrameNum : picNumNoWrap;
+			int found = -1;
+			for (int i = 0; i < candidateCount; ++i)
+			{
+				if (candidates[i].picNum == picNum)
+				{
+					found = i;
+				}
+			}
+			if (found < 0)
+			{
+				continue;
+			}
+			for (int c = slice.numRefIdxActive; c > refIdx; --c)
+			{
+				list[c] = list[c - 1];
+			}
+			list[refIdx++] = found;
+			int nIdx = refIdx;
+			for (int c = refIdx; c <= slice.numRefIdxActive; ++c)
+			{
+				if (list[c] != found)
+				{
+					list[nIdx++] = list[c];
+				}
+			}
+		}
+	}
+	for (int i = 0; i < slice.numRefIdxActive; ++i)
+	{
+		slice.refSlot[i] = list[i] >= 0 ? candidates[list[i]].slot : -1;
+	}
+	return true;
+}
+
+void SoftwareH264Decoder::ConcealMissingMacroblocks(const FrameDesc& desc)
+{
+	auto& picture = m_pictures[m_targetSlot];
+	const Picture* ref = nullptr;
+	for (uint32_t i = 0; i < desc.referenceCount && !ref; ++i)
+	{
+		if (desc.references[i].slot < m_pictures.size() && desc.references[i].slot != m_targetSlot)
+		{
+			ref = &m_pictures[desc.references[i].slot];
+		}
+	}
+	for (uint32_t addr = 0; addr < m_mbs.size(); ++addr)
+	{
+		auto& mb = m_mbs[addr];
+		if (mb.decoded)
+		{
+			continue;
+		}
+		// 直前の参照画像の同じ位置で埋める. 参照がなければ灰色.
+		const uint32_t mbx = addr % m_widthInMbs;
+		const uint32_t mby = addr / m_widthInMbs;
+		for (int i = 0; i < 3; ++i)
+		{
+			const uint32_t size = i == 0 ? 16 : 8;
+			const uint32_t stride = picture.stride[i];
+			for (uint32_t y = 0; y < size; ++y)
+			{
+				const size_t offset = size_t(mby * size + y) * stride + mbx * size;
+				if (ref)
+				{
+					memcpy(picture.plane[i].data() + offset, ref->plane[i].data() + offset, size);
+				}
+				else
+				{
+					memset(picture.plane[i].data() + offset, 128, size);
+				}
+			}
+		}
+		mb = MbInfo{};
+		mb.type = eConcealed;
+		memset(mb.refSlot, -1, sizeof(mb.refSlot));
+		m_stats.concealedMacroblocks++;
+	}
+}
+
+namespace {
+
+void FilterLumaEdge(uint8_t* q0, ptrdiff_t across, ptrdiff_t along, const int bS[4], int alpha, int beta, int indexA)
+{
+	for (int i = 0; i < 16; ++i, q0 += along)
+	{
+		const int bs = bS[i >> 2];
+		if (bs == 0)
+		{
+			continue;
+		}
+		const int p0 = q0[-across];
+		const int p1 = q0[-2 * across];
+		const int p2 = q0[-3 * across];
+		const int q0v = q0[0];
+		const int q1 = q0[across];
+		const int q2 = q0[2 * across];
+		if (std::abs(p0 - q0v) >= alpha || std::abs(p1 - p0) >= beta || std::abs(q1 - q0v) >= beta)
+		{
+			continue;
+		}
+		const bool ap = std::abs(p2 - p0) < beta;
+		const bool aq = std::abs(q2 - q0v) < beta;
+		if (bs < 4)
+		{
+			const int tc0 = kTc0[indexA][bs - 1];
+			const int tc = tc0 + ap + aq;
+			const int delta = Clip3(-tc, tc, (((q0v - p0) << 2) + (p1 - q1) + 4) >> 3);
+			q0[-across] = Clip1(p0 + delta);
+			q0[0] = Clip1(q0v - delta);
+			if (ap)
+			{
+				q0[-2 * across] = uint8_t(p1 + Clip3(-tc0, tc0, (p2 + ((p0 + q0v + 1) >> 1) - (p1 << 1)) >> 1));
+			}
+			if (aq)
+			{
+				q0[across] = uint8_t(q1 + Clip3(-tc0, tc0, (q2 + ((p0 + q0v + 1) >> 1) - (q1 << 1)) >> 1));
+			}
+		}
+		else
+		{
+			const bool strong = std::abs(p0 - q0v) < ((alpha >> 2) + 2);
+			if (ap && strong)
+			{
+				const int p3 = q0[-4 * across];
+				q0[-across] = uint8_t((p2 + 2 * p1 + 2 * p0 + 2 * q0v + q1 + 4) >> 3);
+				q0[-2 * across] = uint8_t((p2 + p1 + p0 + q0v + 2) >> 2);
+				q0[-3 * across] = uint8_t((2 * p3 + 3 * p2 + p1 + p0 + q0v + 4) >> 3);
+			}
+			else
+			{
+				q0[-across] = uint8_t((2 * p1 + p0 + q1 + 2) >> 2);
+			}
+			if (aq && strong)
+			{
+				const int q3 = q0[3 * across];
+				q0[0] = uint8_t((p1 + 2 * p0 + 2 * q0v + 2 * q1 + q2 + 4) >> 3);
+				q0[across] = uint8_t((p0 + q0v + q1 + q2 + 2) >> 2);
+				q0[2 * across] = uint8_t((2 * q3 + 3 * q2 + q1 + q0v + p0 + 4) >> 3);
+			}
+			else
+			{
+				q0[0] = uint8_t((2 * q1 + q0v + p1 + 2) >> 2);
+			}
+		}
+	}
+}
+
+void FilterChromaEdge(uint8_t* q0, ptrdiff_t across, ptrdiff_t along, const int bS[4], int alpha, int beta, int indexA)
+{
+	for (int i = 0; i < 8; ++i, q0 += along)
+	{
+		const int bs = bS[i >> 1];
+		if (bs == 0)
+		{
+			continue;
+		}
+		const int p0 = q0[-across];
+		const int p1 = q0[-2 * across];
+		const int q0v = q0[0];
+		const int q1 = q0[across];
+		if (std::abs(p0 - q0v) >= alpha || std::abs(p1 - p0) >= beta || std::abs(q1 - q0v) >= beta)
+		{
+			continue;
+		}
+		if (bs < 4)
+		{
+			const int tc = kTc0[indexA][bs - 1] + 1;
+			const int delta = Clip3(-tc, tc, (((q0v - p0) << 2) + (p1 - q1) + 4) >> 3);
+			q0[-across] = Clip1(p0 + delta);
+			q0[0] = Clip1(q0v - delta);
+		}
+		else
+		{
+			q0[-across] = uint8_t((2 * p1 + p0 + q1 + 2) >> 2);
+			q0[0] = uint8_t((2 * q1 + q0v + p1 + 2) >> 2);
+		}
+	}
+}
+
+}
+
+void SoftwareH264Decoder::DeblockMacroblock(uint32_t mbx, uint32_t mby)
+{
+	const uint32_t addr = mby * m_widthInMbs + mbx;
+	const MbInfo& q = m_mbs[addr];
+	if (q.slice < 0)
+	{
+		return;
+	}
+	const Slice& slice = *m_slices[q.slice];
+	if (slice.disableDeblocking == 1)
+	{
+		return;
+	}
+	auto& picture = m_pictures[m_targetSlot];
+
+	auto computeBs = [](const MbInfo& p, int pb, const MbInfo& q, int qb, bool mbEdge) {
+		if (IsIntraType(p.type) || IsIntraType(q.type))
+		{
+			return mbEdge ? 4 : 3;
+		}
+		if (p.totalCoeff[pb] || q.totalCoeff[qb])
+		{
+			return 2;
+		}
+		if (p.refSlot[Blk8(pb)] != q.refSlot[Blk8(qb)]
+			|| std::abs(p.mv[pb][0] - q.mv[qb][0]) >= 4
+			|| std::abs(p.mv[pb][1] - q.mv[qb][1]) >= 4)
+		{
+			return 1;
+		}
+		return 0;
+	};
+
+	for (int dir = 0; dir < 2; ++dir)
+	{
+		// dir 0: 縦のエッジ (左から右へ)、dir 1: 横のエッジ (上から下へ).
+		const MbInfo* neighbor = nullptr;
+		if (dir == 0 ? mbx > 0 : mby > 0)
+		{
+			neighbor = &m_mbs[dir == 0 ? addr - 1 : addr - m_widthInMbs];
+			if (slice.disableDeblocking == 2 && neighbor->slice != q.slice)
+			{
+				neighbor = nullptr;
+			}
+		}
+		for (int e = 0; e < 4; ++e)
+		{
+			if (e == 0 && !neighbor)
+			{
+				continue;
+			}
+			const MbInfo& p = e == 0 ? *neighbor : q;
+			int bS[4];
+			bool any = false;
+			for (int k = 0; k < 4; ++k)
+			{
+				const int qb = dir == 0 ? k * 4 + e : e * 4 + k;
+				const int pb = e > 0 ? (dir == 0 ? qb - 1 : qb - 4) : (dir == 0 ? k * 4 + 3 : 12 + k);
+				bS[k] = computeBs(p, pb, q, qb, e == 0);
+				any |= bS[k] != 0;
+			}
+			if (!any)
+			{
+				continue;
+			}
+
+			{
+				const int qpAv = (p.qp + q.qp + 1) >> 1;
+				const int indexA = Clip3(0, 51, qpAv + slice.filterOffsetA);
+				const int alpha = kAlpha[indexA];
+				const int beta = kBeta[Clip3(0, 51, qpAv + slice.filterOffsetB)];
+				const ptrdiff_t stride = picture.stride[0];
+				uint8_t* base = picture.plane[0].data() + (mby * 16) * stride + mbx * 16;
+				if (dir == 0)
+				{
+					FilterLumaEdge(base + e * 4, 1, stride, bS, alpha, beta, indexA);
+				}
+				else
+				{
+					FilterLumaEdge(base + e * 4 * stride, stride, 1, bS, alpha, beta, indexA);
+				}
+			}
+			if (e & 1)
+			{
+				continue;
+			}
+			const int qpcP = kChromaQp[Clip3(0, 51, p.qp + slice.chromaQpOffset)];
+			const int qpcQ = kChromaQp[Clip3(0, 51, q.qp + slice.chromaQpOffset)];
+			const int qpAv = (qpcP + qpcQ + 1) >> 1;
+			const int indexA = Clip3(0, 51, qpAv + slice.filterOffsetA);
+			const int alpha = kAlpha[indexA];
+			const int beta = kBeta[Clip3(0, 51, qpAv + slice.filterOffsetB)];
+			for (int c = 1; c < 3; ++c)
+			{
+				const ptrdiff_t stride = picture.stride[c];
+				uint8_t* base = picture.plane[c].data() + (mby * 8) * stride + mbx * 8;
+				if (dir == 0)
+				{
+					FilterChromaEdge(base + e * 2, 1, stride, bS, alpha, beta, indexA);
+				}
+				else
+				{
+					FilterChromaEdge(base + e * 2 * stride, stride, 1, bS, alpha, beta, indexA);
+				}
+			}
+		}
+	}
+}
+
+void SoftwareH264Decoder::DeblockRow(uint32_t mby)
+{
+	// 上の行は、右隣の MB まで処理を終えていれば現在の MB を処理できる.
+	for (uint32_t mbx = 0; mbx < m_widthInMbs; ++mbx)
+	{
+		if (mby > 0)
+		{
+			const uint32_t required = std::min(mbx + 2, m_widthInMbs);
+			while (m_deblockProgress[mby - 1].load(std::memory_order_acquire) < required)
+			{
+				std::this_thread::yield();
+			}
+		}
+		DeblockMacroblock(mbx, mby);
+		m_deblockProgress[mby].store(mbx + 1, std::memory_order_release);
+	}
+}
+
+bool SoftwareH264Decoder::DecodeFrame(const FrameDesc& desc)
+{
+	const auto start = std::chrono::steady_clock::now();
+	m_lastError = nullptr;
+	if (m_pictures.empty() || desc.targetSlot >= m_pictures.size())
+	{
+		m_lastError = "invalid target slot";
+		return false;
+	}
+	m_targetSlot = desc.targetSlot;
+	EnsurePicture(desc.targetSlot);
+	for (uint32_t i = 0; i < desc.referenceCount; ++i)
+	{
+		if (desc.references[i].slot < m_pictures.size())
+		{
+			EnsurePicture(desc.references[i].slot);
+		}
+	}
+
+	// スライスヘッダーを先に読み、各スライスが受け持つ MB の範囲を確定させる.
+	while (m_slices.size() < desc.sliceCount)
+	{
+		m_slices.push_back(std::make_unique<Slice>());
+	}
+	m_sliceCount = 0;
+	for (uint32_t i = 0; i < desc.sliceCount; ++i)
+	{
+		if (PrepareSlice(*m_slices[m_sliceCount], desc, i))
+		{
+			m_sliceCount++;
+		}
+	}
+	std::stable_sort(m_slices.begin(), m_slices.begin() + m_sliceCount,
+		[](const auto& a, const auto& b) { return a->firstMb < b->firstMb; });
+	std::fill(m_mbSlice.begin(), m_mbSlice.end(), int16_t(-1));
+	for (uint32_t i = 0; i < m_sliceCount; ++i)
+	{
+		auto& slice = *m_slices[i];
+		slice.index = int16_t(i);
+		slice.endMb = i + 1 < m_sliceCount ? m_slices[i + 1]->firstMb : uint32_t(m_mbs.size());
+		std::fill(m_mbSlice.begin() + slice.firstMb, m_mbSlice.begin() + slice.endMb, int16_t(i));
+	}
+	for (auto& mb : m_mbs)
+	{
+		mb.decoded = false;
+		mb.slice = -1;
+	}
+
+	ParallelFor(m_sliceCount, [this](uint32_t i) {
+		auto& slice = *m_slices[i];
+		if (slice.firstMb < slice.endMb)
+		{
+			SliceDecoder(*this, slice).Decode();
+		}
+	});
+	bool succeeded = m_sliceCount == desc.sliceCount;
+	for (uint32_t i = 0; i < m_sliceCount; ++i)
+	{
+		if (m_slices[i]->error)
+		{
+			m_lastError = "corrupted slice data";
+			succeeded = false;
+		}
+	}
+	const uint64_t concealed = m_stats.concealedMacroblocks;
+	ConcealMissingMacroblocks(desc);
+	succeeded &= concealed == m_stats.concealedMacroblocks;
+
+	bool deblock = false;
+	for (uint32_t i = 0; i < m_sliceCount; ++i)
+	{
+		deblock |= m_slices[i]->disableDeblocking != 1;
+	}
+	if (deblock)
+	{
+		for (uint32_t y = 0; y < m_heightInMbs; ++y)
+		{
+			m_deblockProgress[y].store(0, std::memory_order_relaxed);
+		}
+		ParallelFor(m_heightInMbs, [this](uint32_t mby) { DeblockRow(mby); });
+	}
+
+	m_stats.decodedFrames++;
+	m_stats.decodedSlices += m_sliceCount;
+	m_stats.lastDecodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return succeeded;
+}
+
+void SoftwareH264Decoder::WriteNV12(uint32_t slot, uint8_t* dstY, uint32_t pitchY, uint8_t* dstUV, uint32_t pitchUV, uint32_t width, uint32_t height) const
+{
+	if (slot >= m_pictures.size() || m_pictures[slot].plane[0].empty())
+	{
+		return;
+	}
+	const auto& picture = m_pictures[slot];
+	width = std::min(width, picture.stride[0]);
+	height = std::min(height, picture.height[0]);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		memcpy(dstY + size_t(y) * pitchY, picture.plane[0].data() + size_t(y) * picture.stride[0], width);
+	}
+	const uint32_t chromaWidth = (width + 1) / 2;
+	const uint32_t chromaHeight = (height + 1) / 2;
+	for (uint32_t y = 0; y < chromaHeight; ++y)
+	{
+		const uint8_t* cb = picture.plane[1].data() + size_t(y) * picture.stride[1];
+		const uint8_t* cr = picture.plane[2].data() + size_t(y) * picture.stride[2];
+		uint8_t* dst = dstUV + size_t(y) * pitchUV;
+		uint32_t x = 0;
+#if SOFTWARE_H264_USE_SSE2
+		for (; x + 16 <= chromaWidth; x += 16)
+		{
+			__m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cb + x));
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cr + x));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * x), _mm_unpacklo_epi8(u, v));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * x + 16), _mm_unpackhi_epi8(u, v));
+		}
+#endif
+		for (; x < chromaWidth; ++x)
+		{
+			dst[2 * x + 0] = cb[x];
+			dst[2 * x + 1] = cr[x];
+		}
+	}
+}
+
+void SoftwareH264Decoder::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& func)
+{
+	if (m_workers.empty() || count <= 1)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			func(i);
+		}
+		return;
+	}
+	uint64_t generation = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = &func;
+		m_taskCount = count;
+		m_taskNext = 0;
+		m_taskDone = 0;
+		generation = ++m_generation;
+	}
+	m_wakeWorkers.notify_all();
+	RunTasks(generation);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_tasksFinished.wait(lock, [&] { return m_taskDone == m_taskCount; });
+	m_task = nullptr;
+}
+
+void SoftwareH264Decoder::RunTasks(uint64_t generation)
+{
+	while (true)
+	{
+		const std::function<void(uint32_t)>* task = nullptr;
+		uint32_t index = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_generation != generation || m_taskNext >= m_taskCount)
+			{
+				return;
+			}
+			task = m_task;
+			index = m_taskNext++;
+		}
+		(*task)(index);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (++m_taskDone == m_taskCount)
+		{
+			m_tasksFinished.notify_all();
+		}
+	}
+}
+
+void SoftwareH264Decoder::WorkerMain()
+{
+	uint64_t seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeWorkers.wait(lock, [&] { return m_exit || m_generation != seen; });
+			if (m_exit)
+			{
+				return;
+			}
+			seen = m_generation;
+		}
+		RunTasks(seen);
+	}
+}
@@ -0,0 +1,139 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace h264 {
+	struct SPS;
+	struct PPS;
+}
+
+// Constrained Baseline プロファイル (CAVLC, I/P スライス) の H.264 を CPU でデコードする.
+// Vulkan Video のデコードキューを持たない環境でのフォールバックとして使う.
+// 参照画像は VideoPlayer が決めた DPB スロットに置き、ハードウェアと同じ指示で動作する.
+// スライスごとにスレッドへ分配し、デブロッキングは MB 行単位のウェーブフロントで並列に行う.
+class SoftwareH264Decoder
+{
+public:
+	struct Reference
+	{
+		uint32_t slot = 0;
+		int frameNum = 0;
+	};
+	struct FrameDesc
+	{
+		// 開始コード付きのスライス NAL を並べたもの. sliceOffsets は各スライスの先頭位置.
+		const uint8_t* bitstream = nullptr;
+		uint64_t size = 0;
+		const uint32_t* sliceOffsets = nullptr;
+		uint32_t sliceCount = 0;
+		const h264::SPS* spsArray = nullptr;
+		const h264::PPS* ppsArray = nullptr;
+		uint32_t spsCount = 0;
+		uint32_t ppsCount = 0;
+		uint32_t targetSlot = 0;
+		const Reference* references = nullptr;
+		uint32_t referenceCount = 0;
+	};
+	struct Statistics
+	{
+		uint64_t decodedFrames = 0;
+		uint64_t decodedSlices = 0;
+		uint64_t concealedMacroblocks = 0;	// 復号に失敗し、参照画像から補った MB 数.
+		double lastDecodeMilliseconds = 0.0;
+	};
+
+	SoftwareH264Decoder();
+	~SoftwareH264Decoder();
+
+	// 対応していないストリームの場合はその理由を返す. 対応していれば nullptr.
+	static const char* CheckSupport(const h264::SPS& sps, const h264::PPS& pps);
+
+	// threadCount が 0 の場合は論理コア数から決める.
+	bool Initialize(uint32_t widthInMbs, uint32_t heightInMbs, uint32_t slotCount, uint32_t threadCount = 0);
+	void Shutdown();
+
+	// 1フレーム分のスライスをデコードし、targetSlot に格納する.
+	// 一部の MB が復号できなかった場合も画像は埋めたうえで false を返す.
+	bool DecodeFrame(const FrameDesc& desc);
+
+	// スロットの画像を NV12 として書き出す.
+	void WriteNV12(uint32_t slot, uint8_t* dstY, uint32_t pitchY, uint8_t* dstUV, uint32_t pitchUV, uint32_t width, uint32_t height) const;
+
+	const Statistics& GetStatistics() const { return m_stats; }
+	uint32_t GetThreadCount() const { return uint32_t(m_workers.size()) + 1; }
+	const char* GetLastError() const { return m_lastError; }
+
+private:
+	struct Picture
+	{
+		std::vector<uint8_t> plane[3];	// Y, Cb, Cr.
+		uint32_t stride[3] = { };
+		uint32_t height[3] = { };
+	};
+	enum MbType : uint8_t
+	{
+		eI4x4,
+		eI16x16,
+		eIPCM,
+		eP,
+		ePSkip,
+		eConcealed,
+	};
+	// MB ごとの復号結果. 4x4 ブロックは MB 内のラスター順で持つ.
+	struct MbInfo
+	{
+		int16_t slice = -1;
+		MbType type = eConcealed;
+		int8_t qp = 0;
+		bool decoded = false;
+		uint8_t totalCoeff[24] = { };	// 輝度 16 + Cb 4 + Cr 4.
+		int8_t intraPredMode[16] = { };
+		int8_t refIdx[4] = { };			// 8x8 単位.
+		int8_t refSlot[4] = { };		// デブロッキングでの参照画像の比較用.
+		int16_t mv[16][2] = { };
+	};
+	struct Slice;
+	class SliceDecoder;
+
+	void EnsurePicture(uint32_t slot);
+	bool PrepareSlice(Slice& slice, const FrameDesc& desc, uint32_t index);
+	void ConcealMissingMacroblocks(const FrameDesc& desc);
+	void DeblockRow(uint32_t mby);
+	void DeblockMacroblock(uint32_t mbx, uint32_t mby);
+
+	// count 個の処理をワーカーと呼び出し元のスレッドで分担して実行し、完了を待つ.
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& func);
+	void RunTasks(uint64_t generation);
+	void WorkerMain();
+
+	uint32_t m_widthInMbs = 0;
+	uint32_t m_heightInMbs = 0;
+	std::vector<Picture> m_pictures;	// DPB スロットごと.
+	std::vector<MbInfo> m_mbs;
+	std::vector<int16_t> m_mbSlice;		// スライスの範囲から求めた MB の所属. 復号前に確定させる.
+	std::vector<std::unique_ptr<Slice>> m_slices;
+	uint32_t m_sliceCount = 0;
+	uint32_t m_targetSlot = 0;
+	std::unique_ptr<std::atomic<uint32_t>[]> m_deblockProgress;	// 行ごとのデブロッキング済み MB 数.
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_wakeWorkers;
+	std::condition_variable m_tasksFinished;
+	const std::function<void(uint32_t)>* m_task = nullptr;
+	uint64_t m_generation = 0;
+	uint32_t m_taskCount = 0;
+	uint32_t m_taskNext = 0;
+	uint32_t m_taskDone = 0;
+	bool m_exit = false;
+
+	Statistics m_stats;
+	const char* m_lastError = nullptr;
+};
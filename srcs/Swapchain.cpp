@@ -1,151 +1,245 @@
-﻿#include "Swapchain.h"
-
-#define VK_USE_PLATFORM_WIN32_KHR
-#include "Volk/volk.h"
-
-#include <format>
-
-bool Swapchain::Initialize(GLFWwindow* window, VkFormat desiredFormat)
-{
-  auto devCtx = DeviceContext::GetContext();
-  auto vkInstance = devCtx->GetVkInstance();
-  auto result = glfwCreateWindowSurface(vkInstance, window, nullptr, &m_surface) != VK_SUCCESS;
-
-  VkSurfaceCapabilitiesKHR surfaceCaps{};
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(devCtx->GetGPU(), m_surface, &surfaceCaps);
-  
-  VkExtent2D swapchainSize = { 1280, 720 };
-  if (surfaceCaps.currentExtent.width != ~0u)
-  {
-    swapchainSize = surfaceCaps.currentExtent;
-  }
-  m_imageCount = (std::min)(surfaceCaps.minImageCount, 2u);
-
-  uint32_t surfaceCount = 0;
-  vkGetPhysicalDeviceSurfaceFormatsKHR(devCtx->GetGPU(), m_surface, &surfaceCount, nullptr);
-  std::vector<VkSurfaceFormatKHR> formats(surfaceCount);
-  vkGetPhysicalDeviceSurfaceFormatsKHR(devCtx->GetGPU(), m_surface, &surfaceCount, formats.data());
-
-  // スワップチェインのフォーマットを決定.
-  for (auto& format : formats)
-  {
-    if (format.format == desiredFormat)
-    {
-      m_surfaceFormat = format;
-      break;
-    }
-  }
-  if (m_surfaceFormat.format == VK_FORMAT_UNDEFINED)
-  {
-    for (auto& format : formats)
-    {
-      if (format.colorSpace == VK_COLORSPACE_SRGB_NONLINEAR_KHR)
-      {
-        m_surfaceFormat = format;
-        break;
-      }
-    }
-    m_surfaceFormat = formats[0];
-  }
-
-  return Resize(swapchainSize);
-}
-
-void Swapchain::Shutdown()
-{
-  auto devCtx = DeviceContext::GetContext();
-  auto vkDevice = devCtx->GetVkDevice();
-  vkDestroySwapchainKHR(vkDevice, m_swapchain, nullptr);
-
-  m_images.clear();
-  for (auto& view : m_imageViews)
-  {
-    vkDestroyImageView(vkDevice, view, nullptr);
-  }
-  m_imageViews.clear();
-  m_swapchain = VK_NULL_HANDLE;
-}
-
-bool Swapchain::Resize(VkExtent2D extent)
-{
-  VkSwapchainKHR oldSwapchain = m_swapchain;
-  VkSwapchainCreateInfoKHR swapchainCI{
-      .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-      .surface = m_surface,
-      .minImageCount = m_imageCount,
-      .imageFormat = m_surfaceFormat.format,
-      .imageColorSpace = m_surfaceFormat.colorSpace,
-      .imageExtent = extent,
-      .imageArrayLayers = 1,
-      .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-      .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
-      .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
-      .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-      .presentMode = m_presentMode,
-      .clipped = VK_TRUE,
-      .oldSwapchain = oldSwapchain,
-  };
-  auto devCtx = DeviceContext::GetContext();
-  auto vkDevice = devCtx->GetVkDevice();
-  auto res = vkCreateSwapchainKHR(vkDevice, &swapchainCI, nullptr, &m_swapchain);
-  if (res != VK_SUCCESS)
-  {
-    char buf[64] = { 0 };
-    sprintf_s(buf, "vkCreateSwapchainKHR failed (%d).\n", res);
-    return false;
-  }
-  if (oldSwapchain != VK_NULL_HANDLE)
-  {
-    for (auto view : m_imageViews)
-    {
-      vkDestroyImageView(vkDevice, view, nullptr);
-    }
-    vkDestroySwapchainKHR(vkDevice, oldSwapchain, nullptr);
-  }
-  uint32_t imageCount = 0;
-  vkGetSwapchainImagesKHR(vkDevice, m_swapchain, &imageCount, nullptr);
-  m_imageViews.resize(imageCount);
-  m_images.resize(imageCount);
-
-  vkGetSwapchainImagesKHR(vkDevice, m_swapchain, &imageCount, m_images.data());
-  for (uint32_t i = 0; i < imageCount; ++i)
-  {
-    VkImageViewCreateInfo viewCI{
-      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-        .image = m_images[i],
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = m_surfaceFormat.format,
-        .components = { 
-          VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A
-        },
-        .subresourceRange = {
-          .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-          .baseMipLevel = 0,
-          .levelCount = 1,
-          .baseArrayLayer = 0,
-          .layerCount = 1
-        }
-    };
-    vkCreateImageView(vkDevice, &viewCI, nullptr, &m_imageViews[i]);
-  }
-  m_extent2D = swapchainCI.imageExtent;
-
-  return true;
-}
-
-VkResult Swapchain::AcquireNextImage(VkSemaphore semPresentComplete)
-{
-  auto devCtx = DeviceContext::GetContext();
-  auto vkDevice = devCtx->GetVkDevice();
-  uint32_t index = 0;
-  auto res = vkAcquireNextImageKHR(vkDevice, m_swapchain, UINT64_MAX, semPresentComplete, VK_NULL_HANDLE, &index);
-  if (res != VK_SUCCESS)
-  {
-    auto str = std::format("vkAcquireNextImageKHR failed. (result = {:d})\n", (int)res);
-    OutputDebugStringA(str.c_str());
-    return res;
-  }
-
-  m_currentIndex = index;
-  return res;
-}
+﻿#include "Swapchain.h"
+
+#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#include <algorithm>
+#include <format>
+
+bool Swapchain::Initialize(GLFWwindow* window, VkFormat desiredFormat)
+{
+  auto devCtx = DeviceContext::GetContext();
+  auto vkInstance = devCtx->GetVkInstance();
+  auto result = glfwCreateWindowSurface(vkInstance, window, nullptr, &m_surface) != VK_SUCCESS;
+
+  VkSurfaceCapabilitiesKHR surfaceCaps{};
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(devCtx->GetGPU(), m_surface, &surfaceCaps);
+  
+  VkExtent2D swapchainSize = { 1280, 720 };
+  if (surfaceCaps.currentExtent.width != ~0u)
+  {
+    swapchainSize = surfaceCaps.currentExtent;
+  }
+  // イメージ数はサーフェスの範囲内に収める. maxImageCount が 0 の場合は上限なし.
+  m_imageCount = m_requestedImageCount == 0 ? surfaceCaps.minImageCount + 1 : m_requestedImageCount;
+  m_imageCount = (std::max)(m_imageCount, surfaceCaps.minImageCount);
+  if (surfaceCaps.maxImageCount != 0)
+  {
+    m_imageCount = (std::min)(m_imageCount, surfaceCaps.maxImageCount);
+  }
+  m_presentMode = SelectPresentMode(m_requestedPresentMode);
+  {
+    auto str = std::format("Swapchain: {} ({} images requested, surface {}..{})\n",
+      GetPresentModeName(m_presentMode), m_imageCount, surfaceCaps.minImageCount, surfaceCaps.maxImageCount);
+    OutputDebugStringA(str.c_str());
+  }
+
+  uint32_t surfaceCount = 0;
+  vkGetPhysicalDeviceSurfaceFormatsKHR(devCtx->GetGPU(), m_surface, &surfaceCount, nullptr);
+  std::vector<VkSurfaceFormatKHR> formats(surfaceCount);
+  vkGetPhysicalDeviceSurfaceFormatsKHR(devCtx->GetGPU(), m_surface, &surfaceCount, formats.data());
+
+  // スワップチェインのフォーマットを決定.
+  for (auto& format : formats)
+  {
+    if (format.format == desiredFormat)
+    {
+      m_surfaceFormat = format;
+      break;
+    }
+  }
+  if (m_surfaceFormat.format == VK_FORMAT_UNDEFINED)
+  {
+    for (auto& format : formats)
+    {
+      if (format.colorSpace == VK_COLORSPACE_SRGB_NONLINEAR_KHR)
+      {
+        m_surfaceFormat = format;
+        break;
+      }
+    }
+    m_surfaceFormat = formats[0];
+  }
+
+  return Resize(swapchainSize);
+}
+
+VkPresentModeKHR Swapchain::SelectPresentMode(VkPresentModeKHR requested) const
+{
+  auto devCtx = DeviceContext::GetContext();
+  uint32_t modeCount = 0;
+  vkGetPhysicalDeviceSurfacePresentModesKHR(devCtx->GetGPU(), m_surface, &modeCount, nullptr);
+  std::vector<VkPresentModeKHR> modes(modeCount);
+  vkGetPhysicalDeviceSurfacePresentModesKHR(devCtx->GetGPU(), m_surface, &modeCount, modes.data());
+
+  if (std::find(modes.begin(), modes.end(), requested) != modes.end())
+  {
+    return requested;
+  }
+  auto str = std::format("Swapchain: {} is not supported. Fallback to FIFO.\n", GetPresentModeName(requested));
+  OutputDebugStringA(str.c_str());
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+const char* Swapchain::GetPresentModeName(VkPresentModeKHR mode)
+{
+  switch (mode)
+  {
+  case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+  case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+  case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+  case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+  default: return "Unknown";
+  }
+}
+
+void Swapchain::Shutdown()
+{
+  auto devCtx = DeviceContext::GetContext();
+  auto vkDevice = devCtx->GetVkDevice();
+  DestroyRetired(true);
+  vkDestroySwapchainKHR(vkDevice, m_swapchain, nullptr);
+
+  m_images.clear();
+  for (auto& view : m_imageViews)
+  {
+    vkDestroyImageView(vkDevice, view, nullptr);
+  }
+  m_imageViews.clear();
+  m_swapchain = VK_NULL_HANDLE;
+}
+
+bool Swapchain::Resize(VkExtent2D extent)
+{
+  auto devCtx = DeviceContext::GetContext();
+  auto vkDevice = devCtx->GetVkDevice();
+
+  // サーフェスが大きさを決めている場合はそれに従い、そうでなければ範囲内に収める.
+  VkSurfaceCapabilitiesKHR surfaceCaps{};
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(devCtx->GetGPU(), m_surface, &surfaceCaps);
+  if (surfaceCaps.currentExtent.width != ~0u)
+  {
+    extent = surfaceCaps.currentExtent;
+  }
+  else
+  {
+    extent.width = std::clamp(extent.width, surfaceCaps.minImageExtent.width, surfaceCaps.maxImageExtent.width);
+    extent.height = std::clamp(extent.height, surfaceCaps.minImageExtent.height, surfaceCaps.maxImageExtent.height);
+  }
+  if (extent.width == 0 || extent.height == 0)
+  {
+    // 最小化中は作成できない.
+    return false;
+  }
+
+  VkSwapchainKHR oldSwapchain = m_swapchain;
+  VkSwapchainCreateInfoKHR swapchainCI{
+      .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+      .surface = m_surface,
+      .minImageCount = m_imageCount,
+      .imageFormat = m_surfaceFormat.format,
+      .imageColorSpace = m_surfaceFormat.colorSpace,
+      .imageExtent = extent,
+      .imageArrayLayers = 1,
+      .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+      .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
+      .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+      .presentMode = m_presentMode,
+      .clipped = VK_TRUE,
+      .oldSwapchain = oldSwapchain,
+  };
+  VkSwapchainKHR newSwapchain = VK_NULL_HANDLE;
+  auto res = vkCreateSwapchainKHR(vkDevice, &swapchainCI, nullptr, &newSwapchain);
+  if (res != VK_SUCCESS)
+  {
+    char buf[64] = { 0 };
+    sprintf_s(buf, "vkCreateSwapchainKHR failed (%d).\n", res);
+    OutputDebugStringA(buf);
+    return false;
+  }
+  m_swapchain = newSwapchain;
+  if (oldSwapchain != VK_NULL_HANDLE)
+  {
+    // 古いスワップチェインのイメージは、処理中のフレームがまだ描画・表示に使っている可能性がある.
+    m_retired.push_back(Retired{ oldSwapchain, std::move(m_imageViews), m_acquireCount });
+    m_imageViews.clear();
+    if (m_framesInFlight == 0)
+    {
+      DestroyRetired(true);
+    }
+  }
+  uint32_t imageCount = 0;
+  vkGetSwapchainImagesKHR(vkDevice, m_swapchain, &imageCount, nullptr);
+  m_imageViews.resize(imageCount);
+  m_images.resize(imageCount);
+
+  vkGetSwapchainImagesKHR(vkDevice, m_swapchain, &imageCount, m_images.data());
+  for (uint32_t i = 0; i < imageCount; ++i)
+  {
+    VkImageViewCreateInfo viewCI{
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = m_images[i],
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = m_surfaceFormat.format,
+        .components = { 
+          VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A
+        },
+        .subresourceRange = {
+          .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+          .baseMipLevel = 0,
+          .levelCount = 1,
+          .baseArrayLayer = 0,
+          .layerCount = 1
+        }
+    };
+    vkCreateImageView(vkDevice, &viewCI, nullptr, &m_imageViews[i]);
+  }
+  m_extent2D = swapchainCI.imageExtent;
+
+  return true;
+}
+
+void Swapchain::DestroyRetired(bool force)
+{
+  auto vkDevice = DeviceContext::GetContext()->GetVkDevice();
+  // 呼び出し側は取得前にフレームのフェンスを待つため、m_framesInFlight 回前までの取得分は完了している.
+  std::erase_if(m_retired, [&](Retired& retired) {
+    if (!force && m_acquireCount < retired.acquireCount + m_framesInFlight)
+    {
+      return false;
+    }
+    for (auto view : retired.imageViews)
+    {
+      vkDestroyImageView(vkDevice, view, nullptr);
+    }
+    vkDestroySwapchainKHR(vkDevice, retired.swapchain, nullptr);
+    return true;
+  });
+}
+
+VkResult Swapchain::AcquireNextImage(VkSemaphore semPresentComplete)
+{
+  auto devCtx = DeviceContext::GetContext();
+  auto vkDevice = devCtx->GetVkDevice();
+  DestroyRetired(false);
+
+  uint32_t index = 0;
+  auto res = vkAcquireNextImageKHR(vkDevice, m_swapchain, UINT64_MAX, semPresentComplete, VK_NULL_HANDLE, &index);
+  if (res == VK_SUBOPTIMAL_KHR)
+  {
+    m_currentIndex = index;
+    m_acquireCount++;
+    return res;
+  }
+  if (res != VK_SUCCESS)
+  {
+    auto str = std::format("vkAcquireNextImageKHR failed. (result = {:d})\n", (int)res);
+    OutputDebugStringA(str.c_str());
+    return res;
+  }
+
+  m_currentIndex = index;
+  m_acquireCount++;
+  return res;
+}
@@ -1,37 +1,66 @@
-#pragma once
-
-#include "DeviceContext.h"
-
-#define GLFW_EXPOSE_NATIVE_WIN32
-#include "GLFW/glfw3.h"
-#include "GLFW/glfw3native.h"
-
-class Swapchain
-{
-public:
-  bool Initialize(GLFWwindow* window, VkFormat desiredFormat = VK_FORMAT_R8G8B8A8_UNORM);
-  void Shutdown();
-
-  bool Resize(VkExtent2D newExtent);
-
-  uint32_t GetCurrentIndex() const { return m_currentIndex; }
-  VkResult AcquireNextImage(VkSemaphore semPresentComplete);
-
-  VkSurfaceKHR m_surface;
-
-  uint32_t GetImageCount() const { return uint32_t(m_imageViews.size()); }
-  VkImageView GetImageView(int index) const { return m_imageViews[index]; }
-  VkSurfaceFormatKHR GetSurfaceFormat() const { return m_surfaceFormat; }
-  VkExtent2D GetExtent2D() const { return m_extent2D; }
-  VkSwapchainKHR GetHandle() const { return m_swapchain; }
-private:
-  uint32_t m_imageCount = 2;
-  VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
-  VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
-  VkSurfaceFormatKHR m_surfaceFormat = { .format = VK_FORMAT_UNDEFINED, .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
-
-  VkExtent2D m_extent2D;
-  std::vector<VkImage> m_images;
-  std::vector<VkImageView> m_imageViews;
-  uint32_t m_currentIndex = 0;
+#pragma once
+
+#include "DeviceContext.h"
+
+#define GLFW_EXPOSE_NATIVE_WIN32
+#include "GLFW/glfw3.h"
+#include "GLFW/glfw3native.h"
+
+class Swapchain
+{
+public:
+  bool Initialize(GLFWwindow* window, VkFormat desiredFormat = VK_FORMAT_R8G8B8A8_UNORM);
+  void Shutdown();
+
+  // 要求する表示モードとイメージ数. Initialize の前に設定し、サーフェスの対応状況で検証して確定する.
+  // 対応していない表示モードは FIFO (常に使用可能) になる. イメージ数 0 はサーフェスの最小数 + 1.
+  void SetPresentMode(VkPresentModeKHR mode) { m_requestedPresentMode = mode; }
+  void SetImageCount(uint32_t count) { m_requestedImageCount = count; }
+  VkPresentModeKHR GetPresentMode() const { return m_presentMode; }
+  static const char* GetPresentModeName(VkPresentModeKHR mode);
+
+  // oldSwapchain を指定して作り直す. 大きさはサーフェスの現在の大きさを優先する.
+  // 置き換えたスワップチェインとビューは、使用中のフレームが完了するまで破棄を遅らせる.
+  bool Resize(VkExtent2D newExtent);
+
+  // 同時に処理中となるフレーム数. 置き換えたスワップチェインは、この数のフレームを取得した後に破棄する.
+  // 0 の場合は Resize で即座に破棄する (呼び出し側でデバイスの完了を待つ場合).
+  void SetFramesInFlight(uint32_t count) { m_framesInFlight = count; }
+
+  uint32_t GetCurrentIndex() const { return m_currentIndex; }
+  // VK_SUBOPTIMAL_KHR の場合もイメージは取得されている. 表示後に Resize すること.
+  VkResult AcquireNextImage(VkSemaphore semPresentComplete);
+
+  VkSurfaceKHR m_surface;
+
+  uint32_t GetImageCount() const { return uint32_t(m_imageViews.size()); }
+  VkImageView GetImageView(int index) const { return m_imageViews[index]; }
+  VkSurfaceFormatKHR GetSurfaceFormat() const { return m_surfaceFormat; }
+  VkExtent2D GetExtent2D() const { return m_extent2D; }
+  VkSwapchainKHR GetHandle() const { return m_swapchain; }
+private:
+  VkPresentModeKHR SelectPresentMode(VkPresentModeKHR requested) const;
+  void DestroyRetired(bool force);
+
+  struct Retired
+  {
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    std::vector<VkImageView> imageViews;
+    uint64_t acquireCount = 0;  // 置き換えた時点の取得回数.
+  };
+  std::vector<Retired> m_retired;
+  uint32_t m_framesInFlight = 0;
+  uint64_t m_acquireCount = 0;
+
+  uint32_t m_imageCount = 2;
+  VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
+  uint32_t m_requestedImageCount = 0;
+  VkPresentModeKHR m_requestedPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+  VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
+  VkSurfaceFormatKHR m_surfaceFormat = { .format = VK_FORMAT_UNDEFINED, .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+
+  VkExtent2D m_extent2D;
+  std::vector<VkImage> m_images;
+  std::vector<VkImageView> m_imageViews;
+  uint32_t m_currentIndex = 0;
 };
\ No newline at end of file
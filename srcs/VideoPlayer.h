@@ -1,302 +1,367 @@
-﻿#pragma once
-
-#include <fstream>
-#include <deque>
-
-namespace vku
-{
-	struct GPUBuffer {
-		VkBuffer buffer = VK_NULL_HANDLE;
-		VmaAllocation allocation;
-		VmaAllocationInfo allocationInfo;
-	};
-	struct GPUImage {
-		VkImage						image = VK_NULL_HANDLE;
-		VkImageView				view = VK_NULL_HANDLE;
-		VmaAllocation			allocation;
-		VmaAllocationInfo	allocationInfo;
-	};
-}
-
-class VideoPlayer
-{
-public:
-	bool Initialize(const char* filePath);
-	void Shutdown();
-
-	// 再生のカウンタを進めるなど、コマンド積み込みが不要な処理を実行.
-	void Update(VkCommandBuffer graphicsCmdBuffer, double timestamp);
-
-	// デコード処理をコマンドに積む.
-	void UpdateDecode(VkCommandBuffer command, std::vector<VkImageMemoryBarrier2>& requestBarrierOnGfx);
-
-	class Decoder {
-	public:
-		struct DecoderQueryProperties
-		{
-			VkVideoDecodeH264CapabilitiesKHR decodeH264Caps;
-			VkVideoDecodeCapabilitiesKHR     decodeCaps;
-			VkVideoCapabilitiesKHR           caps;
-			VkVideoFormatPropertiesKHR       formatProps = {};
-			VkImageUsageFlags                usageDPB;
-		} m_properties;
-
-		struct Settings
-		{
-			VkVideoDecodeH264ProfileInfoKHR decodeH264ProfileInfo;
-			VkVideoProfileInfoKHR           profileInfo;
-			VkVideoProfileListInfoKHR       profileListInfo;
-		} m_settings;
-
-		enum class FrameType : uint8_t
-		{
-			eUnknown = 0,
-			eIntra,
-			ePredictive,
-		};
-		struct VideoDataFrameInfo
-		{
-			uint64_t srcOffset;
-			uint64_t frameBytes;
-			uint64_t size;
-
-			int poc;
-			int bottomFieldOrderCnt;
-			int topFieldOrderCnt;
-			int gop;
-			int displayOrder;
-			double decodeTimeSeconds;
-			double displayTimeSeconds;
-			double duration;
-
-			uint8_t nalUnitType;
-			FrameType frameType;
-			uint32_t nalRefIdc;
-			uint32_t  referencePriority = 0;
-		};
-		struct VideoFilePropertis
-		{
-			std::ifstream inputStream;
-			uint32_t widthPadd;
-			uint32_t heightPadd;
-			uint32_t width;
-			uint32_t height;
-			uint32_t spsCount;
-			uint32_t ppsCount;
-			uint32_t sliceHeaderCount;
-
-			std::vector<VideoDataFrameInfo> frameInfos;
-			uint64_t maxMemoryFrameSizeBytes;
-			uint32_t numDPBslots;
-			uint32_t maxReferencePictures;
-
-			std::vector<uint8_t> spsBytes;
-			std::vector<uint8_t> ppsBytes;
-			std::vector<uint8_t> sliceHeaderBytes;
-			std::vector<uint64_t> frameDisplayOrder;
-
-			double totalDuration;
-		} m_videoData;
-
-		struct VideoMemoryFrameInfo
-		{
-			const VideoDataFrameInfo* dataFrameInfo;
-			uint64_t gpuBitstreamOffset = 0;
-			uint64_t gpuBitstreamCapacity = 0;
-			uint64_t gpuBitstreamSize = 0;
-			uint8_t* gpuBitstreamSliceMappedMemoryAddress;
-			int decodingFrameIndex = -1;
-		};
-
-		struct DpbImage {
-			VkImage image;
-			VkImageView view;
-			VmaAllocation allocation;
-			VmaAllocationInfo allocationInfo;
-		};
-		struct DpbState {
-			int32_t slotindex;
-			uint16_t	frameNum;
-			StdVideoDecodeH264ReferenceInfo referenceInfo;
-		};
-
-		struct VideoDecodeOperation
-		{
-			enum Flags {
-				eNone = 0,
-				eSessionReset = 1 << 0,
-			};
-			enum class FrameType {
-				eIntra = 0,
-				ePredictive,
-			};
-			uint32_t flags;
-			uint64_t streamOffset = 0;
-			uint64_t streamSize = 0;
-			FrameType frameType = FrameType::eIntra;
-			uint32_t referencePriority = 0;
-			int decodedFrameIndex = 0;
-			const void* slideHeader = nullptr;
-			const void* pps = nullptr;
-			const void* sps = nullptr;
-			int poc[2] = { 0 };
-			uint32_t current_dpb = 0;
-			uint32_t dpbReferenceCount = 0;
-			const uint8_t* dpbReferenceSlots = nullptr;
-			const int* dpbPoc = nullptr;
-			const int* dpbFramenum = nullptr;
-
-			uint32_t dpbSlotNum = 0;
-			VkImage* pDPBs;
-			VkImageView* pDPBviews;
-		};
-
-		struct DecoderInfo
-		{
-			std::vector<VideoMemoryFrameInfo> memoryFrames;
-			std::vector<DpbImage> imagesDPB;
-			std::deque<DpbState>  dpbState;
-			uint32_t dpbTargetSlotIndex = 0;
-
-			uint64_t currentDecodeFrameIndex = 0;
-			int processingMemoryFrameIndex = -1;
-			int decodeFrameIndex = -1;
-
-			bool controlResetIssued = false;
-		} m_info;
-
-		void Initialize(const char* filePath);
-		void WriteVideoFrame(VideoMemoryFrameInfo& memoryFrame);
-
-		VkVideoSessionKHR GetVideoSession() {
-			return m_videoSession;
-		}
-
-		const void* GetSliceHeader() const;
-		const void* GetPPS()const;
-		const void* GetSPS()const;
-	private:
-		void ParseMp4Data(const char* filePath);
-		void CreateVideoSessionParameters();
-		void PrepareDecodedPictureBuffer();
-	public:
-		VkVideoSessionKHR m_videoSession = VK_NULL_HANDLE;
-		VkVideoSessionParametersKHR m_videoSessionParameters = VK_NULL_HANDLE;
-		vku::GPUBuffer m_gpuBitstreamBuffer;
-		std::vector<VmaAllocation> m_sessionMemoryAllocations;
-
-	};
-
-	struct Image {
-		VkImage image;
-		VkImageView view;
-		VmaAllocation allocation;
-		VmaAllocationInfo allocationInfo;
-	};
-	struct OutputImage
-	{
-		int display_order = -1;
-		Image texture;
-		uint32_t flags = 0;
-		enum Flags {
-			eInit = 1,
-		};
-		double duration = 0;
-	};
-
-	struct CommandBufferInfo
-	{
-		VkCommandBuffer videoCommandBuffer;
-		VkCommandBuffer graphicsCommandBuffer;
-		VkSemaphore     semVideoToGfx;
-	};
-	VkCommandPool m_gfxCommandPool;
-	VkCommandPool m_videoCommandPool;
-	VkEvent m_evtVideoPlayer;
-	std::vector<CommandBufferInfo> m_commandBuffersInfo;
-
-	int GetDecodeFrameNumber() const;
-	int GetDisplayFrameNumber() const;
-	int GetLastVideoFrameNumber()  const;
-	const Decoder::VideoFilePropertis& GetVideoProperties() const;
-	const Decoder::VideoDecodeOperation& GetDecodeOperation()const { return m_decodeOpration; }
-	std::vector<int> GetDPBSlotUsed() const { return m_DPBSlotUsed; }
-
-private:
-	struct DPB
-	{
-		enum {
-			SlotCount = 17,
-		};
-		Image image[SlotCount];
-		struct ResourceState {
-			VkAccessFlags2 flag;
-			VkImageLayout  layout;
-		} resourceState[SlotCount];
-
-		int pocStatus[SlotCount] = { 0 };
-		int framenumStatus[SlotCount] = { 0 };
-		std::vector<uint8_t> referenceUsage;
-		uint8_t nextRef = 0;
-		uint8_t nextSlot = 0;
-		uint8_t currentSlot = 0;
-	} m_dpb;
-
-	enum Flags : uint32_t{
-		eNone = 0,
-		ePlaying = 1 << 1,
-		eInitiallFirstFrameDecoded = 1 << 2,
-		eDecoderReset = 1 << 3,
-		eNeedResolve = 1 << 4,
-	};
-	uint32_t m_flags = Flags::eNone;
-  std::shared_ptr<Decoder> m_decoder;
-
-	int m_current_frame = 0;
-
-	vku::GPUBuffer m_movieBitStreamBuffer;
-	struct DecodeStreamFrame {
-		uint64_t gpuBitstreamCapacity;
-		uint64_t gpuBitstreamOffset;
-		uint64_t gpuBitstreamSize;
-		uint8_t* gpuBitstreamSliceMappedMemoryAddress;
-	} m_videoFrames[18];
-
-	void VideoDecodeCore(std::shared_ptr<Decoder> decoder, const Decoder::VideoDecodeOperation* operation, VkCommandBuffer commandBuffer);
-	void WriteVideoFrame(DecodeStreamFrame* frame);
-
-	Image CreateVideoTexture();
-
-	public:
-	std::vector<OutputImage> m_outputTexturesFree;
-	std::vector<OutputImage> m_outputTexturesUsed;
-
-	// 再生用のテクスチャが準備できているか.
-	bool IsReady();
-	// 現在の再生位置が示すテクスチャを取得.
-	const OutputImage& GetVideoTexture();
-
-	enum {
-		MAX_TEXTURE_COUNT = 64
-	};
-
-
-	void UpdateDisplayFrame(double elapsed);
-	void UpdateDecodeVideo();
-
-	void VideoDecodePreBarrier(VkCommandBuffer videoCmdBuffer);
-	void VideoDecodePostBarrier(VkCommandBuffer videoCmdBuffer);
-	void CopyToTexture(VkCommandBuffer videoCmdBuffer, OutputImage& dstImage);
-
-	struct VideoCursorInfo
-	{
-		int32_t playIndex;	// 再生中のフレーム番号を指す.
-		int32_t frameIndex;	// デコード済み配列内インデックスを指す.
-	} m_video_cursor;
-	bool m_isPrepared = false;
-	bool m_isStopped = false;
-
-	
-	Decoder::VideoDecodeOperation m_decodeOpration;	// 情報表示用.
-	std::vector<int> m_DPBSlotUsed;
-};
+﻿#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <deque>
+#include <cstdint>
+
+#pragma warning(push)
+#pragma warning(disable: 4068)
+#include "vk_mem_alloc.h"
+#pragma warning(pop)
+
+#include "ReorderQueue.h"
+#include "PresentationClock.h"
+#include "DecodeScheduler.h"
+#include "DecodeBackend.h"
+
+class FrameDumper;
+class VideoScaler;
+
+namespace vku
+{
+	struct GPUBuffer {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VmaAllocation allocation;
+		VmaAllocationInfo allocationInfo;
+	};
+	struct GPUImage {
+		VkImage						image = VK_NULL_HANDLE;
+		VkImageView				view = VK_NULL_HANDLE;
+		VmaAllocation			allocation;
+		VmaAllocationInfo	allocationInfo;
+	};
+}
+
+class VideoPlayer
+{
+public:
+	// backend を省略した場合は Vulkan Video でデコードする. デコードキューがなければ CPU でデコードする.
+	// scheduler が nullptr の場合は、要求したデコードを毎回その場で実行する.
+	bool Initialize(const char* filePath, std::shared_ptr<DecodeScheduler> scheduler, std::shared_ptr<IDecodeBackend> backend = nullptr);
+	void Shutdown();
+
+	// 再生のカウンタを進め、必要ならスケジューラーへデコードを要求する.
+	// 表示フレームは時刻源の現在時刻とフレームの表示時刻から決定する.
+	void RequestDecode();
+	// スケジューラーに許可された場合にデコード処理をコマンドに積む.
+	// DecodeScheduler::Schedule の後、Submit の前に呼ぶ.
+	void Update();
+
+	// 再生タイミングの時刻源を差し替える. 既定は SystemClock.
+	void SetClock(std::shared_ptr<IClock> clock) { m_presentationClock.SetClock(std::move(clock)); }
+	const PresentationClock::Statistics& GetPresentationStatistics() const { return m_presentationClock.GetStatistics(); }
+
+	// 負荷が高いときに参照されないフレームのデコードを省略するか.
+	void SetLoadSheddingEnabled(bool enabled) { m_loadSheddingEnabled = enabled; }
+	uint64_t GetShedFrameCount() const { return m_shedFrameCount; }
+	// 表示されないまま並べ替えのリングから追い出されたフレーム数.
+	uint64_t GetReorderEvictedCount() const { return m_reorderEvictedCount; }
+
+	// 表示開始までに先行してデコードしておくフレーム数. 負の値ならストリームの並べ替え深さを使う.
+	void SetPrebufferDepth(int depth) { m_prebufferDepth = depth; }
+	uint32_t GetPrebufferDepth() const;
+	// Initialize から最初のフレームを表示できるまでの時間. 未表示なら負の値.
+	double GetTimeToFirstFrame() const { return m_timeToFirstFrameSeconds; }
+
+	// 確保を要求する出力テクスチャの数. Initialize の前に呼ぶ. メモリの予算により減る場合がある.
+	void SetOutputTextureCount(uint32_t count) { m_outputTextureCount = std::min(count, uint32_t(MAX_TEXTURE_COUNT)); }
+
+	// 並べ替えのないストリームでは、デコードしたフレームを同じ送信で表示へ回す.
+	void SetLowLatencyEnabled(bool enabled) { m_lowLatencyEnabled = enabled; }
+	bool IsLowLatencyMode() const;
+
+	// 描画側で同時に処理中となるフレーム数. 表示を終えたテクスチャは、この回数の RequestDecode を経てから再利用する.
+	// 0 の場合は即座に再利用する (描画の完了を毎フレーム待つ場合).
+	void SetFramesInFlight(uint32_t count) { m_framesInFlight = count; }
+
+	// デコードしたフレームを表示順でファイルへ書き出す. スケジューラーを使う場合のみ有効.
+	void SetFrameDumper(std::shared_ptr<FrameDumper> dumper) { m_frameDumper = std::move(dumper); }
+	// デコードしたフレームを縮小する. 縮小はバックエンドがデコード後のバリアに続けて記録する.
+	// scaler は出力テクスチャ (OutputImage::index) ごとの縮小先を持つこと.
+	void SetScaler(std::shared_ptr<VideoScaler> scaler);
+	const std::shared_ptr<VideoScaler>& GetScaler() const { return m_scaler; }
+
+	// ループ再生. 表示順はループをまたいで連続し、セッションのリセットも行わない.
+	void SetLoopEnabled(bool enabled);
+	bool IsLoopEnabled() const { return m_loopEnabled; }
+	uint32_t GetLoopCount() const;
+	// デコード中のループ回数. 出力テクスチャに余裕があれば表示より先のループへ進む.
+	uint32_t GetDecodeLoopCount() const { return m_decodeLoopCount; }
+	// 末尾のフレームの表示期間を終えた.
+	bool IsStopped() const { return m_isStopped; }
+
+	// デコード処理をコマンドに積む.
+	void UpdateDecode(VkCommandBuffer command, std::vector<VkImageMemoryBarrier2>& requestBarrierOnGfx);
+
+	class Decoder {
+	public:
+		struct DecoderQueryProperties
+		{
+			VkVideoDecodeH264CapabilitiesKHR decodeH264Caps;
+			VkVideoDecodeCapabilitiesKHR     decodeCaps;
+			VkVideoCapabilitiesKHR           caps;
+			VkVideoFormatPropertiesKHR       formatProps = {};
+			VkImageUsageFlags                usageDPB;
+		} m_properties;
+
+		struct Settings
+		{
+			VkVideoDecodeH264ProfileInfoKHR decodeH264ProfileInfo;
+			VkVideoProfileInfoKHR           profileInfo;
+			VkVideoProfileListInfoKHR       profileListInfo;
+		} m_settings;
+
+		enum class FrameType : uint8_t
+		{
+			eUnknown = 0,
+			eIntra,
+			ePredictive,
+		};
+		struct VideoDataFrameInfo
+		{
+			uint64_t srcOffset;
+			uint64_t frameBytes;
+			uint64_t size;
+
+			int poc;
+			int bottomFieldOrderCnt;
+			int topFieldOrderCnt;
+			int gop;
+			int displayOrder;
+			double decodeTimeSeconds;
+			double displayTimeSeconds;
+			double duration;
+
+			uint8_t nalUnitType;
+			FrameType frameType;
+			uint32_t nalRefIdc;
+			uint32_t  referencePriority = 0;
+			uint32_t sliceCount = 0;	// フレームを構成するスライス NAL の数.
+		};
+		struct VideoFilePropertis
+		{
+			std::ifstream inputStream;
+			uint32_t widthPadd;
+			uint32_t heightPadd;
+			uint32_t width;
+			uint32_t height;
+			uint32_t spsCount;
+			uint32_t ppsCount;
+			uint32_t sliceHeaderCount;
+
+			std::vector<VideoDataFrameInfo> frameInfos;
+			uint64_t maxMemoryFrameSizeBytes;
+			uint32_t numDPBslots;
+			uint32_t maxReferencePictures;
+			uint32_t numReorderFrames;	// 表示順へ並べ替えるために先行してデコードが必要なフレーム数.
+			bool isReorderFree;			// デコード順がそのまま表示順となるストリーム.
+
+			std::vector<uint8_t> spsBytes;
+			std::vector<uint8_t> ppsBytes;
+			std::vector<uint8_t> sliceHeaderBytes;
+			std::vector<uint64_t> frameDisplayOrder;
+
+			double totalDuration;
+		} m_videoData;
+
+		struct DpbState {
+			int32_t slotindex;
+			uint16_t	frameNum;
+			StdVideoDecodeH264ReferenceInfo referenceInfo;
+		};
+
+		using VideoDecodeOperation = ::VideoDecodeOperation;
+
+		struct DecoderInfo
+		{
+			std::deque<DpbState>  dpbState;
+			uint32_t dpbTargetSlotIndex = 0;
+
+			uint64_t currentDecodeFrameIndex = 0;
+			int decodeFrameIndex = -1;
+
+			bool controlResetIssued = false;
+		} m_info;
+
+		// ファイルを解析する. デバイスには依存しない.
+		void Open(const char* filePath);
+		// Vulkan Video のセッションを作成し、デバイスの制限を反映する. Open の後に呼ぶ.
+		void CreateVideoSession();
+		// CreateVideoSession で作ったセッションとパラメーター、セッションのメモリを破棄する. GPU の完了後に呼ぶ.
+		void DestroyVideoSession();
+
+		VkVideoSessionKHR GetVideoSession() {
+			return m_videoSession;
+		}
+
+		const void* GetSliceHeader() const;
+		const void* GetPPS()const;
+		const void* GetSPS()const;
+	private:
+		void ParseMp4Data(const char* filePath);
+		void CreateVideoSessionParameters();
+	public:
+		VkVideoSessionKHR m_videoSession = VK_NULL_HANDLE;
+		VkVideoSessionParametersKHR m_videoSessionParameters = VK_NULL_HANDLE;
+		std::vector<VmaAllocation> m_sessionMemoryAllocations;
+
+	};
+
+	struct Image {
+		VkImage image;
+		VkImageView view;
+		VmaAllocation allocation;
+		VmaAllocationInfo allocationInfo;
+	};
+	struct OutputImage
+	{
+		int64_t display_order = -1;
+		uint32_t index = 0;	// バックエンドの出力先の番号.
+		DecodeOutputTexture texture;
+	};
+
+	std::shared_ptr<DecodeScheduler> m_scheduler;
+	DecodeScheduler::StreamId m_streamId = DecodeScheduler::InvalidStream;
+	DecodeScheduler::StreamId GetStreamId() const { return m_streamId; }
+
+	std::shared_ptr<IDecodeBackend> m_backend;
+	const std::shared_ptr<IDecodeBackend>& GetBackend() const { return m_backend; }
+
+	std::shared_ptr<FrameDumper> m_frameDumper;
+	std::shared_ptr<VideoScaler> m_scaler;
+
+	int GetDecodeFrameNumber() const;
+	int GetDisplayFrameNumber() const;
+	int GetLastVideoFrameNumber()  const;
+	const Decoder::VideoFilePropertis& GetVideoProperties() const;
+	const Decoder::VideoDecodeOperation& GetDecodeOperation()const { return m_decodeOpration; }
+	std::vector<int> GetDPBSlotUsed() const { return m_DPBSlotUsed; }
+
+	// 範囲を指定したデコード (OfflineDecoder が使う). 表示や時刻は使わず、[firstFrame, endFrame) をデコード順にデコードする.
+	// firstFrame は IDR であること. デコードしたフレームは表示順で FindDecodedFrame から取得し、ReleaseDecodedFrame で返す.
+	void BeginDecodeRange(int firstFrame, int endFrame);
+	// 範囲の次のフレームのデコードを要求する. 範囲を終えた場合と出力テクスチャに空きがない場合は要求しない.
+	void RequestRangeDecode();
+	// 許可された場合に範囲の次のフレームのデコードをコマンドに積む.
+	void UpdateRangeDecode();
+	bool IsRangeDecoded() const { return m_isDecodeCompleted; }
+	const OutputImage* FindDecodedFrame(int64_t displayOrder) { return m_outputTexturesUsed.Find(displayOrder); }
+	void ReleaseDecodedFrame(int64_t displayOrder);
+
+private:
+	// backend を省略した場合のバックエンド. デバイスに依存するため VideoPlayerDevice.cpp で定義する.
+	static std::shared_ptr<IDecodeBackend> CreateDefaultBackend(std::shared_ptr<Decoder> decoder);
+
+	struct DPB
+	{
+		enum {
+			SlotCount = VideoDecodeOperation::MaxDpbSlotCount,
+		};
+		uint32_t slotCount = 0;	// SPS から求めた実際に使用するスロット数.
+
+		int pocStatus[SlotCount] = { 0 };
+		int framenumStatus[SlotCount] = { 0 };
+		std::vector<uint8_t> referenceUsage;
+		uint8_t nextRef = 0;
+		uint8_t nextSlot = 0;
+		uint8_t currentSlot = 0;
+	} m_dpb;
+
+	enum Flags : uint32_t{
+		eNone = 0,
+		ePlaying = 1 << 1,
+		eInitiallFirstFrameDecoded = 1 << 2,
+		eDecoderReset = 1 << 3,
+		eNeedResolve = 1 << 4,
+	};
+	uint32_t m_flags = Flags::eNone;
+  std::shared_ptr<Decoder> m_decoder;
+
+	int m_current_frame = 0;
+
+	// ビットストリームはデコード順にスロットを巡回して書き込む.
+	// ループや範囲の指定で m_current_frame が戻っても使用中のスロットを上書きしないよう、デコードの通し番号で選ぶ.
+	enum {
+		BITSTREAM_SLOT_COUNT = DPB::SlotCount + 1,
+	};
+	uint64_t m_decodeCounter = 0;
+	uint64_t WriteVideoFrame(uint32_t bitstreamSlot);
+
+	// 出力テクスチャはバックエンドが初期化時にまとめて確保し、以降は再利用する.
+	void InitializeOutputTextures(uint32_t textureCount);
+
+	// 表示を終えたテクスチャ. 描画中のフレームが完了するまで再利用を待つ.
+	struct RetiredImage
+	{
+		OutputImage image;
+		uint64_t frame = 0;	// 表示を終えたときの m_frameCounter.
+	};
+	std::deque<RetiredImage> m_outputTexturesRetired;
+	uint32_t m_framesInFlight = 0;
+	uint64_t m_frameCounter = 0;
+	uint32_t m_outputTextureCount = MAX_TEXTURE_COUNT;
+	void RetireOutputTexture(const OutputImage& image);
+	void ReclaimOutputTextures();
+	void OnReorderEvicted(const OutputImage& image);
+	uint64_t m_reorderEvictedCount = 0;
+
+	public:
+	std::vector<OutputImage> m_outputTexturesFree;
+	// デコード済みのフレーム. 表示順で参照する.
+	ReorderQueue<OutputImage> m_outputTexturesUsed;
+
+	// 再生用のテクスチャが準備できているか.
+	bool IsReady();
+	// 現在の再生位置が示すテクスチャを取得.
+	const OutputImage& GetVideoTexture();
+
+	enum {
+		MAX_TEXTURE_COUNT = 64,
+		// メモリが足りない場合に、並べ替えの深さに加えて最低限確保する出力テクスチャの数.
+		MIN_TEXTURE_MARGIN = 4,
+	};
+	// バックエンドが確保できた出力テクスチャの数. MAX_TEXTURE_COUNT 以下.
+	uint32_t GetOutputTextureCount() const { return m_outputTextureCount; }
+
+
+	PresentationClock m_presentationClock;
+	void UpdateDisplayFrame();
+	void UpdateDecodeVideo();
+	void AdvanceDecodeFrame();
+
+	// 負荷制御. nal_ref_idc が 0 のフレームは、他から参照されないため省略できる.
+	bool m_loadSheddingEnabled = true;
+	uint64_t m_shedFrameCount = 0;
+	bool ShouldShedFrame(const Decoder::VideoDataFrameInfo& frameInfo) const;
+
+	struct VideoCursorInfo
+	{
+		int64_t playIndex = 0;	// 再生中のフレームの表示順を指す.
+	} m_video_cursor;
+	bool m_isPrepared = false;
+	int m_prebufferDepth = -1;
+	double m_startupTime = 0.0;
+	double m_timeToFirstFrameSeconds = -1.0;
+	void UpdateStartupState();
+	bool m_lowLatencyEnabled = true;
+	bool m_isStopped = false;
+	bool m_decodeRequested = false;	// スケジューラーなしで使う場合の要求.
+	bool m_isDecodeCompleted = false;	// 末尾までデコードを終えた.
+	int m_decodeRangeEnd = -1;		// BeginDecodeRange の終端. 負の値なら範囲を指定しない再生.
+
+	// ループ再生.
+	// 表示順は (ループ回数 * フレーム数 + ファイル内の表示順) として単調に増加させる.
+	// 長時間のループでも桁あふれしないよう 64bit で扱う.
+	bool m_loopEnabled = false;
+	uint32_t m_decodeLoopCount = 0;		// デコード中のループ回数.
+	int64_t m_lastDisplayOrder = INT64_MAX;	// 再生を終える表示順. ループ中は未確定.
+	int64_t GetDecodeDisplayOrder(const Decoder::VideoDataFrameInfo& frameInfo) const;
+	const Decoder::VideoDataFrameInfo& GetFrameInfoByDisplayOrder(int64_t displayOrder) const;
+	double GetDisplayTime(int64_t displayOrder) const;
+
+	
+	Decoder::VideoDecodeOperation m_decodeOpration;	// 情報表示用.
+	std::vector<uint32_t> m_sliceOffsets;	// 書き込んだフレームの各スライスの位置.
+	std::vector<int> m_DPBSlotUsed;
+};
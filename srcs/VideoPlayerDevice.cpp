@@ -0,0 +1,499 @@
+﻿#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+#include "DeviceContext.h"
+
+#undef ERROR
+#undef min
+#undef max
+
+#include "h264.h"
+
+#define ARRAY_SIZE( x ) \
+	( sizeof( x ) / sizeof( x[ 0 ] ) )
+
+#include <vulkan/vulkan.hpp>
+#include "VideoPlayer.h"
+#include "VulkanDecodeBackend.h"
+#include "SoftwareDecodeBackend.h"
+
+// VideoPlayer のうちデバイスに依存する部分. 既定のバックエンドの選択と Vulkan Video のセッションの作成.
+// NullDecodeBackend を渡して動かす場合は使われない.
+
+static constexpr size_t align_to(size_t sz, size_t alignment) {
+	return ((sz - 1) / alignment + 1) * alignment;
+};
+
+std::shared_ptr<IDecodeBackend> VideoPlayer::CreateDefaultBackend(std::shared_ptr<Decoder> decoder)
+{
+	if (DeviceContext::GetContext()->HasVideoDecodeQueue())
+	{
+		return std::make_shared<VulkanDecodeBackend>(std::move(decoder));
+	}
+	return std::make_shared<SoftwareDecodeBackend>(std::move(decoder));
+}
+
+void VideoPlayer::Decoder::CreateVideoSession()
+{
+	auto devCtx = DeviceContext::GetContext();
+	m_properties.decodeH264Caps = {
+		.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_CAPABILITIES_KHR,
+	};
+	m_properties.decodeCaps = {
+		.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_CAPABILITIES_KHR,
+		.pNext = &m_properties.decodeH264Caps
+	};
+	m_properties.caps = {
+		.sType = VK_STRUCTURE_TYPE_VIDEO_CAPABILITIES_KHR,
+		.pNext = &m_properties.decodeCaps,
+	};
+		
+		
+	vk::VideoDecodeH264CapabilitiesKHR();
+	m_properties.decodeCaps = vk::VideoDecodeCapabilitiesKHR();
+	m_properties.decodeCaps.pNext = &m_properties.decodeH264Caps;
+	
+	m_settings.decodeH264ProfileInfo = vk::VideoDecodeH264ProfileInfoKHR()
+		.setStdProfileIdc(STD_VIDEO_H264_PROFILE_IDC_BASELINE)
+		.setPictureLayout(vk::VideoDecodeH264PictureLayoutFlagBitsKHR::eInterlacedInterleavedLines);
+	m_settings.profileInfo = vk::VideoProfileInfoKHR()
+		.setPNext(&m_settings.decodeH264ProfileInfo)
+		.setVideoCodecOperation(vk::VideoCodecOperationFlagBitsKHR::eDecodeH264)
+		.setChromaSubsampling(vk::VideoChromaSubsamplingFlagBitsKHR::e420)
+		.setLumaBitDepth(vk::VideoComponentBitDepthFlagBitsKHR::e8)
+		.setChromaBitDepth(vk::VideoComponentBitDepthFlagBitsKHR::e8);
+
+	m_properties.caps = vk::VideoCapabilitiesKHR();
+  m_properties.caps.pNext = &m_properties.decodeCaps;
+
+	VkResult res;
+	res = vkGetPhysicalDeviceVideoCapabilitiesKHR(
+		devCtx->GetGPU(), &m_settings.profileInfo, &m_properties.caps);
+	assert(res == VK_SUCCESS);
+
+	// ビデオフォーマットの確認.
+	m_settings.profileListInfo = vk::VideoProfileListInfoKHR();
+	m_settings.profileListInfo.profileCount = 1;
+	m_settings.profileListInfo.pProfiles = &m_settings.profileInfo;
+
+	VkPhysicalDeviceVideoFormatInfoKHR formatInfo = vk::PhysicalDeviceVideoFormatInfoKHR()
+		.setPNext(&m_settings.profileListInfo)
+		.setImageUsage(
+			vk::ImageUsageFlagBits::eVideoDecodeSrcKHR |
+			vk::ImageUsageFlagBits::eVideoDecodeDstKHR |
+			vk::ImageUsageFlagBits::eVideoDecodeDpbKHR |
+			vk::ImageUsageFlagBits::eTransferSrc |
+			vk::ImageUsageFlagBits::eSampled
+		);
+	uint32_t formatPropsCount = 0;
+	res = vkGetPhysicalDeviceVideoFormatPropertiesKHR(
+		devCtx->GetGPU(), &formatInfo, &formatPropsCount, nullptr);
+	assert(res == VK_SUCCESS);
+	std::vector<VkVideoFormatPropertiesKHR> videoFormatProps;
+	videoFormatProps.resize(formatPropsCount, { .sType = VK_STRUCTURE_TYPE_VIDEO_FORMAT_PROPERTIES_KHR });
+	res = vkGetPhysicalDeviceVideoFormatPropertiesKHR(
+		devCtx->GetGPU(), &formatInfo, &formatPropsCount, videoFormatProps.data());
+	assert(res == VK_SUCCESS);
+	assert(videoFormatProps.size() != 0);
+	m_properties.formatProps = videoFormatProps.front();
+
+	// ビットストリームの配置に必要なアライメントを反映.
+	uint64_t frameSizeBytes = align_to(m_videoData.maxMemoryFrameSizeBytes, m_properties.caps.minBitstreamBufferOffsetAlignment);
+	m_videoData.maxMemoryFrameSizeBytes = align_to(frameSizeBytes, m_properties.caps.minBitstreamBufferSizeAlignment);
+
+	// ビットストリームのバッファはバックエンドが確保する (VulkanDecodeBackend::CreateBitstreamBuffer).
+	auto videoDecoderQueueFamilyIndex = devCtx->GetDecoderQueueFamilyIndex();
+
+	if (m_videoData.numDPBslots > m_properties.caps.maxDpbSlots)
+	{
+		char buf[1024] = { 0 };
+		sprintf_s(buf, "Number of requested dpb slots is %d, but device can only provide a maximum of %d\n",
+			m_videoData.numDPBslots,m_properties.caps.maxDpbSlots);
+		OutputDebugStringA(buf);
+	}
+	m_videoData.numDPBslots = std::min({ m_videoData.numDPBslots, m_properties.caps.maxDpbSlots, uint32_t(DPB::SlotCount) });
+	m_videoData.maxReferencePictures = std::min(m_videoData.numDPBslots, m_properties.caps.maxActiveReferencePictures);
+
+	VkVideoSessionCreateInfoKHR sessionCI{
+		.sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_CREATE_INFO_KHR,
+		.queueFamilyIndex = videoDecoderQueueFamilyIndex,
+		.pVideoProfile = &m_settings.profileInfo,
+		.pictureFormat = m_properties.formatProps.format,
+		.maxCodedExtent = {
+			.width = std::min(m_videoData.width, m_properties.caps.maxCodedExtent.width),
+			.height = std::min(m_videoData.height, m_properties.caps.maxCodedExtent.height),
+		},
+		.referencePictureFormat = m_properties.formatProps.format,
+		.maxDpbSlots = m_videoData.numDPBslots,
+		.maxActiveReferencePictures = m_videoData.maxReferencePictures,
+		.pStdHeaderVersion = &m_properties.caps.stdHeaderVersion,
+	};
+	res = vkCreateVideoSessionKHR(devCtx->GetVkDevice(), &sessionCI, nullptr, &m_videoSession);
+	assert(res == VK_SUCCESS);
+
+	{
+		uint32_t requirementCount = 0;
+		vkGetVideoSessionMemoryRequirementsKHR(
+			devCtx->GetVkDevice(),
+			m_videoSession,
+			&requirementCount, nullptr);
+		std::vector<VkVideoSessionMemoryRequirementsKHR> requirements(requirementCount, { .sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_MEMORY_REQUIREMENTS_KHR });
+		res = vkGetVideoSessionMemoryRequirementsKHR(
+			devCtx->GetVkDevice(),
+			m_videoSession,	&requirementCount, requirements.data());
+		assert(res == VK_SUCCESS);
+		m_sessionMemoryAllocations.resize(requirementCount);
+
+		std::vector<VkBindVideoSessionMemoryInfoKHR> bindSessionMemoryInfos(requirementCount);
+		for (uint32_t i = 0; i < requirementCount; ++i)
+		{
+			auto& req = requirements[i];
+			VmaAllocationInfo				allocInfo{};
+			VmaAllocationCreateInfo	allocCI{};
+			allocCI.memoryTypeBits = req.memoryRequirements.memoryTypeBits;
+
+			res = vmaAllocateMemory(
+				devCtx->GetVmaAllocator(),
+				&req.memoryRequirements,
+				&allocCI,	&m_sessionMemoryAllocations[i],	&allocInfo);
+			assert(res == VK_SUCCESS);
+
+			auto& bindInfo = bindSessionMemoryInfos[i];
+			bindInfo = {
+				.sType = VK_STRUCTURE_TYPE_BIND_VIDEO_SESSION_MEMORY_INFO_KHR,
+				.memoryBindIndex = req.memoryBindIndex,
+				.memory = allocInfo.deviceMemory,
+				.memoryOffset = allocInfo.offset,
+				.memorySize = allocInfo.size,
+			};
+		}
+		res = vkBindVideoSessionMemoryKHR(
+			devCtx->GetVkDevice(), m_videoSession, 
+			uint32_t(bindSessionMemoryInfos.size()), bindSessionMemoryInfos.data());
+		assert(res == VK_SUCCESS);
+	}
+
+	CreateVideoSessionParameters();
+	
+	if (m_properties.decodeCaps.flags & VK_VIDEO_DECODE_CAPABILITY_DPB_AND_OUTPUT_COINCIDE_BIT_KHR)
+	{
+		OutputDebugStringA("NOTE: video decode: dpb and output coincide\n");
+	}
+	else
+	{
+		OutputDebugStringA("NOTE: video decode: dpb and output NOT coincide\n");
+	}
+	if (m_properties.decodeCaps.flags & VK_VIDEO_DECODE_CAPABILITY_DPB_AND_OUTPUT_DISTINCT_BIT_KHR)
+	{
+		OutputDebugStringA("NOTE: video decode: dpb and output distinct\n");
+	}
+	else
+	{
+		OutputDebugStringA("NOTE: video decode: dpb and output NOT distinct\n");
+	}
+	m_properties.usageDPB = \
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+		VK_IMAGE_USAGE_VIDEO_DECODE_DPB_BIT_KHR |
+		VK_IMAGE_USAGE_VIDEO_DECODE_DST_BIT_KHR;
+
+#if _DEBUG
+	// このフラグを立てておくと、nsight graphics で中身をある程度確認可能.
+	m_properties.usageDPB |= VK_IMAGE_USAGE_SAMPLED_BIT;
+#endif
+
+	m_videoData.inputStream.seekg(0, std::ios::beg);
+}
+
+void VideoPlayer::Decoder::CreateVideoSessionParameters()
+{
+	std::vector<StdVideoH264PictureParameterSet> videoPictureParameterSets(m_videoData.ppsCount);
+	std::vector<StdVideoH264ScalingLists>        videoScalingListPPS(m_videoData.ppsCount);
+	for (size_t i = 0; i != m_videoData.ppsCount; i++)
+	{
+		const auto pps = reinterpret_cast<const h264::PPS*>(m_videoData.ppsBytes.data()) + i;
+
+		auto& sl = videoScalingListPPS[i];
+		sl = {};
+		for (int j = 0; j != std::size(pps->pic_scaling_list_present_flag); j++) {
+			sl.scaling_list_present_mask |= uint16_t(pps->pic_scaling_list_present_flag[j]) << j;
+		}
+
+		{
+			decltype(sl.use_default_scaling_matrix_mask) j;
+			for (j = 0; j != ARRAY_SIZE(pps->UseDefaultScalingMatrix4x4Flag); j++) {
+				sl.use_default_scaling_matrix_mask |=
+					static_cast<decltype(j)>(pps->UseDefaultScalingMatrix4x4Flag[j]) << j;
+			}
+		}
+
+		for (size_t list_idx = 0;
+			list_idx < STD_VIDEO_H264_SCALING_LIST_4X4_NUM_LISTS &&
+			list_idx < ARRAY_SIZE(pps->ScalingList4x4);
+			list_idx++) {
+			for (size_t el_idx = 0;
+				el_idx < STD_VIDEO_H264_SCALING_LIST_4X4_NUM_ELEMENTS &&
+				el_idx < ARRAY_SIZE(pps->ScalingList4x4[0]);
+				el_idx++) {
+				sl.ScalingList4x4[list_idx][el_idx] = pps->ScalingList4x4[list_idx][el_idx];
+			}
+		}
+
+		for (size_t list_idx = 0;
+			list_idx < STD_VIDEO_H264_SCALING_LIST_8X8_NUM_LISTS &&
+			list_idx < ARRAY_SIZE(pps->ScalingList8x8);
+			list_idx++) {
+			for (size_t el_idx = 0;
+				el_idx < STD_VIDEO_H264_SCALING_LIST_8X8_NUM_ELEMENTS &&
+				el_idx < ARRAY_SIZE(pps->ScalingList8x8[0]);
+				el_idx++) {
+				sl.ScalingList8x8[list_idx][el_idx] = pps->ScalingList8x8[list_idx][el_idx];
+			}
+		}
+
+		videoPictureParameterSets[i] = {
+			.flags = {
+				.transform_8x8_mode_flag = uint32_t(pps->transform_8x8_mode_flag),
+				.redundant_pic_cnt_present_flag = uint32_t(pps->redundant_pic_cnt_present_flag),
+				.constrained_intra_pred_flag = uint32_t(pps->constrained_intra_pred_flag),
+				.deblocking_filter_control_present_flag = uint32_t(pps->deblocking_filter_control_present_flag),
+				.weighted_pred_flag = uint32_t(pps->weighted_pred_flag),
+				.bottom_field_pic_order_in_frame_present_flag = uint32_t(pps->pic_order_present_flag),
+				.entropy_coding_mode_flag = uint32_t(pps->entropy_coding_mode_flag),
+				.pic_scaling_matrix_present_flag = uint32_t(pps->pic_scaling_matrix_present_flag),
+			},
+			.seq_parameter_set_id = uint8_t(pps->seq_parameter_set_id),
+			.pic_parameter_set_id = uint8_t(pps->pic_parameter_set_id),
+			.num_ref_idx_l0_default_active_minus1 = uint8_t(pps->num_ref_idx_l0_active_minus1),
+			.num_ref_idx_l1_default_active_minus1 = uint8_t(pps->num_ref_idx_l1_active_minus1),
+			.weighted_bipred_idc = StdVideoH264WeightedBipredIdc(pps->weighted_bipred_idc),
+			.pic_init_qp_minus26 = int8_t(pps->pic_init_qp_minus26),
+			.pic_init_qs_minus26 = int8_t(pps->pic_init_qs_minus26),
+			.chroma_qp_index_offset = int8_t(pps->chroma_qp_index_offset),
+			.second_chroma_qp_index_offset = int8_t(pps->second_chroma_qp_index_offset),
+			.pScalingLists = &videoScalingListPPS[i],
+		};
+	}
+
+	std::vector<StdVideoH264SequenceParameterSet>    videoSequenceParameterSet(m_videoData.spsCount);
+	std::vector<StdVideoH264SequenceParameterSetVui> videoSequenceParameterSetVui(m_videoData.spsCount);
+	std::vector<StdVideoH264ScalingLists>            videoScalingListsSPS(m_videoData.spsCount);
+	std::vector<StdVideoH264HrdParameters>           videoHrdParameters(m_videoData.spsCount);
+
+	for (size_t i = 0; i != m_videoData.spsCount; i++) {
+
+		const auto sps = (reinterpret_cast<const h264::SPS*>(m_videoData.spsBytes.data()) + i);
+
+		auto get_chroma_format = [](int const& profile, int const& chroma) -> StdVideoH264ChromaFormatIdc {
+			if (profile < STD_VIDEO_H264_PROFILE_IDC_HIGH) {
+				// If profile is less than HIGH chroma format will not be explicitly given. (A.2)
+				// If chroma format is not present, it shall be inferred to be equal to 1 (4:2:0) (7.4.2.1.1)
+				return StdVideoH264ChromaFormatIdc::STD_VIDEO_H264_CHROMA_FORMAT_IDC_420;
+			} else {
+				// If Profile is greater than High, then we assume chroma to be explicitly specified.
+				return StdVideoH264ChromaFormatIdc(chroma);
+			}
+			};
+
+		videoSequenceParameterSet[i] = {
+			.flags = {
+				.constraint_set0_flag = uint32_t(sps->constraint_set0_flag),
+				.constraint_set1_flag = uint32_t(sps->constraint_set1_flag),
+				.constraint_set2_flag = uint32_t(sps->constraint_set2_flag),
+				.constraint_set3_flag = uint32_t(sps->constraint_set3_flag),
+				.constraint_set4_flag = uint32_t(sps->constraint_set4_flag),
+				.constraint_set5_flag = uint32_t(sps->constraint_set5_flag),
+				.direct_8x8_inference_flag = uint32_t(sps->direct_8x8_inference_flag),
+				.mb_adaptive_frame_field_flag = uint32_t(sps->mb_adaptive_frame_field_flag),
+				.frame_mbs_only_flag = uint32_t(sps->frame_mbs_only_flag),
+				.delta_pic_order_always_zero_flag = uint32_t(sps->delta_pic_order_always_zero_flag),
+				.separate_colour_plane_flag = uint32_t(sps->separate_colour_plane_flag),
+				.gaps_in_frame_num_value_allowed_flag = uint32_t(sps->gaps_in_frame_num_value_allowed_flag),
+				.qpprime_y_zero_transform_bypass_flag = uint32_t(sps->qpprime_y_zero_transform_bypass_flag),
+				.frame_cropping_flag = uint32_t(sps->frame_cropping_flag),
+				.seq_scaling_matrix_present_flag = uint32_t(sps->seq_scaling_matrix_present_flag),
+				.vui_parameters_present_flag = uint32_t(sps->vui_parameters_present_flag),
+			},
+			.profile_idc = StdVideoH264ProfileIdc(sps->profile_idc),
+			.level_idc = StdVideoH264LevelIdc(sps->level_idc),
+			.chroma_format_idc = get_chroma_format(sps->profile_idc, sps->chroma_format_idc),
+			.seq_parameter_set_id = uint8_t(sps->seq_parameter_set_id),
+			.bit_depth_luma_minus8 = uint8_t(sps->bit_depth_luma_minus8),
+			.bit_depth_chroma_minus8 = uint8_t(sps->bit_depth_chroma_minus8),
+			.log2_max_frame_num_minus4 = uint8_t(sps->log2_max_frame_num_minus4),
+			.pic_order_cnt_type = StdVideoH264PocType(sps->pic_order_cnt_type),
+			.offset_for_non_ref_pic = int32_t(sps->offset_for_non_ref_pic),
+			.offset_for_top_to_bottom_field = int32_t(sps->offset_for_top_to_bottom_field),
+			.log2_max_pic_order_cnt_lsb_minus4 = uint8_t(sps->log2_max_pic_order_cnt_lsb_minus4),
+			.num_ref_frames_in_pic_order_cnt_cycle = uint8_t(sps->num_ref_frames_in_pic_order_cnt_cycle),
+			.max_num_ref_frames = uint8_t(sps->num_ref_frames),
+			.reserved1 = 0,
+			.pic_width_in_mbs_minus1 = uint32_t(sps->pic_width_in_mbs_minus1),
+			.pic_height_in_map_units_minus1 = uint32_t(sps->pic_height_in_map_units_minus1),
+			.frame_crop_left_offset = uint32_t(sps->frame_crop_left_offset),
+			.frame_crop_right_offset = uint32_t(sps->frame_crop_right_offset),
+			.frame_crop_top_offset = uint32_t(sps->frame_crop_top_offset),
+			.frame_crop_bottom_offset = uint32_t(sps->frame_crop_bottom_offset),
+			.reserved2 = 0,
+			.pOffsetForRefFrame = nullptr, // todo:?
+			.pScalingLists = &videoScalingListsSPS[i],
+			.pSequenceParameterSetVui = &videoSequenceParameterSetVui[i],
+		};
+
+		// VUI stands for "Video Usablility Information"
+		auto& vui = sps->vui;
+
+		videoSequenceParameterSetVui[i] = {
+			.flags = {
+				.aspect_ratio_info_present_flag = uint32_t(vui.aspect_ratio_info_present_flag),
+				.overscan_info_present_flag = uint32_t(vui.overscan_info_present_flag),
+				.overscan_appropriate_flag = uint32_t(vui.overscan_appropriate_flag),
+				.video_signal_type_present_flag = uint32_t(vui.video_signal_type_present_flag),
+				.video_full_range_flag = uint32_t(vui.video_full_range_flag),
+				.color_description_present_flag = uint32_t(vui.colour_description_present_flag),
+				.chroma_loc_info_present_flag = uint32_t(vui.chroma_loc_info_present_flag),
+				.timing_info_present_flag = uint32_t(vui.timing_info_present_flag),
+				.fixed_frame_rate_flag = uint32_t(vui.fixed_frame_rate_flag),
+				.bitstream_restriction_flag = uint32_t(vui.bitstream_restriction_flag),
+				.nal_hrd_parameters_present_flag = uint32_t(vui.nal_hrd_parameters_present_flag),
+				.vcl_hrd_parameters_present_flag = uint32_t(vui.vcl_hrd_parameters_present_flag),
+			}, // StdVideoH264SpsVuiFlags
+			.aspect_ratio_idc = StdVideoH264AspectRatioIdc(vui.aspect_ratio_idc),
+			.sar_width = uint16_t(vui.sar_width),
+			.sar_height = uint16_t(vui.sar_height),
+			.video_format = uint8_t(vui.video_format),
+			.colour_primaries = uint8_t(vui.colour_primaries),
+			.transfer_characteristics = uint8_t(vui.transfer_characteristics),
+			.matrix_coefficients = uint8_t(vui.matrix_coefficients),
+			.num_units_in_tick = uint32_t(vui.num_units_in_tick),
+			.time_scale = uint32_t(vui.time_scale),
+			.max_num_reorder_frames = uint8_t(vui.num_reorder_frames),
+			.max_dec_frame_buffering = uint8_t(vui.max_dec_frame_buffering),
+			.chroma_sample_loc_type_top_field = uint8_t(vui.chroma_sample_loc_type_top_field),
+			.chroma_sample_loc_type_bottom_field = uint8_t(vui.chroma_sample_loc_type_bottom_field),
+			.reserved1 = 0,
+			.pHrdParameters = &videoHrdParameters[i],
+		};
+		{
+			StdVideoH264HrdParameters& vk_hrd = videoHrdParameters[i];
+
+			auto const& hrd = sps->hrd;
+			vk_hrd = {
+				.cpb_cnt_minus1 = uint8_t(hrd.cpb_cnt_minus1),
+				.bit_rate_scale = uint8_t(hrd.bit_rate_scale),
+				.cpb_size_scale = uint8_t(hrd.cpb_size_scale),
+				.reserved1 = uint8_t(),
+				.bit_rate_value_minus1 = {},
+				.cpb_size_value_minus1 = {},
+				.cbr_flag = {},
+				.initial_cpb_removal_delay_length_minus1 = uint32_t(hrd.initial_cpb_removal_delay_length_minus1),
+				.cpb_removal_delay_length_minus1 = uint32_t(hrd.cpb_removal_delay_length_minus1),
+				.dpb_output_delay_length_minus1 = uint32_t(hrd.dpb_output_delay_length_minus1),
+				.time_offset_length = uint32_t(hrd.time_offset_length),
+			};
+
+			// Sigh, nobody said it was easy ...
+			for (int j = 0; j != STD_VIDEO_H264_CPB_CNT_LIST_SIZE; j++) {
+				vk_hrd.bit_rate_value_minus1[j] = hrd.bit_rate_value_minus1[j];
+				vk_hrd.cpb_size_value_minus1[j] = hrd.cpb_size_value_minus1[j];
+				vk_hrd.cbr_flag[j] = hrd.cbr_flag[j];
+			}
+		}
+
+		{ // Now fill in the Scaling Lists
+			StdVideoH264ScalingLists& sl = videoScalingListsSPS[i];
+			sl = {};
+			{
+				decltype(sl.scaling_list_present_mask) j;
+				for (j = 0; j != ARRAY_SIZE(sps->seq_scaling_list_present_flag); j++) {
+					sl.scaling_list_present_mask |=
+						static_cast<decltype(j)>(sps->seq_scaling_list_present_flag[j]) << j;
+				}
+			}
+			{
+				decltype(sl.use_default_scaling_matrix_mask) j;
+				for (j = 0; j != ARRAY_SIZE(sps->UseDefaultScalingMatrix4x4Flag); j++) {
+					sl.use_default_scaling_matrix_mask |=
+						static_cast<decltype(j)>(sps->UseDefaultScalingMatrix4x4Flag[j]) << j;
+				}
+			}
+
+			for (size_t list_idx = 0;
+				list_idx < STD_VIDEO_H264_SCALING_LIST_4X4_NUM_LISTS &&
+				list_idx < ARRAY_SIZE(sps->ScalingList4x4);
+				list_idx++) {
+				for (size_t el_idx = 0;
+					el_idx < STD_VIDEO_H264_SCALING_LIST_4X4_NUM_ELEMENTS &&
+					el_idx < ARRAY_SIZE(sps->ScalingList4x4[0]);
+					el_idx++) {
+					sl.ScalingList4x4[list_idx][el_idx] = sps->ScalingList4x4[list_idx][el_idx];
+				}
+			}
+
+			for (size_t list_idx = 0;
+				list_idx < STD_VIDEO_H264_SCALING_LIST_8X8_NUM_LISTS &&
+				list_idx < ARRAY_SIZE(sps->ScalingList8x8);
+				list_idx++) {
+				for (size_t el_idx = 0;
+					el_idx < STD_VIDEO_H264_SCALING_LIST_8X8_NUM_ELEMENTS &&
+					el_idx < ARRAY_SIZE(sps->ScalingList8x8[0]);
+					el_idx++) {
+					sl.ScalingList8x8[list_idx][el_idx] = sps->ScalingList8x8[list_idx][el_idx];
+				}
+			}
+		}
+	}
+
+	VkVideoDecodeH264SessionParametersAddInfoKHR sessionParametersAddInfo = {
+		.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_SESSION_PARAMETERS_ADD_INFO_KHR,
+		.stdSPSCount = m_videoData.spsCount,
+		.pStdSPSs = videoSequenceParameterSet.data(),
+		.stdPPSCount = m_videoData.ppsCount,
+		.pStdPPSs = videoPictureParameterSets.data(),
+	};
+	VkVideoDecodeH264SessionParametersCreateInfoKHR videoDecodeSessionParamersCI = {
+		.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_SESSION_PARAMETERS_CREATE_INFO_KHR,
+		.maxStdSPSCount = m_videoData.spsCount,
+		.maxStdPPSCount = m_videoData.ppsCount,
+		.pParametersAddInfo = &sessionParametersAddInfo,
+	};
+	VkVideoSessionParametersCreateInfoKHR videoSessionParametersCI = {
+		.sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_PARAMETERS_CREATE_INFO_KHR,
+		.pNext = &videoDecodeSessionParamersCI,
+		.flags = 0,
+		.videoSessionParametersTemplate = nullptr,
+		.videoSession = m_videoSession,
+	};
+
+	auto devCtx = DeviceContext::GetContext();
+	VkResult res = vkCreateVideoSessionParametersKHR(
+		devCtx->GetVkDevice(),
+		&videoSessionParametersCI,
+		nullptr, &m_videoSessionParameters);
+	assert(res == VK_SUCCESS);
+}
+
+void VideoPlayer::Decoder::DestroyVideoSession()
+{
+	auto devCtx = DeviceContext::GetContext();
+	auto vkDevice = devCtx->GetVkDevice();
+	if (m_videoSessionParameters != VK_NULL_HANDLE)
+	{
+		vkDestroyVideoSessionParametersKHR(vkDevice, m_videoSessionParameters, nullptr);
+		m_videoSessionParameters = VK_NULL_HANDLE;
+	}
+	if (m_videoSession != VK_NULL_HANDLE)
+	{
+		vkDestroyVideoSessionKHR(vkDevice, m_videoSession, nullptr);
+		m_videoSession = VK_NULL_HANDLE;
+	}
+	// バインドしていたセッションを破棄した後に解放する.
+	for (auto allocation : m_sessionMemoryAllocations)
+	{
+		vmaFreeMemory(devCtx->GetVmaAllocator(), allocation);
+	}
+	m_sessionMemoryAllocations.clear();
+}
@@ -0,0 +1,500 @@
+﻿#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <string>
+
+#include "DeviceContext.h"
+
+#undef ERROR
+#undef min
+#undef max
+
+#include "VideoScaler.h"
+#include "scaleComputeShader.h"
+
+namespace {
+
+// scale.comp の push_constant と同じ配置.
+struct PushConstants
+{
+	uint32_t outputs[VideoScaler::MAX_OUTPUTS][4];
+	uint32_t outputCount;
+};
+
+enum {
+	LOCAL_SIZE = 8,
+	BINDING_SOURCE = 0,
+	BINDING_RGBA = 1,
+	BINDING_LUMA = 2,
+	BINDING_CHROMA = 3,
+};
+
+}
+
+bool VideoScaler::Initialize(const Desc& desc)
+{
+	assert(!desc.outputs.empty() && desc.outputs.size() <= MAX_OUTPUTS);
+	auto devCtx = DeviceContext::GetContext();
+
+	// 出力の配列を実行時の添字で参照する. scale.comp は出力の形式によらず r8/rg8 の配列を宣言するため、拡張形式も常に必要.
+	VkPhysicalDeviceFeatures features{};
+	vkGetPhysicalDeviceFeatures(devCtx->GetGPU(), &features);
+	if (!features.shaderStorageImageArrayDynamicIndexing || !features.shaderStorageImageExtendedFormats)
+	{
+		OutputDebugStringA("VideoScaler: required storage image features are not supported.\n");
+		return false;
+	}
+
+	m_outputs = desc.outputs;
+	m_extents.clear();
+	m_dispatchExtent = {};
+	for (const auto& output : m_outputs)
+	{
+		VkExtent2D extent{ output.width, output.height };
+		if (output.divisor != 0)
+		{
+			extent = { desc.width / output.divisor, desc.height / output.divisor };
+		}
+		if (output.format == Format::NV12)
+		{
+			// 色差は 2x2 画素で1つのため偶数にそろえる.
+			extent = { (extent.width + 1) & ~1u, (extent.height + 1) & ~1u };
+		}
+		extent = { std::max(extent.width, 1u), std::max(extent.height, 1u) };
+		m_extents.push_back(extent);
+		m_dispatchExtent.width = std::max(m_dispatchExtent.width, extent.width);
+		m_dispatchExtent.height = std::max(m_dispatchExtent.height, extent.height);
+	}
+
+	const uint32_t sourceCount = uint32_t(desc.sources.size());
+	m_targets.resize(sourceCount * m_outputs.size());
+	for (uint32_t source = 0; source < sourceCount; ++source)
+	{
+		for (uint32_t i = 0; i < m_outputs.size(); ++i)
+		{
+			auto& target = m_targets[source * m_outputs.size() + i];
+			const auto extent = m_extents[i];
+			if (m_outputs[i].format == Format::RGBA)
+			{
+				auto& image = m_images.emplace_back(CreateImage(VK_FORMAT_R8G8B8A8_UNORM, extent));
+				target.image = image.image;
+				target.view = image.view;
+			}
+			else
+			{
+				auto& luma = m_images.emplace_back(CreateImage(VK_FORMAT_R8_UNORM, extent));
+				target.image = luma.image;
+				target.view = luma.view;
+				auto& chroma = m_images.emplace_back(CreateImage(VK_FORMAT_R8G8_UNORM, { extent.width / 2, extent.height / 2 }));
+				target.chromaImage = chroma.image;
+				target.chromaView = chroma.view;
+			}
+		}
+	}
+	m_dummyRGBA = CreateImage(VK_FORMAT_R8G8B8A8_UNORM, { 1, 1 });
+	m_dummyLuma = CreateImage(VK_FORMAT_R8_UNORM, { 1, 1 });
+	m_dummyChroma = CreateImage(VK_FORMAT_R8G8_UNORM, { 1, 1 });
+
+	CreatePipeline();
+	CreateDescriptorSets(desc);
+
+	char buf[256];
+	sprintf_s(buf, "VideoScaler: %u outputs x %u sources, dispatch %ux%u\n",
+		uint32_t(m_outputs.size()), sourceCount, m_dispatchExtent.width, m_dispatchExtent.height);
+	OutputDebugStringA(buf);
+	return true;
+}
+
+void VideoScaler::Shutdown()
+{
+	auto devCtx = DeviceContext::GetContext();
+	if (!devCtx)
+	{
+		return;
+	}
+	auto vkDevice = devCtx->GetVkDevice();
+
+	// セットはプールと共に解放される.
+	if (m_descriptorPool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(vkDevice, m_descriptorPool, nullptr);
+		m_descriptorPool = VK_NULL_HANDLE;
+	}
+	m_descriptorSets.clear();
+	if (m_pipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(vkDevice, m_pipeline, nullptr);
+		m_pipeline = VK_NULL_HANDLE;
+	}
+	if (m_pipelineLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineLayout(vkDevice, m_pipelineLayout, nullptr);
+		m_pipelineLayout = VK_NULL_HANDLE;
+	}
+	if (m_dsLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorSetLayout(vkDevice, m_dsLayout, nullptr);
+		m_dsLayout = VK_NULL_HANDLE;
+	}
+	if (m_sampler != VK_NULL_HANDLE)
+	{
+		vkDestroySampler(vkDevice, m_sampler, nullptr);
+		m_sampler = VK_NULL_HANDLE;
+	}
+
+	for (auto& image : m_images)
+	{
+		DestroyImage(image);
+	}
+	m_images.clear();
+	DestroyImage(m_dummyRGBA);
+	DestroyImage(m_dummyLuma);
+	DestroyImage(m_dummyChroma);
+	m_targets.clear();
+	m_outputs.clear();
+	m_extents.clear();
+}
+
+void VideoScaler::RegisterResources(ResourceStateTracker& tracker) const
+{
+	for (const auto& image : m_images)
+	{
+		tracker.Register(image.image, 0);
+	}
+	for (const auto* dummy : { &m_dummyRGBA, &m_dummyLuma, &m_dummyChroma })
+	{
+		tracker.Register(dummy->image, 0);
+	}
+}
+
+void VideoScaler::UnregisterResources(ResourceStateTracker& tracker) const
+{
+	for (const auto& image : m_images)
+	{
+		tracker.Unregister(image.image);
+	}
+	for (const auto* dummy : { &m_dummyRGBA, &m_dummyLuma, &m_dummyChroma })
+	{
+		tracker.Unregister(dummy->image);
+	}
+}
+
+void VideoScaler::RequireWrite(ResourceStateTracker& tracker, uint32_t sourceIndex) const
+{
+	for (uint32_t i = 0; i < m_outputs.size(); ++i)
+	{
+		const auto& target = GetOutput(sourceIndex, i);
+		tracker.Require(target.image, 0,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+		if (target.chromaImage != VK_NULL_HANDLE)
+		{
+			tracker.Require(target.chromaImage, 0,
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+		}
+	}
+	// 書き込まれないため、最初の1回のみ遷移する.
+	for (const auto* dummy : { &m_dummyRGBA, &m_dummyLuma, &m_dummyChroma })
+	{
+		tracker.Require(dummy->image, 0,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL);
+	}
+}
+
+void VideoScaler::Dispatch(VkCommandBuffer commandBuffer, uint32_t sourceIndex) const
+{
+	assert(sourceIndex < m_descriptorSets.size());
+	PushConstants constants{
+		.outputCount = uint32_t(m_outputs.size()),
+	};
+	for (uint32_t i = 0; i < m_outputs.size(); ++i)
+	{
+		constants.outputs[i][0] = m_extents[i].width;
+		constants.outputs[i][1] = m_extents[i].height;
+		constants.outputs[i][2] = m_outputs[i].format == Format::RGBA ? 0 : 1;
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout,
+		0, 1, &m_descriptorSets[sourceIndex], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(commandBuffer,
+		(m_dispatchExtent.width + LOCAL_SIZE - 1) / LOCAL_SIZE,
+		(m_dispatchExtent.height + LOCAL_SIZE - 1) / LOCAL_SIZE, 1);
+}
+
+void VideoScaler::RequireRead(ResourceStateTracker& tracker, uint32_t sourceIndex) const
+{
+	// 利用側がサンプリングと読み戻しのどちらでも使えるようにする.
+	constexpr VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_COPY_BIT;
+	constexpr VkAccessFlags2 access = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT;
+	for (uint32_t i = 0; i < m_outputs.size(); ++i)
+	{
+		const auto& target = GetOutput(sourceIndex, i);
+		tracker.Require(target.image, 0, stage, access, VK_IMAGE_LAYOUT_GENERAL);
+		if (target.chromaImage != VK_NULL_HANDLE)
+		{
+			tracker.Require(target.chromaImage, 0, stage, access, VK_IMAGE_LAYOUT_GENERAL);
+		}
+	}
+}
+
+const VideoScaler::Output& VideoScaler::GetOutput(uint32_t sourceIndex, uint32_t output) const
+{
+	assert(output < m_outputs.size());
+	const size_t index = size_t(sourceIndex) * m_outputs.size() + output;
+	assert(index < m_targets.size());
+	return m_targets[index];
+}
+
+VideoScaler::Image VideoScaler::CreateImage(VkFormat format, VkExtent2D extent)
+{
+	auto devCtx = DeviceContext::GetContext();
+	VkImageCreateInfo imageCI{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = format,
+		.extent = { extent.width, extent.height, 1 },
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	VmaAllocationCreateInfo allocationCI{
+		.usage = VMA_MEMORY_USAGE_GPU_ONLY,
+		.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+	};
+	Image ret{};
+	auto res = devCtx->CreateImage(MemoryCategory::Other, imageCI, allocationCI, &ret.image, &ret.allocation);
+	assert(res == VK_SUCCESS);
+
+	VkImageViewCreateInfo imageViewCI{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = ret.image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = format,
+		.subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+	};
+	res = vkCreateImageView(devCtx->GetVkDevice(), &imageViewCI, nullptr, &ret.view);
+	assert(res == VK_SUCCESS);
+	return ret;
+}
+
+void VideoScaler::DestroyImage(Image& image)
+{
+	auto devCtx = DeviceContext::GetContext();
+	if (image.view != VK_NULL_HANDLE)
+	{
+		vkDestroyImageView(devCtx->GetVkDevice(), image.view, nullptr);
+	}
+	if (image.image != VK_NULL_HANDLE)
+	{
+		devCtx->DestroyImage(image.image, image.allocation);
+	}
+	image = {};
+}
+
+void VideoScaler::CreatePipeline()
+{
+	auto devCtx = DeviceContext::GetContext();
+	auto vkDevice = devCtx->GetVkDevice();
+
+	// 縮小元は表示と同じ YCbCr 変換でサンプリングする.
+	VkSamplerYcbcrConversionInfo samplerConversionInfo{
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO,
+		.conversion = devCtx->m_samplerYcbcrConversion,
+	};
+	VkSamplerCreateInfo samplerCI{
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.pNext = &samplerConversionInfo,
+		.magFilter = VK_FILTER_LINEAR,
+		.minFilter = VK_FILTER_LINEAR,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+	};
+	vkCreateSampler(vkDevice, &samplerCI, nullptr, &m_sampler);
+
+	std::array<VkDescriptorSetLayoutBinding, 4> bindings = { {
+		{
+			.binding = BINDING_SOURCE,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.pImmutableSamplers = &m_sampler,
+		},
+		{
+			.binding = BINDING_RGBA,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.descriptorCount = MAX_OUTPUTS,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		},
+		{
+			.binding = BINDING_LUMA,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.descriptorCount = MAX_OUTPUTS,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		},
+		{
+			.binding = BINDING_CHROMA,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.descriptorCount = MAX_OUTPUTS,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		},
+	} };
+	VkDescriptorSetLayoutCreateInfo dsLayoutCI{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = uint32_t(bindings.size()),
+		.pBindings = bindings.data(),
+	};
+	vkCreateDescriptorSetLayout(vkDevice, &dsLayoutCI, nullptr, &m_dsLayout);
+
+	VkPushConstantRange pushConstantRange{
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(PushConstants),
+	};
+	VkPipelineLayoutCreateInfo layoutCI{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &m_dsLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstantRange,
+	};
+	vkCreatePipelineLayout(vkDevice, &layoutCI, nullptr, &m_pipelineLayout);
+
+	VkShaderModuleCreateInfo shaderCI{
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = sizeof(gCSScale),
+		.pCode = gCSScale,
+	};
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	vkCreateShaderModule(vkDevice, &shaderCI, nullptr, &shaderModule);
+
+	VkComputePipelineCreateInfo pipelineCI{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = shaderModule,
+			.pName = "main",
+		},
+		.layout = m_pipelineLayout,
+	};
+	auto res = vkCreateComputePipelines(vkDevice, devCtx->GetPipelineCache(), 1, &pipelineCI, nullptr, &m_pipeline);
+	assert(res == VK_SUCCESS);
+	vkDestroyShaderModule(vkDevice, shaderModule, nullptr);
+}
+
+void VideoScaler::CreateDescriptorSets(const Desc& desc)
+{
+	auto vkDevice = DeviceContext::GetContext()->GetVkDevice();
+	const uint32_t sourceCount = uint32_t(desc.sources.size());
+
+	// YCbCr 変換を伴うサンプラーは複数の記述子を消費する場合がある.
+	std::array<VkDescriptorPoolSize, 2> poolSizes = { {
+		{
+			.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.descriptorCount = sourceCount * DeviceContext::GetContext()->GetYcbcrDescriptorCount(),
+		},
+		{
+			.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.descriptorCount = sourceCount * MAX_OUTPUTS * 3,
+		},
+	} };
+	VkDescriptorPoolCreateInfo descriptorPoolCI{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = sourceCount,
+		.poolSizeCount = uint32_t(poolSizes.size()),
+		.pPoolSizes = poolSizes.data(),
+	};
+	vkCreateDescriptorPool(vkDevice, &descriptorPoolCI, nullptr, &m_descriptorPool);
+
+	std::vector<VkDescriptorSetLayout> layouts(sourceCount, m_dsLayout);
+	VkDescriptorSetAllocateInfo dsAllocInfo{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = m_descriptorPool,
+		.descriptorSetCount = sourceCount,
+		.pSetLayouts = layouts.data(),
+	};
+	m_descriptorSets.resize(sourceCount);
+	vkAllocateDescriptorSets(vkDevice, &dsAllocInfo, m_descriptorSets.data());
+
+	for (uint32_t source = 0; source < sourceCount; ++source)
+	{
+		VkDescriptorImageInfo sourceInfo{
+			.imageView = desc.sources[source].view,
+			.imageLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL,
+		};
+		// 使わない要素は 1x1 のイメージで埋める.
+		std::array<VkDescriptorImageInfo, MAX_OUTPUTS> rgbaInfos, lumaInfos, chromaInfos;
+		for (uint32_t i = 0; i < MAX_OUTPUTS; ++i)
+		{
+			rgbaInfos[i] = { .imageView = m_dummyRGBA.view, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+			lumaInfos[i] = { .imageView = m_dummyLuma.view, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+			chromaInfos[i] = { .imageView = m_dummyChroma.view, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+			if (i < m_outputs.size())
+			{
+				const auto& target = GetOutput(source, i);
+				if (m_outputs[i].format == Format::RGBA)
+				{
+					rgbaInfos[i].imageView = target.view;
+				}
+				else
+				{
+					lumaInfos[i].imageView = target.view;
+					chromaInfos[i].imageView = target.chromaView;
+				}
+			}
+		}
+
+		const auto dstSet = m_descriptorSets[source];
+		std::array<VkWriteDescriptorSet, 4> writes = { {
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = dstSet,
+				.dstBinding = BINDING_SOURCE,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.pImageInfo = &sourceInfo,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = dstSet,
+				.dstBinding = BINDING_RGBA,
+				.descriptorCount = MAX_OUTPUTS,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.pImageInfo = rgbaInfos.data(),
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = dstSet,
+				.dstBinding = BINDING_LUMA,
+				.descriptorCount = MAX_OUTPUTS,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.pImageInfo = lumaInfos.data(),
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = dstSet,
+				.dstBinding = BINDING_CHROMA,
+				.descriptorCount = MAX_OUTPUTS,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.pImageInfo = chromaInfos.data(),
+			},
+		} };
+		vkUpdateDescriptorSets(vkDevice, uint32_t(writes.size()), writes.data(), 0, nullptr);
+	}
+}
@@ -0,0 +1,106 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "DecodeBackend.h"
+#include "ResourceStateTracker.h"
+
+// デコード結果を縮小したコピーを作る. サムネイルやプレビュー、解析の入力に使う.
+// 出力テクスチャ (VideoPlayer::OutputImage::index) ごとに縮小先を持ち、出力テクスチャと同じ期間だけ有効となる.
+// 全ての縮小先は1回のディスパッチで書き込む. 縮小先の遷移は、バックエンドがデコード後のバリアと一緒に発行する.
+// 1フレームの流れ (バックエンドのグラフィックスコマンド):
+//   RequireWrite -> (出力テクスチャの遷移と共に Flush) -> Dispatch -> RequireRead -> Flush
+class VideoScaler
+{
+public:
+	enum class Format
+	{
+		RGBA,	// R8G8B8A8_UNORM.
+		NV12,	// Y (R8_UNORM) と CbCr (R8G8_UNORM, 1/2 x 1/2) の2枚. BT.709 limited.
+	};
+
+	struct OutputDesc
+	{
+		// divisor が 0 以外なら元の大きさをこれで割った大きさ. 0 の場合は width x height.
+		uint32_t divisor = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		Format format = Format::RGBA;
+	};
+
+	struct Desc
+	{
+		uint32_t width = 0;		// デコード結果の大きさ.
+		uint32_t height = 0;
+		std::vector<DecodeOutputTexture> sources;	// 縮小元. 添字が出力テクスチャの番号.
+		std::vector<OutputDesc> outputs;
+	};
+
+	struct Output
+	{
+		VkImage image = VK_NULL_HANDLE;		// RGBA、または NV12 の Y.
+		VkImageView view = VK_NULL_HANDLE;
+		VkImage chromaImage = VK_NULL_HANDLE;	// NV12 の CbCr.
+		VkImageView chromaView = VK_NULL_HANDLE;
+	};
+
+	enum {
+		MAX_OUTPUTS = 4,	// scale.comp と合わせる.
+	};
+
+	~VideoScaler() { Shutdown(); }
+
+	// 必要なデバイスの機能がない場合は false を返す.
+	bool Initialize(const Desc& desc);
+	void Shutdown();
+
+	// 縮小先をバックエンドの状態管理へ登録する. 出力テクスチャの遷移と同じバリアで発行するため.
+	void RegisterResources(ResourceStateTracker& tracker) const;
+	void UnregisterResources(ResourceStateTracker& tracker) const;
+
+	// sourceIndex の縮小先を書き込み可能にする. 呼び出し側の Flush で発行される.
+	void RequireWrite(ResourceStateTracker& tracker, uint32_t sourceIndex) const;
+	// sourceIndex の出力テクスチャは READ_ONLY_OPTIMAL でコンピュートシェーダーから読める状態であること.
+	void Dispatch(VkCommandBuffer commandBuffer, uint32_t sourceIndex) const;
+	// 書き込んだ縮小先を読み込み (サンプリング/転送) 用にする.
+	void RequireRead(ResourceStateTracker& tracker, uint32_t sourceIndex) const;
+
+	uint32_t GetOutputCount() const { return uint32_t(m_outputs.size()); }
+	const OutputDesc& GetOutputDesc(uint32_t output) const { return m_outputs[output]; }
+	VkExtent2D GetOutputExtent(uint32_t output) const { return m_extents[output]; }
+	const Output& GetOutput(uint32_t sourceIndex, uint32_t output) const;
+
+private:
+	struct Image
+	{
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+	};
+	Image CreateImage(VkFormat format, VkExtent2D extent);
+	void DestroyImage(Image& image);
+	void CreatePipeline();
+	void CreateDescriptorSets(const Desc& desc);
+
+	std::vector<OutputDesc> m_outputs;
+	std::vector<VkExtent2D> m_extents;
+	VkExtent2D m_dispatchExtent{};
+
+	// [sourceIndex * 出力数 + output].
+	std::vector<Output> m_targets;
+	std::vector<Image> m_images;
+	// 使わない配列要素を埋める 1x1 のイメージ.
+	Image m_dummyRGBA;
+	Image m_dummyLuma;
+	Image m_dummyChroma;
+
+	VkSampler m_sampler = VK_NULL_HANDLE;
+	VkDescriptorSetLayout m_dsLayout = VK_NULL_HANDLE;
+	VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_pipeline = VK_NULL_HANDLE;
+	VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> m_descriptorSets;	// 出力テクスチャごとに一度だけ書き込む.
+};
@@ -0,0 +1,691 @@
+﻿#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#include <cassert>
+#include <sstream>
+#include <string>
+
+#include "DeviceContext.h"
+
+#undef ERROR
+#undef min
+#undef max
+
+#include "h264.h"
+#include "GpuProfiler.h"
+#include "VideoScaler.h"
+#include "VulkanDecodeBackend.h"
+
+static constexpr size_t align_to(size_t sz, size_t alignment) {
+	return ((sz - 1) / alignment + 1) * alignment;
+};
+
+bool VulkanDecodeBackend::Initialize(const DecodeStreamDesc& desc)
+{
+	m_decoder->CreateVideoSession();
+
+	CreateBitstreamBuffer(desc.bitstreamSlotCount);
+	CreateDPB();
+
+	// 再生中に確保が発生しないよう、出力テクスチャをここで確保しておく.
+	// 予算が足りない場合は minOutputCount まで減らし、それでも足りなければ失敗とする.
+	if (!CreateOutputTexturePool(desc.outputCount, desc.minOutputCount != 0 ? desc.minOutputCount : desc.outputCount))
+	{
+		return false;
+	}
+	CreateStatusQueryPool();
+	return true;
+}
+
+void VulkanDecodeBackend::Shutdown()
+{
+	auto devCtx = DeviceContext::GetContext();
+	auto vkDevice = devCtx->GetVkDevice();
+
+	SetScaler(nullptr);
+	DestroyOutputTexturePool();
+	if (m_statusQueryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(vkDevice, m_statusQueryPool, nullptr);
+		m_statusQueryPool = VK_NULL_HANDLE;
+	}
+	m_statusQueryUsed.clear();
+
+	for (auto& slot : m_dpb.slot)
+	{
+		vkDestroyImageView(vkDevice, slot.view, nullptr);
+		slot = {};
+	}
+	for (uint32_t i = 0; i < m_dpb.imageCount; ++i)
+	{
+		devCtx->DestroyImage(m_dpb.image[i].image, m_dpb.image[i].allocation);
+		m_dpb.image[i] = {};
+	}
+	m_dpb.imageCount = 0;
+	devCtx->DestroyPool(m_dpb.pool);
+	m_dpb.pool = VK_NULL_HANDLE;
+	m_stateTracker.Clear();
+
+	if (m_bitstreamBuffer.buffer != VK_NULL_HANDLE)
+	{
+		vmaUnmapMemory(devCtx->GetVmaAllocator(), m_bitstreamBuffer.allocation);
+		devCtx->DestroyBuffer(m_bitstreamBuffer.buffer, m_bitstreamBuffer.allocation);
+		m_bitstreamBuffer = {};
+		m_bitstreamMapped = nullptr;
+	}
+	m_decoder->DestroyVideoSession();
+}
+
+uint8_t* VulkanDecodeBackend::GetBitstreamSlot(uint32_t slot, uint64_t& capacity)
+{
+	assert(slot < m_bitstreamSlotCount);
+	capacity = m_bitstreamSlotSize;
+	return m_bitstreamMapped + slot * m_bitstreamSlotSize;
+}
+
+uint64_t VulkanDecodeBackend::GetBitstreamAlignment() const
+{
+	return m_decoder->m_properties.caps.minBitstreamBufferSizeAlignment;
+}
+
+void VulkanDecodeBackend::Decode(const VideoDecodeOperation& operation, const DecodeScheduler::Job& job)
+{
+	VideoDecodePreBarrier(job.videoCommandBuffer, operation);
+	ResetStatusQuery(job.videoCommandBuffer, operation.outputIndex, job.profiler);
+
+	GpuProfiler::Scope scope;
+	if (job.profiler)
+	{
+		scope = job.profiler->BeginScope(job.videoCommandBuffer, GpuProfiler::Stage::Decode);
+	}
+	VideoDecodeCore(operation, job.videoCommandBuffer);
+	if (job.profiler)
+	{
+		job.profiler->EndScope(job.videoCommandBuffer, scope);
+		scope = job.profiler->BeginScope(job.videoCommandBuffer, GpuProfiler::Stage::Copy);
+	}
+
+	// DPB->出力先へ.
+	// DPB は次に参照されるときに必要な遷移を行うため、ここでは戻さない.
+	CopyToTexture(job.videoCommandBuffer, operation);
+	if (job.profiler)
+	{
+		job.profiler->EndScope(job.videoCommandBuffer, scope);
+	}
+
+	VideoDecodePostBarrier(job.graphicsCommandBuffer, operation.outputIndex);
+}
+
+uint32_t VulkanDecodeBackend::GetOutputTextureCount() const
+{
+	return uint32_t(m_outputTextures.size());
+}
+
+DecodeOutputTexture VulkanDecodeBackend::GetOutputTexture(uint32_t index) const
+{
+	assert(index < m_outputTextures.size());
+	return {
+		.image = m_outputTextures[index].image,
+		.view = m_outputTextures[index].view,
+	};
+}
+
+void VulkanDecodeBackend::SetScaler(std::shared_ptr<VideoScaler> scaler)
+{
+	if (m_scaler)
+	{
+		m_scaler->UnregisterResources(m_stateTracker);
+	}
+	m_scaler = std::move(scaler);
+	if (m_scaler)
+	{
+		m_scaler->RegisterResources(m_stateTracker);
+	}
+}
+
+void VulkanDecodeBackend::CreateBitstreamBuffer(uint32_t slotCount)
+{
+	auto devCtx = DeviceContext::GetContext();
+	m_bitstreamSlotCount = slotCount;
+	m_bitstreamSlotSize = m_decoder->m_videoData.maxMemoryFrameSizeBytes;
+
+	uint64_t bufferSize = m_bitstreamSlotSize * slotCount;
+	VkBufferCreateInfo bufferCI{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = &m_decoder->m_settings.profileListInfo,
+		.flags = 0,
+		.size = bufferSize,
+		.usage = VK_BUFFER_USAGE_VIDEO_DECODE_SRC_BIT_KHR,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = nullptr,
+	};
+	VmaAllocationCreateInfo allocateCI{};
+	allocateCI.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+	allocateCI.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+	allocateCI.requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	auto res = devCtx->CreateBuffer(
+		MemoryCategory::Bitstream,
+		bufferCI,
+		allocateCI,
+		&m_bitstreamBuffer.buffer,
+		&m_bitstreamBuffer.allocation,
+		&m_bitstreamBuffer.allocationInfo);
+	assert(res == VK_SUCCESS);
+
+	void* pData = nullptr;
+	vmaMapMemory(devCtx->GetVmaAllocator(), m_bitstreamBuffer.allocation, &pData);
+	m_bitstreamMapped = static_cast<uint8_t*>(pData);
+}
+
+void VulkanDecodeBackend::CreateDPB()
+{
+	auto devCtx = DeviceContext::GetContext();
+
+	// 参照画像を個別のイメージで持てない実装では、1つの配列イメージの各レイヤーを DPB スロットとする.
+	m_dpb.layered = !(m_decoder->m_properties.caps.flags & VK_VIDEO_CAPABILITY_SEPARATE_REFERENCE_IMAGES_BIT_KHR);
+	m_dpb.slotCount = m_decoder->m_videoData.numDPBslots;
+	m_dpb.imageCount = m_dpb.layered ? 1 : m_dpb.slotCount;
+	{
+		VkImageCreateInfo imageCI = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = &m_decoder->m_settings.profileListInfo,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = m_decoder->m_properties.formatProps.format,
+			.extent = {
+				.width = m_decoder->m_videoData.width,
+				.height = m_decoder->m_videoData.height,
+				.depth = 1
+			},
+			.mipLevels = 1,
+			.arrayLayers = m_dpb.layered ? m_dpb.slotCount : 1u,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = m_decoder->m_properties.usageDPB,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = nullptr,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		};
+		// DPB は減らせないため、全スロット分を1つのプールに確保する.
+		uint32_t imageCount = m_dpb.imageCount;
+		m_dpb.pool = devCtx->CreateImagePool(MemoryCategory::DPB, imageCI, imageCount, imageCount);
+		assert(m_dpb.pool != VK_NULL_HANDLE);
+		VmaAllocationCreateInfo allocationCI{
+			.flags = { },
+			.pool = m_dpb.pool,
+		};
+		for (uint32_t i = 0; i < m_dpb.imageCount; ++i)
+		{
+			auto& dpb = m_dpb.image[i];
+			auto res = devCtx->CreateImage(
+				MemoryCategory::DPB,
+				imageCI,
+				allocationCI,
+				&dpb.image,
+				&dpb.allocation,
+				&dpb.allocationInfo
+			);
+			assert(res == VK_SUCCESS);
+
+			std::string name = m_dpb.layered ? "dpbArray" : "dpbSlot:" + std::to_string(i);
+			VkDebugUtilsObjectNameInfoEXT nameInfo{
+				.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
+				.objectType = VK_OBJECT_TYPE_IMAGE,
+				.objectHandle = (uint64_t)(void*)dpb.image,
+				.pObjectName = name.c_str(),
+			};
+			vkSetDebugUtilsObjectNameEXT(devCtx->GetVkDevice(), &nameInfo);
+		}
+	}
+
+	// スロットごとのビュー. 配列イメージの場合はレイヤー単位で作成する.
+	for (uint32_t i = 0; i < m_dpb.slotCount; ++i)
+	{
+		auto& slot = m_dpb.slot[i];
+		slot.image = m_dpb.layered ? m_dpb.image[0].image : m_dpb.image[i].image;
+		slot.layer = m_dpb.layered ? i : 0;
+
+		VkSamplerYcbcrConversionInfo samplerConversionInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO,
+			.conversion = devCtx->m_samplerYcbcrConversion,
+		};
+		VkImageViewCreateInfo imageViewCI = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = &samplerConversionInfo,
+			.flags = 0,
+			.image = slot.image,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = m_decoder->m_properties.formatProps.format,
+			.components = {},
+			.subresourceRange = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = slot.layer,
+				.layerCount = 1,
+			},
+		};
+		auto res = vkCreateImageView(
+			devCtx->GetVkDevice(),
+			&imageViewCI, nullptr, &slot.view);
+		assert(res == VK_SUCCESS);
+
+		m_stateTracker.Register(slot.image, slot.layer);
+	}
+}
+
+bool VulkanDecodeBackend::CreateOutputTexturePool(uint32_t textureCount, uint32_t minTextureCount)
+{
+	auto devCtx = DeviceContext::GetContext();
+
+	VkImageUsageFlags imageUsage = \
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | \
+		VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	VkImageCreateInfo imageCI = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.pNext = &m_decoder->m_settings.profileListInfo,
+		.flags = 0,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = m_decoder->m_properties.formatProps.format,
+		.extent = {
+			.width = m_decoder->m_videoData.width,
+			.height = m_decoder->m_videoData.height,
+			.depth = 1
+		},
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = imageUsage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = nullptr,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+
+	// 全テクスチャが収まる1ブロックのプールを作成. 予算に応じて枚数が減る.
+	m_outputTexturePool = devCtx->CreateImagePool(MemoryCategory::OutputTexture, imageCI, textureCount, minTextureCount);
+	if (m_outputTexturePool == VK_NULL_HANDLE)
+	{
+		OutputDebugStringA("Vulkan decoder: not enough memory for output textures.\n");
+		return false;
+	}
+
+	m_outputTextures.resize(textureCount);
+	for (uint32_t i = 0; i < textureCount; ++i)
+	{
+		m_outputTextures[i] = CreateVideoTexture(imageCI, i);
+		m_stateTracker.Register(m_outputTextures[i].image, 0);
+	}
+	return true;
+}
+
+void VulkanDecodeBackend::DestroyOutputTexturePool()
+{
+	auto devCtx = DeviceContext::GetContext();
+	for (auto& texture : m_outputTextures)
+	{
+		m_stateTracker.Unregister(texture.image);
+		vkDestroyImageView(devCtx->GetVkDevice(), texture.view, nullptr);
+		devCtx->DestroyImage(texture.image, texture.allocation);
+	}
+	m_outputTextures.clear();
+
+	devCtx->DestroyPool(m_outputTexturePool);
+	m_outputTexturePool = VK_NULL_HANDLE;
+}
+
+VulkanDecodeBackend::Image VulkanDecodeBackend::CreateVideoTexture(const VkImageCreateInfo& imageCI, uint32_t index)
+{
+	auto devCtx = DeviceContext::GetContext();
+	Image ret{};
+
+	VmaAllocationCreateInfo allocationCI{
+		.flags = { },
+		.pool = m_outputTexturePool,
+	};
+	VkSamplerYcbcrConversionInfo samplerConversionInfo{
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO,
+		.conversion = devCtx->m_samplerYcbcrConversion,
+	};
+
+	auto res = devCtx->CreateImage(MemoryCategory::OutputTexture, imageCI, allocationCI, &ret.image, &ret.allocation, &ret.allocationInfo);
+	assert(res == VK_SUCCESS);
+
+	VkImageViewCreateInfo imageViewCI = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.pNext = &samplerConversionInfo,
+		.flags = 0,
+		.image = ret.image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = imageCI.format,
+		.components = {},
+		.subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+	};
+	vkCreateImageView(devCtx->GetVkDevice(), &imageViewCI, nullptr, &ret.view);
+
+	std::string name;
+	name = "dispImage:";
+	name += std::to_string(index);
+	VkDebugUtilsObjectNameInfoEXT nameInfo{
+		.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
+		.objectType = VK_OBJECT_TYPE_IMAGE,
+		.objectHandle = (uint64_t)(void*)ret.image,
+		.pObjectName = name.c_str(),
+	};
+	vkSetDebugUtilsObjectNameEXT(devCtx->GetVkDevice(), &nameInfo);
+
+	return ret;
+}
+
+void VulkanDecodeBackend::VideoDecodePreBarrier(VkCommandBuffer videoCmdBuffer, const VideoDecodeOperation& operation)
+{
+	// 今回のデコードで書き込むスロットと参照するスロットのみを遷移.
+	const auto& currentSlot = m_dpb.slot[operation.current_dpb];
+	m_stateTracker.Require(currentSlot.image, currentSlot.layer,
+		VK_PIPELINE_STAGE_2_VIDEO_DECODE_BIT_KHR, VK_ACCESS_2_VIDEO_DECODE_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_VIDEO_DECODE_DPB_KHR);
+
+	for (uint32_t i = 0; i < operation.dpbReferenceCount; ++i)
+	{
+		auto refIndex = operation.dpbReferenceSlots[i];
+		if (refIndex == operation.current_dpb)
+		{
+			continue;
+		}
+		const auto& refSlot = m_dpb.slot[refIndex];
+		m_stateTracker.Require(refSlot.image, refSlot.layer,
+			VK_PIPELINE_STAGE_2_VIDEO_DECODE_BIT_KHR, VK_ACCESS_2_VIDEO_DECODE_READ_BIT_KHR, VK_IMAGE_LAYOUT_VIDEO_DECODE_DPB_KHR);
+	}
+	m_stateTracker.Flush(videoCmdBuffer);
+}
+
+void VulkanDecodeBackend::VideoDecodeCore(const VideoDecodeOperation& operation, VkCommandBuffer commandBuffer)
+{
+	auto sliceHeader = reinterpret_cast<const h264::SliceHeader*>(operation.slideHeader);
+	auto pps = reinterpret_cast<const h264::PPS*>(operation.pps);
+	auto sps = reinterpret_cast<const h264::SPS*>(operation.sps);
+
+	StdVideoDecodeH264PictureInfo stdPictureInfoH264 = {};
+	stdPictureInfoH264.pic_parameter_set_id = sliceHeader->pic_parameter_set_id;
+	stdPictureInfoH264.seq_parameter_set_id = pps->seq_parameter_set_id;
+	stdPictureInfoH264.frame_num = sliceHeader->frame_num;
+	stdPictureInfoH264.PicOrderCnt[0] = operation.poc[0];
+	stdPictureInfoH264.PicOrderCnt[1] = operation.poc[1];
+	stdPictureInfoH264.idr_pic_id = sliceHeader->idr_pic_id;
+	stdPictureInfoH264.flags.is_intra = operation.frameType == VideoDecodeOperation::FrameType::eIntra ? 1 : 0;
+	stdPictureInfoH264.flags.is_reference = operation.referencePriority > 0 ? 1 : 0;
+	stdPictureInfoH264.flags.IdrPicFlag = (stdPictureInfoH264.flags.is_intra && stdPictureInfoH264.flags.is_reference) ? 1 : 0;
+
+	{
+		auto& frame = m_decoder->m_videoData.frameInfos[operation.decodedFrameIndex];
+		stdPictureInfoH264.flags.IdrPicFlag = (frame.nalUnitType == 5) ? 1 : 0;
+	}
+	stdPictureInfoH264.flags.field_pic_flag = sliceHeader->field_pic_flag;
+	stdPictureInfoH264.flags.bottom_field_flag = sliceHeader->bottom_field_flag;
+	stdPictureInfoH264.flags.complementary_field_pair = 0;
+
+
+	VkVideoReferenceSlotInfoKHR referenceSlotInfos[SlotCount] = { };
+	VkVideoPictureResourceInfoKHR referenceSlotPictures[SlotCount] = { };
+	VkVideoDecodeH264DpbSlotInfoKHR dpbSlotH264[SlotCount] = { };
+	StdVideoDecodeH264ReferenceInfo referenceInfosH264[SlotCount] = { };
+	for (uint32_t i = 0; i < operation.dpbSlotNum; ++i)
+	{
+		auto& slot = referenceSlotInfos[i];
+		auto& pic = referenceSlotPictures[i];
+		auto& dpb = dpbSlotH264[i];
+		auto& info = referenceInfosH264[i];
+
+		slot.sType = VK_STRUCTURE_TYPE_VIDEO_REFERENCE_SLOT_INFO_KHR;
+		slot.pPictureResource = &pic;
+		slot.slotIndex = i;
+		slot.pNext = &dpb;
+
+		pic.sType = VK_STRUCTURE_TYPE_VIDEO_PICTURE_RESOURCE_INFO_KHR;
+		pic.codedOffset = { .x = 0, .y = 0 };
+		pic.codedExtent = {
+			.width = m_decoder->m_videoData.width,
+			.height = m_decoder->m_videoData.height,
+		};
+		pic.baseArrayLayer = 0;
+		pic.imageViewBinding = m_dpb.slot[i].view;
+
+		dpb.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_DPB_SLOT_INFO_KHR;
+		dpb.pStdReferenceInfo = &info;
+
+		info.flags.bottom_field_flag = 0;
+		info.flags.top_field_flag = 0;
+		info.flags.is_non_existing = 0;
+		info.flags.used_for_long_term_reference = 0;
+		info.FrameNum = operation.dpbFramenum[i];
+		info.PicOrderCnt[0] = operation.dpbPoc[i];
+		info.PicOrderCnt[1] = operation.dpbPoc[i];
+	}
+	VkVideoReferenceSlotInfoKHR referenceSlots[SlotCount] = { };
+	for (uint32_t i = 0; i < operation.dpbReferenceCount; ++i)
+	{
+		uint32_t refSlot = operation.dpbReferenceSlots[i];
+		assert(refSlot != operation.current_dpb);
+		referenceSlots[i] = referenceSlotInfos[refSlot];
+	}
+	referenceSlots[operation.dpbReferenceCount] = referenceSlotInfos[operation.current_dpb];
+	referenceSlots[operation.dpbReferenceCount].slotIndex = -1;
+
+	VkVideoBeginCodingInfoKHR beginInfo{
+		.sType = VK_STRUCTURE_TYPE_VIDEO_BEGIN_CODING_INFO_KHR,
+		.videoSession = m_decoder->m_videoSession,
+		.videoSessionParameters = m_decoder->m_videoSessionParameters,
+		.referenceSlotCount = operation.dpbReferenceCount + 1, // カレント分を+1
+	};
+	if (beginInfo.referenceSlotCount > 0)
+	{
+		beginInfo.pReferenceSlots = referenceSlots;
+	}
+	vkCmdBeginVideoCodingKHR(commandBuffer, &beginInfo);
+
+	if (operation.flags & VideoDecodeOperation::eSessionReset)
+	{
+		VkVideoCodingControlInfoKHR controlInfo = {};
+		controlInfo.sType = VK_STRUCTURE_TYPE_VIDEO_CODING_CONTROL_INFO_KHR;
+		controlInfo.flags = VK_VIDEO_CODING_CONTROL_RESET_BIT_KHR;
+		vkCmdControlVideoCodingKHR(commandBuffer, &controlInfo);
+	}
+
+	VkVideoDecodeInfoKHR decodeInfo = {};
+	decodeInfo.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_INFO_KHR;
+	decodeInfo.srcBuffer = m_bitstreamBuffer.buffer;
+	decodeInfo.srcBufferOffset = (VkDeviceSize)(operation.bitstreamSlot * m_bitstreamSlotSize);
+	decodeInfo.srcBufferRange = align_to(operation.streamSize, 256/*VIDEO_DECODE_BITSTREAM_ALIGNMENT*/);
+	decodeInfo.dstPictureResource = *referenceSlotInfos[operation.current_dpb].pPictureResource;
+	decodeInfo.referenceSlotCount = operation.dpbReferenceCount;
+	decodeInfo.pReferenceSlots = decodeInfo.referenceSlotCount == 0 ? nullptr : referenceSlots;
+	decodeInfo.pSetupReferenceSlot = &referenceSlotInfos[operation.current_dpb];
+
+	{
+		assert(operation.current_dpb < m_decoder->m_videoData.numDPBslots);
+	}
+
+	VkVideoDecodeH264PictureInfoKHR pictureInfoH264{
+		.sType = VK_STRUCTURE_TYPE_VIDEO_DECODE_H264_PICTURE_INFO_KHR,
+		.pStdPictureInfo = &stdPictureInfoH264,
+		.sliceCount = operation.sliceCount,
+		.pSliceOffsets = operation.sliceOffsets,
+	};
+	decodeInfo.pNext = &pictureInfoH264;
+
+	if (m_statusQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdBeginQuery(commandBuffer, m_statusQueryPool, operation.outputIndex, 0);
+	}
+	vkCmdDecodeVideoKHR(commandBuffer, &decodeInfo);
+	if (m_statusQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdEndQuery(commandBuffer, m_statusQueryPool, operation.outputIndex);
+	}
+
+	{
+		std::stringstream ss;
+		ss << "decoded_frame_index:" << operation.decodedFrameIndex << std::endl;
+		ss << "  srcOffset:" << decodeInfo.srcBufferOffset << ", srcBufferRange:" << decodeInfo.srcBufferRange;
+		ss << "  referenceSlotCount:" << decodeInfo.referenceSlotCount << std::endl;
+		for (uint32_t i = 0; i < decodeInfo.referenceSlotCount; ++i) {
+			const auto& slot = decodeInfo.pReferenceSlots[i];
+			ss << "    [" << i << "] slotIndex:" << slot.slotIndex << "  view:" << std::hex << slot.pPictureResource->imageViewBinding << "\n";
+		}
+		ss << "  frame_num: " << std::dec << pictureInfoH264.pStdPictureInfo->frame_num << std::endl;
+		ss << "  pSetupReferenceSlot: \n";
+		ss << "    slotIndex:" << decodeInfo.pSetupReferenceSlot->slotIndex << std::hex << "\n";
+		ss << "    viewBinding:" << std::hex << decodeInfo.pSetupReferenceSlot->pPictureResource->imageViewBinding << "\n";
+
+		ss << std::endl;
+		OutputDebugStringA(ss.str().c_str());
+	}
+
+
+	VkVideoEndCodingInfoKHR endInfo{
+		.sType = VK_STRUCTURE_TYPE_VIDEO_END_CODING_INFO_KHR,
+	};
+	vkCmdEndVideoCodingKHR(commandBuffer, &endInfo);
+}
+
+void VulkanDecodeBackend::CopyToTexture(VkCommandBuffer videoCmdBuffer, const VideoDecodeOperation& operation)
+{
+	const auto& srcSlotDPB = m_dpb.slot[operation.current_dpb];
+	const auto& dstImage = m_outputTextures[operation.outputIndex];
+	auto devCtx = DeviceContext::GetContext();
+	// DPBを転送元へ、出力先を転送先へ遷移.
+	// 出力先は全体を上書きするため、グラフィックスキューから所有権を戻さずに内容を捨てて使う.
+	m_stateTracker.Require(srcSlotDPB.image, srcSlotDPB.layer,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	m_stateTracker.Require(dstImage.image, 0,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		devCtx->GetDecoderQueueFamilyIndex());
+	m_stateTracker.Flush(videoCmdBuffer);
+
+	// テクスチャとしてコピー.
+	const auto width = m_decoder->m_videoData.width;
+	const auto height = m_decoder->m_videoData.height;
+	VkImageCopy2 regions[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_COPY_2,
+			.srcSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT,
+				.mipLevel = 0, .baseArrayLayer = srcSlotDPB.layer, .layerCount = 1,
+			},
+			.srcOffset = { },
+			.dstSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_PLANE_0_BIT,
+				.mipLevel = 0, .baseArrayLayer = 0,	.layerCount = 1,
+			},
+			.dstOffset = { },
+			.extent = {	.width = width, .height = height, .depth = 1,	}
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_COPY_2,
+			.srcSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT,
+				.mipLevel = 0, .baseArrayLayer = srcSlotDPB.layer, .layerCount = 1,
+			},
+			.srcOffset = { },
+			.dstSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_PLANE_1_BIT,
+				.mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1,
+			},
+			.dstOffset = { },
+			.extent = { .width = width / 2, .height = height / 2, .depth = 1,	}
+		},
+	};
+	{
+		VkCopyImageInfo2 info = {
+			.sType = VK_STRUCTURE_TYPE_COPY_IMAGE_INFO_2,
+			.srcImage = srcSlotDPB.image,
+			.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.dstImage = dstImage.image,
+			.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.regionCount = uint32_t(std::size(regions)),
+			.pRegions = regions,
+		};
+		vkCmdCopyImage2(videoCmdBuffer, &info);
+	}
+
+	// キューファミリーが異なる場合は、グラフィックスキューへ所有権を移す. 取得は VideoDecodePostBarrier で行う.
+	m_stateTracker.Release(dstImage.image, 0, devCtx->GetGraphicsQueueFamilyIndex(), VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL);
+	m_stateTracker.Flush(videoCmdBuffer);
+}
+
+void VulkanDecodeBackend::CreateStatusQueryPool()
+{
+	auto devCtx = DeviceContext::GetContext();
+	if (devCtx->GetTimestampValidBits(DeviceContext::VideoDecode) != 0 || !devCtx->HasDecodeQueryResultStatus())
+	{
+		return;
+	}
+	// 結果状態クエリはビデオセッションと同じプロファイルで作る.
+	VkQueryPoolCreateInfo queryPoolCI{
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.pNext = &m_decoder->m_settings.profileInfo,
+		.queryType = VK_QUERY_TYPE_RESULT_STATUS_ONLY_KHR,
+		.queryCount = uint32_t(m_outputTextures.size()),
+	};
+	auto res = vkCreateQueryPool(devCtx->GetVkDevice(), &queryPoolCI, nullptr, &m_statusQueryPool);
+	assert(res == VK_SUCCESS);
+	m_statusQueryUsed.assign(m_outputTextures.size(), false);
+}
+
+void VulkanDecodeBackend::ResetStatusQuery(VkCommandBuffer videoCmdBuffer, uint32_t outputIndex, GpuProfiler* profiler)
+{
+	if (m_statusQueryPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	// 出力テクスチャを再利用する時点で前回のデコードは完了しているため、待たずに読める.
+	if (m_statusQueryUsed[outputIndex] && profiler)
+	{
+		int64_t status = 0;
+		auto res = vkGetQueryPoolResults(DeviceContext::GetContext()->GetVkDevice(), m_statusQueryPool,
+			outputIndex, 1, sizeof(status), &status, sizeof(status), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_STATUS_BIT_KHR);
+		if (res == VK_SUCCESS)
+		{
+			profiler->AddDecodeStatus(0 < status);
+		}
+	}
+	// ビデオコーディングの範囲の外でリセットする.
+	vkCmdResetQueryPool(videoCmdBuffer, m_statusQueryPool, outputIndex, 1);
+	m_statusQueryUsed[outputIndex] = true;
+}
+
+void VulkanDecodeBackend::VideoDecodePostBarrier(VkCommandBuffer graphicsCmdBuffer, uint32_t outputIndex)
+{
+	const auto& output = m_outputTextures[outputIndex];
+	VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
+	if (m_scaler)
+	{
+		// 縮小でも読むため、縮小先の遷移と同じバリアで発行する.
+		stage |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		m_scaler->RequireWrite(m_stateTracker, outputIndex);
+	}
+	// テクスチャとして使用するためのレイアウトへ. デコードキューで解放していれば取得のバリアとなる.
+	m_stateTracker.Require(output.image, 0,
+		stage, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL,
+		DeviceContext::GetContext()->GetGraphicsQueueFamilyIndex());
+	m_stateTracker.Flush(graphicsCmdBuffer);
+
+	if (m_scaler)
+	{
+		m_scaler->Dispatch(graphicsCmdBuffer, outputIndex);
+		m_scaler->RequireRead(m_stateTracker, outputIndex);
+		m_stateTracker.Flush(graphicsCmdBuffer);
+	}
+
+	// 次にデコードキューで再利用する際の同期はセマフォとフェンスで保証されるため、レイアウトのみ引き継ぐ.
+	m_stateTracker.ResetAccess(output.image, 0);
+}
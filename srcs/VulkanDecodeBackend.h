@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "DecodeBackend.h"
+#include "ResourceStateTracker.h"
+#include "VideoPlayer.h"
+
+// Vulkan Video によるデコード. DPB、ビットストリーム、出力テクスチャを保持する.
+class VulkanDecodeBackend : public IDecodeBackend
+{
+public:
+	explicit VulkanDecodeBackend(std::shared_ptr<VideoPlayer::Decoder> decoder) : m_decoder(std::move(decoder)) { }
+
+	const char* GetName() const override { return "Vulkan"; }
+
+	// ビデオセッションを作成し、SPS とデバイスの制限から DPB スロット数を確定させる.
+	bool Initialize(const DecodeStreamDesc& desc) override;
+	void Shutdown() override;
+
+	uint8_t* GetBitstreamSlot(uint32_t slot, uint64_t& capacity) override;
+	uint64_t GetBitstreamAlignment() const override;
+
+	void Decode(const VideoDecodeOperation& operation, const DecodeScheduler::Job& job) override;
+
+	uint32_t GetOutputTextureCount() const override;
+	DecodeOutputTexture GetOutputTexture(uint32_t index) const override;
+
+	void SetScaler(std::shared_ptr<VideoScaler> scaler) override;
+
+private:
+	using Image = VideoPlayer::Image;
+	enum {
+		SlotCount = VideoDecodeOperation::MaxDpbSlotCount,
+	};
+
+	void CreateBitstreamBuffer(uint32_t slotCount);
+	void CreateDPB();
+	bool CreateOutputTexturePool(uint32_t textureCount, uint32_t minTextureCount);
+	void DestroyOutputTexturePool();
+	Image CreateVideoTexture(const VkImageCreateInfo& imageCI, uint32_t index);
+
+	void VideoDecodePreBarrier(VkCommandBuffer videoCmdBuffer, const VideoDecodeOperation& operation);
+	void VideoDecodeCore(const VideoDecodeOperation& operation, VkCommandBuffer commandBuffer);
+	void CopyToTexture(VkCommandBuffer videoCmdBuffer, const VideoDecodeOperation& operation);
+	void VideoDecodePostBarrier(VkCommandBuffer graphicsCmdBuffer, uint32_t outputIndex);
+	void CreateStatusQueryPool();
+	void ResetStatusQuery(VkCommandBuffer videoCmdBuffer, uint32_t outputIndex, GpuProfiler* profiler);
+
+	std::shared_ptr<VideoPlayer::Decoder> m_decoder;
+
+	vku::GPUBuffer m_bitstreamBuffer;
+	uint8_t* m_bitstreamMapped = nullptr;
+	uint64_t m_bitstreamSlotSize = 0;
+	uint32_t m_bitstreamSlotCount = 0;
+
+	struct DPB
+	{
+		// 確保したイメージ. 配列イメージ使用時は先頭の1つのみ.
+		Image image[SlotCount];
+		uint32_t imageCount = 0;
+		uint32_t slotCount = 0;
+		VmaPool pool = VK_NULL_HANDLE;
+		bool layered = false;
+
+		// スロットごとのイメージ/レイヤー/ビュー.
+		struct Slot {
+			VkImage     image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			uint32_t    layer = 0;
+		} slot[SlotCount];
+	} m_dpb;
+
+	// 出力テクスチャは初期化時にプールからまとめて確保し、以降は再利用する.
+	VmaPool m_outputTexturePool = VK_NULL_HANDLE;
+	std::vector<Image> m_outputTextures;
+
+	// DPB と出力テクスチャのレイアウト/アクセス状態. 必要な遷移のみをまとめて発行する.
+	ResourceStateTracker m_stateTracker;
+
+	// デコードキューでタイムスタンプを使えない場合の、デコードの成否を確認する結果状態クエリ.
+	// 出力テクスチャごとに1つ持ち、出力テクスチャを再利用するときに前回の結果を読む.
+	VkQueryPool m_statusQueryPool = VK_NULL_HANDLE;
+	std::vector<bool> m_statusQueryUsed;
+
+	// 設定されている場合はデコード後のバリアに続けて縮小する.
+	std::shared_ptr<VideoScaler> m_scaler;
+};
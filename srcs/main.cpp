@@ -1,777 +1,1445 @@
-﻿#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <windows.h>
-
-#undef ERROR
-#ifndef VK_NO_PROTOTYPES
-# error "VK_NO_PROTOTYPESを定義して下さい.volkを使用しています"
-#endif
-
-// volk をインクルード.
-// VOLK_IMPLEMENTATIONを定義して実装も含める.
-#define VOLK_IMPLEMENTATION
-#define VK_USE_PLATFORM_WIN32_KHR
-#include "Volk/volk.h"
-
-#define GLFW_EXPOSE_NATIVE_WIN32
-#include "GLFW/glfw3.h"
-#include "GLFW/glfw3native.h"
-
-#include <cstdint>
-#include <iostream>
-#include <vector>
-#include <string>
-#include <algorithm>
-#include <filesystem>
-#include <fstream>
-#include <array>
-#include <format>
-
-#include "DeviceContext.h"
-#include "Swapchain.h"
-#include "VideoPlayer.h"
-
-#include "imgui.h"
-#define IMGUI_IMPL_VULKAN_HAS_DYNAMIC_RENDERING
-#include "backends/imgui_impl_vulkan.h"
-#include "backends/imgui_impl_glfw.h"
-#include "implot.h"
-
-#include "vertexShader.h"
-#include "fragementShader.h"
-
-class Swapchain;
-
-class VkVideoDecodeApp
-{
-public:
-	bool Initialize()
-	{
-		// GLFWの初期化.
-		if (!glfwInit()) {
-			return false;
-		}
-
-		// GLFWでVulkanを使用することを指定.
-		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-
-		// ウィンドウを生成.
-		m_window = glfwCreateWindow(1280, 720, "Sample", nullptr, nullptr);
-		if (!m_window)
-		{
-			return false;
-		}
-		glfwSetWindowUserPointer(m_window, this);
-
-		DeviceContext::Initialize();
-		DeviceContext::GetContext()->InitializeDevice(0);
-		DeviceContext::GetContext()->InitializeSwapchain(m_window);
-
-		auto devCtx = DeviceContext::GetContext();
-		auto vkDevice = devCtx->GetVkDevice();
-
-		std::vector<VkDescriptorPoolSize> descriptorPoolSizes = { {
-			{
-				.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				.descriptorCount = 1000,
-			},
-			{
-				.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.descriptorCount = 1000,
-			}
-		} };
-		VkDescriptorPoolCreateInfo descriptorPoolCI{
-			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-			.maxSets = 100,
-			.poolSizeCount = uint32_t(descriptorPoolSizes.size()),
-			.pPoolSizes = descriptorPoolSizes.data(),
-		};
-		vkCreateDescriptorPool(vkDevice, &descriptorPoolCI, nullptr, &m_descriptorPool);
-
-		VkSamplerCreateInfo samplerCI{
-			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-			.magFilter = VK_FILTER_LINEAR,
-			.minFilter = VK_FILTER_LINEAR,
-			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
-			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-		};
-		VkSamplerYcbcrConversionInfo samplerConversionInfo{
-			.sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO,
-			.conversion = devCtx->m_samplerYcbcrConversion,
-		};
-		samplerCI.pNext = &samplerConversionInfo;
-		vkCreateSampler(vkDevice, &samplerCI, nullptr, &m_sampler);
-
-		// ImGui
-		IMGUI_CHECKVERSION();
-		ImGui::CreateContext();
-		ImGui::StyleColorsDark();
-		ImPlot::CreateContext();
-
-		ImGui_ImplGlfw_InitForVulkan(m_window, true);
-		ImGui_ImplVulkan_LoadFunctions(
-			[](const char* functionName, void* userArgs) {
-				auto devCtx = DeviceContext::GetContext();
-				auto vkDevice = devCtx->GetVkDevice();
-				auto vkInstance = devCtx->GetVkInstance();
-				auto devFuncAddr = vkGetDeviceProcAddr(vkDevice, functionName);
-				if (devFuncAddr != nullptr)
-				{
-					return devFuncAddr;
-				}
-				auto instanceFuncAddr = vkGetInstanceProcAddr(vkInstance, functionName);
-				return instanceFuncAddr;
-			});
-		std::vector<VkDescriptorSetLayoutBinding> dsLayouts = { {
-			{
-				.binding = 0,
-				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				.descriptorCount = 1,
-				.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS,
-			},
-			{
-				.binding = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.descriptorCount = 1,
-				.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS,
-				.pImmutableSamplers = &m_sampler,
-			},
-		} };
-		VkDescriptorSetLayoutCreateInfo dsLayoutCI{
-			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-			.bindingCount = uint32_t(dsLayouts.size()),
-			.pBindings = dsLayouts.data(),
-		};
-		vkCreateDescriptorSetLayout(vkDevice, &dsLayoutCI, nullptr, &m_dsLayout);
-
-		InitializeRenderPass();
-		InitializePipeline();
-		InitializeFramebuffers();
-
-		ImGui_ImplVulkan_InitInfo vkInfo{
-			.Instance = devCtx->GetVkInstance(),
-			.PhysicalDevice = devCtx->GetGPU(0),
-			.Device = vkDevice,
-			.QueueFamily = devCtx->GetGraphicsQueueFamilyIndex(),
-			.Queue = devCtx->GetQueue(DeviceContext::Graphics),
-			.DescriptorPool = m_descriptorPool,
-			.RenderPass = m_renderPass,
-			.MinImageCount = 2,
-			.ImageCount = 2,
-			.MSAASamples = VK_SAMPLE_COUNT_1_BIT,
-		};
-		ImGui_ImplVulkan_Init(&vkInfo);
-		auto& io = ImGui::GetIO();
-		ImFontConfig cfg;
-		cfg.SizePixels = 15;
-		io.Fonts->AddFontDefault(&cfg);
-
-		// リソースフォルダにムービーファイルを配置して読み込む.
-		m_videoPlayer.Initialize("res/oceans.mp4");
-
-		VkSemaphoreCreateInfo semaphoreCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
-		};
-		vkCreateSemaphore(vkDevice, &semaphoreCreateInfo, nullptr, &m_semRenderComplete);
-		vkCreateSemaphore(vkDevice, &semaphoreCreateInfo, nullptr, &m_semPresentComplete);
-
-		return true;
-	}
-
-	void Run()
-	{
-		m_referenceSlots.resize(300);
-		for (auto& graph : m_DPBSlotGraph)
-		{
-			graph.resize(300);
-		}
-
-		LARGE_INTEGER prev, freq;
-		QueryPerformanceCounter(&prev);
-		QueryPerformanceFrequency(&freq);
-		while (glfwWindowShouldClose(m_window) == GLFW_FALSE 
-			&& glfwGetKey(m_window, GLFW_KEY_ESCAPE) == GLFW_RELEASE)
-		{
-			glfwPollEvents();
-
-			ImGui_ImplGlfw_NewFrame();
-			ImGui_ImplVulkan_NewFrame();
-			ImGui::NewFrame();
-
-			LARGE_INTEGER now;
-			QueryPerformanceCounter(&now);
-			double elapsed = (now.QuadPart - prev.QuadPart) / double(freq.QuadPart);
-			elapsed = std::min(elapsed, 0.5);
-			prev = now;
-
-			auto devCtx = DeviceContext::GetContext();
-			auto res = devCtx->GetSwapchain()->AcquireNextImage(m_semPresentComplete);
-			if (res != VK_SUCCESS)
-			{
-				devCtx->WaitForIdle();
-				return;
-			}
-
-			FrameInfo frame;
-			BeginFrame(frame);
-			auto vkDevice = devCtx->GetVkDevice();
-
-			VkCommandBufferBeginInfo beginInfo{
-				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-			};
-			vkBeginCommandBuffer(frame.commandBuffer, &beginInfo);
-
-			// デコード.
-			m_videoPlayer.Update(frame.commandBuffer, elapsed);
-
-
-
-			auto imageExtent = DeviceContext::GetContext()->GetSwapchain()->GetExtent2D();
-			VkClearValue clearValue{};
-			clearValue.color = { { 1.0f, 0.6f, 0.5f, 1.0f,} };
-			VkRenderPassBeginInfo renderPassBI{};
-			renderPassBI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassBI.renderPass = m_renderPass;
-			renderPassBI.framebuffer = frame.framebuffer;
-			renderPassBI.renderArea.offset = VkOffset2D{ 0, 0 };
-			renderPassBI.renderArea.extent = imageExtent;
-			renderPassBI.pClearValues = &clearValue;
-			renderPassBI.clearValueCount = 1;
-
-			if(m_videoPlayer.IsReady())
-			{
-				const auto& videoTex = m_videoPlayer.GetVideoTexture();
-				// テクスチャを書き込んでみる
-				VkDescriptorImageInfo imageInfo{
-					.sampler = VK_NULL_HANDLE,
-					.imageView = videoTex.texture.view,
-					.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-				};
-
-				VkWriteDescriptorSet writeDS{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = frame.descriptorSet,
-					.dstBinding = 1,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-					.pImageInfo = &imageInfo,
-				};
-				vkUpdateDescriptorSets(vkDevice, 1, &writeDS, 0, nullptr);
-			}
-
-			vkCmdBeginRenderPass(frame.commandBuffer, &renderPassBI, VK_SUBPASS_CONTENTS_INLINE);
-
-
-			vkCmdBindPipeline(frame.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
-			vkCmdBindDescriptorSets(frame.commandBuffer, 
-				VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
-
-			VkViewport viewport{
-				.x = 0,
-				.y = 0,
-				.width = float(imageExtent.width),
-				.height = float(imageExtent.height),
-				.minDepth = 0.0f,
-				.maxDepth = 1.0f,
-			};
-			VkRect2D scissor{
-				.offset = { 0, 0 },
-				.extent = imageExtent,
-			};
-			vkCmdSetViewport(frame.commandBuffer, 0, 1, &viewport);
-			vkCmdSetScissor(frame.commandBuffer, 0, 1, &scissor);
-
-			if(m_videoPlayer.IsReady())
-			{
-				vkCmdDraw(frame.commandBuffer, 4, 1, 0, 0);
-			}
-
-
-			auto& videoProps = m_videoPlayer.GetVideoProperties();
-			auto& decodeOpe = m_videoPlayer.GetDecodeOperation();
-
-			m_referenceSlots.push_back(decodeOpe.dpbReferenceCount);
-
-			auto DPBused = m_videoPlayer.GetDPBSlotUsed();
-
-			const int GRAPTH_SPAN = 300;
-      for (int i = 0; i < std::size(DPBused); ++i)
-      {
-        m_DPBSlotGraph[i].push_back(DPBused[i]);
-
-				if (m_DPBSlotGraph[i].size() > GRAPTH_SPAN)
-				{
-					m_DPBSlotGraph[i].erase(m_DPBSlotGraph[i].begin());
-				}
-      }
-
-			if (m_referenceSlots.size() > GRAPTH_SPAN)
-			{
-				m_referenceSlots.erase(m_referenceSlots.begin());
-			}
-
-			ImGui::SetNextWindowPos(ImVec2(0, 0));
-			ImGui::SetNextWindowSize(ImVec2(300, 720));
-			ImGui::Begin("Information", nullptr, ImGuiWindowFlags_NoDecoration);
-			ImGui::Text("Resolution: %d x %d", videoProps.width, videoProps.height);
-			ImGui::Text("Display Frame: %d / %d", m_videoPlayer.GetDisplayFrameNumber(), m_videoPlayer.GetLastVideoFrameNumber());
-			
-			if (ImPlot::BeginPlot("Reference Slots"))
-			{
-				auto maxReferences = videoProps.maxReferencePictures;
-				ImPlot::SetupAxesLimits(0, GRAPTH_SPAN, 0, maxReferences + 1);
-				ImPlot::PlotLine("Slot Used", m_referenceSlots.data(), int(m_referenceSlots.size()));
-				ImPlot::EndPlot();
-			}
-			ImGui::End();
-
-
-			ImGui::SetNextWindowPos(ImVec2(980, 0));
-			ImGui::SetNextWindowSize(ImVec2(300, 720));
-			ImGui::Begin("DPBSlot", nullptr, ImGuiWindowFlags_NoResize);
-      uint32_t tableFlags = ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV |
-        ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable;
-      if (ImGui::BeginTable("DPB", 2, tableFlags, ImVec2(-1, 0)))
-      {
-        ImGui::TableSetupColumn("DPBSlot", ImGuiTableColumnFlags_WidthFixed, 75.0f);
-        ImGui::TableSetupColumn("Used");
-        ImGui::TableHeadersRow();
-        ImPlot::PushColormap(ImPlotColormap_Cool);
-
-        auto maxReferences = videoProps.maxReferencePictures;
-        for (int row = 0; row < maxReferences; ++row)
-        {
-          ImGui::TableNextRow();
-          ImGui::TableSetColumnIndex(0);
-          ImGui::Text("Slot%d", row);
-          ImGui::PushID(row);
-
-          ImGui::TableSetColumnIndex(1);
-          ImPlot::PushStyleVar(ImPlotStyleVar_PlotPadding, ImVec2(0, 0));
-          if (ImPlot::BeginPlot("", ImVec2(-1, 35), ImPlotFlags_CanvasOnly))
-          {
-            ImPlot::SetupAxes(nullptr, nullptr, ImPlotAxisFlags_NoDecorations, ImPlotAxisFlags_NoDecorations);
-						ImPlot::SetupAxesLimits(0, GRAPTH_SPAN, 0, 1.5, ImGuiCond_Always);
-						auto col = ImPlot::GetColormapColor(row);
-						ImPlot::SetNextLineStyle(col);
-						ImPlot::SetNextFillStyle(col, 0.25);
-
-						ImPlot::PlotLine("", m_DPBSlotGraph[row].data(), m_DPBSlotGraph[row].size(), 1, 0, ImPlotLineFlags_Shaded, 0);
-
-            ImPlot::EndPlot();
-          }
-          ImPlot::PopStyleVar();
-          ImGui::PopID();
-        }
-        ImPlot::PopColormap();
-        ImGui::EndTable();
-      }
-      ImGui::End();
-
-
-			ImGui::Render();
-			ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), frame.commandBuffer);
-
-
-			vkCmdEndRenderPass(frame.commandBuffer);
-
-			vkEndCommandBuffer(frame.commandBuffer);
-
-			VkPipelineStageFlags wait_stage[] = { 
-				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT	};
-			std::vector<VkSemaphore> waitSemaphores = {	m_semPresentComplete, };
-
-			VkSubmitInfo submitInfo{
-				.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-				.waitSemaphoreCount = uint32_t(waitSemaphores.size()),
-				.pWaitSemaphores = waitSemaphores.data(),
-				.pWaitDstStageMask = wait_stage,
-				.commandBufferCount = 1,
-				.pCommandBuffers = &frame.commandBuffer,
-				.signalSemaphoreCount = 1,
-				.pSignalSemaphores = &m_semRenderComplete,
-			};
-			devCtx->Submit(DeviceContext::Graphics, &submitInfo, frame.queueSubmitFence);
-			devCtx->Present({ m_semRenderComplete });
-		}
-	}
-
-	void Shutdown()
-	{
-		auto devCtx = DeviceContext::GetContext();
-		auto vkDevice = devCtx->GetVkDevice();
-		vkDeviceWaitIdle(vkDevice);
-
-		if (m_pipeline != VK_NULL_HANDLE)
-		{
-			vkDestroyPipeline(vkDevice, m_pipeline, nullptr);
-			m_pipeline = VK_NULL_HANDLE;
-		}
-		if (m_pipelineLayout != VK_NULL_HANDLE)
-		{
-			vkDestroyPipelineLayout(vkDevice, m_pipelineLayout, nullptr);
-			m_pipelineLayout = VK_NULL_HANDLE;
-		}
-
-		TeardownFramebuffers();
-		for (auto& frame : m_frames)
-		{
-			TeardownPerFrame(frame);
-		}
-		m_frames.clear();
-
-		vkDestroySemaphore(vkDevice, m_semRenderComplete, nullptr);
-		vkDestroySemaphore(vkDevice, m_semPresentComplete, nullptr);
-		m_semRenderComplete = VK_NULL_HANDLE;
-		m_semPresentComplete = VK_NULL_HANDLE;
-
-		if (m_renderPass != VK_NULL_HANDLE)
-		{
-			vkDestroyRenderPass(vkDevice, m_renderPass, nullptr);
-		}
-
-		DeviceContext::Shutdown();
-		if (m_window)
-		{
-			glfwDestroyWindow(m_window);
-			m_window = nullptr;
-		}
-	}
-
-private:
-
-	void InitializeRenderPass()
-	{
-		auto devCtx = DeviceContext::GetContext();
-		auto vkDevice = devCtx->GetVkDevice();
-		VkAttachmentDescription attachment = { 0 };
-		attachment.format = devCtx->GetSwapchain()->GetSurfaceFormat().format;
-		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-		VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-		VkSubpassDescription subpass = { 0 };
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &colorRef;
-
-		VkSubpassDependency dependency = { 
-			.srcSubpass = VK_SUBPASS_EXTERNAL,
-			.dstSubpass = 0,
-			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			.srcAccessMask = 0,
-			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
-		};
-
-		VkRenderPassCreateInfo rp_info = { 
-			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-			.attachmentCount = 1,
-			.pAttachments = &attachment,
-			.subpassCount = 1,
-			.pSubpasses = &subpass,
-			.dependencyCount = 1,
-			.pDependencies = &dependency
-		};
-
-		vkCreateRenderPass(vkDevice, &rp_info, nullptr, &m_renderPass);
-	}
-	VkShaderModule CreateShaderModule(const uint32_t* data, size_t length)
-	{
-		auto vkDevice = DeviceContext::GetContext()->GetVkDevice();
-		VkShaderModuleCreateInfo moduleCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-			.codeSize = length,
-			.pCode = data
-		};
-		VkShaderModule shaderModule;
-		vkCreateShaderModule(vkDevice, &moduleCreateInfo, nullptr, &shaderModule);
-		return shaderModule;
-	}
-
-	void InitializePipeline()
-	{
-		auto devCtx = DeviceContext::GetContext();
-		auto vkDevice = devCtx->GetVkDevice();
-		VkPipelineLayoutCreateInfo layoutInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-			.setLayoutCount = 1,
-			.pSetLayouts = &m_dsLayout,
-		};
-		vkCreatePipelineLayout(vkDevice, &layoutInfo, nullptr, &m_pipelineLayout);
-
-		VkPipelineVertexInputStateCreateInfo vertexInput{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO
-		};
-
-		VkPipelineInputAssemblyStateCreateInfo inputAssembly{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO
-		};
-		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
-
-		VkPipelineRasterizationStateCreateInfo raster{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-			.cullMode = VK_CULL_MODE_BACK_BIT,
-			.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
-			.lineWidth = 1.0f,
-		};
-
-		VkPipelineColorBlendAttachmentState blendAttachment{
-			.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-		};
-
-		VkPipelineColorBlendStateCreateInfo blend{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-			.attachmentCount = 1,
-			.pAttachments = &blendAttachment
-		};
-
-		VkPipelineViewportStateCreateInfo viewport{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-			.viewportCount = 1,
-			.scissorCount = 1,
-		};
-
-		VkPipelineDepthStencilStateCreateInfo depthStencil{
-			.stencilTestEnable = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO
-		};
-
-		VkPipelineMultisampleStateCreateInfo multisample{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-			.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-		};
-
-		std::array<VkDynamicState, 2> dynamics{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-
-		VkPipelineDynamicStateCreateInfo dynamic{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-			.dynamicStateCount = uint32_t(dynamics.size()),
-			.pDynamicStates = dynamics.data(),
-		};
-
-		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{{
-			{
-				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-				.stage = VK_SHADER_STAGE_VERTEX_BIT,
-				.module= CreateShaderModule(gVS, sizeof(gVS)),
-				.pName = "main",
-			},
-			{
-				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-				.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-				.module = CreateShaderModule(gFS, sizeof(gFS)),
-				.pName = "main",
-			}
-		}};
-
-		VkGraphicsPipelineCreateInfo pipelineCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-			.stageCount = uint32_t(shaderStages.size()),
-			.pStages = shaderStages.data(),
-			.pVertexInputState = &vertexInput,
-			.pInputAssemblyState = &inputAssembly,
-			.pViewportState = &viewport,
-			.pRasterizationState = &raster,
-			.pMultisampleState = &multisample,
-			.pDepthStencilState = &depthStencil,
-			.pColorBlendState = &blend,
-			.pDynamicState = &dynamic,
-			.layout = m_pipelineLayout,
-			.renderPass = m_renderPass,
-		};
-
-		vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_pipeline);
-
-		for (auto& m : shaderStages)
-		{
-			vkDestroyShaderModule(vkDevice, m.module, nullptr);
-		}
-	}
-	void InitializeFramebuffers()
-	{
-		auto devCtx = DeviceContext::GetContext();
-		auto swapchain = devCtx->GetSwapchain();
-		auto vkDevice = devCtx->GetVkDevice();
-		auto count = swapchain->GetImageCount();
-		auto extent = swapchain->GetExtent2D();
-
-		m_frames.resize(swapchain->GetImageCount());
-
-		for (uint32_t i=0;i<count;++i)
-		{
-			auto view = swapchain->GetImageView(i);
-			VkFramebufferCreateInfo framebufferCreateInfo{
-				.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-				.renderPass = m_renderPass,
-				.attachmentCount = 1,
-				.pAttachments = &view,
-				.width = extent.width,
-				.height = extent.height,
-				.layers = 1,
-			};
-			VkFramebuffer fb;
-			vkCreateFramebuffer(vkDevice, &framebufferCreateInfo, nullptr, &fb);
-			m_frames[i].framebuffer = fb;
-			InitPerFrame(m_frames[i]);
-		}
-
-	}
-
-private:
-	struct FrameInfo
-	{
-		VkCommandPool commandPool = VK_NULL_HANDLE;
-		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
-		VkFence queueSubmitFence = VK_NULL_HANDLE;
-		uint32_t queueIndex = 0;
-
-		VkFramebuffer framebuffer = VK_NULL_HANDLE;
-		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-	};
-
-	GLFWwindow* m_window = nullptr;
-
-	std::vector<FrameInfo>   m_frames{};
-
-	VkSemaphore m_semRenderComplete = VK_NULL_HANDLE;
-	VkSemaphore m_semPresentComplete = VK_NULL_HANDLE;
-	VkRenderPass m_renderPass = VK_NULL_HANDLE;
-	VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
-	VkPipeline m_pipeline = VK_NULL_HANDLE;
-
-	VkDescriptorSetLayout m_dsLayout = VK_NULL_HANDLE;
-	VkSampler m_sampler = VK_NULL_HANDLE;
-
-	VideoPlayer m_videoPlayer;
-
-	std::vector<int> m_referenceSlots;
-	std::vector<int> m_DPBSlotGraph[18];
-
-
-	VkDescriptorPool m_descriptorPool;
-
-	void InitPerFrame(FrameInfo& frameInfo)
-	{
-		auto devCtx = DeviceContext::GetContext();
-		auto vkDevice = devCtx->GetVkDevice();
-		VkFenceCreateInfo fenceCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-			.flags = VK_FENCE_CREATE_SIGNALED_BIT,
-		};
-		vkCreateFence(vkDevice, &fenceCreateInfo, nullptr, &frameInfo.queueSubmitFence);
-
-		VkCommandPoolCreateInfo commandPoolCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
-			.queueFamilyIndex = devCtx->GetGraphicsQueueFamilyIndex(),
-		};
-		vkCreateCommandPool(vkDevice, &commandPoolCreateInfo, nullptr, &frameInfo.commandPool);
-
-		VkCommandBufferAllocateInfo commandBufferAllocateInfo{
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-			.commandPool = frameInfo.commandPool,
-			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-			.commandBufferCount = 1,
-		};
-		vkAllocateCommandBuffers(vkDevice, &commandBufferAllocateInfo, &frameInfo.commandBuffer);
-		frameInfo.queueIndex = 0;
-
-		VkDescriptorSetAllocateInfo dsAllocInfo{
-			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-			.descriptorPool = m_descriptorPool,
-			.descriptorSetCount = 1,
-			.pSetLayouts = &m_dsLayout,
-		};
-		vkAllocateDescriptorSets(vkDevice, &dsAllocInfo, &frameInfo.descriptorSet);
-	}
-
-	void TeardownPerFrame(FrameInfo& frameInfo)
-	{
-		auto devCtx = DeviceContext::GetContext();
-		auto vkDevice = devCtx->GetVkDevice();
-
-		if (frameInfo.queueSubmitFence != VK_NULL_HANDLE)
-		{
-			vkDestroyFence(vkDevice, frameInfo.queueSubmitFence, nullptr);
-			frameInfo.queueSubmitFence = VK_NULL_HANDLE;
-		}
-		if (frameInfo.commandBuffer != VK_NULL_HANDLE)
-		{
-			vkFreeCommandBuffers(vkDevice, frameInfo.commandPool, 1, &frameInfo.commandBuffer);
-			frameInfo.commandBuffer = VK_NULL_HANDLE;
-		}
-		if (frameInfo.commandPool != VK_NULL_HANDLE)
-		{
-			vkDestroyCommandPool(vkDevice, frameInfo.commandPool, nullptr);
-			frameInfo.commandPool = VK_NULL_HANDLE;
-		}
-
-		if (frameInfo.framebuffer != VK_NULL_HANDLE)
-		{
-			vkDestroyFramebuffer(vkDevice, frameInfo.framebuffer, nullptr);
-			frameInfo.framebuffer = VK_NULL_HANDLE;
-		}
-
-		frameInfo.queueIndex = 0;
-	}
-
-	void TeardownFramebuffers()
-	{
-		auto devCtx = DeviceContext::GetContext();
-		devCtx->WaitForIdle();
-		auto vkDevice = devCtx->GetVkDevice();
-		for (auto& frame : m_frames)
-		{
-			vkDestroyFramebuffer(vkDevice, frame.framebuffer, nullptr);
-			frame.framebuffer = VK_NULL_HANDLE;
-		}
-	}
-
-	void BeginFrame(FrameInfo& frame)
-	{
-		auto devCtx = DeviceContext::GetContext();
-		auto index = devCtx->GetSwapchain()->GetCurrentIndex();
-		auto vkDevice = devCtx->GetVkDevice();
-		frame = m_frames[index];
-		if (frame.queueSubmitFence != VK_NULL_HANDLE)
-		{
-			vkWaitForFences(vkDevice, 1, &frame.queueSubmitFence, VK_TRUE, UINT64_MAX);
-			vkResetFences(vkDevice, 1, &frame.queueSubmitFence);
-		}
-
-		if (frame.commandPool != VK_NULL_HANDLE)
-		{
-			vkResetCommandPool(vkDevice, frame.commandPool, 0);
-		}
-	}
-};
-
-int __stdcall wWinMain(_In_ HINSTANCE hInstance,
-	_In_opt_ HINSTANCE hPrevInstance,
-	_In_ LPWSTR lpCmdLine,
-	_In_ int nCmdShow)
-{
-
-	VkVideoDecodeApp app;
-	if (app.Initialize())
-	{
-		app.Run();
-		app.Shutdown();
-	}
-	else
-	{
-		return -1;
-	}
-
-	return 0;
-}
-
+﻿#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <shellapi.h>
+
+#undef ERROR
+#ifndef VK_NO_PROTOTYPES
+# error "VK_NO_PROTOTYPESを定義して下さい.volkを使用しています"
+#endif
+
+// volk をインクルード.
+// VOLK_IMPLEMENTATIONを定義して実装も含める.
+#define VOLK_IMPLEMENTATION
+#define VK_USE_PLATFORM_WIN32_KHR
+#include "Volk/volk.h"
+
+#define GLFW_EXPOSE_NATIVE_WIN32
+#include "GLFW/glfw3.h"
+#include "GLFW/glfw3native.h"
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <array>
+#include <deque>
+#include <format>
+#include <chrono>
+#include <cassert>
+
+#include "DeviceContext.h"
+#include "Swapchain.h"
+#include "VideoPlayer.h"
+#include "FrameDumper.h"
+#include "ColorConverter.h"
+#include "VideoScaler.h"
+#include "OfflineDecoder.h"
+#include "GpuProfiler.h"
+#include "HeadlessPlayback.h"
+
+#include "imgui.h"
+#define IMGUI_IMPL_VULKAN_HAS_DYNAMIC_RENDERING
+#include "backends/imgui_impl_vulkan.h"
+#include "backends/imgui_impl_glfw.h"
+#include "implot.h"
+
+#include "vertexShader.h"
+#include "fragementShader.h"
+
+class Swapchain;
+
+class VkVideoDecodeApp
+{
+public:
+	// 同時に処理中とするフレーム数. スワップチェインのイメージ数とは独立させる.
+	enum {
+		MAX_FRAMES_IN_FLIGHT = 2,
+	};
+
+	// スワップチェインの表示モードとイメージ数. サーフェスが対応していない場合は Initialize で補正される.
+	// 使用する GPU の番号. DeviceContext::AUTO_SELECT_GPU の場合はデコードの能力で選ぶ.
+	void SetGpuIndex(int index) { m_gpuIndex = index; }
+	void SetPresentMode(VkPresentModeKHR mode) { m_presentMode = mode; }
+	void SetSwapchainImageCount(uint32_t count) { m_swapchainImageCount = count; }
+
+	// デコード結果を書き出すファイル. "-" で標準出力.
+	void SetDumpPath(const std::filesystem::path& path) { m_dumpPath = path; }
+	void SetDumpFormat(FrameDumper::Format format) { m_dumpFormat = format; m_hasDumpFormat = true; }
+	// パイプラインキャッシュのファイル. 空の場合はキャッシュを保存しない.
+	void SetPipelineCachePath(const std::filesystem::path& path) { m_pipelineCachePath = path; }
+	// デコード結果の縮小コピー. 空の場合は縮小しない.
+	void SetScaleOutputs(const std::vector<VideoScaler::OutputDesc>& outputs) { m_scaleOutputs = outputs; }
+	// 段階ごとの GPU の時間を書き出す CSV. 空の場合は書き出さない.
+	void SetGpuTimingCsvPath(const std::filesystem::path& path) { m_gpuTimingCsvPath = path; }
+
+	bool Initialize()
+	{
+		auto startTime = std::chrono::steady_clock::now();
+
+		// GLFWの初期化.
+		if (!glfwInit()) {
+			return false;
+		}
+
+		// GLFWでVulkanを使用することを指定.
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+
+		// ウィンドウを生成.
+		m_window = glfwCreateWindow(1280, 720, "Sample", nullptr, nullptr);
+		if (!m_window)
+		{
+			return false;
+		}
+		glfwSetWindowUserPointer(m_window, this);
+		glfwSetFramebufferSizeCallback(m_window, [](GLFWwindow* window, int width, int height) {
+			auto app = static_cast<VkVideoDecodeApp*>(glfwGetWindowUserPointer(window));
+			app->m_isSwapchainDirty = true;
+		});
+
+		DeviceContext::Initialize();
+		if (m_gpuIndex >= int(DeviceContext::GetContext()->GetGPUCount()))
+		{
+			m_gpuIndex = DeviceContext::AUTO_SELECT_GPU;
+		}
+		DeviceContext::GetContext()->InitializeDevice(m_gpuIndex);
+		DeviceContext::GetContext()->InitializeSwapchain(m_window, m_presentMode, m_swapchainImageCount);
+		// 作り直しで置き換えたスワップチェインは、処理中のフレームが完了してから破棄する.
+		DeviceContext::GetContext()->GetSwapchain()->SetFramesInFlight(MAX_FRAMES_IN_FLIGHT);
+		if (!m_pipelineCachePath.empty())
+		{
+			DeviceContext::GetContext()->InitializePipelineCache(m_pipelineCachePath);
+		}
+
+		auto devCtx = DeviceContext::GetContext();
+		auto vkDevice = devCtx->GetVkDevice();
+
+		std::vector<VkDescriptorPoolSize> descriptorPoolSizes = { {
+			{
+				.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				.descriptorCount = 1000,
+			},
+			{
+				.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.descriptorCount = 1000,
+			}
+		} };
+		VkDescriptorPoolCreateInfo descriptorPoolCI{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.maxSets = 100,
+			.poolSizeCount = uint32_t(descriptorPoolSizes.size()),
+			.pPoolSizes = descriptorPoolSizes.data(),
+		};
+		vkCreateDescriptorPool(vkDevice, &descriptorPoolCI, nullptr, &m_descriptorPool);
+
+		VkSamplerCreateInfo samplerCI{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		};
+		VkSamplerYcbcrConversionInfo samplerConversionInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO,
+			.conversion = devCtx->m_samplerYcbcrConversion,
+		};
+		samplerCI.pNext = &samplerConversionInfo;
+		vkCreateSampler(vkDevice, &samplerCI, nullptr, &m_sampler);
+
+		// ImGui
+		IMGUI_CHECKVERSION();
+		ImGui::CreateContext();
+		ImGui::StyleColorsDark();
+		ImPlot::CreateContext();
+
+		ImGui_ImplGlfw_InitForVulkan(m_window, true);
+		ImGui_ImplVulkan_LoadFunctions(
+			[](const char* functionName, void* userArgs) {
+				auto devCtx = DeviceContext::GetContext();
+				auto vkDevice = devCtx->GetVkDevice();
+				auto vkInstance = devCtx->GetVkInstance();
+				auto devFuncAddr = vkGetDeviceProcAddr(vkDevice, functionName);
+				if (devFuncAddr != nullptr)
+				{
+					return devFuncAddr;
+				}
+				auto instanceFuncAddr = vkGetInstanceProcAddr(vkInstance, functionName);
+				return instanceFuncAddr;
+			});
+		std::vector<VkDescriptorSetLayoutBinding> dsLayouts = { {
+			{
+				.binding = 0,
+				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS,
+			},
+			{
+				.binding = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS,
+				.pImmutableSamplers = &m_sampler,
+			},
+		} };
+		VkDescriptorSetLayoutCreateInfo dsLayoutCI{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = uint32_t(dsLayouts.size()),
+			.pBindings = dsLayouts.data(),
+		};
+		vkCreateDescriptorSetLayout(vkDevice, &dsLayoutCI, nullptr, &m_dsLayout);
+
+		InitializeRenderPass();
+		// パイプライン作成 (ImGui を含む) の時間. キャッシュの効果を確認するために計る.
+		auto pipelineStartTime = std::chrono::steady_clock::now();
+		InitializePipeline();
+		InitializeFramebuffers();
+		InitializeFrames();
+
+		ImGui_ImplVulkan_InitInfo vkInfo{
+			.Instance = devCtx->GetVkInstance(),
+			.PhysicalDevice = devCtx->GetGPU(0),
+			.Device = vkDevice,
+			.QueueFamily = devCtx->GetGraphicsQueueFamilyIndex(),
+			.Queue = devCtx->GetQueue(DeviceContext::Graphics),
+			.DescriptorPool = m_descriptorPool,
+			.RenderPass = m_renderPass,
+			.MinImageCount = 2,
+			.ImageCount = MAX_FRAMES_IN_FLIGHT,
+			.MSAASamples = VK_SAMPLE_COUNT_1_BIT,
+			.PipelineCache = devCtx->GetPipelineCache(),
+		};
+		ImGui_ImplVulkan_Init(&vkInfo);
+		m_pipelineSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - pipelineStartTime).count();
+		auto& io = ImGui::GetIO();
+		ImFontConfig cfg;
+		cfg.SizePixels = 15;
+		io.Fonts->AddFontDefault(&cfg);
+
+		// デコードの送信は全プレイヤーで共有するスケジューラーが行う.
+		m_decodeScheduler = std::make_shared<DecodeScheduler>();
+		m_decodeScheduler->Initialize(MAX_FRAMES_IN_FLIGHT);
+		InitializeGpuProfiler();
+
+		// リソースフォルダにムービーファイルを配置して読み込む.
+		m_videoPlayer.Initialize("res/oceans.mp4", m_decodeScheduler);
+		// 表示を終えたテクスチャは、描画中のフレームが完了してから再利用する.
+		m_videoPlayer.SetFramesInFlight(MAX_FRAMES_IN_FLIGHT);
+		InitializeVideoDescriptorSets();
+		InitializeScaler();
+		InitializeFrameDumper();
+
+		m_startupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		char buf[256];
+		sprintf_s(buf, "Startup: %.1f ms (pipeline %.1f ms)\n", m_startupSeconds * 1000.0, m_pipelineSeconds * 1000.0);
+		OutputDebugStringA(buf);
+		return true;
+	}
+
+	void Run()
+	{
+		m_referenceSlots.resize(300);
+		for (auto& graph : m_DPBSlotGraph)
+		{
+			graph.resize(300);
+		}
+
+		while (glfwWindowShouldClose(m_window) == GLFW_FALSE 
+			&& glfwGetKey(m_window, GLFW_KEY_ESCAPE) == GLFW_RELEASE)
+		{
+			glfwPollEvents();
+
+			// このフレームのリソースを前回使った送信の完了を待つ. 他のフレームは GPU で処理中のまま.
+			FrameInfo frame;
+			BeginFrame(frame);
+
+			auto devCtx = DeviceContext::GetContext();
+			if (m_isSwapchainDirty && !RecreateSwapchain())
+			{
+				// 最小化中. 元の大きさに戻るまで待つ.
+				glfwWaitEvents();
+				continue;
+			}
+			auto res = devCtx->GetSwapchain()->AcquireNextImage(frame.semPresentComplete);
+			if (res == VK_ERROR_OUT_OF_DATE_KHR)
+			{
+				// イメージは取得されていないため、このフレームは何も送信せずに作り直す.
+				m_isSwapchainDirty = true;
+				continue;
+			}
+			if (res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR)
+			{
+				devCtx->WaitForIdle();
+				return;
+			}
+			auto vkDevice = devCtx->GetVkDevice();
+
+			ImGui_ImplGlfw_NewFrame();
+			ImGui_ImplVulkan_NewFrame();
+			ImGui::NewFrame();
+			const auto& swapchainImage = m_swapchainImages[devCtx->GetSwapchain()->GetCurrentIndex()];
+
+			VkCommandBufferBeginInfo beginInfo{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			};
+			vkBeginCommandBuffer(frame.commandBuffer, &beginInfo);
+
+			// デコード.
+			// 各プレイヤーの要求を集めてから、まとめて記録・送信する.
+			m_decodeScheduler->BeginFrame(m_frameIndex);
+			if (m_gpuProfiler)
+			{
+				// 区画を使ったデコードと描画の送信は、どちらもここまでに完了を待っている.
+				m_gpuProfiler->BeginFrame(m_frameIndex);
+			}
+			m_videoPlayer.RequestDecode();
+			m_decodeScheduler->Schedule();
+			m_videoPlayer.Update();
+			m_decodeScheduler->Submit();
+			if (m_frameDumper)
+			{
+				m_frameDumper->Submit();
+			}
+
+
+
+			auto imageExtent = DeviceContext::GetContext()->GetSwapchain()->GetExtent2D();
+			VkClearValue clearValue{};
+			clearValue.color = { { 1.0f, 0.6f, 0.5f, 1.0f,} };
+			VkRenderPassBeginInfo renderPassBI{};
+			renderPassBI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			renderPassBI.renderPass = m_renderPass;
+			renderPassBI.framebuffer = swapchainImage.framebuffer;
+			renderPassBI.renderArea.offset = VkOffset2D{ 0, 0 };
+			renderPassBI.renderArea.extent = imageExtent;
+			renderPassBI.pClearValues = &clearValue;
+			renderPassBI.clearValueCount = 1;
+
+			GpuProfiler::Scope renderScope;
+			if (m_gpuProfiler)
+			{
+				renderScope = m_gpuProfiler->BeginScope(frame.commandBuffer, GpuProfiler::Stage::Render);
+			}
+			vkCmdBeginRenderPass(frame.commandBuffer, &renderPassBI, VK_SUBPASS_CONTENTS_INLINE);
+
+
+			vkCmdBindPipeline(frame.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+
+			VkViewport viewport{
+				.x = 0,
+				.y = 0,
+				.width = float(imageExtent.width),
+				.height = float(imageExtent.height),
+				.minDepth = 0.0f,
+				.maxDepth = 1.0f,
+			};
+			VkRect2D scissor{
+				.offset = { 0, 0 },
+				.extent = imageExtent,
+			};
+			vkCmdSetViewport(frame.commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(frame.commandBuffer, 0, 1, &scissor);
+
+			if(m_videoPlayer.IsReady() && !m_videoDescriptorSets.empty())
+			{
+				// 出力テクスチャごとに書き込み済みのセットを選ぶだけで、描画中にディスクリプタは更新しない.
+				const auto& videoTex = m_videoPlayer.GetVideoTexture();
+				assert(videoTex.index < m_videoDescriptorSets.size());
+				vkCmdBindDescriptorSets(frame.commandBuffer,
+					VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_videoDescriptorSets[videoTex.index], 0, nullptr);
+				vkCmdDraw(frame.commandBuffer, 4, 1, 0, 0);
+			}
+
+
+			auto& videoProps = m_videoPlayer.GetVideoProperties();
+			auto& decodeOpe = m_videoPlayer.GetDecodeOperation();
+
+			m_referenceSlots.push_back(decodeOpe.dpbReferenceCount);
+
+			auto DPBused = m_videoPlayer.GetDPBSlotUsed();
+
+			const int GRAPTH_SPAN = 300;
+      for (int i = 0; i < std::size(DPBused); ++i)
+      {
+        m_DPBSlotGraph[i].push_back(DPBused[i]);
+
+				if (m_DPBSlotGraph[i].size() > GRAPTH_SPAN)
+				{
+					m_DPBSlotGraph[i].erase(m_DPBSlotGraph[i].begin());
+				}
+      }
+
+			if (m_referenceSlots.size() > GRAPTH_SPAN)
+			{
+				m_referenceSlots.erase(m_referenceSlots.begin());
+			}
+
+			// 情報パネルはウィンドウの左右の端に合わせる.
+			ImGui::SetNextWindowPos(ImVec2(0, 0));
+			ImGui::SetNextWindowSize(ImVec2(300, float(imageExtent.height)));
+			ImGui::Begin("Information", nullptr, ImGuiWindowFlags_NoDecoration);
+			ImGui::Text("Resolution: %d x %d", videoProps.width, videoProps.height);
+			ImGui::Text("Display Frame: %d / %d", m_videoPlayer.GetDisplayFrameNumber(), m_videoPlayer.GetLastVideoFrameNumber());
+			{
+				bool loop = m_videoPlayer.IsLoopEnabled();
+				if (ImGui::Checkbox("Loop", &loop))
+				{
+					m_videoPlayer.SetLoopEnabled(loop);
+				}
+				ImGui::SameLine();
+				ImGui::Text("Count: %u", m_videoPlayer.GetLoopCount());
+			}
+			{
+				const auto& stats = m_videoPlayer.GetPresentationStatistics();
+				ImGui::Text("Presented: %llu Dropped: %llu", stats.presented, stats.dropped);
+				ImGui::Text("Repeated: %llu Resynced: %llu", stats.repeated, stats.resynced);
+				ImGui::Text("Decode Skipped: %llu  Evicted: %llu", m_videoPlayer.GetShedFrameCount(), m_videoPlayer.GetReorderEvictedCount());
+				ImGui::Text("Prebuffer: %u  First Frame: %.1f ms", m_videoPlayer.GetPrebufferDepth(), m_videoPlayer.GetTimeToFirstFrame() * 1000.0);
+				ImGui::Text("Low Latency: %s", m_videoPlayer.IsLowLatencyMode() ? "on" : "off");
+				{
+					auto swapchain = DeviceContext::GetContext()->GetSwapchain();
+					ImGui::Text("Present: %s (%u images)", Swapchain::GetPresentModeName(swapchain->GetPresentMode()), swapchain->GetImageCount());
+				}
+				ImGui::Text("Startup: %.1f ms (pipeline %.1f ms)", m_startupSeconds * 1000.0, m_pipelineSeconds * 1000.0);
+				{
+					auto devCtx = DeviceContext::GetContext();
+					auto budget = devCtx->GetMemoryBudget();
+					ImGui::Text("VRAM: %.1f / %.1f MB%s", budget.usage / (1024.0 * 1024.0), budget.budget / (1024.0 * 1024.0),
+						devCtx->HasMemoryBudgetExtension() ? "" : " (estimated)");
+					for (size_t i = 0; i < budget.categoryBytes.size(); ++i)
+					{
+						ImGui::Text("  %-13s %8.1f MB", DeviceContext::GetMemoryCategoryName(MemoryCategory(i)), budget.categoryBytes[i] / (1024.0 * 1024.0));
+					}
+					ImGui::Text("Output Textures: %u", m_videoPlayer.GetOutputTextureCount());
+				}
+				{
+					auto devCtx = DeviceContext::GetContext();
+					ImGui::Text("GPU: %s", devCtx->GetGPUInfo().name.c_str());
+					ImGui::Text("Decode Queues: %u%s", devCtx->GetVideoDecodeQueueCount(), devCtx->IsUnifiedQueue() ? " (unified)" : "");
+				}
+				const auto& total = m_decodeScheduler->GetTotalStatistics();
+				ImGui::Text("Decode: %.1f fps (%u streams)", total.framesPerSecond, m_decodeScheduler->GetStreamCount());
+				ImGui::Text("Deferred: %llu  Late: %llu", total.deferred, total.deadlineMissed);
+				ImGui::Text("Lateness: %.2f ms (max %.2f ms)", stats.lastLatenessSeconds * 1000.0, stats.maxLatenessSeconds * 1000.0);
+			}
+			if (m_frameDumper)
+			{
+				auto dump = m_frameDumper->GetStatistics();
+				ImGui::Text("Dump: %llu / %llu frames", dump.written, dump.captured);
+				ImGui::Text("Dump Stalled: %llu  Skipped: %llu", dump.stalled, dump.skipped);
+			}
+			if (m_scaler)
+			{
+				for (uint32_t i = 0; i < m_scaler->GetOutputCount(); ++i)
+				{
+					auto extent = m_scaler->GetOutputExtent(i);
+					bool nv12 = m_scaler->GetOutputDesc(i).format == VideoScaler::Format::NV12;
+					ImGui::Text("Scale[%u]: %ux%u %s", i, extent.width, extent.height, nv12 ? "NV12" : "RGBA");
+				}
+			}
+			
+			if (ImPlot::BeginPlot("Reference Slots"))
+			{
+				auto maxReferences = videoProps.maxReferencePictures;
+				ImPlot::SetupAxesLimits(0, GRAPTH_SPAN, 0, maxReferences + 1);
+				ImPlot::PlotLine("Slot Used", m_referenceSlots.data(), int(m_referenceSlots.size()));
+				ImPlot::EndPlot();
+			}
+			if (m_gpuProfiler)
+			{
+				// 読み戻しは MAX_FRAMES_IN_FLIGHT フレーム遅れる.
+				const auto& latest = m_gpuProfiler->GetLatest();
+				for (uint32_t i = 0; i < uint32_t(GpuProfiler::Stage::Count); ++i)
+				{
+					auto stage = GpuProfiler::Stage(i);
+					if (m_gpuProfiler->IsStageTimed(stage))
+					{
+						ImGui::Text("GPU %-6s %6.3f ms (x%u)", GpuProfiler::GetStageName(stage), latest.milliseconds[i], latest.counts[i]);
+					}
+					else
+					{
+						ImGui::Text("GPU %-6s n/a", GpuProfiler::GetStageName(stage));
+					}
+				}
+				if (0 < m_gpuProfiler->GetDecodeSucceeded() + m_gpuProfiler->GetDecodeFailed())
+				{
+					ImGui::Text("Decode Status: %llu ok, %llu failed", m_gpuProfiler->GetDecodeSucceeded(), m_gpuProfiler->GetDecodeFailed());
+				}
+				if (ImPlot::BeginPlot("GPU Time (ms)"))
+				{
+					ImPlot::SetupAxes(nullptr, nullptr, ImPlotAxisFlags_None, ImPlotAxisFlags_AutoFit);
+					ImPlot::SetupAxisLimits(ImAxis_X1, 0, GRAPTH_SPAN, ImGuiCond_Always);
+					for (uint32_t i = 0; i < uint32_t(GpuProfiler::Stage::Count); ++i)
+					{
+						auto stage = GpuProfiler::Stage(i);
+						if (m_gpuProfiler->IsStageTimed(stage))
+						{
+							const auto& history = m_gpuProfiler->GetHistory(stage);
+							ImPlot::PlotLine(GpuProfiler::GetStageName(stage), history.data(), int(history.size()));
+						}
+					}
+					ImPlot::EndPlot();
+				}
+			}
+			ImGui::End();
+
+
+			ImGui::SetNextWindowPos(ImVec2(float(imageExtent.width) - 300, 0));
+			ImGui::SetNextWindowSize(ImVec2(300, float(imageExtent.height)));
+			ImGui::Begin("DPBSlot", nullptr, ImGuiWindowFlags_NoResize);
+      uint32_t tableFlags = ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV |
+        ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable;
+      if (ImGui::BeginTable("DPB", 2, tableFlags, ImVec2(-1, 0)))
+      {
+        ImGui::TableSetupColumn("DPBSlot", ImGuiTableColumnFlags_WidthFixed, 75.0f);
+        ImGui::TableSetupColumn("Used");
+        ImGui::TableHeadersRow();
+        ImPlot::PushColormap(ImPlotColormap_Cool);
+
+        auto maxReferences = videoProps.maxReferencePictures;
+        for (int row = 0; row < maxReferences; ++row)
+        {
+          ImGui::TableNextRow();
+          ImGui::TableSetColumnIndex(0);
+          ImGui::Text("Slot%d", row);
+          ImGui::PushID(row);
+
+          ImGui::TableSetColumnIndex(1);
+          ImPlot::PushStyleVar(ImPlotStyleVar_PlotPadding, ImVec2(0, 0));
+          if (ImPlot::BeginPlot("", ImVec2(-1, 35), ImPlotFlags_CanvasOnly))
+          {
+            ImPlot::SetupAxes(nullptr, nullptr, ImPlotAxisFlags_NoDecorations, ImPlotAxisFlags_NoDecorations);
+						ImPlot::SetupAxesLimits(0, GRAPTH_SPAN, 0, 1.5, ImGuiCond_Always);
+						auto col = ImPlot::GetColormapColor(row);
+						ImPlot::SetNextLineStyle(col);
+						ImPlot::SetNextFillStyle(col, 0.25);
+
+						ImPlot::PlotLine("", m_DPBSlotGraph[row].data(), m_DPBSlotGraph[row].size(), 1, 0, ImPlotLineFlags_Shaded, 0);
+
+            ImPlot::EndPlot();
+          }
+          ImPlot::PopStyleVar();
+          ImGui::PopID();
+        }
+        ImPlot::PopColormap();
+        ImGui::EndTable();
+      }
+      ImGui::End();
+
+
+			ImGui::Render();
+			ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), frame.commandBuffer);
+
+
+			vkCmdEndRenderPass(frame.commandBuffer);
+			if (m_gpuProfiler)
+			{
+				m_gpuProfiler->EndScope(frame.commandBuffer, renderScope);
+			}
+
+			vkEndCommandBuffer(frame.commandBuffer);
+
+			VkPipelineStageFlags wait_stage[] = { 
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT	};
+			std::vector<VkSemaphore> waitSemaphores = {	frame.semPresentComplete, };
+
+			VkSubmitInfo submitInfo{
+				.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				.waitSemaphoreCount = uint32_t(waitSemaphores.size()),
+				.pWaitSemaphores = waitSemaphores.data(),
+				.pWaitDstStageMask = wait_stage,
+				.commandBufferCount = 1,
+				.pCommandBuffers = &frame.commandBuffer,
+				.signalSemaphoreCount = 1,
+				.pSignalSemaphores = &swapchainImage.semRenderComplete,
+			};
+			// 送信する直前にリセットする. 取得に失敗した場合にフェンスが未シグナルのまま残らないように.
+			vkResetFences(vkDevice, 1, &frame.queueSubmitFence);
+			devCtx->Submit(DeviceContext::Graphics, &submitInfo, frame.queueSubmitFence);
+			auto presentResult = devCtx->Present({ swapchainImage.semRenderComplete });
+			if (res == VK_SUBOPTIMAL_KHR || presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+			{
+				m_isSwapchainDirty = true;
+			}
+
+			m_frameIndex = (m_frameIndex + 1) % MAX_FRAMES_IN_FLIGHT;
+			m_submittedFrameCount++;
+		}
+	}
+
+	void Shutdown()
+	{
+		auto devCtx = DeviceContext::GetContext();
+		auto vkDevice = devCtx->GetVkDevice();
+		vkDeviceWaitIdle(vkDevice);
+		devCtx->SavePipelineCache();
+
+		// 書き込み待ちのフレームを全て書き出してから閉じる.
+		if (m_frameDumper)
+		{
+			m_frameDumper->Close();
+			m_frameDumper.reset();
+		}
+		m_videoPlayer.Shutdown();
+		if (m_scaler)
+		{
+			m_scaler->Shutdown();
+			m_scaler.reset();
+		}
+		// セットはプールと共に解放される.
+		if (m_videoDescriptorPool != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorPool(vkDevice, m_videoDescriptorPool, nullptr);
+			m_videoDescriptorPool = VK_NULL_HANDLE;
+		}
+		m_videoDescriptorSets.clear();
+		if (m_decodeScheduler)
+		{
+			m_decodeScheduler->Shutdown();
+			m_decodeScheduler.reset();
+		}
+		if (m_gpuProfiler)
+		{
+			m_gpuProfiler->Shutdown();
+			m_gpuProfiler.reset();
+		}
+
+		if (m_pipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(vkDevice, m_pipeline, nullptr);
+			m_pipeline = VK_NULL_HANDLE;
+		}
+		if (m_pipelineLayout != VK_NULL_HANDLE)
+		{
+			vkDestroyPipelineLayout(vkDevice, m_pipelineLayout, nullptr);
+			m_pipelineLayout = VK_NULL_HANDLE;
+		}
+
+		TeardownFramebuffers();
+		for (auto& frame : m_frames)
+		{
+			TeardownPerFrame(frame);
+		}
+		m_frames.clear();
+
+		if (m_renderPass != VK_NULL_HANDLE)
+		{
+			vkDestroyRenderPass(vkDevice, m_renderPass, nullptr);
+		}
+
+		DeviceContext::Shutdown();
+		if (m_window)
+		{
+			glfwDestroyWindow(m_window);
+			m_window = nullptr;
+		}
+	}
+
+	// ウィンドウを作らずに、GOP ごとに並行してデコードする. --dump があれば表示順に書き出す.
+	// 標準出力は書き出しに使う場合があるため、結果は標準エラー出力へ出す.
+	bool RunOffline(uint32_t sessionCount)
+	{
+		if (!glfwInit())
+		{
+			return false;
+		}
+		DeviceContext::Initialize();
+		if (m_gpuIndex >= int(DeviceContext::GetContext()->GetGPUCount()))
+		{
+			m_gpuIndex = DeviceContext::AUTO_SELECT_GPU;
+		}
+		DeviceContext::GetContext()->InitializeDevice(m_gpuIndex);
+
+		bool result = false;
+		OfflineDecoder decoder;
+		if (decoder.Initialize("res/oceans.mp4", { .sessionCount = sessionCount }))
+		{
+			std::shared_ptr<FrameDumper> frameDumper;
+			if (!m_dumpPath.empty())
+			{
+				const auto& videoProps = decoder.GetVideoProperties();
+				FrameDumper::Desc desc{
+					.width = videoProps.width,
+					.height = videoProps.height,
+					.format = m_hasDumpFormat ? m_dumpFormat : FrameDumper::GetFormatFromPath(m_dumpPath),
+				};
+				if (0.0 < videoProps.totalDuration)
+				{
+					desc.framesPerSecond = videoProps.frameInfos.size() / videoProps.totalDuration;
+				}
+				frameDumper = std::make_shared<FrameDumper>();
+				if (!frameDumper->Open(m_dumpPath, desc))
+				{
+					frameDumper.reset();
+				}
+				decoder.SetFrameDumper(frameDumper);
+			}
+
+			while (decoder.Step())
+			{
+			}
+			if (frameDumper)
+			{
+				frameDumper->Close();
+			}
+
+			const auto& stats = decoder.GetStatistics();
+			char buf[256];
+			int length = sprintf_s(buf, "Offline: %llu frames, %u GOPs, %u sessions, %.2f s, %.1f fps\n",
+				stats.delivered, stats.gopCount, decoder.GetSessionCount(), stats.elapsedSeconds, stats.framesPerSecond);
+			OutputDebugStringA(buf);
+			auto stdErr = GetStdHandle(STD_ERROR_HANDLE);
+			if (stdErr != INVALID_HANDLE_VALUE && stdErr != nullptr)
+			{
+				DWORD written = 0;
+				WriteFile(stdErr, buf, DWORD(length), &written, nullptr);
+			}
+			result = true;
+		}
+		decoder.Shutdown();
+		DeviceContext::Shutdown();
+		return result;
+	}
+
+private:
+
+	void InitializeFrameDumper()
+	{
+		if (m_dumpPath.empty())
+		{
+			return;
+		}
+		const auto& videoProps = m_videoPlayer.GetVideoProperties();
+		FrameDumper::Desc desc{
+			.width = videoProps.width,
+			.height = videoProps.height,
+			.format = m_hasDumpFormat ? m_dumpFormat : FrameDumper::GetFormatFromPath(m_dumpPath),
+		};
+		if (0.0 < videoProps.totalDuration)
+		{
+			desc.framesPerSecond = videoProps.frameInfos.size() / videoProps.totalDuration;
+		}
+		m_frameDumper = std::make_shared<FrameDumper>();
+		if (!m_frameDumper->Open(m_dumpPath, desc))
+		{
+			m_frameDumper.reset();
+			return;
+		}
+		// 全フレームを書き出すため、負荷によるデコードの省略は行わない.
+		m_videoPlayer.SetLoadSheddingEnabled(false);
+		m_videoPlayer.SetFrameDumper(m_frameDumper);
+	}
+
+	void InitializeGpuProfiler()
+	{
+		m_gpuProfiler = std::make_shared<GpuProfiler>();
+		if (!m_gpuProfiler->Initialize(MAX_FRAMES_IN_FLIGHT))
+		{
+			m_gpuProfiler.reset();
+			return;
+		}
+		if (!m_gpuTimingCsvPath.empty())
+		{
+			m_gpuProfiler->OpenCsv(m_gpuTimingCsvPath);
+		}
+		// デコードとコピーの区間はバックエンドがジョブのコマンドバッファへ記録する.
+		m_decodeScheduler->SetProfiler(m_gpuProfiler);
+	}
+
+	// 縮小先は出力テクスチャごとに持つため、バックエンドの出力テクスチャを全て縮小元として渡す.
+	void InitializeScaler()
+	{
+		const auto& backend = m_videoPlayer.GetBackend();
+		if (m_scaleOutputs.empty() || !backend)
+		{
+			return;
+		}
+		const auto& videoProps = m_videoPlayer.GetVideoProperties();
+		VideoScaler::Desc desc{
+			.width = videoProps.width,
+			.height = videoProps.height,
+			.outputs = m_scaleOutputs,
+		};
+		for (uint32_t i = 0; i < backend->GetOutputTextureCount(); ++i)
+		{
+			desc.sources.push_back(backend->GetOutputTexture(i));
+		}
+		m_scaler = std::make_shared<VideoScaler>();
+		if (!m_scaler->Initialize(desc))
+		{
+			m_scaler.reset();
+			return;
+		}
+		m_videoPlayer.SetScaler(m_scaler);
+	}
+
+	// 出力テクスチャは初期化時に確保したものを使い回すため、テクスチャごとのセットを一度だけ書き込んでおく.
+	void InitializeVideoDescriptorSets()
+	{
+		const auto& backend = m_videoPlayer.GetBackend();
+		if (!backend)
+		{
+			return;
+		}
+		auto vkDevice = DeviceContext::GetContext()->GetVkDevice();
+		const uint32_t textureCount = backend->GetOutputTextureCount();
+
+		std::vector<VkDescriptorPoolSize> descriptorPoolSizes = { {
+			{
+				.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				.descriptorCount = textureCount,
+			},
+			{
+				// YCbCr 変換を伴うサンプラーは1つで複数の記述子を消費する場合がある.
+				.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.descriptorCount = textureCount * DeviceContext::GetContext()->GetYcbcrDescriptorCount(),
+			}
+		} };
+		VkDescriptorPoolCreateInfo descriptorPoolCI{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.maxSets = textureCount,
+			.poolSizeCount = uint32_t(descriptorPoolSizes.size()),
+			.pPoolSizes = descriptorPoolSizes.data(),
+		};
+		vkCreateDescriptorPool(vkDevice, &descriptorPoolCI, nullptr, &m_videoDescriptorPool);
+
+		std::vector<VkDescriptorSetLayout> layouts(textureCount, m_dsLayout);
+		VkDescriptorSetAllocateInfo dsAllocInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = m_videoDescriptorPool,
+			.descriptorSetCount = textureCount,
+			.pSetLayouts = layouts.data(),
+		};
+		m_videoDescriptorSets.resize(textureCount);
+		auto res = vkAllocateDescriptorSets(vkDevice, &dsAllocInfo, m_videoDescriptorSets.data());
+		if (res != VK_SUCCESS)
+		{
+			// セットがない間は映像を描画しない.
+			OutputDebugStringA("Failed to allocate descriptor sets for video textures.\n");
+			m_videoDescriptorSets.clear();
+			return;
+		}
+
+		std::vector<VkDescriptorImageInfo> imageInfos(textureCount);
+		std::vector<VkWriteDescriptorSet> writes(textureCount);
+		for (uint32_t i = 0; i < textureCount; ++i)
+		{
+			imageInfos[i] = VkDescriptorImageInfo{
+				.sampler = VK_NULL_HANDLE,
+				.imageView = backend->GetOutputTexture(i).view,
+				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			};
+			writes[i] = VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = m_videoDescriptorSets[i],
+				.dstBinding = 1,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.pImageInfo = &imageInfos[i],
+			};
+		}
+		vkUpdateDescriptorSets(vkDevice, textureCount, writes.data(), 0, nullptr);
+	}
+
+	void InitializeRenderPass()
+	{
+		auto devCtx = DeviceContext::GetContext();
+		auto vkDevice = devCtx->GetVkDevice();
+		VkAttachmentDescription attachment = { 0 };
+		attachment.format = devCtx->GetSwapchain()->GetSurfaceFormat().format;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+		VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass = { 0 };
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorRef;
+
+		VkSubpassDependency dependency = { 
+			.srcSubpass = VK_SUBPASS_EXTERNAL,
+			.dstSubpass = 0,
+			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.srcAccessMask = 0,
+			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+		};
+
+		VkRenderPassCreateInfo rp_info = { 
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+			.attachmentCount = 1,
+			.pAttachments = &attachment,
+			.subpassCount = 1,
+			.pSubpasses = &subpass,
+			.dependencyCount = 1,
+			.pDependencies = &dependency
+		};
+
+		vkCreateRenderPass(vkDevice, &rp_info, nullptr, &m_renderPass);
+	}
+	VkShaderModule CreateShaderModule(const uint32_t* data, size_t length)
+	{
+		auto vkDevice = DeviceContext::GetContext()->GetVkDevice();
+		VkShaderModuleCreateInfo moduleCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.codeSize = length,
+			.pCode = data
+		};
+		VkShaderModule shaderModule;
+		vkCreateShaderModule(vkDevice, &moduleCreateInfo, nullptr, &shaderModule);
+		return shaderModule;
+	}
+
+	void InitializePipeline()
+	{
+		auto devCtx = DeviceContext::GetContext();
+		auto vkDevice = devCtx->GetVkDevice();
+		VkPipelineLayoutCreateInfo layoutInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = 1,
+			.pSetLayouts = &m_dsLayout,
+		};
+		vkCreatePipelineLayout(vkDevice, &layoutInfo, nullptr, &m_pipelineLayout);
+
+		VkPipelineVertexInputStateCreateInfo vertexInput{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO
+		};
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO
+		};
+		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+
+		VkPipelineRasterizationStateCreateInfo raster{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+			.cullMode = VK_CULL_MODE_BACK_BIT,
+			.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+			.lineWidth = 1.0f,
+		};
+
+		VkPipelineColorBlendAttachmentState blendAttachment{
+			.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+		};
+
+		VkPipelineColorBlendStateCreateInfo blend{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+			.attachmentCount = 1,
+			.pAttachments = &blendAttachment
+		};
+
+		VkPipelineViewportStateCreateInfo viewport{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+			.viewportCount = 1,
+			.scissorCount = 1,
+		};
+
+		VkPipelineDepthStencilStateCreateInfo depthStencil{
+			.stencilTestEnable = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO
+		};
+
+		VkPipelineMultisampleStateCreateInfo multisample{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+			.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+		};
+
+		std::array<VkDynamicState, 2> dynamics{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+		VkPipelineDynamicStateCreateInfo dynamic{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+			.dynamicStateCount = uint32_t(dynamics.size()),
+			.pDynamicStates = dynamics.data(),
+		};
+
+		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{{
+			{
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage = VK_SHADER_STAGE_VERTEX_BIT,
+				.module= CreateShaderModule(gVS, sizeof(gVS)),
+				.pName = "main",
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+				.module = CreateShaderModule(gFS, sizeof(gFS)),
+				.pName = "main",
+			}
+		}};
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+			.stageCount = uint32_t(shaderStages.size()),
+			.pStages = shaderStages.data(),
+			.pVertexInputState = &vertexInput,
+			.pInputAssemblyState = &inputAssembly,
+			.pViewportState = &viewport,
+			.pRasterizationState = &raster,
+			.pMultisampleState = &multisample,
+			.pDepthStencilState = &depthStencil,
+			.pColorBlendState = &blend,
+			.pDynamicState = &dynamic,
+			.layout = m_pipelineLayout,
+			.renderPass = m_renderPass,
+		};
+
+		vkCreateGraphicsPipelines(vkDevice, devCtx->GetPipelineCache(), 1, &pipelineCreateInfo, nullptr, &m_pipeline);
+
+		for (auto& m : shaderStages)
+		{
+			vkDestroyShaderModule(vkDevice, m.module, nullptr);
+		}
+	}
+	void InitializeFramebuffers()
+	{
+		auto devCtx = DeviceContext::GetContext();
+		auto swapchain = devCtx->GetSwapchain();
+		auto vkDevice = devCtx->GetVkDevice();
+		auto count = swapchain->GetImageCount();
+		auto extent = swapchain->GetExtent2D();
+
+		// フレームバッファと描画完了のセマフォは、表示エンジンが使い終えるまで再利用できないためイメージごとに持つ.
+		m_swapchainImages.resize(count);
+
+		VkSemaphoreCreateInfo semaphoreCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+		};
+		for (uint32_t i=0;i<count;++i)
+		{
+			auto view = swapchain->GetImageView(i);
+			VkFramebufferCreateInfo framebufferCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+				.renderPass = m_renderPass,
+				.attachmentCount = 1,
+				.pAttachments = &view,
+				.width = extent.width,
+				.height = extent.height,
+				.layers = 1,
+			};
+			VkFramebuffer fb;
+			vkCreateFramebuffer(vkDevice, &framebufferCreateInfo, nullptr, &fb);
+			m_swapchainImages[i].framebuffer = fb;
+			vkCreateSemaphore(vkDevice, &semaphoreCreateInfo, nullptr, &m_swapchainImages[i].semRenderComplete);
+		}
+
+	}
+
+	// スワップチェインと、そのイメージに依存するフレームバッファのみを作り直す.
+	// デバイスの完了は待たず、置き換えたものは処理中のフレームが完了してから破棄する.
+	bool RecreateSwapchain()
+	{
+		int width = 0, height = 0;
+		glfwGetFramebufferSize(m_window, &width, &height);
+		if (width == 0 || height == 0)
+		{
+			return false;
+		}
+		auto swapchain = DeviceContext::GetContext()->GetSwapchain();
+		if (!swapchain->Resize({ uint32_t(width), uint32_t(height) }))
+		{
+			return false;
+		}
+		m_retiredSwapchainImages.push_back(RetiredSwapchainImages{ std::move(m_swapchainImages), m_submittedFrameCount });
+		m_swapchainImages.clear();
+		InitializeFramebuffers();
+		m_isSwapchainDirty = false;
+		return true;
+	}
+
+	void DestroySwapchainImages(std::vector<SwapchainImageInfo>& images)
+	{
+		auto vkDevice = DeviceContext::GetContext()->GetVkDevice();
+		for (auto& image : images)
+		{
+			vkDestroyFramebuffer(vkDevice, image.framebuffer, nullptr);
+			vkDestroySemaphore(vkDevice, image.semRenderComplete, nullptr);
+		}
+		images.clear();
+	}
+
+	void InitializeFrames()
+	{
+		m_frames.resize(MAX_FRAMES_IN_FLIGHT);
+		for (auto& frame : m_frames)
+		{
+			InitPerFrame(frame);
+		}
+		m_frameIndex = 0;
+	}
+
+private:
+	struct FrameInfo
+	{
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence queueSubmitFence = VK_NULL_HANDLE;
+		VkSemaphore semPresentComplete = VK_NULL_HANDLE;
+		uint32_t queueIndex = 0;
+	};
+	struct SwapchainImageInfo
+	{
+		VkFramebuffer framebuffer = VK_NULL_HANDLE;
+		VkSemaphore semRenderComplete = VK_NULL_HANDLE;
+	};
+
+	GLFWwindow* m_window = nullptr;
+
+	std::vector<FrameInfo>   m_frames{};
+	uint32_t m_frameIndex = 0;
+	std::vector<SwapchainImageInfo> m_swapchainImages{};
+	// 作り直しで置き換えたフレームバッファ. 置き換えた時点までの送信が完了したら破棄する.
+	struct RetiredSwapchainImages
+	{
+		std::vector<SwapchainImageInfo> images;
+		uint64_t submittedFrameCount = 0;
+	};
+	std::deque<RetiredSwapchainImages> m_retiredSwapchainImages;
+	uint64_t m_submittedFrameCount = 0;
+	bool m_isSwapchainDirty = false;
+	VkRenderPass m_renderPass = VK_NULL_HANDLE;
+	VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_pipeline = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout m_dsLayout = VK_NULL_HANDLE;
+	VkSampler m_sampler = VK_NULL_HANDLE;
+
+	std::shared_ptr<DecodeScheduler> m_decodeScheduler;
+	VideoPlayer m_videoPlayer;
+
+	int m_gpuIndex = DeviceContext::AUTO_SELECT_GPU;
+	VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	uint32_t m_swapchainImageCount = 0;
+
+	std::filesystem::path m_dumpPath;
+	FrameDumper::Format m_dumpFormat = FrameDumper::Format::Y4M;
+	bool m_hasDumpFormat = false;
+	std::shared_ptr<FrameDumper> m_frameDumper;
+
+	std::vector<VideoScaler::OutputDesc> m_scaleOutputs;
+	std::shared_ptr<VideoScaler> m_scaler;
+
+	std::filesystem::path m_gpuTimingCsvPath;
+	std::shared_ptr<GpuProfiler> m_gpuProfiler;
+
+	std::filesystem::path m_pipelineCachePath = "pipeline_cache.bin";
+	double m_startupSeconds = 0.0;
+	double m_pipelineSeconds = 0.0;
+
+	std::vector<int> m_referenceSlots;
+	std::vector<int> m_DPBSlotGraph[18];
+
+
+	VkDescriptorPool m_descriptorPool;
+	// 出力テクスチャの番号 (VideoPlayer::OutputImage::index) で引く.
+	VkDescriptorPool m_videoDescriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> m_videoDescriptorSets;
+
+	void InitPerFrame(FrameInfo& frameInfo)
+	{
+		auto devCtx = DeviceContext::GetContext();
+		auto vkDevice = devCtx->GetVkDevice();
+		VkFenceCreateInfo fenceCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+		};
+		vkCreateFence(vkDevice, &fenceCreateInfo, nullptr, &frameInfo.queueSubmitFence);
+
+		VkCommandPoolCreateInfo commandPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = devCtx->GetGraphicsQueueFamilyIndex(),
+		};
+		vkCreateCommandPool(vkDevice, &commandPoolCreateInfo, nullptr, &frameInfo.commandPool);
+
+		VkCommandBufferAllocateInfo commandBufferAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = frameInfo.commandPool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		vkAllocateCommandBuffers(vkDevice, &commandBufferAllocateInfo, &frameInfo.commandBuffer);
+		frameInfo.queueIndex = 0;
+
+		VkSemaphoreCreateInfo semaphoreCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+		};
+		vkCreateSemaphore(vkDevice, &semaphoreCreateInfo, nullptr, &frameInfo.semPresentComplete);
+	}
+
+	void TeardownPerFrame(FrameInfo& frameInfo)
+	{
+		auto devCtx = DeviceContext::GetContext();
+		auto vkDevice = devCtx->GetVkDevice();
+
+		if (frameInfo.queueSubmitFence != VK_NULL_HANDLE)
+		{
+			vkDestroyFence(vkDevice, frameInfo.queueSubmitFence, nullptr);
+			frameInfo.queueSubmitFence = VK_NULL_HANDLE;
+		}
+		if (frameInfo.commandBuffer != VK_NULL_HANDLE)
+		{
+			vkFreeCommandBuffers(vkDevice, frameInfo.commandPool, 1, &frameInfo.commandBuffer);
+			frameInfo.commandBuffer = VK_NULL_HANDLE;
+		}
+		if (frameInfo.commandPool != VK_NULL_HANDLE)
+		{
+			vkDestroyCommandPool(vkDevice, frameInfo.commandPool, nullptr);
+			frameInfo.commandPool = VK_NULL_HANDLE;
+		}
+
+		if (frameInfo.semPresentComplete != VK_NULL_HANDLE)
+		{
+			vkDestroySemaphore(vkDevice, frameInfo.semPresentComplete, nullptr);
+			frameInfo.semPresentComplete = VK_NULL_HANDLE;
+		}
+
+		frameInfo.queueIndex = 0;
+	}
+
+	void TeardownFramebuffers()
+	{
+		auto devCtx = DeviceContext::GetContext();
+		devCtx->WaitForIdle();
+		DestroySwapchainImages(m_swapchainImages);
+		for (auto& retired : m_retiredSwapchainImages)
+		{
+			DestroySwapchainImages(retired.images);
+		}
+		m_retiredSwapchainImages.clear();
+	}
+
+	void BeginFrame(FrameInfo& frame)
+	{
+		auto devCtx = DeviceContext::GetContext();
+		auto vkDevice = devCtx->GetVkDevice();
+		frame = m_frames[m_frameIndex];
+		if (frame.queueSubmitFence != VK_NULL_HANDLE)
+		{
+			vkWaitForFences(vkDevice, 1, &frame.queueSubmitFence, VK_TRUE, UINT64_MAX);
+		}
+
+		// このフレームの前回の送信が完了したので、MAX_FRAMES_IN_FLIGHT 回前までの送信は全て完了している.
+		while (!m_retiredSwapchainImages.empty()
+			&& m_retiredSwapchainImages.front().submittedFrameCount + MAX_FRAMES_IN_FLIGHT <= m_submittedFrameCount)
+		{
+			DestroySwapchainImages(m_retiredSwapchainImages.front().images);
+			m_retiredSwapchainImages.pop_front();
+		}
+
+		if (frame.commandPool != VK_NULL_HANDLE)
+		{
+			vkResetCommandPool(vkDevice, frame.commandPool, 0);
+		}
+		// VMA が保持している予算をフレームごとに更新させる.
+		vmaSetCurrentFrameIndex(devCtx->GetVmaAllocator(), uint32_t(m_submittedFrameCount));
+	}
+};
+
+// "1/2,1/4,320x180,nv12:1/4" のような縮小先の指定を解釈する. 形式を省略した場合は RGBA.
+static std::vector<VideoScaler::OutputDesc> ParseScaleOutputs(const std::wstring& text)
+{
+	std::vector<VideoScaler::OutputDesc> outputs;
+	size_t begin = 0;
+	while (begin <= text.size() && outputs.size() < VideoScaler::MAX_OUTPUTS)
+	{
+		size_t end = text.find(L',', begin);
+		if (end == std::wstring::npos)
+		{
+			end = text.size();
+		}
+		std::wstring item = text.substr(begin, end - begin);
+		begin = end + 1;
+
+		VideoScaler::OutputDesc output;
+		if (item.starts_with(L"nv12:"))
+		{
+			output.format = VideoScaler::Format::NV12;
+			item = item.substr(5);
+		}
+		else if (item.starts_with(L"rgba:"))
+		{
+			item = item.substr(5);
+		}
+		unsigned int a = 0, b = 0;
+		if (swscanf_s(item.c_str(), L"1/%u", &a) == 1 && a != 0)
+		{
+			output.divisor = a;
+		}
+		else if (swscanf_s(item.c_str(), L"%ux%u", &a, &b) == 2 && a != 0 && b != 0)
+		{
+			output.width = a;
+			output.height = b;
+		}
+		else
+		{
+			continue;
+		}
+		outputs.push_back(output);
+	}
+	return outputs;
+}
+
+// 1080p の変換速度をカーネルとスレッド数ごとに出力する. 標準出力がリダイレクトされていればそこにも書く.
+static void BenchmarkColorConverter()
+{
+	const uint32_t width = 1920, height = 1080;
+	auto stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+	for (const auto& result : ColorConverter::Benchmark(width, height, 100))
+	{
+		char buf[256];
+		int length = sprintf_s(buf, "ColorConverter %ux%u: %-6s x%-2u %8.1f Mpixels/s\n", width, height,
+			ColorConverter::GetKernelName(result.kernel), result.threadCount, result.megapixelsPerSecond);
+		OutputDebugStringA(buf);
+		if (stdOut != INVALID_HANDLE_VALUE && stdOut != nullptr)
+		{
+			DWORD written = 0;
+			WriteFile(stdOut, buf, DWORD(length), &written, nullptr);
+		}
+	}
+}
+
+// GPU を使わずに NullDecodeBackend で再生し、デコードの指示を検証する. 結果は標準エラー出力へ出す.
+// logPath があれば指示の記録 (NullDecodeBackend::Dump) を書き出す. 検証に失敗した場合は false を返す.
+static bool RunNullDecode(uint32_t loopCount, const std::filesystem::path& logPath)
+{
+	HeadlessPlayback playback;
+	bool result = playback.Run("res/oceans.mp4", { .loopCount = loopCount });
+	if (!logPath.empty())
+	{
+		std::ofstream log(logPath, std::ios::trunc);
+		log << playback.Dump();
+	}
+
+	std::string text = playback.GetSummary() + "\n";
+	for (const auto& error : playback.GetErrors())
+	{
+		text += error + "\n";
+	}
+	auto stdErr = GetStdHandle(STD_ERROR_HANDLE);
+	if (stdErr != INVALID_HANDLE_VALUE && stdErr != nullptr)
+	{
+		DWORD written = 0;
+		WriteFile(stdErr, text.data(), DWORD(text.size()), &written, nullptr);
+	}
+	return result;
+}
+
+int __stdcall wWinMain(_In_ HINSTANCE hInstance,
+	_In_opt_ HINSTANCE hPrevInstance,
+	_In_ LPWSTR lpCmdLine,
+	_In_ int nCmdShow)
+{
+
+	VkVideoDecodeApp app;
+
+	// --dump <path> : デコード結果を書き出す. 拡張子が .nv12/.yuv なら NV12、.rgba なら RGBA、それ以外は Y4M.
+	// --dump-format <y4m|nv12|rgba> : 形式を明示する.
+	// --gpu <index> : 使用する GPU. 省略時は H.264 デコードの能力が最も高い GPU.
+	// --present-mode <fifo|fifo_relaxed|mailbox|immediate> : スワップチェインの表示モード.
+	// --swapchain-images <count> : スワップチェインのイメージ数.
+	// --pipeline-cache <path> : パイプラインキャッシュのファイル. "none" で使わない.
+	// --scale <list> : デコード結果の縮小コピーを作る. 例: "1/2,1/4,320x180,nv12:1/4". 最大 4 つ.
+	// --gpu-timing-csv <path> : デコード、コピー、描画パスの GPU の時間をフレームごとに CSV で書き出す.
+	// --offline <sessions> : ウィンドウを作らずに GOP ごとに並行してデコードし、速度を出力して終了する. 0 でデコードキュー数.
+	// --benchmark-color-converter : NV12 -> RGBA の CPU 変換の速度を計って終了する.
+	// --null-decode <loops> : GPU を使わずに再生してデコードの指示を検証し、終了する. 失敗した場合の終了コードは 1.
+	// --null-decode-log <path> : --null-decode で記録したデコードの指示を書き出す.
+	int offlineSessions = -1;
+	int nullDecodeLoops = -1;
+	std::filesystem::path nullDecodeLog;
+	int argc = 0;
+	auto argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	for (int i = 1; argv && i < argc; ++i)
+	{
+		std::wstring arg = argv[i];
+		if (arg == L"--dump" && i + 1 < argc)
+		{
+			app.SetDumpPath(argv[++i]);
+		}
+		else if (arg == L"--dump-format" && i + 1 < argc)
+		{
+			std::wstring format = argv[++i];
+			if (format == L"nv12") { app.SetDumpFormat(FrameDumper::Format::NV12); }
+			else if (format == L"rgba") { app.SetDumpFormat(FrameDumper::Format::RGBA); }
+			else { app.SetDumpFormat(FrameDumper::Format::Y4M); }
+		}
+		else if (arg == L"--gpu" && i + 1 < argc)
+		{
+			app.SetGpuIndex(_wtoi(argv[++i]));
+		}
+		else if (arg == L"--present-mode" && i + 1 < argc)
+		{
+			std::wstring mode = argv[++i];
+			if (mode == L"fifo_relaxed") { app.SetPresentMode(VK_PRESENT_MODE_FIFO_RELAXED_KHR); }
+			else if (mode == L"mailbox") { app.SetPresentMode(VK_PRESENT_MODE_MAILBOX_KHR); }
+			else if (mode == L"immediate") { app.SetPresentMode(VK_PRESENT_MODE_IMMEDIATE_KHR); }
+			else { app.SetPresentMode(VK_PRESENT_MODE_FIFO_KHR); }
+		}
+		else if (arg == L"--swapchain-images" && i + 1 < argc)
+		{
+			app.SetSwapchainImageCount(uint32_t(_wtoi(argv[++i])));
+		}
+		else if (arg == L"--pipeline-cache" && i + 1 < argc)
+		{
+			std::wstring path = argv[++i];
+			app.SetPipelineCachePath(path == L"none" ? std::filesystem::path() : std::filesystem::path(path));
+		}
+		else if (arg == L"--scale" && i + 1 < argc)
+		{
+			app.SetScaleOutputs(ParseScaleOutputs(argv[++i]));
+		}
+		else if (arg == L"--gpu-timing-csv" && i + 1 < argc)
+		{
+			app.SetGpuTimingCsvPath(argv[++i]);
+		}
+		else if (arg == L"--offline" && i + 1 < argc)
+		{
+			offlineSessions = std::max(_wtoi(argv[++i]), 0);
+		}
+		else if (arg == L"--null-decode" && i + 1 < argc)
+		{
+			nullDecodeLoops = std::max(_wtoi(argv[++i]), 0);
+		}
+		else if (arg == L"--null-decode-log" && i + 1 < argc)
+		{
+			nullDecodeLog = argv[++i];
+		}
+		else if (arg == L"--benchmark-color-converter")
+		{
+			LocalFree(argv);
+			BenchmarkColorConverter();
+			return 0;
+		}
+	}
+	LocalFree(argv);
+
+	if (0 <= nullDecodeLoops)
+	{
+		return RunNullDecode(uint32_t(nullDecodeLoops), nullDecodeLog) ? 0 : 1;
+	}
+	if (0 <= offlineSessions)
+	{
+		return app.RunOffline(uint32_t(offlineSessions)) ? 0 : -1;
+	}
+	if (app.Initialize())
+	{
+		app.Run();
+		app.Shutdown();
+	}
+	else
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,146 @@
+﻿#include "ColorConverter.h"
+
+#include <cstdio>
+#include <iterator>
+#include <vector>
+
+#include "TestCommon.h"
+
+namespace {
+
+using Kernel = ColorConverter::Kernel;
+
+// 行末に余白を持つ NV12. 奇数の幅と高さでは色差が切り上げになる.
+struct Frame
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	size_t lumaPitch = 0;
+	size_t chromaPitch = 0;
+	std::vector<uint8_t> luma;
+	std::vector<uint8_t> chroma;
+
+	Frame(uint32_t w, uint32_t h, uint32_t seed) : width(w), height(h)
+	{
+		lumaPitch = w + 13;
+		chromaPitch = ((w + 1) & ~1u) + 6;
+		luma.resize(lumaPitch * h);
+		chroma.resize(chromaPitch * ((h + 1) / 2));
+		// 範囲外の値 (limited の 0-15, 236-255 など) も含める.
+		uint32_t state = seed * 2654435761u + 1;
+		for (auto* plane : { &luma, &chroma })
+		{
+			for (auto& v : *plane)
+			{
+				state = state * 1664525u + 1013904223u;
+				v = uint8_t(state >> 24);
+			}
+		}
+	}
+
+	ColorConverter::NV12Planes GetPlanes() const
+	{
+		return {
+			.luma = luma.data(), .lumaPitch = lumaPitch,
+			.chroma = chroma.data(), .chromaPitch = chromaPitch,
+			.width = width, .height = height,
+		};
+	}
+};
+
+std::vector<uint8_t> Convert(const Frame& frame, const ColorConverter::Desc& desc, size_t dstPitch)
+{
+	ColorConverter converter;
+	CHECK(converter.Initialize(desc));
+	// 書き込まれない行末の余白も比べるため、決まった値で埋めておく.
+	std::vector<uint8_t> dst(dstPitch * frame.height, 0xcd);
+	converter.Convert(frame.GetPlanes(), dst.data(), dstPitch);
+	return dst;
+}
+
+// 既知の色. limited の白と黒、full の灰色.
+void TestScalarValues()
+{
+	Frame frame(2, 2, 0);
+	frame.luma[0] = 235;
+	frame.luma[1] = 16;
+	frame.chroma.assign(frame.chroma.size(), 128);
+
+	auto rgba = Convert(frame, { .matrix = ColorConverter::Matrix::BT709, .kernel = Kernel::Scalar, .threadCount = 1 }, 8);
+	const uint8_t expected[] = { 255, 255, 255, 255, 0, 0, 0, 255 };
+	for (size_t i = 0; i < std::size(expected); ++i)
+	{
+		CHECK_EQ(rgba[i], expected[i]);
+	}
+
+	frame.luma[0] = 128;
+	rgba = Convert(frame, { .range = ColorConverter::Range::Full, .kernel = Kernel::Scalar, .threadCount = 1 }, 8);
+	CHECK_EQ(rgba[0], 128);
+	CHECK_EQ(rgba[1], 128);
+	CHECK_EQ(rgba[2], 128);
+}
+
+// 各カーネルの結果がスカラー版 (1スレッド) と一致する.
+void TestKernelsMatchScalar()
+{
+	const uint32_t sizes[][2] = { { 1, 1 }, { 2, 2 }, { 3, 5 }, { 7, 3 }, { 15, 9 }, { 16, 16 }, { 17, 33 }, { 33, 17 }, { 69, 70 } };
+	uint32_t compared = 0;
+	for (auto kernel : { Kernel::SSE41, Kernel::AVX2, Kernel::NEON })
+	{
+		if (!ColorConverter::IsKernelSupported(kernel))
+		{
+			std::printf("ColorConverterTest: %s is not supported, skipped\n", ColorConverter::GetKernelName(kernel));
+			continue;
+		}
+		for (auto matrix : { ColorConverter::Matrix::BT601, ColorConverter::Matrix::BT709 })
+		{
+			for (auto range : { ColorConverter::Range::Limited, ColorConverter::Range::Full })
+			{
+				for (auto order : { ColorConverter::PixelOrder::RGBA, ColorConverter::PixelOrder::BGRA })
+				{
+					for (const auto& size : sizes)
+					{
+						Frame frame(size[0], size[1], compared);
+						const size_t dstPitch = size_t(size[0]) * 4 + 12;
+						const auto expected = Convert(frame, { matrix, range, order, Kernel::Scalar, 1 }, dstPitch);
+						for (uint32_t threadCount : { 1u, 4u })
+						{
+							const auto actual = Convert(frame, { matrix, range, order, kernel, threadCount }, dstPitch);
+							CHECK(actual == expected);
+						}
+						compared++;
+					}
+				}
+			}
+		}
+	}
+	std::printf("ColorConverterTest: %u frames compared against Scalar\n", compared);
+}
+
+// 複数スレッドのスカラー版も帯の境界で結果が変わらない. 同じ変換器を繰り返し使う.
+void TestScalarThreads()
+{
+	Frame frame(37, 211, 7);
+	const size_t dstPitch = 37 * 4;
+	const auto expected = Convert(frame, { .kernel = Kernel::Scalar, .threadCount = 1 }, dstPitch);
+
+	ColorConverter converter;
+	CHECK(converter.Initialize({ .kernel = Kernel::Scalar, .threadCount = 8 }));
+	CHECK_EQ(converter.GetThreadCount(), 8u);
+	for (int i = 0; i < 3; ++i)
+	{
+		std::vector<uint8_t> dst(dstPitch * frame.height, 0xcd);
+		converter.Convert(frame.GetPlanes(), dst.data(), dstPitch);
+		CHECK(dst == expected);
+	}
+}
+
+}
+
+int main()
+{
+	TestScalarValues();
+	TestKernelsMatchScalar();
+	TestScalarThreads();
+	return ReportTestResult("ColorConverterTest");
+}
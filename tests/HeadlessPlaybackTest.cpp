@@ -0,0 +1,93 @@
+﻿#include "HeadlessPlayback.h"
+
+#include <cstdlib>
+#include <string>
+
+#include "FrameDumper.h"
+
+#include "TestCommon.h"
+
+// VideoPlayer.cpp が参照するデバイス側の定義. 実装 (VideoPlayerDevice.cpp, DecodeScheduler.cpp, FrameDumper.cpp) は Vulkan のデバイスを必要とする.
+// HeadlessPlayback は NullDecodeBackend を渡し、スケジューラーとフレームの書き出しを使わないため、いずれも呼ばれない.
+std::shared_ptr<IDecodeBackend> VideoPlayer::CreateDefaultBackend(std::shared_ptr<Decoder>) { std::abort(); }
+DecodeScheduler::StreamId DecodeScheduler::RegisterStream(const std::string&) { std::abort(); }
+void DecodeScheduler::UnregisterStream(StreamId) { std::abort(); }
+void DecodeScheduler::RequestDecode(StreamId, double) { std::abort(); }
+bool DecodeScheduler::IsGranted(StreamId) const { std::abort(); }
+DecodeScheduler::Job DecodeScheduler::BeginJob(StreamId) { std::abort(); }
+void DecodeScheduler::EndJob(StreamId, const Job&) { std::abort(); }
+bool DecodeScheduler::IsSaturated(StreamId) const { std::abort(); }
+void FrameDumper::Capture(VkImage, int64_t) { std::abort(); }
+
+namespace {
+
+// data/headless.mp4 は 176x144, 30 フレーム (15 フレームごとの IDR) の Main プロファイル. B フレームを含むため表示順への並べ替えが起きる.
+//   ffmpeg -f lavfi -i "testsrc2=size=176x144:rate=30" -frames:v 30 -c:v libx264 -profile:v main
+//     -x264-params "ref=3:bframes=2:b-pyramid=none:keyint=15:min-keyint=15:scenecut=0:qp=40" -movflags +faststart headless.mp4
+const size_t kFrameCount = 30;
+
+size_t CountLines(const std::string& text)
+{
+	size_t count = 0;
+	for (char c : text)
+	{
+		count += (c == '\n') ? 1 : 0;
+	}
+	return count;
+}
+
+void ReportErrors(const HeadlessPlayback& playback)
+{
+	for (const auto& error : playback.GetErrors())
+	{
+		std::fprintf(stderr, "HeadlessPlaybackTest: %s\n", error.c_str());
+	}
+}
+
+// ループ回数ごとに、全てのフレームを1回ずつデコードして検証を通る.
+void TestLoops(const char* path)
+{
+	for (uint32_t loopCount : { 0u, 2u })
+	{
+		HeadlessPlayback playback;
+		CHECK(playback.Run(path, { .loopCount = loopCount }));
+		ReportErrors(playback);
+		CHECK_EQ(CountLines(playback.Dump()), kFrameCount * (loopCount + 1));
+	}
+}
+
+// 表示の更新の頻度と描画側の処理中のフレーム数を変えても、出力テクスチャの再利用などの検証を通る.
+void TestTimings(const char* path)
+{
+	for (double refreshRate : { 24.0, 60.0, 144.0 })
+	{
+		for (uint32_t framesInFlight : { 0u, 3u })
+		{
+			HeadlessPlayback playback;
+			CHECK(playback.Run(path, { .loopCount = 1, .refreshRate = refreshRate, .framesInFlight = framesInFlight }));
+			ReportErrors(playback);
+			CHECK_EQ(CountLines(playback.Dump()), kFrameCount * 2);
+		}
+	}
+}
+
+// 時刻は VirtualClock で進めるため、同じ設定なら記録は一致する.
+void TestDeterministic(const char* path)
+{
+	HeadlessPlayback first, second;
+	CHECK(first.Run(path, { .loopCount = 1 }));
+	CHECK(second.Run(path, { .loopCount = 1 }));
+	CHECK(!first.Dump().empty());
+	CHECK(first.Dump() == second.Dump());
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "data/headless.mp4";
+	TestLoops(path);
+	TestTimings(path);
+	TestDeterministic(path);
+	return ReportTestResult("HeadlessPlaybackTest");
+}
@@ -0,0 +1,229 @@
+﻿#include "PresentationClock.h"
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+
+#include "TestCommon.h"
+
+namespace {
+
+// VideoPlayer::UpdateDisplayFrame と同じ手順で、VirtualClock の時刻に表示するフレームを決める.
+// 表示順 i のフレームの表示時刻は i * frameDuration. 0 番目を表示した状態から始める.
+class Playback
+{
+public:
+	Playback(int frameCount, double frameDuration)
+		: m_clock(std::make_shared<VirtualClock>()), m_frameCount(frameCount), m_frameDuration(frameDuration)
+	{
+		m_presentation.SetClock(m_clock);
+		m_presentation.Start(0.0);
+	}
+
+	// デコードが間に合っているか. 既定では全て間に合っている.
+	void SetReady(std::function<bool(int displayOrder, double now)> isReady) { m_isReady = std::move(isReady); }
+
+	// 表示の更新 (垂直同期) 1回分.
+	void Tick(double now)
+	{
+		m_clock->Set(now);
+		for (;;)
+		{
+			int nextIndex = m_playIndex + 1;
+			if (m_frameCount <= nextIndex)
+			{
+				return;
+			}
+			bool isReady = m_isReady(nextIndex, now);
+			bool canSkip = nextIndex + 1 < m_frameCount && m_isReady(nextIndex + 1, now);
+			auto decision = m_presentation.Evaluate(nextIndex * m_frameDuration, m_frameDuration, isReady, canSkip);
+			if (decision == PresentationClock::Decision::Wait || decision == PresentationClock::Decision::Repeat)
+			{
+				return;
+			}
+			m_playIndex = nextIndex;
+			if (decision == PresentationClock::Decision::Present)
+			{
+				return;
+			}
+		}
+	}
+
+	bool IsFinished() const { return m_playIndex + 1 == m_frameCount; }
+	int GetPlayIndex() const { return m_playIndex; }
+	const PresentationClock& GetPresentation() const { return m_presentation; }
+
+private:
+	std::shared_ptr<VirtualClock> m_clock;
+	PresentationClock m_presentation;
+	std::function<bool(int, double)> m_isReady = [](int, double) { return true; };
+	int m_frameCount = 0;
+	double m_frameDuration = 0.0;
+	int m_playIndex = 0;
+};
+
+// 表示の更新の時刻. 表示時刻とちょうど重なって判定が揺れないよう、周期の 1/4 だけずらす.
+double TickTime(uint64_t tick, double refreshInterval)
+{
+	return (tick + 0.25) * refreshInterval;
+}
+
+// 30fps を 60Hz で表示. 全てのフレームを遅れなく表示する.
+void TestSteady()
+{
+	const double refresh = 1.0 / 60.0;
+	Playback playback(300, 1.0 / 30.0);
+	for (uint64_t tick = 0; !playback.IsFinished() && tick < 1000; ++tick)
+	{
+		playback.Tick(TickTime(tick, refresh));
+	}
+	const auto& stats = playback.GetPresentation().GetStatistics();
+	CHECK(playback.IsFinished());
+	CHECK_EQ(stats.presented, 299u);
+	CHECK_EQ(stats.dropped, 0u);
+	CHECK_EQ(stats.repeated, 0u);
+	CHECK_EQ(stats.resynced, 0u);
+	CHECK(std::abs(stats.maxLatenessSeconds - refresh * 0.25) < 1e-9);
+}
+
+// 29.97fps を 60Hz で 10 時間表示. 時刻を積算しないため遅れは 1 周期未満のまま増えない.
+void TestLongRunNoDrift()
+{
+	const double refresh = 1.0 / 60.0;
+	const double duration = 1001.0 / 30000.0;
+	const int frameCount = int(10 * 3600 / duration);
+	Playback playback(frameCount, duration);
+	uint64_t tick = 0;
+	for (; !playback.IsFinished(); ++tick)
+	{
+		playback.Tick(TickTime(tick, refresh));
+	}
+	const auto& stats = playback.GetPresentation().GetStatistics();
+	CHECK_EQ(stats.presented, uint64_t(frameCount - 1));
+	CHECK_EQ(stats.dropped, 0u);
+	CHECK_EQ(stats.repeated, 0u);
+	CHECK_EQ(stats.resynced, 0u);
+	CHECK(stats.maxLatenessSeconds < refresh);
+	// 終了時刻は最後のフレームの表示時刻から 1 周期以内.
+	CHECK(TickTime(tick - 1, refresh) - (frameCount - 1) * duration < refresh);
+}
+
+// 60fps を 59.94Hz で 10 時間表示. 表示が追い付かない分だけ読み飛ばし、遅れは 1 フレーム分を超えて溜まらない.
+void TestLongRunSlowDisplay()
+{
+	const double refresh = 1001.0 / 60000.0;
+	const double duration = 1.0 / 60.0;
+	const int frameCount = int(10 * 3600 / duration);
+	Playback playback(frameCount, duration);
+	uint64_t tick = 0;
+	for (; !playback.IsFinished(); ++tick)
+	{
+		playback.Tick(TickTime(tick, refresh));
+	}
+	const auto& stats = playback.GetPresentation().GetStatistics();
+	// 1 回の更新で 1 枚を表示する.
+	CHECK_EQ(stats.presented, tick - 1);
+	CHECK_EQ(stats.presented + stats.dropped, uint64_t(frameCount - 1));
+	CHECK_EQ(stats.repeated, 0u);
+	CHECK_EQ(stats.resynced, 0u);
+	CHECK(stats.maxLatenessSeconds < duration);
+	// 読み飛ばしは周期の差の分 (約 1000 フレームに 1 枚).
+	const double expectedDropped = (frameCount - 1) * (1.0 - duration / refresh);
+	CHECK(std::abs(double(stats.dropped) - expectedDropped) < 2.0);
+}
+
+// 0.3 秒止まった後、遅れたフレームを読み飛ばして追い付く.
+void TestShortStall()
+{
+	const double refresh = 1.0 / 60.0;
+	Playback playback(300, 1.0 / 30.0);
+	for (uint64_t tick = 0; !playback.IsFinished() && tick < 1000; ++tick)
+	{
+		// 60 回目 (1 秒) の後の 18 回 (0.3 秒) を処理しない.
+		if (60 < tick && tick <= 78)
+		{
+			continue;
+		}
+		playback.Tick(TickTime(tick, refresh));
+		if (tick == 79)
+		{
+			// 1.32 秒の時点で、表示期間を過ぎた 31 - 38 を読み飛ばして 39 を表示している.
+			CHECK_EQ(playback.GetPlayIndex(), 39);
+		}
+	}
+	const auto& stats = playback.GetPresentation().GetStatistics();
+	CHECK(playback.IsFinished());
+	CHECK_EQ(stats.dropped, 8u);
+	CHECK_EQ(stats.presented, 299u - 8u);
+	CHECK_EQ(stats.repeated, 0u);
+	CHECK_EQ(stats.resynced, 0u);
+	CHECK(stats.maxLatenessSeconds < 1.0 / 30.0);
+	// 追い付いた後は元の遅れに戻る.
+	CHECK(std::abs(stats.lastLatenessSeconds - refresh * 0.25) < 1e-9);
+}
+
+// 2 秒止まった場合は読み飛ばさずに基準時刻を合わせ直す.
+void TestLongStallResync()
+{
+	const double refresh = 1.0 / 60.0;
+	Playback playback(300, 1.0 / 30.0);
+	uint64_t tick = 0;
+	for (; !playback.IsFinished() && tick < 1000; ++tick)
+	{
+		if (60 < tick && tick <= 180)
+		{
+			continue;
+		}
+		playback.Tick(TickTime(tick, refresh));
+		if (tick == 181)
+		{
+			// 止まる前の次のフレームから再開する.
+			CHECK_EQ(playback.GetPlayIndex(), 31);
+			CHECK(std::abs(playback.GetPresentation().GetMediaTime() - 31.0 / 30.0) < 1e-9);
+		}
+	}
+	const auto& stats = playback.GetPresentation().GetStatistics();
+	CHECK(playback.IsFinished());
+	CHECK_EQ(stats.resynced, 1u);
+	CHECK_EQ(stats.dropped, 0u);
+	CHECK_EQ(stats.presented, 299u);
+	CHECK(stats.maxLatenessSeconds < refresh);
+	// 合わせ直した分 (2 秒) だけ終了が遅れる.
+	CHECK(TickTime(tick - 1, refresh) - 299.0 / 30.0 > 2.0 - refresh);
+}
+
+// デコードが間に合わない間は現在のフレームを再表示し、間に合ったら遅れた分を読み飛ばす.
+void TestDecodeLate()
+{
+	const double refresh = 1.0 / 60.0;
+	const double duration = 1.0 / 30.0;
+	Playback playback(300, duration);
+	// 50 番目だけ表示時刻の 0.05 秒後にデコードが終わる.
+	playback.SetReady([=](int displayOrder, double now) {
+		return displayOrder != 50 || 50 * duration + 0.05 <= now;
+	});
+	for (uint64_t tick = 0; !playback.IsFinished() && tick < 1000; ++tick)
+	{
+		playback.Tick(TickTime(tick, refresh));
+	}
+	const auto& stats = playback.GetPresentation().GetStatistics();
+	CHECK(playback.IsFinished());
+	// 100 - 102 回目の更新で再表示、103 回目で 50 を読み飛ばして 51 を表示.
+	CHECK_EQ(stats.repeated, 3u);
+	CHECK_EQ(stats.dropped, 1u);
+	CHECK_EQ(stats.presented, 298u);
+	CHECK_EQ(stats.resynced, 0u);
+}
+
+}
+
+int main()
+{
+	TestSteady();
+	TestLongRunNoDrift();
+	TestLongRunSlowDisplay();
+	TestShortStall();
+	TestLongStallResync();
+	TestDecodeLate();
+	return ReportTestResult("PresentationClockTest");
+}
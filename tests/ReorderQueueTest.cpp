@@ -0,0 +1,90 @@
+﻿#include "ReorderQueue.h"
+
+#include "TestCommon.h"
+
+namespace {
+
+// デコード順 (表示順と異なる) に挿入し、表示順に取り出す.
+void TestReorder()
+{
+	ReorderQueue<int> queue;
+	queue.Initialize(5);
+	CHECK_EQ(queue.GetCapacity(), 8u);
+
+	const int64_t decodeOrder[] = { 0, 3, 1, 2, 6, 4, 5 };
+	int evicted = -1;
+	for (auto displayOrder : decodeOrder)
+	{
+		CHECK(!queue.Insert(displayOrder, int(displayOrder * 10), evicted));
+	}
+	CHECK_EQ(queue.GetCount(), 7u);
+	for (int64_t displayOrder = 0; displayOrder < 7; ++displayOrder)
+	{
+		auto item = queue.Find(displayOrder);
+		CHECK(item != nullptr && *item == displayOrder * 10);
+		int out = -1;
+		CHECK(queue.Retire(displayOrder, out));
+		CHECK_EQ(out, displayOrder * 10);
+	}
+	CHECK_EQ(queue.GetCount(), 0u);
+}
+
+// 表示済みにならなかったエントリーを上書きした場合は、保持していたアイテムを返す.
+void TestEvict()
+{
+	ReorderQueue<int> queue;
+	queue.Initialize(4);
+	int evicted = -1;
+	CHECK(!queue.Insert(1, 100, evicted));
+	// 容量分だけ先の表示順が同じエントリーを使う.
+	CHECK(queue.Insert(5, 500, evicted));
+	CHECK_EQ(evicted, 100);
+	CHECK_EQ(queue.GetCount(), 1u);
+	CHECK(queue.GetState(1) == ReorderQueue<int>::State::Empty);
+	CHECK(queue.GetState(5) == ReorderQueue<int>::State::Ready);
+
+	evicted = -1;
+	CHECK(queue.MarkDropped(9, evicted));
+	CHECK_EQ(evicted, 500);
+	CHECK_EQ(queue.GetCount(), 0u);
+	CHECK(queue.GetState(9) == ReorderQueue<int>::State::Dropped);
+	// 省略したフレームはアイテムを持たないため、上書きしても返さない.
+	CHECK(!queue.Insert(13, 1300, evicted));
+	CHECK_EQ(queue.GetCount(), 1u);
+}
+
+// 長時間のループ再生で表示順が INT_MAX を超えても使える.
+void TestLargeDisplayOrder()
+{
+	ReorderQueue<int> queue;
+	queue.Initialize(4);
+	const int64_t base = (int64_t(1) << 31) - 2;
+	int evicted = -1;
+	for (int64_t i = 0; i < 4; ++i)
+	{
+		CHECK(!queue.Insert(base + i, int(i), evicted));
+	}
+	for (int64_t i = 0; i < 4; ++i)
+	{
+		auto item = queue.Find(base + i);
+		CHECK(item != nullptr && *item == i);
+		if (INT32_MAX < base + i)
+		{
+			// 32bit へ切り詰めた (負の) 表示順とは区別する.
+			CHECK(queue.Find(int32_t(uint32_t(base + i))) == nullptr);
+		}
+		int out = -1;
+		CHECK(queue.Retire(base + i, out));
+	}
+	CHECK_EQ(queue.GetCount(), 0u);
+}
+
+}
+
+int main()
+{
+	TestReorder();
+	TestEvict();
+	TestLargeDisplayOrder();
+	return ReportTestResult("ReorderQueueTest");
+}
@@ -0,0 +1,239 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include "scaleComputeShader.h"
+
+#include "TestCommon.h"
+
+namespace {
+
+// 合成した NV12 の入力で scale.comp と同じ計算を CPU で行い、RGBToYCbCr がサンプラーの変換の逆になっていることを確かめる.
+// サンプラーは VideoScaler と同じ設定 (BT.709 limited, 色差は最近傍/MIDPOINT, 双線形, CLAMP_TO_EDGE).
+struct Nv12
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint8_t> luma;		// width x height.
+	std::vector<uint8_t> chroma;	// (width / 2) x (height / 2) の CbCr.
+
+	Nv12(uint32_t w, uint32_t h) : width(w), height(h), luma(w * h), chroma(w * h / 2) {}
+
+	uint8_t& Y(uint32_t x, uint32_t y) { return luma[y * width + x]; }
+	uint8_t& Cb(uint32_t x, uint32_t y) { return chroma[(y * (width / 2) + x) * 2]; }
+	uint8_t& Cr(uint32_t x, uint32_t y) { return chroma[(y * (width / 2) + x) * 2 + 1]; }
+};
+
+struct Vec3
+{
+	float x, y, z;
+	Vec3 operator+(const Vec3& o) const { return { x + o.x, y + o.y, z + o.z }; }
+	Vec3 operator*(float s) const { return { x * s, y * s, z * s }; }
+};
+
+// VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_709 + VK_SAMPLER_YCBCR_RANGE_ITU_NARROW.
+Vec3 YCbCrToRGB(uint8_t y8, uint8_t cb8, uint8_t cr8)
+{
+	const float kr = 0.2126f, kb = 0.0722f, kg = 1.0f - kr - kb;
+	float y = (y8 - 16.0f) / 219.0f;
+	float cb = (cb8 - 128.0f) / 224.0f;
+	float cr = (cr8 - 128.0f) / 224.0f;
+	return {
+		y + 2.0f * (1.0f - kr) * cr,
+		y - 2.0f * (1.0f - kb) * kb / kg * cb - 2.0f * (1.0f - kr) * kr / kg * cr,
+		y + 2.0f * (1.0f - kb) * cb,
+	};
+}
+
+Vec3 Texel(Nv12& src, int x, int y)
+{
+	x = std::clamp(x, 0, int(src.width) - 1);
+	y = std::clamp(y, 0, int(src.height) - 1);
+	return YCbCrToRGB(src.Y(x, y), src.Cb(x / 2, y / 2), src.Cr(x / 2, y / 2));
+}
+
+Vec3 SampleLinear(Nv12& src, float u, float v)
+{
+	float x = u * src.width - 0.5f;
+	float y = v * src.height - 0.5f;
+	int x0 = int(std::floor(x)), y0 = int(std::floor(y));
+	float fx = x - x0, fy = y - y0;
+	auto top = Texel(src, x0, y0) * (1.0f - fx) + Texel(src, x0 + 1, y0) * fx;
+	auto bottom = Texel(src, x0, y0 + 1) * (1.0f - fx) + Texel(src, x0 + 1, y0 + 1) * fx;
+	return top * (1.0f - fy) + bottom * fy;
+}
+
+// 以下は scale.comp の SampleFootprint/RGBToYCbCr/main と同じ.
+Vec3 SampleFootprint(Nv12& src, float cx, float cy, float fx, float fy)
+{
+	float dx = fx * 0.25f, dy = fy * 0.25f;
+	auto color = SampleLinear(src, cx - dx, cy - dy);
+	color = color + SampleLinear(src, cx + dx, cy - dy);
+	color = color + SampleLinear(src, cx - dx, cy + dy);
+	color = color + SampleLinear(src, cx + dx, cy + dy);
+	return color * 0.25f;
+}
+
+Vec3 RGBToYCbCr(const Vec3& rgb)
+{
+	float y = rgb.x * 0.2126f + rgb.y * 0.7152f + rgb.z * 0.0722f;
+	float cb = (rgb.z - y) / 1.8556f;
+	float cr = (rgb.x - y) / 1.5748f;
+	return { y * (219.0f / 255.0f) + (16.0f / 255.0f), cb * (224.0f / 255.0f) + (128.0f / 255.0f), cr * (224.0f / 255.0f) + (128.0f / 255.0f) };
+}
+
+uint8_t ToUnorm8(float v)
+{
+	return uint8_t(std::lround(std::clamp(v, 0.0f, 1.0f) * 255.0f));
+}
+
+// NV12 の出力 (width x height).
+Nv12 ScaleToNv12(Nv12& src, uint32_t width, uint32_t height)
+{
+	Nv12 out(width, height);
+	const float fx = 1.0f / width, fy = 1.0f / height;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			auto rgb = SampleFootprint(src, (x + 0.5f) * fx, (y + 0.5f) * fy, fx, fy);
+			out.Y(x, y) = ToUnorm8(RGBToYCbCr(rgb).x);
+			if ((x & 1) == 0 && (y & 1) == 0)
+			{
+				auto ycbcr = RGBToYCbCr(SampleFootprint(src, (x + 1.0f) * fx, (y + 1.0f) * fy, fx * 2.0f, fy * 2.0f));
+				out.Cb(x / 2, y / 2) = ToUnorm8(ycbcr.y);
+				out.Cr(x / 2, y / 2) = ToUnorm8(ycbcr.z);
+			}
+		}
+	}
+	return out;
+}
+
+// 一様な色は縮小しても同じ値に戻る.
+void TestUniform()
+{
+	Nv12 src(64, 32);
+	std::fill(src.luma.begin(), src.luma.end(), uint8_t(120));
+	for (uint32_t y = 0; y < 16; ++y)
+	{
+		for (uint32_t x = 0; x < 32; ++x)
+		{
+			src.Cb(x, y) = 90;
+			src.Cr(x, y) = 170;
+		}
+	}
+	for (uint32_t divisor : { 2u, 4u })
+	{
+		auto out = ScaleToNv12(src, 64 / divisor, 32 / divisor);
+		CHECK(std::all_of(out.luma.begin(), out.luma.end(), [](uint8_t v) { return v == 120; }));
+		for (uint32_t y = 0; y < out.height / 2; ++y)
+		{
+			for (uint32_t x = 0; x < out.width / 2; ++x)
+			{
+				CHECK_EQ(out.Cb(x, y), 90);
+				CHECK_EQ(out.Cr(x, y), 170);
+			}
+		}
+	}
+}
+
+// 輝度は出力1画素が覆う範囲、色差は 2x2 画素が覆う範囲の平均になる.
+void TestFootprint()
+{
+	Nv12 src(64, 32);
+	for (uint32_t y = 0; y < 32; ++y)
+	{
+		for (uint32_t x = 0; x < 64; ++x)
+		{
+			src.Y(x, y) = uint8_t(16 + 2 * x);
+		}
+	}
+	for (uint32_t y = 0; y < 16; ++y)
+	{
+		for (uint32_t x = 0; x < 32; ++x)
+		{
+			src.Cb(x, y) = uint8_t(100 + 4 * x);
+			src.Cr(x, y) = uint8_t(150 - 2 * y);
+		}
+	}
+
+	auto half = ScaleToNv12(src, 32, 16);
+	for (uint32_t x = 0; x < 32; ++x)
+	{
+		CHECK_EQ(half.Y(x, 7), 17 + 4 * x);
+	}
+	for (uint32_t y = 0; y < 8; ++y)
+	{
+		for (uint32_t x = 0; x < 16; ++x)
+		{
+			CHECK_EQ(half.Cb(x, y), 102 + 8 * x);
+			CHECK_EQ(half.Cr(x, y), 149 - 4 * y);
+		}
+	}
+
+	auto quarter = ScaleToNv12(src, 16, 8);
+	for (uint32_t x = 0; x < 16; ++x)
+	{
+		CHECK_EQ(quarter.Y(x, 3), 19 + 8 * x);
+	}
+}
+
+// 埋め込んだ SPIR-V が VideoScaler の前提 (バインディング、push_constant の配置、ワークグループの大きさ) と合う.
+void TestShaderModule()
+{
+	const uint32_t wordCount = sizeof(gCSScale) / sizeof(gCSScale[0]);
+	CHECK(5 < wordCount);
+	CHECK_EQ(gCSScale[0], 0x07230203u);
+
+	std::set<uint32_t> capabilities;
+	std::set<uint32_t> bindings;
+	uint32_t localSize[3] = {};
+	uint32_t outputCountOffset = 0;
+	uint32_t pos = 5;
+	while (pos < wordCount)
+	{
+		const uint32_t length = gCSScale[pos] >> 16;
+		const uint32_t opcode = gCSScale[pos] & 0xffff;
+		const uint32_t* operands = &gCSScale[pos + 1];
+		if (length == 0 || wordCount < pos + length)
+		{
+			break;
+		}
+		if (opcode == 17)	// OpCapability.
+		{
+			capabilities.insert(operands[0]);
+		}
+		else if (opcode == 16 && operands[1] == 17)	// OpExecutionMode LocalSize.
+		{
+			std::copy(operands + 2, operands + 5, localSize);
+		}
+		else if (opcode == 71 && operands[1] == 33)	// OpDecorate Binding.
+		{
+			bindings.insert(operands[2]);
+		}
+		else if (opcode == 72 && operands[1] == 1 && operands[2] == 35)	// OpMemberDecorate 1 Offset.
+		{
+			outputCountOffset = operands[3];
+		}
+		pos += length;
+	}
+	CHECK_EQ(pos, wordCount);
+	CHECK(capabilities.count(49) == 1);	// StorageImageExtendedFormats. VideoScaler::Initialize で確認する.
+	CHECK((bindings == std::set<uint32_t>{ 0, 1, 2, 3 }));
+	CHECK_EQ(localSize[0], 8u);
+	CHECK_EQ(localSize[1], 8u);
+	CHECK_EQ(localSize[2], 1u);
+	CHECK_EQ(outputCountOffset, 64u);
+}
+
+}
+
+int main()
+{
+	TestUniform();
+	TestFootprint();
+	TestShaderModule();
+	return ReportTestResult("ScaleShaderTest");
+}
@@ -0,0 +1,360 @@
+﻿#include "SoftwareH264Decoder.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <vector>
+
+#define H264_IMPLEMENTATION
+#include "h264.h"
+
+#include "TestCommon.h"
+
+namespace {
+
+// data/baseline.h264 は 176x144, 12 フレームの Constrained Baseline (参照 3 枚, 2 スライス, デブロッキングあり, 6 フレームごとの IDR).
+// x264 で作成し、ffmpeg でデコードした I420 (全フレームを連結) の MD5 を正解とする.
+//   ffmpeg -f lavfi -i "testsrc2=size=176x144:rate=30,noise=alls=3:allf=t" -frames:v 12 -c:v libx264 -profile:v baseline -level 3.0
+//     -x264-params "ref=3:slices=2:keyint=6:min-keyint=6:scenecut=0:qp=30:deblock=1,0" baseline.h264
+const char* const kBaselineMd5 = "f0441629e7dab16bfc00091ffd2bcac4";
+const uint32_t kBaselineFrameCount = 12;
+
+// RFC 1321.
+class Md5
+{
+public:
+	void Update(const uint8_t* data, size_t size)
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			m_block[m_length++ % 64] = data[i];
+			if (m_length % 64 == 0)
+			{
+				Transform();
+			}
+		}
+	}
+
+	std::string Finish()
+	{
+		const uint64_t bits = m_length * 8;
+		const uint8_t pad = 0x80, zero = 0;
+		Update(&pad, 1);
+		while (m_length % 64 != 56)
+		{
+			Update(&zero, 1);
+		}
+		for (int i = 0; i < 8; ++i)
+		{
+			const uint8_t v = uint8_t(bits >> (i * 8));
+			Update(&v, 1);
+		}
+		std::string hex;
+		for (uint32_t word : m_state)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				char text[3];
+				std::snprintf(text, sizeof(text), "%02x", (word >> (i * 8)) & 0xff);
+				hex += text;
+			}
+		}
+		return hex;
+	}
+
+private:
+	static uint32_t Rotate(uint32_t v, uint32_t s) { return (v << s) | (v >> (32 - s)); }
+
+	void Transform()
+	{
+		static const uint32_t shifts[4][4] = { { 7, 12, 17, 22 }, { 5, 9, 14, 20 }, { 4, 11, 16, 23 }, { 6, 10, 15, 21 } };
+		uint32_t m[16];
+		for (int i = 0; i < 16; ++i)
+		{
+			m[i] = m_block[i * 4] | (m_block[i * 4 + 1] << 8) | (m_block[i * 4 + 2] << 16) | (uint32_t(m_block[i * 4 + 3]) << 24);
+		}
+		uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+		for (uint32_t i = 0; i < 64; ++i)
+		{
+			uint32_t f, g;
+			switch (i / 16)
+			{
+			case 0: f = (b & c) | (~b & d); g = i; break;
+			case 1: f = (d & b) | (~d & c); g = (5 * i + 1) % 16; break;
+			case 2: f = b ^ c ^ d; g = (3 * i + 5) % 16; break;
+			default: f = c ^ (b | ~d); g = (7 * i) % 16; break;
+			}
+			// K[i] = floor(abs(sin(i + 1)) * 2^32).
+			static const uint32_t k[64] = {
+				0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+				0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+				0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+				0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+				0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+				0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+				0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+				0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+			};
+			const uint32_t next = b + Rotate(a + f + k[i] + m[g], shifts[i / 16][i % 4]);
+			a = d;
+			d = c;
+			c = b;
+			b = next;
+		}
+		m_state[0] += a;
+		m_state[1] += b;
+		m_state[2] += c;
+		m_state[3] += d;
+	}
+
+	uint32_t m_state[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+	uint8_t m_block[64] = { };
+	uint64_t m_length = 0;
+};
+
+std::vector<uint8_t> LoadFile(const char* path)
+{
+	std::ifstream file(path, std::ios::binary);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Annex-B のストリームを NAL ごとに分ける. 開始コードは含めない.
+std::vector<std::span<const uint8_t>> SplitNalUnits(const std::vector<uint8_t>& stream)
+{
+	std::vector<size_t> starts;
+	for (size_t i = 0; i + 3 <= stream.size(); )
+	{
+		if (stream[i] == 0 && stream[i + 1] == 0 && stream[i + 2] == 1)
+		{
+			starts.push_back(i + 3);
+			i += 3;
+		}
+		else
+		{
+			i++;
+		}
+	}
+	std::vector<std::span<const uint8_t>> nals;
+	for (size_t i = 0; i < starts.size(); ++i)
+	{
+		size_t end = (i + 1 < starts.size()) ? starts[i + 1] - 3 : stream.size();
+		// 4バイトの開始コードの先頭の 0 は次の NAL に属する.
+		while (starts[i] < end && stream[end - 1] == 0)
+		{
+			end--;
+		}
+		nals.emplace_back(stream.data() + starts[i], end - starts[i]);
+	}
+	return nals;
+}
+
+std::vector<uint8_t> RemoveEmulationPreventionBytes(std::span<const uint8_t> ebsp)
+{
+	std::vector<uint8_t> rbsp;
+	rbsp.reserve(ebsp.size());
+	for (size_t i = 0; i < ebsp.size(); ++i)
+	{
+		rbsp.push_back(ebsp[i]);
+		if (i + 2 < ebsp.size() && ebsp[i] == 0 && ebsp[i + 1] == 0 && ebsp[i + 2] == 3)
+		{
+			rbsp.push_back(0);
+			i += 2;
+		}
+	}
+	return rbsp;
+}
+
+struct DecodeResult
+{
+	uint32_t frameCount = 0;
+	uint32_t failedFrames = 0;
+	uint64_t concealedMacroblocks = 0;
+	uint32_t threadCount = 0;
+	std::string md5;
+};
+
+// VideoPlayer と同じく、スライスを1フレーム分まとめてスロットを指定してデコードする.
+// 参照はスライディングウィンドウのみ (MMCO を持たないストリームが前提).
+DecodeResult DecodeStream(const std::vector<uint8_t>& stream, uint32_t threadCount)
+{
+	const uint32_t slotCount = 17;
+	static h264::SPS spsArray[32];
+	static h264::PPS ppsArray[256];
+
+	DecodeResult result;
+	SoftwareH264Decoder decoder;
+	Md5 md5;
+	uint32_t width = 0, height = 0;
+	std::vector<uint8_t> nv12, i420;
+
+	std::vector<uint8_t> bitstream;
+	std::vector<uint32_t> sliceOffsets;
+	std::vector<SoftwareH264Decoder::Reference> references;
+	int frameNum = 0;
+	bool isReference = false;
+	bool isIdr = false;
+
+	auto decodeFrame = [&]()
+	{
+		if (sliceOffsets.empty())
+		{
+			return;
+		}
+		if (isIdr)
+		{
+			references.clear();
+		}
+		// 参照に使われていないスロットに書き込む.
+		uint32_t slot = 0;
+		while (std::any_of(references.begin(), references.end(), [slot](const auto& r) { return r.slot == slot; }))
+		{
+			slot++;
+		}
+		const SoftwareH264Decoder::FrameDesc desc = {
+			.bitstream = bitstream.data(),
+			.size = bitstream.size(),
+			.sliceOffsets = sliceOffsets.data(),
+			.sliceCount = uint32_t(sliceOffsets.size()),
+			.spsArray = spsArray,
+			.ppsArray = ppsArray,
+			.spsCount = uint32_t(std::size(spsArray)),
+			.ppsCount = uint32_t(std::size(ppsArray)),
+			.targetSlot = slot,
+			.references = references.data(),
+			.referenceCount = uint32_t(references.size()),
+		};
+		if (!decoder.DecodeFrame(desc))
+		{
+			result.failedFrames++;
+		}
+
+		// NV12 で書き出し、ffmpeg の出力と同じ I420 に並べ替える.
+		const uint32_t lumaSize = width * height;
+		nv12.resize(lumaSize * 3 / 2);
+		i420.resize(lumaSize * 3 / 2);
+		decoder.WriteNV12(slot, nv12.data(), width, nv12.data() + lumaSize, width, width, height);
+		std::memcpy(i420.data(), nv12.data(), lumaSize);
+		for (uint32_t i = 0; i < lumaSize / 4; ++i)
+		{
+			i420[lumaSize + i] = nv12[lumaSize + i * 2];
+			i420[lumaSize + lumaSize / 4 + i] = nv12[lumaSize + i * 2 + 1];
+		}
+		md5.Update(i420.data(), i420.size());
+
+		if (isReference)
+		{
+			references.push_back({ .slot = slot, .frameNum = frameNum });
+			const size_t maxReferences = std::max(1, spsArray[0].num_ref_frames);
+			if (maxReferences < references.size())
+			{
+				references.erase(references.begin());
+			}
+		}
+		result.frameCount++;
+		bitstream.clear();
+		sliceOffsets.clear();
+	};
+
+	for (auto nal : SplitNalUnits(stream))
+	{
+		if (nal.size() < 2)
+		{
+			continue;
+		}
+		h264::NALHeader nalHeader = {
+			.idc = h264::NAL_REF_IDC((nal[0] >> 5) & 3),
+			.type = h264::NAL_UNIT_TYPE(nal[0] & 0x1f),
+		};
+		auto rbsp = RemoveEmulationPreventionBytes(nal.subspan(1));
+		h264::Bitstream bs = {};
+		bs.init(rbsp.data(), rbsp.size());
+		if (nalHeader.type == h264::NAL_UNIT_TYPE_SPS)
+		{
+			h264::SPS sps = {};
+			h264::read_sps(&sps, &bs);
+			spsArray[sps.seq_parameter_set_id] = sps;
+			if (width == 0)
+			{
+				const uint32_t widthInMbs = sps.pic_width_in_mbs_minus1 + 1;
+				const uint32_t heightInMbs = sps.pic_height_in_map_units_minus1 + 1;
+				CHECK(decoder.Initialize(widthInMbs, heightInMbs, slotCount, threadCount));
+				width = widthInMbs * 16 - sps.frame_crop_left_offset * 2 - sps.frame_crop_right_offset * 2;
+				height = heightInMbs * 16 - sps.frame_crop_top_offset * 2 - sps.frame_crop_bottom_offset * 2;
+			}
+		}
+		else if (nalHeader.type == h264::NAL_UNIT_TYPE_PPS)
+		{
+			h264::PPS pps = {};
+			h264::read_pps(&pps, &bs);
+			ppsArray[pps.pic_parameter_set_id] = pps;
+		}
+		else if (nalHeader.type == h264::NAL_UNIT_TYPE_CODED_SLICE_NON_IDR || nalHeader.type == h264::NAL_UNIT_TYPE_CODED_SLICE_IDR)
+		{
+			h264::SliceHeader sliceHeader = {};
+			h264::read_slice_header(&sliceHeader, &nalHeader, ppsArray, spsArray, &bs);
+			if (sliceHeader.first_mb_in_slice == 0)
+			{
+				decodeFrame();
+			}
+			frameNum = sliceHeader.frame_num;
+			isReference = nalHeader.idc != h264::NAL_REF_IDC_PRIORITY_DISPOSABLE;
+			isIdr = nalHeader.type == h264::NAL_UNIT_TYPE_CODED_SLICE_IDR;
+			sliceOffsets.push_back(uint32_t(bitstream.size()));
+			bitstream.insert(bitstream.end(), { 0, 0, 1 });
+			bitstream.insert(bitstream.end(), nal.begin(), nal.end());
+		}
+	}
+	decodeFrame();
+
+	result.concealedMacroblocks = decoder.GetStatistics().concealedMacroblocks;
+	result.threadCount = decoder.GetThreadCount();
+	result.md5 = md5.Finish();
+	return result;
+}
+
+// 既知の値で MD5 の実装を確かめる.
+void TestMd5()
+{
+	Md5 empty;
+	CHECK(empty.Finish() == "d41d8cd98f00b204e9800998ecf8427e");
+	Md5 text;
+	const char* message = "The quick brown fox jumps over the lazy dog";
+	text.Update(reinterpret_cast<const uint8_t*>(message), std::strlen(message));
+	CHECK(text.Finish() == "9e107d9d372bb6826bd81d3542a419d6");
+}
+
+// 1スレッドと複数スレッドのどちらでも ffmpeg と同じ画像になる.
+void TestBaselineStream(const char* path)
+{
+	const auto stream = LoadFile(path);
+	CHECK(!stream.empty());
+	if (stream.empty())
+	{
+		std::fprintf(stderr, "SoftwareH264DecoderTest: failed to load %s\n", path);
+		return;
+	}
+	for (uint32_t threadCount : { 1u, 4u })
+	{
+		const auto result = DecodeStream(stream, threadCount);
+		std::printf("SoftwareH264DecoderTest: %u threads, %u frames, md5 %s\n", result.threadCount, result.frameCount, result.md5.c_str());
+		CHECK_EQ(result.threadCount, threadCount);
+		CHECK_EQ(result.frameCount, kBaselineFrameCount);
+		CHECK_EQ(result.failedFrames, 0u);
+		CHECK_EQ(result.concealedMacroblocks, 0u);
+		CHECK(result.md5 == kBaselineMd5);
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	TestMd5();
+	TestBaselineStream(argc > 1 ? argv[1] : "data/baseline.h264");
+	return ReportTestResult("SoftwareH264DecoderTest");
+}
@@ -0,0 +1,40 @@
+﻿#pragma once
+
+#include <cstdio>
+
+// テスト用の最小限の確認マクロ. 失敗しても続行し、最後に ReportTestResult で結果を返す.
+inline int& TestFailureCount()
+{
+	static int count = 0;
+	return count;
+}
+
+#define CHECK(expr) \
+	do { \
+		if (!(expr)) { \
+			std::fprintf(stderr, "%s(%d): CHECK failed: %s\n", __FILE__, __LINE__, #expr); \
+			TestFailureCount()++; \
+		} \
+	} while (false)
+
+#define CHECK_EQ(actual, expected) \
+	do { \
+		auto actualValue_ = (actual); \
+		auto expectedValue_ = (expected); \
+		if (!(actualValue_ == expectedValue_)) { \
+			std::fprintf(stderr, "%s(%d): CHECK_EQ failed: %s = %lld, expected %lld\n", __FILE__, __LINE__, \
+				#actual, (long long)actualValue_, (long long)expectedValue_); \
+			TestFailureCount()++; \
+		} \
+	} while (false)
+
+inline int ReportTestResult(const char* name)
+{
+	if (TestFailureCount() == 0)
+	{
+		std::printf("%s: passed\n", name);
+		return 0;
+	}
+	std::printf("%s: %d failure(s)\n", name, TestFailureCount());
+	return 1;
+}